@@ -0,0 +1,113 @@
+#ifndef HMAC_ENGINE_H
+#define HMAC_ENGINE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <mbedtls/version.h>
+#include <mbedtls/sha256.h>
+
+// ==================== HMAC-SHA256 với key schedule tính sẵn ====================
+// mbedtls_md_hmac() mỗi lần gọi: malloc context, băm key^ipad và key^opad
+// (2 block SHA-256) rồi mới tới message. Với key cố định (pairing key, friend
+// key) 2 block đó băm 1 lần lúc begin() và giữ lại midstate; compute() chỉ
+// clone midstate (memcpy) + 2 block: inner (message ≤ 55 byte) và outer (digest).
+//
+// mbedtls_sha256_* của Arduino core ESP32/ESP32-S3 chạy trên SHA accelerator của
+// chip; host build (Tools/hmac_bench) chạy software.
+// compute()/verify() là const, context làm việc nằm trên stack → nhiều task dùng
+// chung 1 key được. begin()/end() không được chạy song song với compute().
+//
+// File giống nhau ở Anchor, Tag và s3_super_mini_central.
+
+#if defined(MBEDTLS_VERSION_NUMBER) && MBEDTLS_VERSION_NUMBER >= 0x03000000
+#define HMAC_SHA256_STARTS(c)       mbedtls_sha256_starts((c), 0)
+#define HMAC_SHA256_UPDATE(c, d, n) mbedtls_sha256_update((c), (d), (n))
+#define HMAC_SHA256_FINISH(c, o)    mbedtls_sha256_finish((c), (o))
+#else
+#define HMAC_SHA256_STARTS(c)       mbedtls_sha256_starts_ret((c), 0)
+#define HMAC_SHA256_UPDATE(c, d, n) mbedtls_sha256_update_ret((c), (d), (n))
+#define HMAC_SHA256_FINISH(c, o)    mbedtls_sha256_finish_ret((c), (o))
+#endif
+
+#define HMAC_SHA256_LEN   (32)
+#define HMAC_SHA256_BLOCK (64)
+
+class HmacSha256Key {
+private:
+    mbedtls_sha256_context inner;   // đã băm key ^ ipad
+    mbedtls_sha256_context outer;   // đã băm key ^ opad
+    bool                   ready = false;
+
+public:
+    HmacSha256Key() {
+        mbedtls_sha256_init(&inner);
+        mbedtls_sha256_init(&outer);
+    }
+    ~HmacSha256Key() { end(); }
+    HmacSha256Key(const HmacSha256Key&) = delete;
+    HmacSha256Key& operator=(const HmacSha256Key&) = delete;
+
+    bool begin(const uint8_t* key, size_t keyLen) {
+        end();
+        uint8_t k[HMAC_SHA256_BLOCK] = {};
+        uint8_t pad[HMAC_SHA256_BLOCK];
+        bool ok = true;
+        if (keyLen > HMAC_SHA256_BLOCK) {          // RFC 2104: key dài → băm trước
+            mbedtls_sha256_context c;
+            mbedtls_sha256_init(&c);
+            ok = HMAC_SHA256_STARTS(&c) == 0 && HMAC_SHA256_UPDATE(&c, key, keyLen) == 0 &&
+                 HMAC_SHA256_FINISH(&c, k) == 0;
+            mbedtls_sha256_free(&c);
+        } else {
+            memcpy(k, key, keyLen);
+        }
+
+        for (int i = 0; i < HMAC_SHA256_BLOCK; i++) pad[i] = k[i] ^ 0x36;
+        ok = ok && HMAC_SHA256_STARTS(&inner) == 0 && HMAC_SHA256_UPDATE(&inner, pad, sizeof(pad)) == 0;
+        for (int i = 0; i < HMAC_SHA256_BLOCK; i++) pad[i] = k[i] ^ 0x5c;
+        ok = ok && HMAC_SHA256_STARTS(&outer) == 0 && HMAC_SHA256_UPDATE(&outer, pad, sizeof(pad)) == 0;
+
+        memset(k, 0, sizeof(k));
+        memset(pad, 0, sizeof(pad));
+        ready = ok;
+        if (!ok) end();
+        return ok;
+    }
+
+    // Xoá midstate (mbedtls_sha256_free zeroize context)
+    void end() {
+        mbedtls_sha256_free(&inner);
+        mbedtls_sha256_free(&outer);
+        mbedtls_sha256_init(&inner);
+        mbedtls_sha256_init(&outer);
+        ready = false;
+    }
+
+    bool valid() const { return ready; }
+
+    bool compute(const uint8_t* msg, size_t len, uint8_t out[HMAC_SHA256_LEN]) const {
+        if (!ready) return false;
+        uint8_t ih[HMAC_SHA256_LEN];
+        mbedtls_sha256_context c;
+        mbedtls_sha256_init(&c);
+        mbedtls_sha256_clone(&c, &inner);
+        bool ok = HMAC_SHA256_UPDATE(&c, msg, len) == 0 && HMAC_SHA256_FINISH(&c, ih) == 0;
+        mbedtls_sha256_clone(&c, &outer);
+        ok = ok && HMAC_SHA256_UPDATE(&c, ih, sizeof(ih)) == 0 && HMAC_SHA256_FINISH(&c, out) == 0;
+        mbedtls_sha256_free(&c);
+        memset(ih, 0, sizeof(ih));
+        return ok;
+    }
+
+    // So sánh constant-time. expectedLen < 32 → HMAC bị cắt ngắn (so expectedLen byte đầu).
+    bool verify(const uint8_t* msg, size_t len, const uint8_t* expected, size_t expectedLen) const {
+        uint8_t mac[HMAC_SHA256_LEN];
+        if (expectedLen == 0 || expectedLen > sizeof(mac) || !compute(msg, len, mac)) return false;
+        uint8_t d = 0;
+        for (size_t i = 0; i < expectedLen; i++) d |= mac[i] ^ expected[i];
+        memset(mac, 0, sizeof(mac));
+        return d == 0;
+    }
+};
+
+#endif // HMAC_ENGINE_H
@@ -35,6 +35,7 @@
 #include <BLEAdvertisedDevice.h>
 #include <mbedtls/md.h>
 #include "tag_config.h"
+#include "hmac_engine.h"
 
 #include <SPI.h>
 #include "dw3000.h"
@@ -144,11 +145,18 @@ static void hexStringToBytes(const char* hex, uint8_t* bytes, size_t length) {
         sscanf(hex + 2 * i, "%2hhx", &bytes[i]);
 }
 
+// Key schedule (ipad/opad midstate) tính 1 lần, dựng lại khi key đổi — chỉ bleTask gọi
 static bool computeHMAC(const uint8_t* key, size_t keyLen,
-                         const uint8_t* data, size_t dataLen,
-                         uint8_t* output) {
-    const mbedtls_md_info_t* md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
-    return (mbedtls_md_hmac(md, key, keyLen, data, dataLen, output) == 0);
+                        const uint8_t* data, size_t dataLen,
+                        uint8_t* output) {
+    static HmacSha256Key schedule;
+    static uint8_t       scheduleKey[16];
+    if (keyLen != sizeof(scheduleKey)) return false;
+    if (!schedule.valid() || memcmp(scheduleKey, key, keyLen) != 0) {
+        if (!schedule.begin(key, keyLen)) return false;
+        memcpy(scheduleKey, key, keyLen);
+    }
+    return schedule.compute(data, dataLen, output);
 }
 
 static void printHex(const char* label, const uint8_t* data, size_t length) {
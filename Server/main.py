@@ -9,6 +9,8 @@ import os
 import secrets
 import sqlite3
 import socket
+import struct
+import hashlib
 from datetime import datetime, timedelta
 from typing import Optional
 from contextlib import asynccontextmanager
@@ -55,6 +57,49 @@ def verify_friend_bundle_sig(friend_id: str, vehicle_id: str, friend_key_hex: st
         return False
 
 
+# --- Compact friend-key table for the anchor (see friend_keys.h on the anchor) ---
+FRIEND_TABLE_MAGIC = b"FKT1"
+FRIEND_TABLE_VERSION = 1
+FRIEND_TABLE_MAX_KEYS = 32
+FRIEND_FLAG_REVOKED = 0x01
+
+
+def friend_id_hash(friend_id: str) -> bytes:
+    return hashlib.sha256(b"friend-id:" + friend_id.encode()).digest()[:8]
+
+
+def build_friend_table(vehicle_id: str) -> bytes:
+    """Header 16 B + 32 B per key: id_hash | expires_at | flags | key. Expired keys are left out;
+    revoked keys stay (flagged, key zeroed) until they would have expired."""
+    now = datetime.utcnow()
+    conn = sqlite3.connect('car_access.db')
+    cursor = conn.cursor()
+    cursor.execute('''
+        SELECT friend_id, friend_key, expires_at, is_revoked
+        FROM friend_keys WHERE vehicle_id = ?
+        ORDER BY created_at DESC
+    ''', (vehicle_id,))
+    rows = cursor.fetchall()
+    conn.close()
+
+    entries = []
+    for friend_id, key_b64, expires_at, is_revoked in rows:
+        expires = datetime.fromisoformat(expires_at)
+        if expires <= now:
+            continue
+        flags = FRIEND_FLAG_REVOKED if is_revoked else 0
+        key = bytes(16) if is_revoked else base64.b64decode(key_b64)
+        expires_unix = int((expires - datetime(1970, 1, 1)).total_seconds())
+        entries.append(friend_id_hash(friend_id) + struct.pack("<IB3x", expires_unix, flags) + key)
+        if len(entries) == FRIEND_TABLE_MAX_KEYS:
+            break
+
+    generated_at = int((now - datetime(1970, 1, 1)).total_seconds())
+    vehicle_tag = hashlib.sha256(vehicle_id.encode()).digest()[:4]
+    header = FRIEND_TABLE_MAGIC + struct.pack("<BBHI", FRIEND_TABLE_VERSION, len(entries), 0, generated_at) + vehicle_tag
+    return header + b"".join(entries)
+
+
 def get_local_ip():
     s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
     try:
@@ -87,6 +132,7 @@ async def lifespan(app: FastAPI):
     print("  POST   /friend-sharing/create")
     print("  GET    /friend-sharing/claim/{claim_token}")
     print("  POST   /validate-friend-key")
+    print("  POST   /friend-sharing/sync")
     print("  DELETE /friend-sharing/{friend_id}")
     print("  GET    /friend-sharing/list/{vehicle_id}")
     print("  GET    /server-public-key")
@@ -275,9 +321,11 @@ class SecureCheckRequest(BaseModel):
 
 
 class SecureCheckResponse(BaseModel):
+    # Field order is the JSON order: the anchor decrypts the ciphertext while it
+    # streams in over the SIM link, so the key and nonce must come first.
     server_public_key_b64: str
-    encrypted_data_b64: str
     nonce_b64: str
+    encrypted_data_b64: str
 
 
 @app.post("/secure-check-pairing", response_model=SecureCheckResponse)
@@ -526,6 +574,19 @@ class ValidateFriendKeyResponse(BaseModel):
     expires_at: str
 
 
+class FriendSyncRequest(BaseModel):
+    vehicle_id: str
+    client_public_key_b64: str
+
+
+class FriendSyncResponse(BaseModel):
+    # Same ordering rule as SecureCheckResponse: ciphertext last.
+    server_public_key_b64: str
+    nonce_b64: str
+    signing_public_key_b64: str
+    encrypted_data_b64: str
+
+
 @app.post("/friend-sharing/create", response_model=FriendShareCreateResponse)
 def create_friend_share(req: FriendShareCreateRequest):
     """Owner creates a friend sharing link. Returns a claim token/URL the owner sends to the friend."""
@@ -605,6 +666,44 @@ def validate_friend_key(req: ValidateFriendKeyRequest):
     )
 
 
+@app.post("/friend-sharing/sync", response_model=FriendSyncResponse)
+def sync_friend_keys(req: FriendSyncRequest):
+    """Anchor pulls its compact friend-key table at provisioning time.
+    Plaintext = blob_len (u16 LE) | blob | ECDSA-SHA256 signature of blob, encrypted with
+    ECDH + HKDF("friend-sync-kek") + AES-GCM like /secure-check-pairing."""
+    if not get_vehicle_pairing(req.vehicle_id):
+        raise HTTPException(status_code=404, detail="Vehicle not found")
+    try:
+        client_public_key = serialization.load_der_public_key(base64.b64decode(req.client_public_key_b64))
+    except Exception:
+        raise HTTPException(status_code=400, detail="Invalid client public key")
+
+    blob = build_friend_table(req.vehicle_id)
+    sig = get_server_signing_key().sign(blob, ec.ECDSA(hashes.SHA256()))
+    payload = struct.pack("<H", len(blob)) + blob + sig
+
+    server_private_key = ec.generate_private_key(ec.SECP256R1())
+    shared_secret = server_private_key.exchange(ec.ECDH(), client_public_key)
+    kek = HKDF(
+        algorithm=hashes.SHA256(),
+        length=16,
+        salt=None,
+        info=b"friend-sync-kek",
+    ).derive(shared_secret)
+    nonce = os.urandom(12)
+    encrypted = AESGCM(kek).encrypt(nonce, payload, None)
+
+    der = serialization.Encoding.DER
+    spki = serialization.PublicFormat.SubjectPublicKeyInfo
+    print(f"✓ Friend table synced for vehicle {req.vehicle_id}: {blob[5]} keys, {len(blob)} bytes")
+    return FriendSyncResponse(
+        server_public_key_b64=base64.b64encode(server_private_key.public_key().public_bytes(der, spki)).decode(),
+        encrypted_data_b64=base64.b64encode(encrypted).decode(),
+        nonce_b64=base64.b64encode(nonce).decode(),
+        signing_public_key_b64=base64.b64encode(get_server_signing_key().public_key().public_bytes(der, spki)).decode()
+    )
+
+
 @app.delete("/friend-sharing/{friend_id}")
 def revoke_friend_key(friend_id: str):
     """Owner revokes a friend sharing key immediately."""
@@ -687,6 +786,7 @@ def root():
             "POST /friend-sharing/create": "Owner creates a friend share link",
             "GET /friend-sharing/claim/{claim_token}": "Friend claims key bundle from share link",
             "POST /validate-friend-key": "Anchor validates a friend key (online check)",
+            "POST /friend-sharing/sync": "Anchor pulls its signed friend-key table (offline validation)",
             "DELETE /friend-sharing/{friend_id}": "Owner revokes a friend key",
             "GET /friend-sharing/list/{vehicle_id}": "List all friend keys for a vehicle",
             "GET /server-public-key": "Get server signing public key"
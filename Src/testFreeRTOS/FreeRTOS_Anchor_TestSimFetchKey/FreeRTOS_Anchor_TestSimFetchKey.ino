@@ -1,5 +1,4 @@
 
-#include <Preferences.h>
 #include <BLEDevice.h>
 #include <BLEServer.h>
 #include <BLE2902.h>
@@ -8,6 +7,23 @@
 #include <mcp2515.h>
 #include "anchor_config.h"
 #include "can_commands.h"
+#include "can_scheduler.h"
+#include "spi_arbiter.h"
+#include "uwb_fsm.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "dlog.h"
+#include "uwb_sniff.h"
+#include "uwb_diag.h"
+#include "boot_profile.h"
+#include "session_ticket.h"
+#include "peer_sessions.h"
+#include "hmac_engine.h"
+#include "friend_keys.h"
+#include "key_store.h"
+#include "sim_modem.h"
+#include "secure_response.h"
+#include "vehicle_state.h"
 #include <mbedtls/entropy.h>
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/md.h>
@@ -27,47 +43,73 @@ static EventGroupHandle_t sysEvents;
 #define EVT_CONNECTED   (1 << 0)   // Tag vừa kết nối BLE
 #define EVT_AUTHED      (1 << 1)   // Tag đã xác thực HMAC OK
 #define EVT_UWB_ACTIVE  (1 << 2)   // UWB đã khởi tạo và đang ranging
+#define EVT_KEY_READY   (1 << 3)   // Pairing key đã cài (NVS lúc boot hoặc provTask)
 
-// BLE queue — commands cho bleTask
+// BLE queue — commands cho bleTask. State per-connection (peer_sessions.h) chỉ
+// bleTask sửa; BLE callback chỉ gửi message kèm conn_id.
 enum BleCmdType : uint8_t {
-    BLE_SEND_CHALLENGE,     // generate + gửi challenge tới Tag
-    BLE_AUTH_VERIFY,        // xác minh HMAC response từ Tag
-    BLE_NOTIFY_UWB_ACTIVE,  // gửi "UWB_ACTIVE" notification tới Tag
-    BLE_RESTART_ADV,        // restart BLE advertising
+    BLE_PEER_CONNECTED,     // mở session + sinh challenge (data = địa chỉ peer)
+    BLE_PEER_DISCONNECTED,  // đóng session
+    BLE_PEER_CCCD,          // peer ghi CCCD (data[0] = PEER_CCCD_*, data[1] = bật/tắt)
+    BLE_AUTH_DATA,          // write lên auth characteristic: mảnh HMAC response hoặc RESUME
+    BLE_PEER_WRITE,         // write lên characteristic chính (VERIFIED, TAG_UWB_READY, ...)
+    BLE_AUTH_RESULT,        // authTask xong (data[0] = AuthVerdict, data[1..] = ticket)
+    BLE_NOTIFY_UWB_ACTIVE,  // gửi "UWB_ACTIVE" tới các peer đã yêu cầu UWB
 };
 struct BleCmdMsg {
     BleCmdType type;
-    uint8_t    data[32];   // dùng cho BLE_AUTH_VERIFY: chứa HMAC response
+    uint8_t    gen;        // BLE_AUTH_RESULT: generation session lúc gửi job
+    uint16_t   connId;
+    uint8_t    data[32];
     uint8_t    dataLen;
 };
-static QueueHandle_t bleQueue;  // depth 8
+static QueueHandle_t bleQueue;  // depth BLE_QUEUE_DEPTH
+
+// Auth worker — HMAC + ticket verify chạy ngoài bleTask, 1 peer đang verify
+// không chặn challenge/notify của peer khác
+enum AuthJobType : uint8_t { AUTH_JOB_HMAC, AUTH_JOB_RESUME };
+enum AuthVerdict : uint8_t { AUTH_VERDICT_OK, AUTH_VERDICT_FAIL, AUTH_VERDICT_RESUMED, AUTH_VERDICT_RESUME_FAIL };
+struct AuthJob {
+    AuthJobType type;
+    uint8_t     gen;
+    uint16_t    connId;
+    bool        friendKey;  // key = friend key (không cấp ticket)
+    const HmacSha256Key* key;   // pairingHmac hoặc slot trong friendKeys
+    uint8_t     challenge[16];
+    uint8_t     data[32];   // HMAC response hoặc RESUME
+    uint8_t     dataLen;
+};
+static QueueHandle_t authQueue;  // depth AUTH_QUEUE_DEPTH
+
+// UWB state machine — lệnh START/SUSPEND/STOP + DW3000 IRQ qua task notification (xem uwb_fsm.h)
+static UwbFsm uwbFsm;
+// Sniff mode lúc chờ Poll + detection/latency stats (uwb_sniff.h) — chỉ uwbTask
+static UwbSniff uwbSniff;
+// Event counter + CIA diag + STS quality mỗi session (uwb_diag.h) — uwbTask ghi, telemetry đọc snapshot
+static UwbDiag uwbDiag;
+
+// Telemetry — task/queue/SPI/heap sampling, stream qua BLE diag và/hoặc Serial
+static Telemetry telemetry;
 
-// UWB queue — commands cho uwbTask
-#define UWB_CMD_INIT   (0U)
-#define UWB_CMD_DEINIT (1U)
-static QueueHandle_t uwbQueue;  // depth 4
+// Unlock latency trace — flush ra Serial từ bleTask (xem trace.h, Tools/trace_merge.py)
+static Tracer tracer;
 
-// CAN queue — commands cho canTask
-#define CAN_CMD_LOCK   (0U)
-#define CAN_CMD_UNLOCK (1U)
-static QueueHandle_t canQueue;  // depth 4
+// CAN scheduler — desired state LOCK/UNLOCK cho canTask (xem can_scheduler.h)
+static CanScheduler canScheduler;
 
-// SPI mutex — arbitrate giữa DW3000 (uwbTask) và MCP2515 (canTask)
-// Cả hai dùng SPI2 bus chung trên ESP32-S3
-static SemaphoreHandle_t spiMutex;
+// SPI arbiter — DW3000 (uwbTask) và MCP2515 (canTask) dùng chung SPI2 trên ESP32-S3,
+// cấp quyền theo transaction (xem spi_arbiter.h)
+static SpiArbiter spiArbiter;
 
 // =============================================================================
 // State variables (tối thiểu — phần lớn state nằm trong EventGroup)
 // =============================================================================
 
 static volatile bool    carUnlocked      = false;
-static volatile bool    hasKey           = false;
 static volatile bool    bleStarted       = false;
-static volatile bool    deviceConnected  = false;
-static volatile bool    authenticated    = false;
-// Incremented on every onConnect — bleTask embeds this in BLE_SEND_CHALLENGE so
-// stale messages from previous sessions can be detected and discarded.
-static volatile uint8_t connectionGen    = 0;
+// Số session đang mở — bleTask ghi, task khác chỉ đọc
+static volatile uint8_t peerCount        = 0;
+static PeerTable        peers;
 
 static BLEServer*       pBleServer       = nullptr;  // global để bleTask có thể ngắt kết nối
 
@@ -78,19 +120,37 @@ static BLEServer*       pBleServer       = nullptr;  // global để bleTask có
 static BLECharacteristic *pCharacteristic          = nullptr;
 static BLECharacteristic *pChallengeCharacteristic = nullptr;
 static BLECharacteristic *pAuthCharacteristic      = nullptr;
-static MCP2515*     pMcp2515    = nullptr;
+static BLECharacteristic *pDiagCharacteristic      = nullptr;  // telemetry notify
+static MCP2515*     pMcp2515[CAN_BUS_MAX] = {};
 static CANCommands* pCanControl = nullptr;
+static VehicleStateDecoder vehicleState;  // chỉ canTask ghi
+static CANFilters::Compiled canFilterCfg[CAN_BUS_COUNT];
+static CANFilters::Stats    canRxStats[CAN_BUS_COUNT];
+
+// CS + bitrate của từng MCP2515 (index = CAN_BUS_*)
+static const uint8_t   CAN_BUS_CS[CAN_BUS_MAX]      = { CAN_CS, CAN1_CS };
+static const CAN_SPEED CAN_BUS_BITRATE[CAN_BUS_MAX] = { CAN0_BITRATE, CAN1_BITRATE };
 
 // =============================================================================
 // Auth state
 // =============================================================================
 
-static uint8_t currentChallenge[16];
+// Thống kê challenge notify qua CCCD so với fallback (mọi session)
+static uint32_t      challengeSentCount  = 0;
+static uint32_t      challengeFallbacks  = 0;
+static uint64_t      challengeSavedMsSum = 0;
 static uint8_t pairingKey[16];
-// responseBuffer: được ghi bởi AuthChar callback (Core 0 BLE stack task)
-// Chỉ được đọc sau khi đã copy vào BleCmdMsg — không cần volatile
-static uint8_t  responseBuffer[32];
-static uint8_t  responseBufferLen = 0;
+static HmacSha256Key pairingHmac;   // key schedule của pairingKey (hmac_engine.h)
+// pairingKey/pairingHmac/ticketIssuer + friendKeys: provTask thay lúc đang chạy,
+// authTask/bleTask/uwbTask giữ keyLock trong lúc dùng
+static SemaphoreHandle_t keyLock;
+
+// Session resumption — ticket cấp sau AUTH_OK, reconnect nhanh không qua challenge
+static TicketIssuer  ticketIssuer;
+// Friend key đồng bộ từ server (friend_keys.h) — load lúc boot, chỉ bleTask lookup
+static FriendKeyTable friendKeys;
+// UWB đang SUSPEND chờ Tag resume (thay vì deinit lúc disconnect) — chỉ bleTask ghi
+static volatile bool uwbParked = false;
 
 // =============================================================================
 // UWB frame buffers + config
@@ -120,8 +180,8 @@ static uint8_t  frame_seq_nb = 0U;
 // NVS + crypto state
 // =============================================================================
 
-static Preferences              preferences;
-static char                     bleKeyHex[33] = "";   // 32 hex chars + null
+// Pairing key + STS + friend table + signing key (key_store.h) — chỉ provTask ghi
+static KeyStore                 keyStore;
 static mbedtls_entropy_context  entropy;
 static mbedtls_ctr_drbg_context ctr_drbg;
 
@@ -138,249 +198,67 @@ static void generateChallenge(uint8_t* challenge, size_t length) {
     mbedtls_ctr_drbg_random(&ctr_drbg, challenge, length);
 }
 
-static bool computeHMAC(const uint8_t* key, size_t keyLen,
-                        const uint8_t* data, size_t dataLen,
-                        uint8_t* output) {
-    const mbedtls_md_info_t* md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
-    return (mbedtls_md_hmac(md, key, keyLen, data, dataLen, output) == 0);
-}
-
-// HKDF-SHA256 theo RFC 5869 — thay thế mbedtls_hkdf() không có trong SDK cũ.
-// salt=NULL/0 → dùng 32 zero bytes (RFC 5869 §2.2).
-// Chỉ cần output <= 32 bytes (1 block SHA-256).
-static bool hkdfSha256(const uint8_t* salt, size_t saltLen,
-                       const uint8_t* ikm,  size_t ikmLen,
-                       const uint8_t* info, size_t infoLen,
-                       uint8_t* out, size_t outLen) {
-    if (outLen > 32) return false;
-    const mbedtls_md_info_t* md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
-
-    // Extract: PRK = HMAC-SHA256(salt, IKM)
-    uint8_t zeros[32] = {};
-    const uint8_t* s  = (salt && saltLen > 0) ? salt : zeros;
-    size_t         sl = (salt && saltLen > 0) ? saltLen : 32;
-    uint8_t prk[32];
-    if (mbedtls_md_hmac(md, s, sl, ikm, ikmLen, prk) != 0) return false;
-
-    // Expand: T(1) = HMAC-SHA256(PRK, info || 0x01)
-    uint8_t counter = 0x01;
-    mbedtls_md_context_t ctx;
-    mbedtls_md_init(&ctx);
-    if (mbedtls_md_setup(&ctx, md, 1) != 0) { mbedtls_md_free(&ctx); return false; }
-    mbedtls_md_hmac_starts(&ctx, prk, 32);
-    mbedtls_md_hmac_update(&ctx, info, infoLen);
-    mbedtls_md_hmac_update(&ctx, &counter, 1);
-    uint8_t t1[32];
-    mbedtls_md_hmac_finish(&ctx, t1);
-    mbedtls_md_free(&ctx);
-
-    memcpy(out, t1, outLen);
-    return true;
-}
-
-static void printHex(const char* label, const uint8_t* data, size_t length) {
-    Serial.print(label);
-    for (size_t i = 0; i < length; i++) {
-        if (data[i] < 0x10) Serial.print("0");
-        Serial.print(data[i], HEX);
-    }
-    Serial.println();
-}
-
-// =============================================================================
-// NVS key storage
-// =============================================================================
-
-static void checkStoredKey() {
-    preferences.begin("ble-keys", true);
-    if (preferences.isKey("bleKey")) {
-        preferences.getString("bleKey", bleKeyHex, sizeof(bleKeyHex));
-        hasKey = (bleKeyHex[0] != '\0');
-    } else {
-        hasKey = false;
+// DRBG cho challenge — chỉ bleTask dùng, seed trước challenge đầu tiên
+static void seedChallengeDrbg() {
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    const char* pers = "anchor_rtos";
+    if (mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy,
+                               (const unsigned char*)pers, strlen(pers)) != 0) {
+        Serial.println("mbedTLS init failed — halting"); while(1);
     }
-    preferences.end();
-}
-
-static void saveKeyToNVS(const char* key) {
-    preferences.begin("ble-keys", false);
-    preferences.putString("bleKey", key);
-    preferences.end();
-    strncpy(bleKeyHex, key, sizeof(bleKeyHex) - 1);
-    bleKeyHex[sizeof(bleKeyHex) - 1] = '\0';
-    hasKey = true;
-    Serial.println("Key saved to NVS");
 }
 
 // =============================================================================
-// SIM Module key provisioning (thay thế WiFi)
-// Dùng AT commands qua HardwareSerial để POST /secure-check-pairing
+// SIM Module key provisioning (thay thế WiFi) — gọi từ provTask
+// AT commands qua AtEngine chạy trong simTask (sim_modem.h) — POST /secure-check-pairing
 // =============================================================================
 
 static HardwareSerial simSerial(2);  // UART2 trên ESP32-S3
+static SimModem       simModem(simSerial);
 
-// Gửi lệnh AT, chờ token hoặc "ERROR" trong timeout_ms, trả về toàn bộ response
-static String simAtCmd(const char* cmd, const char* expectToken,
-                       unsigned long timeout_ms = 5000) {
-    while (simSerial.available()) simSerial.read();
-    Serial.printf("[AT] >> %s\n", cmd);
-    simSerial.print(cmd);
-    simSerial.print("\r");
-    unsigned long t = millis();
-    String buf = "";
-    while (millis() - t < timeout_ms) {
-        while (simSerial.available()) buf += (char)simSerial.read();
-        if (buf.indexOf(expectToken) >= 0) break;
-        if (buf.indexOf("ERROR") >= 0)     break;
-    }
-    String trimmed = buf; trimmed.trim();
-    Serial.printf("[AT] << %s\n", trimmed.c_str());
-    return buf;
-}
+// DRBG riêng cho provisioning — ctr_drbg global là của bleTask (challenge), không
+// chia sẻ context giữa task. Seed thẳng từ RNG phần cứng, không đụng entropy global.
+static mbedtls_ctr_drbg_context provDrbg;
 
-static bool simAtOk(const char* cmd, unsigned long timeout_ms = 5000) {
-    return simAtCmd(cmd, "OK", timeout_ms).indexOf("OK") >= 0;
+static int hwEntropy(void*, unsigned char* out, size_t len) {
+    esp_fill_random(out, len);
+    return 0;
 }
 
-static bool simInit() {
-    simSerial.begin(SIM_BAUD, SERIAL_8N1, SIM_RX_PIN, SIM_TX_PIN);
-    Serial.println("[SIM] Cho module khoi dong (500ms)...");
-    vTaskDelay(pdMS_TO_TICKS(500));
-    while (simSerial.available()) simSerial.read();
-
-    bool ok = false;
-    for (int i = 0; i < 5; i++) {
-        if (simAtOk("AT")) { ok = true; break; }
-        vTaskDelay(pdMS_TO_TICKS(50));
-    }
-    if (!ok) { Serial.println("[SIM] LOI: AT khong phan hoi"); return false; }
-    simAtOk("ATE0");
-
-    Serial.println("[SIM] Cho dang ky mang...");
-    unsigned long t = millis();
-    bool netOk = false;
-    while (millis() - t < 30000) {
-        String r = simAtCmd("AT+CREG?", "OK", 3000);
-        if (r.indexOf(",1") >= 0 || r.indexOf(",5") >= 0) { netOk = true; break; }
-        vTaskDelay(pdMS_TO_TICKS(1000));
-    }
-    if (!netOk) { Serial.println("[SIM] LOI: khong co mang"); return false; }
-
-    String cgdcont = String("AT+CGDCONT=1,\"IP\",\"") + SIM_APN + "\"";
-    simAtOk(cgdcont.c_str());
-    simAtOk("AT+CGACT=1,1", 10000);
-    String ip = simAtCmd("AT+CGPADDR=1", "OK", 5000);
-    Serial.println("[SIM] " + ip);
-    return true;
-}
-
-// HTTP POST bằng AT commands A7680C, trả về response body hoặc "" khi lỗi
-static String simHttpPost(const char* url, const char* body) {
-    int bodyLen = strlen(body);
-    simAtOk("AT+HTTPTERM", 3000);
-    vTaskDelay(pdMS_TO_TICKS(100));
-
-    if (!simAtOk("AT+HTTPINIT")) { Serial.println("[HTTP] HTTPINIT failed"); return ""; }
-
-    String urlCmd = String("AT+HTTPPARA=\"URL\",\"") + url + "\"";
-    if (!simAtOk(urlCmd.c_str(), 5000)) { simAtOk("AT+HTTPTERM", 2000); return ""; }
-    if (!simAtOk("AT+HTTPPARA=\"CONTENT\",\"application/json\"")) {
-        simAtOk("AT+HTTPTERM", 2000); return "";
-    }
-
-    // Gửi body — chờ prompt "DOWNLOAD"
-    String dataCmd = String("AT+HTTPDATA=") + bodyLen + ",10000";
-    while (simSerial.available()) simSerial.read();
-    simSerial.println(dataCmd);
-    unsigned long t = millis(); String buf = "";
-    while (millis() - t < 8000) {
-        while (simSerial.available()) buf += (char)simSerial.read();
-        if (buf.indexOf("DOWNLOAD") >= 0) break;
-    }
-    if (buf.indexOf("DOWNLOAD") < 0) { simAtOk("AT+HTTPTERM", 2000); return ""; }
-
-    simSerial.print(body);
-    vTaskDelay(pdMS_TO_TICKS(200));
-    buf = ""; t = millis();
-    while (millis() - t < 5000) {
-        while (simSerial.available()) buf += (char)simSerial.read();
-        if (buf.indexOf("OK") >= 0) break;
-    }
-
-    // POST (action=1)
-    while (simSerial.available()) simSerial.read();
-    simSerial.println("AT+HTTPACTION=1");
-    buf = ""; t = millis();
-    int httpStatus = 0, respLen = 0;
-    while (millis() - t < 30000) {
-        while (simSerial.available()) buf += (char)simSerial.read();
-        int idx = buf.indexOf("+HTTPACTION:");
-        if (idx >= 0) {
-            String line = buf.substring(idx);
-            int c1 = line.indexOf(','), c2 = line.indexOf(',', c1 + 1);
-            int nl = line.indexOf('\n', c2);
-            if (c1 > 0 && c2 > 0) {
-                httpStatus = line.substring(c1 + 1, c2).toInt();
-                respLen    = line.substring(c2 + 1, nl > 0 ? nl : c2 + 10).toInt();
-                break;
-            }
-        }
-    }
-    Serial.printf("[HTTP] Status: %d, Len: %d\n", httpStatus, respLen);
-    if (httpStatus != 200 || respLen <= 0) { simAtOk("AT+HTTPTERM", 2000); return ""; }
-
-    // Đọc response — đọc đúng respLen bytes (dữ liệu base64 có thể chứa "OK")
-    String readCmd = String("AT+HTTPREAD=0,") + respLen;
-    while (simSerial.available()) simSerial.read();
-    simSerial.println(readCmd);
-    buf = ""; t = millis();
-    while (millis() - t < 10000) {
-        while (simSerial.available()) buf += (char)simSerial.read();
-        int hdrIdx = buf.indexOf("+HTTPREAD:");
-        if (hdrIdx >= 0 && buf.indexOf("\r\n", hdrIdx) >= 0) break;
-    }
-    int hdrIdx = buf.indexOf("+HTTPREAD:");
-    int hdrEnd = buf.indexOf("\r\n", hdrIdx);
-    if (hdrIdx < 0 || hdrEnd < 0) { simAtOk("AT+HTTPTERM", 2000); return ""; }
-
-    String respBody = buf.substring(hdrEnd + 2);
-    t = millis();
-    while ((int)respBody.length() < respLen && millis() - t < 10000)
-        while (simSerial.available()) respBody += (char)simSerial.read();
-    respBody = respBody.substring(0, respLen);
-    respBody.trim();
-    simAtOk("AT+HTTPTERM", 2000);
-    return respBody;
-}
-
-// Lấy pairing key từ server qua SIM. Thành công → ghi 32-char hex vào keyHexOut (char[33]).
-// Dùng global ctr_drbg đã seed trong setup().
-static bool fetchPairingKeyViaSim(char* keyHexOut) {
+// POST {vehicle_id, client_public_key_b64} tới SERVER_FALLBACK + path qua SIM, rồi
+// ECDH P-256 + HKDF(kekInfo) + AES-128-GCM decrypt encrypted_data_b64 vào plaintext
+// (kết thúc '\0'). Dùng chung cho /secure-check-pairing và /friend-sharing/sync.
+// Response giải mã theo luồng ngay trong simTask khi +HTTPREAD tới (secure_response.h),
+// không giữ body. signingDer (tuỳ chọn) ← field "signing_public_key_b64" ngoài phần
+// mã hoá, *signingLen = độ dài (0 nếu không có).
+// Trả về số byte plaintext, 0 nếu lỗi. Chạy trong provTask (+ simTask), dùng provDrbg.
+static size_t simSecurePost(const char* path, const char* kekInfo, uint8_t* plaintext, size_t plainMax,
+                            uint8_t* signingDer = nullptr, size_t* signingLen = nullptr) {
     // Tạo EC key pair P-256
     mbedtls_pk_context our_pk;
     mbedtls_pk_init(&our_pk);
     if (mbedtls_pk_setup(&our_pk, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY)) != 0 ||
         mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(our_pk),
-                            mbedtls_ctr_drbg_random, &ctr_drbg) != 0) {
+                            mbedtls_ctr_drbg_random, &provDrbg) != 0) {
         Serial.println("[KEY] LOI: tao EC key");
-        mbedtls_pk_free(&our_pk); return false;
+        mbedtls_pk_free(&our_pk); return 0;
     }
 
     uint8_t pubder[128];
     int pubder_len = mbedtls_pk_write_pubkey_der(&our_pk, pubder, sizeof(pubder));
     if (pubder_len < 0) {
         Serial.println("[KEY] LOI: export pubkey");
-        mbedtls_pk_free(&our_pk); return false;
+        mbedtls_pk_free(&our_pk); return 0;
     }
     char pubkey_b64[200]; size_t b64len;
     if (mbedtls_base64_encode((uint8_t*)pubkey_b64, sizeof(pubkey_b64), &b64len,
                               pubder + sizeof(pubder) - pubder_len, pubder_len) != 0) {
         Serial.println("[KEY] LOI: base64 encode");
-        mbedtls_pk_free(&our_pk); return false;
+        mbedtls_pk_free(&our_pk); return 0;
     }
     pubkey_b64[b64len] = '\0';
 
-    // POST /secure-check-pairing
     char body[512];
     {
         StaticJsonDocument<384> req;
@@ -388,87 +266,37 @@ static bool fetchPairingKeyViaSim(char* keyHexOut) {
         req["client_public_key_b64"] = pubkey_b64;
         serializeJson(req, body, sizeof(body));
     }
-    String endpoint = String(SERVER_FALLBACK) + "/secure-check-pairing";
-    Serial.printf("[HTTP] POST %s\n", endpoint.c_str());
-    String respBody = simHttpPost(endpoint.c_str(), body);
-    if (respBody.length() == 0) {
+    char endpoint[128];
+    snprintf(endpoint, sizeof(endpoint), "%s%s", SERVER_FALLBACK, path);
+    Serial.printf("[HTTP] POST %s\n", endpoint);
+
+    SecureResponse resp(&our_pk, kekInfo, plaintext, plainMax, mbedtls_ctr_drbg_random, &provDrbg);
+    if (signingDer && signingLen) resp.captureSigningKey(signingDer, *signingLen);
+    uint32_t t0 = millis();
+    size_t respLen = simModem.httpPost(endpoint, body, SecureResponse::sink, &resp);
+    size_t ptLen   = respLen ? resp.finish() : 0;
+    mbedtls_pk_free(&our_pk);
+    simModem.printStats();
+    if (respLen == 0) {
         Serial.println("[HTTP] LOI: khong nhan duoc response");
-        mbedtls_pk_free(&our_pk); return false;
-    }
-    Serial.println("[HTTP] Response: " + respBody.substring(0, 80));
-
-    // Parse JSON response
-    StaticJsonDocument<768> resp;
-    if (deserializeJson(resp, respBody) != DeserializationError::Ok) {
-        Serial.println("[KEY] LOI: parse JSON response");
-        mbedtls_pk_free(&our_pk); return false;
-    }
-    const char* srv_pub_b64   = resp["server_public_key_b64"];
-    const char* encrypted_b64 = resp["encrypted_data_b64"];
-    const char* nonce_b64     = resp["nonce_b64"];
-    if (!srv_pub_b64 || !encrypted_b64 || !nonce_b64) {
-        Serial.println("[KEY] LOI: thieu truong JSON");
-        mbedtls_pk_free(&our_pk); return false;
-    }
-
-    // Base64 decode
-    uint8_t srv_pub_der[128]; size_t srv_pub_len;
-    uint8_t encrypted[256];   size_t enc_len;
-    uint8_t nonce[12];        size_t nonce_len;
-    if (mbedtls_base64_decode(srv_pub_der, sizeof(srv_pub_der), &srv_pub_len,
-                              (const uint8_t*)srv_pub_b64, strlen(srv_pub_b64)) != 0 ||
-        mbedtls_base64_decode(encrypted, sizeof(encrypted), &enc_len,
-                              (const uint8_t*)encrypted_b64, strlen(encrypted_b64)) != 0 ||
-        mbedtls_base64_decode(nonce, sizeof(nonce), &nonce_len,
-                              (const uint8_t*)nonce_b64, strlen(nonce_b64)) != 0 || nonce_len != 12) {
-        Serial.println("[KEY] LOI: base64 decode");
-        mbedtls_pk_free(&our_pk); return false;
-    }
-    if (enc_len < 17) {
-        Serial.println("[KEY] LOI: kich thuoc payload");
-        mbedtls_pk_free(&our_pk); return false;
-    }
-
-    // Load server public key và ECDH
-    mbedtls_pk_context srv_pk; mbedtls_pk_init(&srv_pk);
-    if (mbedtls_pk_parse_public_key(&srv_pk, srv_pub_der, srv_pub_len) != 0) {
-        Serial.println("[KEY] LOI: parse server pubkey");
-        mbedtls_pk_free(&our_pk); mbedtls_pk_free(&srv_pk); return false;
+        return 0;
     }
-    mbedtls_ecdh_context ecdh; mbedtls_ecdh_init(&ecdh);
-    if (mbedtls_ecdh_get_params(&ecdh, mbedtls_pk_ec(our_pk), MBEDTLS_ECDH_OURS)   != 0 ||
-        mbedtls_ecdh_get_params(&ecdh, mbedtls_pk_ec(srv_pk), MBEDTLS_ECDH_THEIRS) != 0) {
-        Serial.println("[KEY] LOI: ECDH setup");
-        mbedtls_ecdh_free(&ecdh); mbedtls_pk_free(&our_pk); mbedtls_pk_free(&srv_pk); return false;
-    }
-    uint8_t shared_secret[32]; size_t shared_len = 0;
-    if (mbedtls_ecdh_calc_secret(&ecdh, &shared_len, shared_secret, sizeof(shared_secret),
-                                 mbedtls_ctr_drbg_random, &ctr_drbg) != 0 || shared_len != 32) {
-        Serial.println("[KEY] LOI: ECDH calc secret");
-        mbedtls_ecdh_free(&ecdh); mbedtls_pk_free(&our_pk); mbedtls_pk_free(&srv_pk); return false;
-    }
-    mbedtls_ecdh_free(&ecdh); mbedtls_pk_free(&our_pk); mbedtls_pk_free(&srv_pk);
-
-    // HKDF → KEK 16 bytes
-    uint8_t kek[16];
-    if (!hkdfSha256(NULL, 0, shared_secret, 32,
-                    (const uint8_t*)"secure-check-kek", 16, kek, 16)) {
-        Serial.println("[KEY] LOI: HKDF"); return false;
+    if (ptLen == 0) {
+        Serial.printf("[KEY] LOI: %s\n", resp.error());
+        return 0;
     }
+    Serial.printf("[KEY] Response %u B → %u B plaintext (%u B decrypt trong luc tai), %lu ms\n",
+                  (unsigned)respLen, (unsigned)ptLen, (unsigned)resp.streamedBytes(),
+                  (unsigned long)(millis() - t0));
+    if (signingLen) *signingLen = resp.signingKeyLen();
+    return ptLen;
+}
 
-    // AES-128-GCM decrypt (16 bytes cuối của encrypted là auth tag)
-    size_t ct_len = enc_len - 16;
+// Lấy pairing key từ server qua SIM. Thành công → 16 byte binary vào keyOut.
+static bool fetchPairingKeyViaSim(uint8_t* keyOut) {
     uint8_t plaintext[256] = {};
-    mbedtls_gcm_context gcm; mbedtls_gcm_init(&gcm);
-    if (mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, kek, 128) != 0 ||
-        mbedtls_gcm_auth_decrypt(&gcm, ct_len, nonce, 12,
-                                 NULL, 0, encrypted + ct_len, 16,
-                                 encrypted, plaintext) != 0) {
-        Serial.println("[KEY] LOI: AES-GCM decrypt");
-        mbedtls_gcm_free(&gcm); return false;
-    }
-    mbedtls_gcm_free(&gcm);
-    plaintext[ct_len] = '\0';
+    if (!simSecurePost("/secure-check-pairing", "secure-check-kek", plaintext, sizeof(plaintext)))
+        return false;
 
     // Parse plaintext JSON
     StaticJsonDocument<512> keyDoc;
@@ -482,7 +310,61 @@ static bool fetchPairingKeyViaSim(char* keyHexOut) {
     if (!keyHex || strlen(keyHex) != 32) {
         Serial.println("[KEY] LOI: pairing_key khong hop le"); return false;
     }
-    strncpy(keyHexOut, keyHex, 33);
+    hexStringToBytes(keyHex, keyOut, 16);
+    return true;
+}
+
+// Friend key chỉ dùng được khi server signing key được pin trong config
+static bool friendSigningConfigured() { return SERVER_SIGNING_PUBKEY_B64[0] != '\0'; }
+
+// Server signing key (DER) dùng kiểm chữ ký friend table — chỉ từ SERVER_SIGNING_PUBKEY_B64.
+// Key server gửi kèm response (signing_public_key_b64) nằm ngoài GCM envelope, ai chặn
+// được đường SIM cũng thay được → không bao giờ tin, chỉ so để báo server đã đổi key.
+static size_t friendSigningKey(const uint8_t* offered, size_t offeredLen, uint8_t* der, size_t derMax) {
+    size_t len = 0;
+    const char* cfg = SERVER_SIGNING_PUBKEY_B64;
+    if (!cfg[0] || mbedtls_base64_decode(der, derMax, &len, (const uint8_t*)cfg, strlen(cfg)) != 0) return 0;
+    if (offeredLen && (offeredLen != len || memcmp(offered, der, len) != 0))
+        Serial.println("[FRIEND] Server gui signing key khac key da pin — bo qua, dung key trong config");
+    return len;
+}
+
+// Sync bảng friend key: plaintext = blob_len(2, LE) | blob | chữ ký ECDSA DER của blob.
+// Chữ ký hợp lệ → nạp vào friendKeys + lưu key store. Lỗi → giữ bảng cũ.
+static bool syncFriendKeysViaSim() {
+    static uint8_t plain[FRIEND_BLOB_MAX + 2 + 80 + 16 + 1];   // + chữ ký + GCM tag
+    uint8_t offered[128];
+    size_t  offeredLen = sizeof(offered);
+    size_t  n = simSecurePost("/friend-sharing/sync", "friend-sync-kek", plain, sizeof(plain),
+                              offered, &offeredLen);
+    if (n < 2) return false;
+
+    size_t blobLen = plain[0] | (plain[1] << 8);
+    if (blobLen > FRIEND_BLOB_MAX || 2 + blobLen >= n) {
+        Serial.println("[FRIEND] LOI: kich thuoc payload"); return false;
+    }
+    const uint8_t* blob = plain + 2;
+    const uint8_t* sig  = blob + blobLen;
+    size_t         sigLen = n - 2 - blobLen;
+
+    uint8_t pub[128];
+    size_t  pubLen = friendSigningKey(offered, offeredLen, pub, sizeof(pub));
+    if (!pubLen) { Serial.println("[FRIEND] LOI: khong co server signing key"); return false; }
+    if (!FriendKeyTable::verifySignature(blob, blobLen, sig, sigLen, pub, pubLen)) {
+        Serial.println("[FRIEND] LOI: chu ky bang friend key khong hop le"); return false;
+    }
+    xSemaphoreTake(keyLock, portMAX_DELAY);
+    bool loaded = friendKeys.load(blob, blobLen, VEHICLE_ID, true);
+    uint32_t clockNow = friendKeys.checkpoint();
+    xSemaphoreGive(keyLock);
+    if (!loaded) return false;
+    keyStore.saveClockFloor(clockNow);
+    size_t storedLen;
+    const uint8_t* stored = keyStore.friendBlob(&storedLen);
+    if (storedLen != blobLen || memcmp(stored, blob, blobLen) != 0) {
+        if (!keyStore.setFriendBlob(blob, blobLen) || !keyStore.commit()) Serial.println("[FRIEND] LOI: ghi NVS");
+    }
+    friendKeys.print();
     return true;
 }
 
@@ -490,19 +372,100 @@ static bool fetchPairingKeyViaSim(char* keyHexOut) {
 // CAN helpers
 // =============================================================================
 
-static void canLock() {
-    if (!pCanControl) return;
-    bool ok = pCanControl->lockCar();
-    carUnlocked = false;  // cập nhật state bất kể CAN result (an toàn: assume locked)
-    Serial.printf(">> Car LOCKED %s\n", ok ? "(CAN OK)" : "(CAN FAILED — state forced)");
+// Lấy/nhả SPI cho từng frame của sequence CAN. DW3000 có thể vẫn đang RX trong
+// hardware — CS của nó đã HIGH nên MCP2515 dùng bus không ảnh hưởng.
+static bool canBusLock()   { return spiArbiter.acquire(SPI_CLIENT_CAN, pdMS_TO_TICKS(50)); }
+static void canBusUnlock() { spiArbiter.release(SPI_CLIENT_CAN); }
+
+// Đọc các frame status trong RXB0/RXB1 (mọi bus) vào decoder. Caller phải giữ bus SPI.
+// Giới hạn 4 frame/bus/lần — MCP2515 chỉ có 2 RX buffer, tránh loop vô hạn nếu SPI lỗi.
+// Dừng sớm khi uwbTask chờ bus; frame còn trong ring/chip đọc ở lượt sau.
+static void canDrainRx() {
+    struct can_frame frame;
+    uint8_t bus = 0;
+    for (int i = 0; i < 4 * CAN_BUS_COUNT && pCanControl->readFrame(&frame, &bus); i++) {
+        if (bus < CAN_BUS_COUNT) canRxStats[bus].accepted++;
+        if (vehicleState.feed(frame)) {
+            carUnlocked = (vehicleState.getLockState() == VehicleState::LOCK_UNLOCKED);
+            DLOGI("[CAN] Body state: %s, door %s",
+                  carUnlocked ? "UNLOCKED" : "LOCKED", vehicleState.isDoorOpen() ? "open" : "closed");
+        }
+        if (spiArbiter.contended(SPI_CLIENT_CAN)) break;  // uwbTask đang chờ bus — frame còn lại đọc lượt sau
+    }
+}
+
+// Chờ body ECU báo lock state == target. Chỉ giữ bus SPI lúc đọc để
+// uwbTask vẫn ranging được trong lúc chờ xe phản hồi.
+// Dừng sớm nếu scheduler yêu cầu abort (LOCK tới khi đang chờ UNLOCK).
+static bool canWaitForState(VehicleState::LockState target, uint32_t timeoutMs) {
+    unsigned long t0 = millis();
+    while (millis() - t0 < timeoutMs && !canScheduler.shouldAbort()) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        if (!canBusLock()) continue;
+        canDrainRx();
+        canBusUnlock();
+        if (vehicleState.isFresh() && vehicleState.getLockState() == target) return true;
+    }
+    return false;
 }
 
-static void canUnlock() {
-    if (carUnlocked || !pCanControl) return;
-    if (pCanControl->unlockCar()) {
-        carUnlocked = true;
-        Serial.println(">> Car UNLOCKED");
+// Gửi LOCK/UNLOCK sequence và xác nhận bằng frame status của xe.
+// Chỉ gửi lại sequence khi state của xe không đổi sau CAN_ACK_TIMEOUT_MS.
+// Nếu xe không broadcast status (sai ID hoặc bus im lặng) → fallback tin TX result.
+// Trả về true nếu bị scheduler abort (có LOCK chờ trong lúc chạy UNLOCK).
+static bool canActuate(const CanCmdMsg& msg) {
+    if (!pCanControl) return false;
+    bool lock = (msg.cmd == CAN_CMD_LOCK);
+    VehicleState::LockState target = lock ? VehicleState::LOCK_LOCKED : VehicleState::LOCK_UNLOCKED;
+    const char* name = lock ? "LOCKED" : "UNLOCKED";
+
+    // BLE luôn request desired state — command trùng state xe bỏ ở đây.
+    // Không có feedback: chỉ bỏ UNLOCK khi đã mở; LOCK luôn gửi (an toàn).
+    if (vehicleState.isFresh()) {
+        if (vehicleState.getLockState() == target) {
+            carUnlocked = !lock;
+            DLOGI(">> Car already %s — sequence skipped", name);
+            return false;
+        }
+    } else if (!lock && carUnlocked) {
+        return false;
+    }
+
+    for (int attempt = 1; attempt <= CAN_MAX_SEQUENCE_ATTEMPTS; attempt++) {
+        if (!canBusLock()) {
+            DLOGE("===CAN=== SPI bus timeout");
+            return false;
+        }
+        canDrainRx();  // cập nhật state ngay trước khi gửi
+        canBusUnlock();
+        // Sequence tự lấy bus cho từng frame (setBusLock) — UWB chen vào giữa các frame
+        unsigned long seqStart = millis();
+        bool txOk = lock ? pCanControl->lockCar() : pCanControl->unlockCar();
+        if (pCanControl->wasAborted()) return true;
+
+        if (!vehicleState.isFresh()) {
+            // Không có feedback: LOCK luôn assume locked (an toàn), UNLOCK tin TX result
+            if (lock)      carUnlocked = false;
+            else if (txOk) carUnlocked = true;
+            DLOGI(">> Car %s (no body feedback, CAN %s)", name, txOk ? "OK" : "FAILED");
+            return false;
+        }
+
+        if (canWaitForState(target, CAN_ACK_TIMEOUT_MS)) {
+            carUnlocked = !lock;
+            unsigned long now = millis();
+            DLOGI(">> Car %s confirmed: %lu ms after request, %lu ms after sequence start (attempt %d)",
+                  name, now - msg.requestedAtMs, now - seqStart, attempt);
+            return false;
+        }
+        if (canScheduler.shouldAbort()) return true;
+        DLOGW("[CAN] No state change %u ms after sequence (attempt %d/%d)",
+              (unsigned)CAN_ACK_TIMEOUT_MS, attempt, CAN_MAX_SEQUENCE_ATTEMPTS);
     }
+
+    carUnlocked = (vehicleState.getLockState() == VehicleState::LOCK_UNLOCKED);
+    DLOGW(">> Car NOT %s — body state unchanged after %d sequences", name, CAN_MAX_SEQUENCE_ATTEMPTS);
+    return false;
 }
 
 // =============================================================================
@@ -512,107 +475,91 @@ static void canUnlock() {
 // Sau:   BLE callback xQueueSend → task nhận và xử lý ngay đúng context
 // =============================================================================
 
+// Gọi từ BLE stack task. Connect/disconnect chờ lâu hơn — mất message = session treo
+// (bleTask vẫn đối chiếu với getPeerDevices() định kỳ).
+static void postPeerMsg(BleCmdType type, uint16_t connId, const uint8_t* data, size_t len,
+                        TickType_t wait = pdMS_TO_TICKS(10)) {
+    BleCmdMsg msg = {};
+    msg.type    = type;
+    msg.connId  = connId;
+    msg.dataLen = (uint8_t)min(len, sizeof(msg.data));
+    if (data) memcpy(msg.data, data, msg.dataLen);
+    if (xQueueSend(bleQueue, &msg, wait) != pdTRUE)
+        Serial.printf("[BLE] bleQueue full — dropped msg %u (conn=%u)\n", (unsigned)type, connId);
+}
+
+// param->write.conn_id: với write dài (prepare/execute) Arduino gọi onWrite lúc
+// EXEC_WRITE — conn_id là field đầu của mọi struct trong union nên vẫn đúng,
+// còn data luôn lấy qua getData()/getLength().
 class AuthCharacteristicCallbacks : public BLECharacteristicCallbacks {
-    void onWrite(BLECharacteristic* pChar) override {
+    void onWrite(BLECharacteristic* pChar, esp_ble_gatts_cb_param_t* param) override {
         // Dùng getData()/getLength() thay getValue() — zero-copy, không heap allocate
         uint8_t* pData = pChar->getData();
         size_t   len   = pChar->getLength();
-        if (!pData || len == 0) return;
+        if (!param || !pData || len == 0) return;
+        if (len == TICKET_RESUME_LEN && pData[0] == TICKET_RESUME_TAG) tracer.mark(TP_A_RESUME_RX);
+        postPeerMsg(BLE_AUTH_DATA, param->write.conn_id, pData, len);
+    }
 
-        size_t toCopy = len;
-        if (toCopy > 32 - responseBufferLen) toCopy = 32 - responseBufferLen;
-        memcpy(responseBuffer + responseBufferLen, pData, toCopy);
-        responseBufferLen += toCopy;
-
-        if (responseBufferLen >= 32) {
-            BleCmdMsg msg;
-            msg.type    = BLE_AUTH_VERIFY;
-            msg.dataLen = 32;
-            memcpy(msg.data, responseBuffer, 32);
-            responseBufferLen = 0;
-            xQueueSend(bleQueue, &msg, pdMS_TO_TICKS(10));
-        }
+    // Fallback read của Tag: mỗi peer thấy reply của chính nó
+    void onRead(BLECharacteristic* pChar, esp_ble_gatts_cb_param_t* param) override {
+        const PeerSession* p = param ? peers.readable(param->read.conn_id) : nullptr;
+        if (p && p->authReplyLen) pChar->setValue((uint8_t*)p->authReply, p->authReplyLen);
+        else                      pChar->setValue("");
+    }
+};
+
+// Fallback readValue() của Tag: trả challenge của đúng connection đang đọc
+class ChallengeCharacteristicCallbacks : public BLECharacteristicCallbacks {
+    void onRead(BLECharacteristic* pChar, esp_ble_gatts_cb_param_t* param) override {
+        const PeerSession* p = param ? peers.readable(param->read.conn_id) : nullptr;
+        if (p && p->challengeReady) pChar->setValue((uint8_t*)p->challenge, 16);
+        else                        pChar->setValue("");
     }
 };
 
+// Handle CCCD của challenge/auth/data characteristic (index = bit PEER_CCCD_*).
+// BLE2902 lưu 1 giá trị chung cho mọi connection → bắt write CCCD ở mức GATTS
+// để biết peer nào subscribe.
+static uint16_t peerCccdHandle[3] = {};
+
+static void gattsCccdHandler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
+                             esp_ble_gatts_cb_param_t* param) {
+    if (event != ESP_GATTS_WRITE_EVT || param->write.is_prep || param->write.len != 2) return;
+    for (uint8_t i = 0; i < 3; i++) {
+        if (!peerCccdHandle[i] || param->write.handle != peerCccdHandle[i]) continue;
+        uint8_t d[2] = { (uint8_t)(1 << i), (uint8_t)(param->write.value[0] & 0x01) };
+        postPeerMsg(BLE_PEER_CCCD, param->write.conn_id, d, sizeof(d));
+        break;
+    }
+}
+
 class CharacteristicCallbacks : public BLECharacteristicCallbacks {
-    void onWrite(BLECharacteristic* pChar) override {
-        if (!pChar) return;
+    void onWrite(BLECharacteristic* pChar, esp_ble_gatts_cb_param_t* param) override {
+        if (!pChar || !param) return;
         // Dùng getData()/getLength() thay getValue() — không tạo String heap copy
         const uint8_t* pData = pChar->getData();
         size_t         len   = pChar->getLength();
         if (!pData || len == 0) return;
 
-        // startsWith bằng memcmp — không allocate
-        #define STARTS(lit) (len >= sizeof(lit)-1 && memcmp(pData, lit, sizeof(lit)-1) == 0)
-
-        uint8_t cmd;
-        if (STARTS("VERIFIED:")) {
-            Serial.printf("[BLE] VERIFIED received (carUnlocked=%d)\n", (int)carUnlocked);
-            if (!carUnlocked) {
-                cmd = CAN_CMD_UNLOCK;
-                BaseType_t sent = xQueueSend(canQueue, &cmd, pdMS_TO_TICKS(10));
-                Serial.printf("[BLE] canQueue send=%d\n", (int)sent);
-            }
-        } else if (STARTS("WARNING:") || STARTS("LOCK_CAR")) {
-            if (carUnlocked) {
-                cmd = CAN_CMD_LOCK;
-                xQueueSend(canQueue, &cmd, pdMS_TO_TICKS(10));
-            }
-        } else if (STARTS("UWB_STOP")) {
-            if (carUnlocked) {
-                cmd = CAN_CMD_LOCK;
-                xQueueSend(canQueue, &cmd, pdMS_TO_TICKS(10));
-            }
-            cmd = UWB_CMD_DEINIT;
-            xQueueSend(uwbQueue, &cmd, pdMS_TO_TICKS(10));
-            Serial.println("UWB: Tag beyond 20m");
-        } else if (STARTS("TAG_UWB_READY")) {
-            bool authed = (xEventGroupGetBits(sysEvents) & EVT_AUTHED) != 0;
-            Serial.printf("[BLE] TAG_UWB_READY received — authed=%d\n", (int)authed);
-            if (authed) {
-                cmd = UWB_CMD_INIT;
-                BaseType_t sent = xQueueSend(uwbQueue, &cmd, pdMS_TO_TICKS(10));
-                Serial.printf("[BLE] UWB_CMD_INIT queued=%d\n", (int)(sent == pdTRUE));
-            }
-        } else if (STARTS("ALERT:RELAY_ATTACK")) {
-            Serial.println("SECURITY ALERT: Relay attack detected!");
-        }
-
-        #undef STARTS
+        // Trace ngay lúc nhận — xử lý (auth check, CAN request) nằm trong bleTask
+        if (len >= 9 && memcmp(pData, "VERIFIED:", 9) == 0)           tracer.mark(TP_A_VERIFIED_RX);
+        else if (len >= 13 && memcmp(pData, "TAG_UWB_READY", 13) == 0) tracer.mark(TP_A_UWB_READY_RX);
+        postPeerMsg(BLE_PEER_WRITE, param->write.conn_id, pData, len);
     }
 };
 
 class MyServerCallbacks : public BLEServerCallbacks {
-    void onConnect(BLEServer* pServer) override {
-        deviceConnected   = true;
-        authenticated     = false;
-        responseBufferLen = 0;
-        connectionGen++;   // new generation — invalidates any pending BLE_SEND_CHALLENGE
-        xEventGroupSetBits(sysEvents, EVT_CONNECTED);
-        xEventGroupClearBits(sysEvents, EVT_AUTHED | EVT_UWB_ACTIVE);
-        Serial.printf("BLE: Tag connected (gen=%u)\n", (unsigned)connectionGen);
-
-        // Gửi BLE_SEND_CHALLENGE vào bleQueue, đính kèm generation ID.
-        // bleTask kiểm tra ID trước khi gửi challenge — nếu lệch (session cũ) thì bỏ qua.
-        BleCmdMsg msg = {};
-        msg.type    = BLE_SEND_CHALLENGE;
-        msg.data[0] = connectionGen;
-        xQueueSend(bleQueue, &msg, pdMS_TO_TICKS(10));
+    void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) override {
+        tracer.newSession();
+        tracer.mark(TP_A_CONNECTED, param->connect.conn_id);
+        postPeerMsg(BLE_PEER_CONNECTED, param->connect.conn_id, param->connect.remote_bda,
+                    sizeof(esp_bd_addr_t), pdMS_TO_TICKS(100));
     }
 
-    void onDisconnect(BLEServer* pServer) override {
-        deviceConnected = false;
-        authenticated   = false;
-        xEventGroupClearBits(sysEvents, EVT_CONNECTED | EVT_AUTHED | EVT_UWB_ACTIVE);
-        Serial.println("BLE: Tag disconnected");
-
-        // Deinit UWB + lock car + restart advertising — mỗi task nhận command riêng
-        uint8_t cmd;
-        cmd = UWB_CMD_DEINIT; xQueueSend(uwbQueue, &cmd, pdMS_TO_TICKS(10));
-        cmd = CAN_CMD_LOCK;   xQueueSend(canQueue, &cmd, pdMS_TO_TICKS(10));
-        BleCmdMsg msg = {}; msg.type = BLE_RESTART_ADV;
-        xQueueSend(bleQueue, &msg, pdMS_TO_TICKS(10));
+    void onDisconnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) override {
+        tracer.mark(TP_SESSION_END, param->disconnect.conn_id);
+        postPeerMsg(BLE_PEER_DISCONNECTED, param->disconnect.conn_id, nullptr, 0, pdMS_TO_TICKS(100));
     }
 };
 
@@ -620,19 +567,53 @@ class MyServerCallbacks : public BLEServerCallbacks {
 // BLE server init
 // =============================================================================
 
-static void startBLE() {
-    hexStringToBytes(bleKeyHex, pairingKey, 16);
-    printHex("Pairing key: ", pairingKey, 16);
+// Hash bảng attribute (UUID + handle value/CCCD), Tag so với bản lưu NVS để bỏ
+// qua service discovery khi reconnect (gatt_cache.h bên Tag). Đổi layout → đổi hash.
+static void publishGattLayoutHash(BLECharacteristic* pLayout, BLECharacteristic* const* chars, size_t count) {
+    uint64_t h = 0xcbf29ce484222325ULL;   // FNV-1a 64
+    auto mix = [&h](const uint8_t* p, size_t n) {
+        for (size_t i = 0; i < n; i++) { h ^= p[i]; h *= 0x100000001b3ULL; }
+    };
+    for (size_t i = 0; i < count; i++) {
+        if (!chars[i]) continue;
+        String uuid = chars[i]->getUUID().toString().c_str();
+        BLEDescriptor* cccd = chars[i]->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
+        uint16_t handles[2] = { chars[i]->getHandle(), (uint16_t)(cccd ? cccd->getHandle() : 0) };
+        mix((const uint8_t*)uuid.c_str(), uuid.length());
+        mix((const uint8_t*)handles, sizeof(handles));
+    }
+    pLayout->setValue((uint8_t*)&h, sizeof(h));
+    Serial.printf("GATT layout hash: %08lx%08lx\n", (unsigned long)(h >> 32), (unsigned long)h);
+}
+
+// Cài pairing key (binary, từ keyStore) cho HMAC và ticket; STS lấy thẳng từ keyStore
+// lúc initUWB. Task đã chạy → caller giữ keyLock.
+// Key khác key cũ (xe pair lại) → huỷ mọi ticket cấp từ key cũ.
+static void installPairingKey(const uint8_t* key) {
+    bool changed = memcmp(key, pairingKey, 16) != 0;
+    memcpy(pairingKey, key, 16);
+    Serial.printf("Pairing key id: %08lx\n", (unsigned long)keyStore.keyId());
+    if (!pairingHmac.begin(pairingKey, 16)) Serial.println("[AUTH] LOI: HMAC key schedule");
+    ticketIssuer.begin(pairingKey, TICKET_LIFETIME_MS);
+    if (changed) ticketIssuer.revokeAll();
+    xEventGroupSetBits(sysEvents, EVT_KEY_READY);
+}
 
+// BLE advertise ngay cả khi chưa có pairing key: friend key (NVS) vẫn dùng được,
+// chủ xe nhận AUTH_FAIL tới khi EVT_KEY_READY.
+static void startBLE() {
     BLEDevice::init(DEVICE_NAME);
     BLEDevice::setPower(ESP_PWR_LVL_P9);
+    BLEDevice::setCustomGattsHandler(gattsCccdHandler);
     pBleServer = BLEDevice::createServer();
     pBleServer->setCallbacks(new MyServerCallbacks());
 
-    BLEService* pService = pBleServer->createService(SERVICE_UUID);
+    // 4 characteristic × 3 handle + layout hash 2 + service 1 → vượt mặc định 15
+    BLEService* pService = pBleServer->createService(BLEUUID(SERVICE_UUID), 20);
 
     pChallengeCharacteristic = pService->createCharacteristic(
         CHALLENGE_CHAR_UUID, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY);
+    pChallengeCharacteristic->setCallbacks(new ChallengeCharacteristicCallbacks());
     pChallengeCharacteristic->addDescriptor(new BLE2902());
 
     pAuthCharacteristic = pService->createCharacteristic(
@@ -647,7 +628,26 @@ static void startBLE() {
     pCharacteristic->addDescriptor(new BLE2902());
     pCharacteristic->setValue("ANCHOR_READY");
 
+#if TELEMETRY_ENABLE
+    if (TELEMETRY_SINKS & TELEMETRY_SINK_BLE) {
+        pDiagCharacteristic = pService->createCharacteristic(
+            TELEMETRY_CHAR_UUID, BLECharacteristic::PROPERTY_NOTIFY);
+        pDiagCharacteristic->addDescriptor(new BLE2902());
+    }
+#endif
+
+    BLECharacteristic* pLayoutCharacteristic = pService->createCharacteristic(
+        GATT_LAYOUT_CHAR_UUID, BLECharacteristic::PROPERTY_READ);
+
     pService->start();
+    // Handle chỉ có sau start()
+    BLECharacteristic* const layoutChars[] = {
+        pChallengeCharacteristic, pAuthCharacteristic, pCharacteristic, pDiagCharacteristic };
+    publishGattLayoutHash(pLayoutCharacteristic, layoutChars, sizeof(layoutChars) / sizeof(layoutChars[0]));
+    for (int i = 0; i < 3; i++) {
+        BLEDescriptor* cccd = layoutChars[i]->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
+        peerCccdHandle[i] = cccd ? cccd->getHandle() : 0;
+    }
 
     BLEAdvertising* pAdv = BLEDevice::getAdvertising();
     pAdv->addServiceUUID(SERVICE_UUID);
@@ -655,39 +655,69 @@ static void startBLE() {
     pAdv->setMinPreferred(0x06);
     pAdv->setMaxPreferred(0x12);
     BLEDevice::startAdvertising();
-    Serial.println("BLE advertising: " + String(DEVICE_NAME));
+    bootProfile.ready("advertising");
+    Serial.printf("BLE advertising: %s (max %u peers)\n", DEVICE_NAME, (unsigned)MAX_BLE_PEERS);
 }
 
-// Đọc key từ NVS. Nếu chưa có → fetch qua SIM module → lưu NVS
-static void executeMainFlow() {
-    checkStoredKey();
-
-    if (!hasKey) {
-        Serial.println("No key in NVS — fetching via SIM module...");
-        if (simInit()) {
-            char simKey[33];
-            if (fetchPairingKeyViaSim(simKey))
-                saveKeyToNVS(simKey);
-            else
-                Serial.println("[SIM] Failed to fetch pairing key — pair the vehicle first.");
-        } else {
-            Serial.println("[SIM] Module init failed — cannot fetch key.");
-        }
-        if (!hasKey) { Serial.println("No key — BLE not started."); return; }
+// Dựng bảng friend key từ blob trong keyStore (đã kiểm chữ ký lúc sync).
+// Đồng hồ bắt đầu từ clock floor đã lưu — không lùi về generated_at sau reboot.
+// Chưa pin signing key → không nạp (blob có thể đã kiểm bằng key tin lần đầu ở bản cũ).
+static bool loadFriendTable() {
+    if (!friendSigningConfigured()) {
+        Serial.println("[FRIEND] SERVER_SIGNING_PUBKEY_B64 chua cau hinh — friend key tat");
+        return false;
     }
+    size_t len;
+    const uint8_t* blob = keyStore.friendBlob(&len);
+    friendKeys.restoreClock(keyStore.clockFloor());
+    return len && friendKeys.load(blob, len, VEHICLE_ID);
+}
 
-    Serial.printf("Key loaded: %.8s...\n", bleKeyHex);
-    startBLE();
-    bleStarted = true;
+// provTask: lưu giờ friend hiện tại làm clock floor (chỉ tăng)
+static void saveFriendClock() {
+    xSemaphoreTake(keyLock, portMAX_DELAY);
+    uint32_t t = friendKeys.checkpoint();
+    xSemaphoreGive(keyLock);
+    if (t && !keyStore.saveClockFloor(t)) Serial.println("[FRIEND] LOI: ghi clock floor");
+}
+
+// provTask ngủ theo chặng FRIEND_CLOCK_SAVE_MS, mỗi chặng lưu clock floor
+static void provSleep(uint32_t ms) {
+    while (ms) {
+        uint32_t step = ms < FRIEND_CLOCK_SAVE_MS ? ms : FRIEND_CLOCK_SAVE_MS;
+        // pdMS_TO_TICKS tràn 32 bit với mốc vài giờ
+        vTaskDelay(step / portTICK_PERIOD_MS);
+        ms -= step;
+        saveFriendClock();
+    }
+}
+
+// Key store (1 lần đọc NVS) lúc boot, chưa có task nào chạy. Chưa có pairing key →
+// provTask fetch nền. BOOT_FAST: friend table để provTask dựng sau khi đã advertise.
+static void loadStoredKeys() {
+    keyStore.begin();
+    keyStore.print();
+#if !BOOT_FAST
+    if (loadFriendTable()) friendKeys.print();
+#endif
+    if (keyStore.hasPairingKey()) {
+        installPairingKey(keyStore.pairingKey());
+    } else {
+        Serial.println("No key in NVS — BLE starts now, provTask fetches via SIM");
+    }
 }
 
 // =============================================================================
 // UWB init / deinit
 // =============================================================================
 
+// DW3000 IRQ — chỉ đánh thức uwbTask, mọi SPI access nằm trong task
+static void IRAM_ATTR uwbIrqIsr() {
+    uwbFsm.irqFromISR();
+}
+
 static bool initUWB() {
     Serial.println("UWB: initializing...");
-    digitalWrite(CAN_CS, HIGH);  // deselect MCP2515 trước
     spiBegin(PIN_IRQ, PIN_RST);
     { extern uint8_t _ss; _ss = PIN_SS; }
     pinMode(PIN_SS, OUTPUT); digitalWrite(PIN_SS, HIGH);
@@ -710,18 +740,23 @@ static bool initUWB() {
     dwt_settxantennadelay(TX_ANT_DLY);
     dwt_setlnapamode(DWT_LNA_ENABLE | DWT_PA_ENABLE);
 
-    // Derive STS key từ pairingKey (16 bytes = 4 × uint32_t)
-    // Cả Anchor và Tag dùng cùng pairingKey → STS key khớp → UWB frame được xác thực
-    memcpy(&sts_key, pairingKey, sizeof(sts_key));
+    // IRQ pin lên khi nhận xong frame hoặc RX lỗi → uwbTask thức dậy, không cần poll SPI
+    dwt_setinterrupt(DWT_INT_RFCG | DWT_INT_RPHE | DWT_INT_RFCE | DWT_INT_RFSL |
+                     DWT_INT_RFTO | DWT_INT_RXPTO | DWT_INT_SFDT, 0, DWT_ENABLE_INT_ONLY);
+    attachInterrupt(digitalPinToInterrupt(PIN_IRQ), uwbIrqIsr, RISING);
+
+    // STS key/IV dẫn xuất sẵn trong keyStore lúc đổi pairing key (Tag dùng cùng cách)
     // IV: upper 96 bits cố định, lower 32 bits = counter reset mỗi ranging
-    sts_iv.iv0 = 0x00000001U;
-    sts_iv.iv1 = 0x00000000U;
-    sts_iv.iv2 = 0x00000000U;
-    sts_iv.iv3 = 0x00000000U;
+    xSemaphoreTake(keyLock, portMAX_DELAY);
+    memcpy(&sts_key, keyStore.stsKey(), sizeof(sts_key));
+    memcpy(&sts_iv,  keyStore.stsIv(),  sizeof(sts_iv));
+    xSemaphoreGive(keyLock);
     dwt_configurestskey(&sts_key);
     dwt_configurestsiv(&sts_iv);
     dwt_configurestsloadiv();
     stsConfigured = true;
+    uwbSniff.begin();
+    uwbDiag.begin();
 
     Serial.println("UWB: ready (STS mode 1)");
     return true;
@@ -731,6 +766,7 @@ fail:
 }
 
 static void deinitUWB() {
+    detachInterrupt(digitalPinToInterrupt(PIN_IRQ));
     dwt_forcetrxoff();
     dwt_softreset();
     vTaskDelay(pdMS_TO_TICKS(2));
@@ -745,29 +781,18 @@ static void deinitUWB() {
 // Logic giống hệt BLE_UWB_Anchor, nhưng dùng vTaskDelay thay delay()
 // =============================================================================
 
-static void uwbResponderLoop() {
-    // Reload STS IV counter trước mỗi RX để sync với Tag
-    dwt_writetodevice(STS_IV0_ID, 0, 4, (uint8_t*)&sts_iv.iv0);
-    dwt_configurestsloadiv();
-
-    dwt_rxenable(DWT_START_RX_IMMEDIATE);
-    uint32_t status_reg = 0U;
-    unsigned long t0 = millis();
-    while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) &
-             (SYS_STATUS_RXFCG_BIT_MASK | SYS_STATUS_ALL_RX_ERR))) {
-        if ((millis() - t0) > 100UL) { dwt_forcetrxoff(); return; }
-        taskYIELD();
-    }
+// Xử lý Poll và hẹn giờ Response. Caller giữ bus SPI suốt hàm (timing-critical).
+static void uwbRespond(uint32_t status_reg) {
     if (!(status_reg & SYS_STATUS_RXFCG_BIT_MASK)) {
         dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_ERR);
-        dwt_forcetrxoff(); return;
+        dwt_forcetrxoff(); uwbSniff.rxError(); return;
     }
 
     // Kiểm tra STS quality — từ chối frame nếu STS không hợp lệ (relay attack)
     int16_t stsQual;
     if (dwt_readstsquality(&stsQual) < 0) {
         dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_GOOD);
-        dwt_forcetrxoff(); return;
+        dwt_forcetrxoff(); uwbSniff.rxError(); uwbDiag.stsReject(); return;
     }
 
     dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG_BIT_MASK);
@@ -775,8 +800,10 @@ static void uwbResponderLoop() {
     if (frame_len == 0 || frame_len > sizeof(rx_buffer)) { dwt_forcetrxoff(); return; }
 
     dwt_readrxdata(rx_buffer, frame_len, 0U);
+    uint8_t pollSeq = rx_buffer[ALL_MSG_SN_IDX];
     rx_buffer[ALL_MSG_SN_IDX] = 0U;
     if (memcmp(rx_buffer, rx_poll_msg, ALL_MSG_COMMON_LEN) != 0) { dwt_forcetrxoff(); return; }
+    uwbDiag.stsOk(stsQual);   // chỉ Poll thật mới vào thống kê / giữ CIA sample
 
     uint64_t poll_rx_ts   = get_rx_timestamp_u64();
     uint32_t resp_tx_time = (uint32_t)((poll_rx_ts + ((uint64_t)POLL_RX_TO_RESP_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8);
@@ -792,8 +819,9 @@ static void uwbResponderLoop() {
     dwt_writetxdata(sizeof(tx_resp_msg), tx_resp_msg, 0U);
     dwt_writetxfctrl(sizeof(tx_resp_msg), 0U, 1);
     if (dwt_starttx(DWT_START_TX_DELAYED) != DWT_SUCCESS) {
-        dwt_forcetrxoff(); return;
+        dwt_forcetrxoff(); uwbSniff.poll(pollSeq); return;
     }
+    uwbSniff.poll(pollSeq);   // sau starttx — không lấn vào budget hẹn giờ Response
     unsigned long tx_t0 = millis();
     while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS_BIT_MASK)) {
         if ((millis() - tx_t0) > 10UL) { dwt_forcetrxoff(); return; }
@@ -802,104 +830,446 @@ static void uwbResponderLoop() {
     frame_seq_nb++;
 }
 
+// Arm RX → nhả bus → chờ IRQ → lấy lại bus cho phần timing-critical (đọc Poll,
+// hẹn giờ Response). Trong lúc DW3000 chờ frame, canTask dùng được SPI.
+// SUSPEND/STOP đánh thức task ngay cả khi đang chờ frame → tắt RX và return.
+static void uwbResponderLoop() {
+    if (!spiArbiter.acquire(SPI_CLIENT_UWB, pdMS_TO_TICKS(50))) return;
+    // Reload STS IV counter trước mỗi RX để sync với Tag
+    dwt_writetodevice(STS_IV0_ID, 0, 4, (uint8_t*)&sts_iv.iv0);
+    dwt_configurestsloadiv();
+    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_GOOD | SYS_STATUS_ALL_RX_ERR);  // IRQ line về LOW
+    uwbFsm.clearIrq();  // bỏ IRQ cũ
+    uwbSniff.arm();
+    uwbDiag.arm();
+    dwt_rxenable(DWT_START_RX_IMMEDIATE);
+    uint32_t armedUs = micros();
+    spiArbiter.release(SPI_CLIENT_UWB);
+
+    // Chờ IRQ, không đụng SPI: status đã xoá trước rxenable nên cạnh IRQ tin được.
+    // Chỉ đọc SYS_STATUS khi có IRQ / lệnh dừng, hoặc 1 lần lúc hết UWB_RX_WAIT_MS (lỡ cạnh).
+    const TickType_t window = pdMS_TO_TICKS(UWB_RX_WAIT_MS);
+    TickType_t t0 = xTaskGetTickCount();
+    uint32_t status_reg = 0U;
+    bool due = false;   // cần đọc status (giữ qua lần acquire hụt)
+    for (;;) {
+        TickType_t elapsed = xTaskGetTickCount() - t0;
+        bool late = elapsed >= window;
+        if (!due && !late) due = uwbFsm.wait(window - elapsed) || uwbFsm.interrupted();
+        if (!due && !late) continue;   // lệnh không cắt RX (START) — chờ tiếp phần còn lại
+        if (!spiArbiter.acquire(SPI_CLIENT_UWB, pdMS_TO_TICKS(10))) continue;
+        status_reg = dwt_read32bitreg(SYS_STATUS_ID);
+        if (status_reg & (SYS_STATUS_RXFCG_BIT_MASK | SYS_STATUS_ALL_RX_ERR)) break;  // giữ bus
+        if (late || uwbFsm.interrupted()) {
+            dwt_forcetrxoff();
+            spiArbiter.release(SPI_CLIENT_UWB);
+            uwbSniff.listened(micros() - armedUs);
+            return;
+        }
+        spiArbiter.release(SPI_CLIENT_UWB);
+        due = false;
+    }
+
+    uwbSniff.listened(micros() - armedUs);
+    uwbRespond(status_reg);
+    uwbDiag.collect();   // Response đã phát xong — đọc CIA diag nếu Poll này được chọn
+    spiArbiter.release(SPI_CLIENT_UWB);
+}
+
 // =============================================================================
 // TASK: bleTask — Core 0, Priority 3
 //
 // Xử lý tất cả BLE-side work items từ bleQueue.
 // Chạy trên Core 0 cùng với BLE stack — không cần cross-core BLE calls.
+// Sở hữu bảng session (peer_sessions.h): tối đa MAX_BLE_PEERS Tag/điện thoại,
+// mỗi peer có challenge/auth/UWB riêng, notify gửi đúng conn_id.
 // =============================================================================
 
+static unsigned long lastAdvRefresh = 0;
+
+// Notify tới đúng 1 peer — BLECharacteristic::notify() gửi cho mọi connection
+static void notifyPeer(BLECharacteristic* c, const PeerSession& p, const uint8_t* data, size_t len) {
+    esp_ble_gatts_send_indicate(pBleServer->getGattsIf(), p.connId, c->getHandle(), len, (uint8_t*)data, false);
+}
+
+// Reply trên auth characteristic: notify + giữ lại cho fallback read của peer đó
+static void setAuthReply(PeerSession& p, const uint8_t* data, size_t len) {
+    len = min(len, sizeof(p.authReply));
+    p.authReplyLen = 0;
+    memcpy(p.authReply, data, len);
+    p.authReplyLen = len;
+    notifyPeer(pAuthCharacteristic, p, data, len);
+}
+
+static void restartAdvertising() {
+    vTaskDelay(pdMS_TO_TICKS(50));
+    BLEDevice::startAdvertising();
+    lastAdvRefresh = millis();
+    Serial.println("[BLE] Advertising restarted");
+}
+
+// Notify challenge đang chờ. via = "CCCD" hoặc "fallback". Ghi nhận thời gian tiết kiệm
+// so với delay cố định CHALLENGE_SEND_DELAY_MS trước đây.
+static void sendChallenge(PeerSession& p, const char* via) {
+    p.challengePending = false;
+    uint32_t waited = millis() - p.challengeSetAt;
+    uint32_t saved  = waited < CHALLENGE_SEND_DELAY_MS ? CHALLENGE_SEND_DELAY_MS - waited : 0;
+    notifyPeer(pChallengeCharacteristic, p, p.challenge, 16);
+    tracer.mark(TP_A_CHALLENGE_NOTIFY, waited);
+    challengeSentCount++;
+    challengeSavedMsSum += saved;
+    DLOG_HEX(DLOG_LVL_DEBUG, "[AUTH] Key:       ", pairingKey,  16);
+    DLOG_HEX(DLOG_LVL_DEBUG, "[AUTH] Challenge:  ", p.challenge, 16);
+    DLOGI("[BLE] Challenge → conn %u via %s after %lu ms (saved %lu ms)", p.connId, via, waited, saved);
+    DLOGD("[BLE] Challenge saved avg %lu ms over %lu, fallback %lu",
+          challengeSavedMsSum / challengeSentCount, challengeSentCount, challengeFallbacks);
+}
+
+// Đóng session rồi tính lại UWB/CAN theo các session còn lại
+static void closePeer(PeerSession* p, const char* why) {
+    uint16_t connId = p->connId;
+    peers.close(p);
+    peerCount = peers.count();
+    Serial.printf("BLE: Tag disconnected (conn=%u, %s) — %u peer(s) left\n", connId, why, (unsigned)peerCount);
+
+    if (!peers.any(&PeerSession::authed)) xEventGroupClearBits(sysEvents, EVT_AUTHED);
+    if (!peerCount)                       xEventGroupClearBits(sysEvents, EVT_CONNECTED);
+
+    // Khoá xe khi không còn Tag nào đang trong vùng unlock
+    if (!peers.any(&PeerSession::inZone)) canScheduler.request(CAN_CMD_LOCK);
+
+    // Không còn ai cần UWB: còn peer khác hoặc còn ticket sống → chỉ SUSPEND
+    // (TAG_UWB_READY / resume không phải init lại DW3000). bleTask gửi STOP khi hết ticket.
+    if (!peers.any(&PeerSession::uwbWanted)) {
+        uwbParked = !peerCount && ticketIssuer.hasLive();
+        uwbFsm.request((peerCount || uwbParked) ? UWB_NOTIFY_SUSPEND : UWB_NOTIFY_STOP);
+        xEventGroupClearBits(sysEvents, EVT_UWB_ACTIVE);
+    }
+}
+
+static void handleAuthData(PeerSession& p, const uint8_t* data, size_t len) {
+    if (p.authed || p.authBusy) return;   // đã xác thực / job đang ở authTask
+
+    AuthJob job = {};
+    job.connId = p.connId;
+    job.gen    = p.gen;
+    // RESUME luôn là 1 write trọn vẹn, không phải mảnh đầu của HMAC 32 byte
+    if (p.respLen == 0 && len == TICKET_RESUME_LEN && data[0] == TICKET_RESUME_TAG) {
+        job.type    = AUTH_JOB_RESUME;
+        job.dataLen = TICKET_RESUME_LEN;
+        memcpy(job.data, data, TICKET_RESUME_LEN);
+        tracer.bind(data + 1 + TICKET_ID_LEN);   // nonce — Tag bind giống vậy
+    } else if (p.respLen == 0 && len == FRIEND_HELLO_LEN && data[0] == FRIEND_HELLO_TAG) {
+        // Friend chọn key trước khi gửi HMAC response — lookup local, không cần mạng
+        xSemaphoreTake(keyLock, portMAX_DELAY);
+        FriendKeyTable::Result r = friendKeys.lookup(data + 1, &p.authKey);
+        xSemaphoreGive(keyLock);
+        if (r == FriendKeyTable::FRIEND_OK) {
+            p.friendKey = true;
+            Serial.printf("[BLE] Friend key accepted (conn=%u)\n", p.connId);
+            return;
+        }
+        Serial.printf("[BLE] Friend key rejected (%s, conn=%u) — disconnecting\n", FriendKeyTable::name(r), p.connId);
+        setAuthReply(p, (const uint8_t*)"AUTH_FAIL", 9);
+        vTaskDelay(pdMS_TO_TICKS(50));
+        pBleServer->disconnect(p.connId);
+        return;
+    } else {
+        size_t toCopy = min(len, sizeof(p.resp) - p.respLen);
+        memcpy(p.resp + p.respLen, data, toCopy);
+        p.respLen += toCopy;
+        if (p.respLen < sizeof(p.resp)) return;
+        tracer.mark(TP_A_AUTH_RX);
+        job.type      = AUTH_JOB_HMAC;
+        job.dataLen   = sizeof(p.resp);
+        job.friendKey = p.friendKey;
+        job.key       = p.friendKey ? p.authKey : &pairingHmac;
+        memcpy(job.challenge, p.challenge, 16);
+        memcpy(job.data, p.resp, sizeof(p.resp));
+        p.respLen = 0;
+    }
+    p.authBusy = true;
+    if (xQueueSend(authQueue, &job, 0) != pdTRUE) {
+        p.authBusy = false;
+        Serial.printf("[BLE] authQueue full — dropped auth from conn %u\n", p.connId);
+    }
+}
+
+static void handleAuthResult(PeerSession& p, const BleCmdMsg& msg) {
+    p.authBusy = false;
+    switch ((AuthVerdict)msg.data[0]) {
+        case AUTH_VERDICT_OK:
+            p.authed = true;
+            xEventGroupSetBits(sysEvents, EVT_AUTHED);
+            setAuthReply(p, (const uint8_t*)"AUTH_OK", 7);
+            tracer.mark(TP_A_AUTH_OK_TX);
+            Serial.printf("[BLE] Auth OK (conn=%u)\n", p.connId);
+            if (msg.dataLen > 1) notifyPeer(pAuthCharacteristic, p, msg.data + 1, msg.dataLen - 1);   // ticket
+            break;
+        case AUTH_VERDICT_RESUMED:
+            // Challenge của connection này không còn cần
+            p.authed           = true;
+            p.challengePending = false;
+            xEventGroupSetBits(sysEvents, EVT_AUTHED);
+            setAuthReply(p, msg.data + 1, msg.dataLen - 1);
+            Serial.printf("[BLE] Resumed with ticket (conn=%u)\n", p.connId);
+            ticketIssuer.print();
+            break;
+        case AUTH_VERDICT_RESUME_FAIL:
+            // Không disconnect — Tag quay về challenge/HMAC trên cùng connection
+            setAuthReply(p, (const uint8_t*)"RESUME_FAIL", 11);
+            break;
+        default:
+            Serial.printf("[BLE] Auth FAIL (conn=%u) — disconnecting\n", p.connId);
+            setAuthReply(p, (const uint8_t*)"AUTH_FAIL", 9);
+            vTaskDelay(pdMS_TO_TICKS(50));
+            pBleServer->disconnect(p.connId);
+            break;
+    }
+}
+
+// Lệnh trên characteristic chính. Chỉ peer đã xác thực được điều khiển xe/UWB;
+// LOCK chỉ gửi khi không còn peer nào khác trong vùng unlock.
+static void handlePeerWrite(PeerSession& p, const uint8_t* pData, size_t len) {
+    // startsWith bằng memcmp — không allocate
+    #define STARTS(lit) (len >= sizeof(lit)-1 && memcmp(pData, lit, sizeof(lit)-1) == 0)
+
+    if (STARTS("ALERT:RELAY_ATTACK")) {
+        Serial.printf("SECURITY ALERT: Relay attack detected! (conn=%u)\n", p.connId);
+        return;
+    }
+    if (!p.authed) {
+        Serial.printf("[BLE] '%.*s' from unauthenticated conn %u — ignored\n", (int)min(len, (size_t)16), pData, p.connId);
+        return;
+    }
+
+    if (STARTS("VERIFIED:")) {
+        DLOGI("[BLE] VERIFIED received (conn=%u, carUnlocked=%d)", p.connId, (int)carUnlocked);
+        p.inZone = true;
+        // Luôn gửi desired state: carUnlocked chỉ đổi khi sequence xong, lọc ở đây thì
+        // WARNING tới giữa UNLOCK không tới được scheduler. Trùng state → canActuate bỏ.
+        canScheduler.request(CAN_CMD_UNLOCK);
+    } else if (STARTS("WARNING:") || STARTS("LOCK_CAR")) {
+        p.inZone = false;
+        if (!peers.any(&PeerSession::inZone)) canScheduler.request(CAN_CMD_LOCK);
+    } else if (STARTS("UWB_STOP")) {
+        p.inZone    = false;
+        p.uwbWanted = false;
+        if (!peers.any(&PeerSession::inZone)) canScheduler.request(CAN_CMD_LOCK);
+        // Tag vẫn kết nối BLE → chỉ suspend, TAG_UWB_READY sau đó resume không cần init lại
+        if (!peers.any(&PeerSession::uwbWanted)) uwbFsm.request(UWB_NOTIFY_SUSPEND);
+        DLOGI("UWB: Tag beyond 20m (conn=%u)", p.connId);
+    } else if (STARTS("TAG_UWB_READY")) {
+        DLOGI("[BLE] TAG_UWB_READY received (conn=%u)", p.connId);
+        p.uwbWanted = true;
+        uwbParked   = false;
+        uwbFsm.request(UWB_NOTIFY_START);
+    }
+
+    #undef STARTS
+}
+
 static void bleTask(void* param) {
     BleCmdMsg msg;
-    static unsigned long lastAdvRefresh = 0;
+    static unsigned long lastReconcile = 0;
     Serial.println("[bleTask] started on core " + String(xPortGetCoreID()));
+#if BOOT_FAST
+    // BLE init trên Core 0 trong lúc canTask init MCP2515 trên Core 1.
+    // Connect tới sớm chỉ xếp hàng trong bleQueue — challenge sinh sau khi DRBG đã seed.
+    uint8_t st = bootProfile.start("ble_init");
+    startBLE();
+    bleStarted = true;
+    bootProfile.end(st);
+    st = bootProfile.start("drbg_seed");
+    seedChallengeDrbg();
+    bootProfile.end(st);
+#endif
 
     for (;;) {
-        // Đợi command với timeout 200ms để check periodic tasks
-        if (xQueueReceive(bleQueue, &msg, pdMS_TO_TICKS(200)) == pdTRUE) {
+        // Đợi command với timeout 200ms để check periodic tasks (ngắn hơn nếu challenge sắp tới fallback)
+        TickType_t wait = pdMS_TO_TICKS(200);
+        peers.forEach([&wait](PeerSession& p) {
+            if (!p.challengePending) return;
+            uint32_t elapsed = millis() - p.challengeSetAt;
+            uint32_t left = elapsed < CHALLENGE_SEND_DELAY_MS ? CHALLENGE_SEND_DELAY_MS - elapsed : 0;
+            if (pdMS_TO_TICKS(left) < wait) wait = pdMS_TO_TICKS(left);
+        });
+        if (xQueueReceive(bleQueue, &msg, wait) == pdTRUE) {
+            PeerSession* p = peers.find(msg.connId);
             switch (msg.type) {
 
-            case BLE_SEND_CHALLENGE: {
-                uint8_t myGen = msg.data[0];
-                // Bỏ qua ngay nếu là lệnh cũ từ session trước — không delay, không gửi.
-                if (myGen != (uint8_t)connectionGen) {
-                    Serial.printf("[BLE] Challenge gen=%u lỗi thời (hiện=%u) — bỏ qua\n",
-                                  myGen, (unsigned)connectionGen);
+            case BLE_PEER_CONNECTED:
+                p = peers.open(msg.connId, msg.data);
+                if (!p) {
+                    Serial.printf("[BLE] %u peers connected — rejecting conn %u\n",
+                                  (unsigned)MAX_BLE_PEERS, msg.connId);
+                    pBleServer->disconnect(msg.connId);
                     break;
                 }
-                // Sinh challenge và setValue TRƯỚC khi delay để fallback readValue()
-                // của Tag luôn trả về challenge đúng nếu notify bị miss.
-                generateChallenge(currentChallenge, 16);
-                pChallengeCharacteristic->setValue(currentChallenge, 16);
-                // Chờ Tag ghi CCCD (đăng ký nhận notify).
-                vTaskDelay(pdMS_TO_TICKS(CHALLENGE_SEND_DELAY_MS));
-                // Kiểm tra lại sau delay — tránh trường hợp session mới bắt đầu trong lúc chờ.
-                if (myGen != (uint8_t)connectionGen) {
-                    Serial.printf("[BLE] Challenge gen=%u lỗi thời sau delay — không notify\n",
-                                  myGen);
-                    break;
-                }
-                pChallengeCharacteristic->notify();
-                printHex("[AUTH] Key:       ", pairingKey,       16);
-                printHex("[AUTH] Challenge:  ", currentChallenge, 16);
-                Serial.println("[BLE] Challenge sent");
+                peerCount = peers.count();
+                xEventGroupSetBits(sysEvents, EVT_CONNECTED);
+                // Sinh challenge ngay để fallback readValue() của Tag luôn trả về challenge
+                // đúng. Notify khi peer ghi CCCD (BLE_PEER_CCCD) hoặc hết CHALLENGE_SEND_DELAY_MS.
+                // Message connect luôn vào queue trước CCCD write của cùng connection.
+                generateChallenge(p->challenge, 16);
+                p->challengeReady   = true;
+                p->challengePending = true;
+                p->challengeSetAt   = millis();
+                tracer.bind(p->challenge);
+                tracer.mark(TP_A_CHALLENGE_SET);
+                DLOGI("BLE: Tag connected (conn=%u gen=%u) — %u/%u peers",
+                      p->connId, p->gen, (unsigned)peerCount, (unsigned)MAX_BLE_PEERS);
+                peers.print();
+                // Còn slot → advertise tiếp cho Tag/điện thoại khác
+                if (peerCount < MAX_BLE_PEERS) restartAdvertising();
                 break;
-            }
 
-            case BLE_AUTH_VERIFY: {
-                printHex("[AUTH] Key:       ", pairingKey,       16);
-                printHex("[AUTH] Challenge:  ", currentChallenge, 16);
-                printHex("[AUTH] Tag resp:   ", msg.data,         32);
-                uint8_t expected[32];
-                if (!computeHMAC(pairingKey, 16, currentChallenge, 16, expected)) {
-                    Serial.println("[BLE] HMAC compute failed — disconnecting");
-                    pBleServer->disconnect(pBleServer->getConnId());
+            case BLE_PEER_DISCONNECTED:
+                if (!p) break;
+                closePeer(p, "disconnect");
+                restartAdvertising();
+                break;
+
+            case BLE_PEER_CCCD:
+                if (!p) break;
+                if (msg.data[1]) p->cccd |= msg.data[0];
+                else             p->cccd &= ~msg.data[0];
+                if (msg.data[0] == PEER_CCCD_CHALLENGE && msg.data[1] && p->challengePending)
+                    sendChallenge(*p, "CCCD");
+                break;
+
+            case BLE_AUTH_DATA:
+                if (p) handleAuthData(*p, msg.data, msg.dataLen);
+                break;
+
+            case BLE_AUTH_RESULT:
+                // Peer đã rời / connection mới cùng conn_id → kết quả lỗi thời
+                if (!p || p->gen != msg.gen) {
+                    DLOGW("[BLE] Auth result for stale conn %u gen %u — dropped", msg.connId, msg.gen);
                     break;
                 }
-                printHex("[AUTH] Expected:   ", expected, 32);
-                if (memcmp(msg.data, expected, 32) == 0) {
-                    authenticated = true;
-                    xEventGroupSetBits(sysEvents, EVT_AUTHED);
-                    pAuthCharacteristic->setValue("AUTH_OK");
-                    pAuthCharacteristic->notify();
-                    Serial.println("[BLE] Auth OK");
-                } else {
-                    Serial.println("[BLE] Auth FAIL — disconnecting");
-                    pAuthCharacteristic->setValue("AUTH_FAIL");
-                    pAuthCharacteristic->notify();
-                    vTaskDelay(pdMS_TO_TICKS(50));
-                    pBleServer->disconnect(pBleServer->getConnId());
-                }
+                handleAuthResult(*p, msg);
                 break;
-            }
 
-            case BLE_NOTIFY_UWB_ACTIVE:
-                // Gửi sau khi uwbTask đã init DW3000 thành công
-                if (pCharacteristic) {
-                    pCharacteristic->setValue("UWB_ACTIVE");
-                    pCharacteristic->notify();
-                    Serial.println("[BLE] Sent UWB_ACTIVE to Tag");
-                }
+            case BLE_PEER_WRITE:
+                if (p) handlePeerWrite(*p, msg.data, msg.dataLen);
                 break;
 
-            case BLE_RESTART_ADV:
-                vTaskDelay(pdMS_TO_TICKS(50));
-                BLEDevice::startAdvertising();
-                lastAdvRefresh = millis();
-                Serial.println("[BLE] Advertising restarted");
+            case BLE_NOTIFY_UWB_ACTIVE: {
+                // Gửi sau khi uwbTask đã init DW3000 thành công — chỉ tới peer đã yêu cầu UWB
+                if (!pCharacteristic) break;
+                uint8_t n = 0;
+                pCharacteristic->setValue("UWB_ACTIVE");
+                peers.forEach([&n](PeerSession& s) {
+                    if (!s.uwbWanted) return;
+                    notifyPeer(pCharacteristic, s, (const uint8_t*)"UWB_ACTIVE", 10);
+                    n++;
+                });
+                tracer.mark(TP_A_UWB_ACTIVE_TX);
+                DLOGI("[BLE] Sent UWB_ACTIVE to %u peer(s)", n);
                 break;
             }
+            }
+        }
+
+        // Periodic: peer không ghi CCCD trong CHALLENGE_SEND_DELAY_MS → notify fallback
+        peers.forEach([](PeerSession& p) {
+            if (!p.challengePending || millis() - p.challengeSetAt < CHALLENGE_SEND_DELAY_MS) return;
+            challengeFallbacks++;
+            sendChallenge(p, "fallback");
+        });
+
+        // Periodic: Tag không quay lại trước khi ticket hết hạn → deinit UWB như cũ
+        if (uwbParked && !peerCount && !ticketIssuer.hasLive()) {
+            uwbParked = false;
+            uwbFsm.request(UWB_NOTIFY_STOP);
+            Serial.println("[BLE] Tickets expired — UWB stopped");
+        }
+
+        // Periodic: đối chiếu bảng session với connection thật của stack — mất
+        // BLE_PEER_DISCONNECTED (bleQueue đầy) sẽ giữ slot mãi
+        if (peerCount && millis() - lastReconcile > 5000) {
+            lastReconcile = millis();
+            auto live = pBleServer->getPeerDevices(false);
+            peers.forEach([&live](PeerSession& s) {
+                if (millis() - s.connectedAt > 1000 && !live.count(s.connId)) closePeer(&s, "stale");
+            });
         }
 
-        // Periodic: refresh advertising nếu disconnected > 10s
+        // Periodic: in trace point (ít dòng mỗi lượt để không chặn BLE)
+        tracer.flush(8);
+
+        // Periodic: đẩy telemetry record đã xếp hàng ra characteristic diag
+        if (peerCount && pDiagCharacteristic) {
+            static uint8_t diagBuf[180];   // vừa ATT MTU 185 của phần lớn điện thoại
+            size_t n = telemetry.takeBle(diagBuf, sizeof(diagBuf));
+            if (n) { pDiagCharacteristic->setValue(diagBuf, n); pDiagCharacteristic->notify(); }
+        }
+
+        // Periodic: refresh advertising khi còn slot > 10s
         // (ESP32-S3 BLE stack đôi khi tự dừng advertising sau disconnect)
-        if (!deviceConnected && (millis() - lastAdvRefresh > 10000)) {
+        if (peerCount < MAX_BLE_PEERS && (millis() - lastAdvRefresh > 10000)) {
             lastAdvRefresh = millis();
             BLEDevice::startAdvertising();
         }
     }
 }
 
+// =============================================================================
+// TASK: authTask — Core 0, Priority 2
+//
+// HMAC verify + cấp/xác minh ticket cho mọi peer. Kết quả quay lại bleTask
+// (BLE_AUTH_RESULT) — chỉ bleTask đụng vào session và BLE stack.
+// =============================================================================
+
+static void authTask(void* param) {
+    AuthJob job;
+    Serial.println("[authTask] started on core " + String(xPortGetCoreID()));
+
+    for (;;) {
+        if (xQueueReceive(authQueue, &job, portMAX_DELAY) != pdTRUE) continue;
+
+        BleCmdMsg res = {};
+        res.type   = BLE_AUTH_RESULT;
+        res.connId = job.connId;
+        res.gen    = job.gen;
+        size_t n   = 0;
+
+        // provTask không thay key/bảng friend giữa lúc verify. Friend slot bị load lại
+        // giữa lookup và verify → verify bằng nội dung slot mới, tức là FAIL.
+        xSemaphoreTake(keyLock, portMAX_DELAY);
+        if (job.type == AUTH_JOB_HMAC) {
+            DLOG_HEX(DLOG_LVL_DEBUG, "[AUTH] Tag resp:   ", job.data, 32);
+            if (!job.friendKey && !(xEventGroupGetBits(sysEvents) & EVT_KEY_READY))
+                DLOGW("[authTask] No pairing key yet — conn %u fails", job.connId);
+            // Midstate tính sẵn + so sánh constant-time — cùng chi phí cho chủ xe và friend
+            bool ok = job.key && job.key->verify(job.challenge, 16, job.data, 32);
+            res.data[0] = ok ? AUTH_VERDICT_OK : AUTH_VERDICT_FAIL;
+#if TICKET_ENABLE
+            // Ticket dẫn xuất từ pairing key của chủ xe → friend luôn đi challenge/HMAC
+            if (ok && !job.friendKey) n = ticketIssuer.issue(job.challenge, "TICKET", res.data + 1, sizeof(res.data) - 1);
+#endif
+        } else {
+            uint8_t seed[TICKET_SEED_LEN];
+            TicketIssuer::Result r = ticketIssuer.verify(job.data, job.dataLen, seed);
+            if (r == TicketIssuer::RESUME_OK)
+                n = ticketIssuer.issue(seed, "RESUME_OK", res.data + 1, sizeof(res.data) - 1);
+            res.data[0] = n ? AUTH_VERDICT_RESUMED : AUTH_VERDICT_RESUME_FAIL;
+            if (!n) DLOGI("[authTask] Resume rejected (%s, conn=%u)", TicketIssuer::name(r), job.connId);
+            tracer.mark(TP_A_RESUME_DONE, n ? TicketIssuer::RESUME_OK : (r ? r : 0xFF));
+        }
+        xSemaphoreGive(keyLock);
+        res.dataLen = 1 + n;
+        // Không được bỏ kết quả: chỉ BLE_AUTH_RESULT xoá authBusy, mất nó thì connection
+        // này bị từ chối mọi lần auth sau. bleTask không bao giờ chờ authTask (authQueue
+        // gửi timeout 0) nên chờ vô hạn ở đây không deadlock.
+        if (xQueueSend(bleQueue, &res, pdMS_TO_TICKS(100)) != pdTRUE) {
+            DLOGW("[authTask] bleQueue full — waiting to deliver result for conn %u", job.connId);
+            xQueueSend(bleQueue, &res, portMAX_DELAY);
+        }
+    }
+}
+
 // =============================================================================
 // TASK: uwbTask — Core 1, Priority 4 (cao nhất)
 //
@@ -907,156 +1277,437 @@ static void bleTask(void* param) {
 // Với FreeRTOS pin cứng Core 1 priority 4 → không có task nào cùng core
 // có thể preempt → POLL_RX_TO_RESP_TX_DLY_UUS giảm từ 8000 µs → 2500 µs.
 //
-// spiMutex: uwbTask hold mutex trong suốt uwbResponderLoop().
-// canTask đợi mutex → sau khi uwbTask release → canTask mới truy cập SPI.
-// Không cần forcetrxoff hack ở loop() nữa.
+// State machine (uwb_fsm.h) chạy bằng task notification: lệnh từ BLE callback và
+// DW3000 IRQ cùng đánh thức task → STOP/SUSPEND có hiệu lực trong ≤ 1 tick
+// kể cả khi đang chờ Poll, thay vì đợi hết vòng RX.
+//
+// SPI qua spiArbiter: uwbTask chỉ giữ bus lúc arm RX và lúc xử lý Poll → Response.
+// Trong lúc chờ frame, uwbTask block trên notification → canTask dùng SPI được.
 // =============================================================================
 
+static bool uwbWithBus(bool (*fn)()) {
+    if (!spiArbiter.acquire(SPI_CLIENT_UWB, pdMS_TO_TICKS(1000))) {
+        DLOGW("[uwbTask] SPI busy");
+        return false;
+    }
+    bool ok = fn();
+    spiArbiter.release(SPI_CLIENT_UWB);
+    return ok;
+}
+
+static void uwbAnnounceActive() {
+    // Báo bleTask gửi "UWB_ACTIVE" notification sang Tag
+    BleCmdMsg notifyMsg = {}; notifyMsg.type = BLE_NOTIFY_UWB_ACTIVE;
+    xQueueSend(bleQueue, &notifyMsg, pdMS_TO_TICKS(100));
+    xEventGroupSetBits(sysEvents, EVT_UWB_ACTIVE);
+}
+
 static void uwbTask(void* param) {
-    uint8_t cmd;
+    uwbFsm.attach(xTaskGetCurrentTaskHandle());   // trước mọi thứ khác — lệnh tới sớm đã được giữ
     Serial.println("[uwbTask] started on core " + String(xPortGetCoreID()));
+    uint32_t lastSniffReport = millis();
 
     for (;;) {
-        // Trạng thái IDLE: đợi UWB_CMD_INIT
-        while (xQueueReceive(uwbQueue, &cmd, portMAX_DELAY) != pdTRUE || cmd != UWB_CMD_INIT);
-
-        // Init DW3000 (không cần mutex vì CAN chưa dùng SPI ở giai đoạn này)
-        if (!initUWB()) {
-            Serial.println("[uwbTask] Init failed — waiting for next command");
-            continue;
-        }
-
-        // Báo bleTask gửi "UWB_ACTIVE" notification sang Tag
-        BleCmdMsg notifyMsg = {}; notifyMsg.type = BLE_NOTIFY_UWB_ACTIVE;
-        xQueueSend(bleQueue, &notifyMsg, pdMS_TO_TICKS(100));
-        xEventGroupSetBits(sysEvents, EVT_UWB_ACTIVE);
-
-        // Trạng thái ACTIVE: ranging loop
-        for (;;) {
-            // Check deinit command (non-blocking peek)
-            if (xQueueReceive(uwbQueue, &cmd, 0) == pdTRUE && cmd == UWB_CMD_DEINIT) break;
-
-            // Take SPI mutex → ranging → release
-            // canTask sẽ đợi ở đây nếu cần gửi CAN command
-            if (xSemaphoreTake(spiMutex, pdMS_TO_TICKS(500)) == pdTRUE) {
-                uwbResponderLoop();
-                xSemaphoreGive(spiMutex);
-                // Delay 5ms để canTask (priority thấp hơn) có cơ hội lấy mutex.
-                // taskYIELD() không đủ vì uwbTask vẫn là highest-priority ready task.
-                vTaskDelay(pdMS_TO_TICKS(5));
-            } else {
-                Serial.println("[uwbTask] spiMutex timeout — skip iteration");
+        // RANGING: mỗi vòng tự chờ IRQ; các state khác block tới khi có lệnh
+        if (uwbFsm.state() == UWB_ST_RANGING) {
+            uwbResponderLoop();
+            if (UWB_SNIFF_REPORT_MS && millis() - lastSniffReport >= UWB_SNIFF_REPORT_MS) {
+                lastSniffReport = millis();
+                uwbSniff.print();
             }
+            if (uwbDiag.counterDue()) uwbWithBus([]() { uwbDiag.readCounters(); return true; });
+        } else if (!uwbFsm.hasCommand()) {   // STOP rồi START: START còn pending sau deinit
+            uwbFsm.wait(portMAX_DELAY);
         }
 
-        // Trạng thái DEINIT
-        if (xSemaphoreTake(spiMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            deinitUWB();
-            xSemaphoreGive(spiMutex);
+        uint32_t cmd = uwbFsm.takeCommand();
+        if (!cmd) continue;
+        UwbState st = uwbFsm.state();
+
+        if (cmd == UWB_NOTIFY_START) {
+            if (st == UWB_ST_RANGING) { uwbAnnounceActive(); continue; }   // Tag gửi lại TAG_UWB_READY vì miss notify
+            if (st == UWB_ST_IDLE) {
+                uwbFsm.enter(UWB_ST_INIT);
+                if (!uwbWithBus(initUWB)) {
+                    Serial.println("[uwbTask] Init failed — waiting for next command");
+                    uwbFsm.enter(UWB_ST_IDLE);
+                    continue;
+                }
+            }
+            uwbFsm.enter(UWB_ST_RANGING, UWB_NOTIFY_START);   // IDLE→INIT→RANGING hoặc resume từ SUSPEND
+            tracer.mark(TP_A_UWB_RANGING);
+            uwbAnnounceActive();
+        } else if (cmd == UWB_NOTIFY_SUSPEND) {
+            if (st != UWB_ST_RANGING) continue;
+            // uwbResponderLoop đã forcetrxoff trước khi return → DW3000 idle, giữ config
+            xEventGroupClearBits(sysEvents, EVT_UWB_ACTIVE);
+            uwbSniff.pause();
+            uwbFsm.enter(UWB_ST_SUSPEND, UWB_NOTIFY_SUSPEND);
+        } else if (cmd == UWB_NOTIFY_STOP) {
+            xEventGroupClearBits(sysEvents, EVT_UWB_ACTIVE);
+            if (st == UWB_ST_IDLE) continue;
+            uwbFsm.enter(UWB_ST_DEINIT);
+            uwbWithBus([]() { uwbDiag.readCounters(); deinitUWB(); return true; });
+            uwbFsm.enter(UWB_ST_IDLE, UWB_NOTIFY_STOP);
+            uwbSniff.print();
+            uwbDiag.print();
         }
-        xEventGroupClearBits(sysEvents, EVT_UWB_ACTIVE);
     }
 }
 
 // =============================================================================
 // TASK: canTask — Core 1, Priority 2 (thấp nhất)
 //
-// Đợi CAN_CMD_LOCK / CAN_CMD_UNLOCK từ canQueue.
-// Trước khi dùng SPI: lấy spiMutex (đợi uwbTask release sau 1 ranging iteration).
-// dwt_forcetrxoff() để DW3000 không drive MISO trong khi MCP2515 dùng bus.
+// Đợi desired state LOCK / UNLOCK từ canScheduler (đã coalesce, LOCK preempt UNLOCK).
+// Khi idle: mỗi CAN_RX_POLL_MS đọc frame status của body ECU (đã lọc bằng
+// acceptance filter) để vehicleState luôn phản ánh trạng thái thật của xe.
+// Mọi truy cập SPI đều qua spiArbiter (SPI_CLIENT_CAN).
 // =============================================================================
 
+// Thống kê filter: đọc cờ overflow, in accepted vs dropped, và probe tốc độ bus
+// khi UWB không active (probe giữ SPI trong CAN_FILTER_PROBE_WINDOW_MS).
+// Caller phải giữ bus SPI.
+// Caller giữ bus SPI. true = tới kỳ in thống kê — in bằng canPrintStats() sau khi nhả bus.
+static bool canFilterHousekeeping() {
+    static unsigned long lastStats = 0, lastProbe = 0;
+    unsigned long now = millis();
+    bool statsDue = now - lastStats >= CAN_FILTER_STATS_MS;
+    if (statsDue) {
+        lastStats = now;
+        for (uint8_t b = 0; b < CAN_BUS_COUNT; b++)
+            if (pCanControl->isOnline(b)) canRxStats[b].overflows += pCanControl->takeRxOverflows(b);
+    }
+    if (now - lastProbe >= CAN_FILTER_PROBE_INTERVAL_MS &&
+        !(xEventGroupGetBits(sysEvents) & EVT_UWB_ACTIVE)) {
+        lastProbe = now;
+        for (uint8_t b = 0; b < CAN_BUS_COUNT; b++) {
+            if (!pCanControl->isOnline(b)) continue;
+            canRxStats[b].probeBusFps = pCanControl->probeBusRate(CAN_FILTER_PROBE_WINDOW_MS, canFilterCfg[b], b);
+            canRxStats[b].probeCount++;
+        }
+    }
+    return statsDue;
+}
+
+static void canPrintStats() {
+    unsigned long now = millis();
+    for (uint8_t b = 0; b < CAN_BUS_COUNT; b++) {
+        if (!pCanControl->isOnline(b)) continue;
+        Serial.printf("[CAN%u] ", b);
+        canRxStats[b].print(now);
+    }
+    pCanControl->printStats();
+    canScheduler.print();
+    spiArbiter.print();
+    uwbFsm.print();
+    Serial.printf("[DLOG] dropped %lu\n", (unsigned long)dlog.getDropped());
+}
+
+// Mỗi bus 1 MCP2515, bus lỗi thì offline, bus còn lại vẫn chạy
+static void initCanBuses() {
+    uint8_t st = bootProfile.start("can_init");
+    SPI.begin();
+    for (int b = 0; b < CAN_BUS_COUNT; b++) pMcp2515[b] = new MCP2515(CAN_BUS_CS[b]);
+    CANCommands* can = new CANCommands(pMcp2515, CAN_BUS_COUNT);
+    can->setAbortCheck([]() { return canScheduler.shouldAbort(); });
+    can->setBusLock(canBusLock, canBusUnlock);
+    for (uint8_t b = 0; b < CAN_BUS_COUNT; b++) {
+        if (!can->initializeBus(b, CAN_BUS_BITRATE[b], MCP_CLOCK)) {
+            Serial.printf("CAN%u: init failed — continuing without this bus\n", b);
+            continue;
+        }
+        canFilterCfg[b] = CANFilters::compileForBus(CANFilters::RX_RULES, CANFilters::RX_RULE_COUNT, b);
+        CANFilters::print(canFilterCfg[b]);
+        if (!can->applyFilters(canFilterCfg[b], b) && b == CAN_BUS_BODY)
+            Serial.println("CAN: status filter failed — lock state will not be confirmed");
+    }
+    pCanControl = can;
+    bootProfile.end(st);
+}
+
 static void canTask(void* param) {
-    uint8_t cmd;
+    CanCmdMsg msg;
     Serial.println("[canTask] started on core " + String(xPortGetCoreID()));
+#if BOOT_FAST
+    initCanBuses();     // lệnh CAN tới trong lúc init chờ ở mailbox
+#endif
+    for (int b = 0; b < CAN_BUS_COUNT; b++) canRxStats[b].sinceMs = millis();
 
     for (;;) {
-        if (xQueueReceive(canQueue, &cmd, portMAX_DELAY) != pdTRUE) continue;
-
-        Serial.printf("===CAN=== cmd=%d received\n", cmd); Serial.flush();
-
-        // Lấy SPI mutex — uwbTask sẽ release sau mỗi uwbResponderLoop() call (~100ms max)
-        if (xSemaphoreTake(spiMutex, pdMS_TO_TICKS(2000)) != pdTRUE) {
-            Serial.println("===CAN=== spiMutex timeout"); Serial.flush();
+        if (!canScheduler.take(msg, pdMS_TO_TICKS(CAN_RX_POLL_MS))) {
+            // Không chờ bus khi idle — uwbTask đang giữ thì bỏ qua lượt này
+            if (pCanControl && spiArbiter.acquire(SPI_CLIENT_CAN, 0)) {
+                canDrainRx();
+                bool statsDue = canFilterHousekeeping();
+                spiArbiter.release(SPI_CLIENT_CAN);
+                if (statsDue) canPrintStats();
+            }
             continue;
         }
 
-        Serial.println("===CAN=== got mutex"); Serial.flush();
+        DLOGI("===CAN=== cmd=%d received", msg.cmd);
+        tracer.mark(TP_A_CAN_START, msg.cmd);
+        canScheduler.finish(canActuate(msg));
+        tracer.mark(TP_A_CAN_DONE, carUnlocked);
+        DLOGI("===CAN=== done");
+    }
+}
 
-        // Nếu DW3000 đang active, force idle và deselect trước khi CAN dùng bus
-        if (xEventGroupGetBits(sysEvents) & EVT_UWB_ACTIVE) {
-            dwt_forcetrxoff();
-            digitalWrite(PIN_SS, HIGH);
+// =============================================================================
+// TASK: provTask — Core 0, Priority 1
+//
+// SIM attach + lấy pairing key + friend sync chạy nền: BLE advertise và CAN đã
+// chạy từ lúc boot, thời gian boot → advertising không phụ thuộc sóng di động.
+// Key mới → lưu NVS, cài dưới keyLock, set EVT_KEY_READY. Thất bại → thử lại với
+// backoff PROV_RETRY_MIN_MS..PROV_RETRY_MAX_MS; thành công → làm mới sau PROV_REFRESH_MS.
+// Phần AT/HTTP chạy trong simTask (sim_modem.h), provTask chỉ chờ kết quả.
+// =============================================================================
+
+// 1 lượt: attach, fetch pairing key (đổi thì cài lại), friend sync. true = đủ cả.
+static bool provisionOnce() {
+    if (!simModem.attach(SIM_APN)) {
+        Serial.println("[PROV] SIM attach failed");
+        return false;
+    }
+    uint8_t simKey[16];
+    bool ok = fetchPairingKeyViaSim(simKey);
+    if (!ok) {
+        Serial.println("[SIM] Failed to fetch pairing key — pair the vehicle first.");
+    } else if (!keyStore.hasPairingKey() || memcmp(simKey, keyStore.pairingKey(), 16) != 0) {
+        bool rekey = keyStore.hasPairingKey();
+        xSemaphoreTake(keyLock, portMAX_DELAY);
+        keyStore.setPairingKey(simKey, 0);
+        installPairingKey(keyStore.pairingKey());
+        xSemaphoreGive(keyLock);
+        keyStore.commit();
+        Serial.printf("[PROV] Pairing key %s\n", rekey ? "changed — old tickets revoked" : "ready");
+    }
+    memset(simKey, 0, sizeof(simKey));
+#if FRIEND_SYNC_ENABLE
+    // Cùng phiên SIM: sync friend key để unlock path sau đó không cần mạng.
+    // Không có signing key pin sẵn → bỏ sync (không phải lỗi, không retry).
+    if (keyStore.hasPairingKey() && friendSigningConfigured() && !syncFriendKeysViaSim()) {
+        Serial.println("[FRIEND] Sync failed — keeping stored table");
+        ok = false;
+    }
+#endif
+    return ok;
+}
+
+static void provTask(void* param) {
+    Serial.println("[provTask] started on core " + String(xPortGetCoreID()));
+#if BOOT_FAST
+    // Friend table không cần cho advertising — nạp ở đây, bleTask lookup dưới keyLock
+    xSemaphoreTake(keyLock, portMAX_DELAY);
+    bool friendsLoaded = loadFriendTable();
+    xSemaphoreGive(keyLock);
+    if (friendsLoaded) friendKeys.print();
+#endif
+    const char* pers = "anchor_prov";
+    mbedtls_ctr_drbg_init(&provDrbg);
+    if (mbedtls_ctr_drbg_seed(&provDrbg, hwEntropy, NULL, (const unsigned char*)pers, strlen(pers)) != 0) {
+        Serial.println("[PROV] LOI: DRBG seed");
+        vTaskDelete(NULL);
+    }
+    if (!simModem.begin(SIM_BAUD, SIM_RX_PIN, SIM_TX_PIN)) {
+        Serial.println("[SIM] LOI: tao simTask");
+        vTaskDelete(NULL);
+    }
+
+    uint32_t retryMs = PROV_RETRY_MIN_MS;
+    bool     due     = !keyStore.hasPairingKey() || FRIEND_SYNC_ON_BOOT;
+    for (;;) {
+        bool ok = false;
+        if (due) {
+            uint32_t t0 = millis();
+            ok = provisionOnce();
+            simModem.printStats();
+            Serial.printf("[PROV] %s in %lu ms (key %s)\n", ok ? "OK" : "FAILED",
+                          (unsigned long)(millis() - t0), keyStore.hasPairingKey() ? "ready" : "missing");
         }
 
-        Serial.println("===CAN=== calling unlock/lock"); Serial.flush();
+        uint32_t waitMs;
+        if (due && !ok) {
+            waitMs  = retryMs;
+            retryMs = min(retryMs * 2, (uint32_t)PROV_RETRY_MAX_MS);
+        } else {
+            retryMs = PROV_RETRY_MIN_MS;
+            waitMs  = PROV_REFRESH_MS;
+        }
+        if (!waitMs) {
+            // Vẫn phải giữ clock floor cho friend expiry
+            Serial.println("[provTask] Key ready, periodic refresh off — clock floor only");
+            for (;;) provSleep(FRIEND_CLOCK_SAVE_MS);
+        }
+        provSleep(waitMs);
+        due = true;
+    }
+}
 
-        if (cmd == CAN_CMD_LOCK)   canLock();
-        if (cmd == CAN_CMD_UNLOCK) canUnlock();
+// =============================================================================
+// TASK: telemetryTask — Core 0, Priority 1
+//
+// Lấy mẫu CPU share / stack / queue depth / SPI wait / heap và phát record
+// nhị phân (telemetry.h). Priority thấp nhất để không làm lệch số liệu đo.
+// =============================================================================
 
-        Serial.println("===CAN=== done"); Serial.flush();
+static void telemetryTask(void* param) {
+    telemetry.run();
+}
 
-        xSemaphoreGive(spiMutex);
+// =============================================================================
+// TASK: dlogTask — Core 0, Priority 1
+//
+// Format + in log deferred (dlog.h) của mọi task. Serial chậm chỉ làm chậm task này.
+// =============================================================================
+
+static void dlogTask(void* param) {
+    dlog.run();
+}
+
+static void telemetrySampleSpi(Telemetry& t) {
+    static const char* NAMES[SPI_CLIENT_COUNT] = { "spi-uwb", "spi-can" };
+    for (int c = 0; c < SPI_CLIENT_COUNT; c++) {
+        const SpiWaitHistogram& h = spiArbiter.getHistogram((SpiClient)c);
+        t.emitLock(c, NAMES[c], h.count, h.timeouts, h.percentileUs(50), h.percentileUs(99), h.maxUs);
     }
 }
 
+static void telemetrySampleUwb(Telemetry& t) {
+    UwbDiag::Session s;
+    uwbDiag.snapshot(s);
+    if (!s.id) return;
+    const UwbEventTotals& e = s.ev;
+    Tlm::UwbCntRec c;
+    c.session         = s.id;
+    c.rxGood          = e.rxGood;
+    c.tx              = e.tx;
+    c.crcBad          = Tlm::sat16(e.crcBad);
+    c.phrErr          = Tlm::sat16(e.phrErr);
+    c.syncLoss        = Tlm::sat16(e.syncLoss);
+    c.sfdTimeout      = Tlm::sat16(e.sfdTimeout);
+    c.preambleTimeout = Tlm::sat16(e.preambleTimeout);
+    c.preambleReject  = Tlm::sat16(e.preambleReject);
+    c.rxTimeout       = Tlm::sat16(e.rxTimeout);
+    c.filterReject    = Tlm::sat16(e.filterReject);
+    c.overrun         = Tlm::sat16(e.overrun);
+    c.halfPeriodWarn  = Tlm::sat16(e.halfPeriodWarn);
+    c.spiCrcErr       = Tlm::sat16(e.spiCrcErr);
+    Tlm::UwbLinkRec l;
+    l.session     = s.id;
+    l.samples     = Tlm::sat16(s.rx.n);
+    l.rxAvg       = s.rx.n ? s.rx.avg() : INT16_MIN;
+    l.rxMin       = s.rx.n ? s.rx.min : INT16_MIN;
+    l.rxMax       = s.rx.n ? s.rx.max : INT16_MIN;
+    l.fpAvg       = s.fp.n ? s.fp.avg() : INT16_MIN;
+    l.fpMin       = s.fp.n ? s.fp.min : INT16_MIN;
+    l.fpMax       = s.fp.n ? s.fp.max : INT16_MIN;
+    l.stsAvg      = s.sts.n ? s.sts.avg() : INT16_MIN;
+    l.stsMin      = s.sts.n ? s.sts.min : INT16_MIN;
+    l.stsFrames   = s.sts.n;
+    l.stsRejected = Tlm::sat16(s.stsRejected);
+    t.emitUwb(c, l);
+}
+
 // =============================================================================
 // setup
 // =============================================================================
 
 void setup() {
     Serial.begin(115200);
+#if BOOT_FAST
+    // Chờ host mở USB-CDC (để thấy log boot) thay vì 1 s cố định — UART0 sẵn sàng ngay
+    for (uint32_t t0 = millis(); !Serial && millis() - t0 < BOOT_SERIAL_WAIT_MS; ) vTaskDelay(1);
+#else
     vTaskDelay(pdMS_TO_TICKS(1000));
+#endif
 
     esp_reset_reason_t reason = esp_reset_reason();
     Serial.printf("\nSmart Car Anchor [FreeRTOS] - Vehicle: %s (reset: %d)\n", VEHICLE_ID, reason);
     if (reason == ESP_RST_PANIC) Serial.println("WARNING: previous reset was a CRASH");
+    bootProfile.begin(BOOT_FAST);
 
-    // Hold DW3000 in reset during init
+    // Hold DW3000 in reset during init — giữ LOW tới initUWB (reset pulse riêng),
+    // không cần chờ ở đây
+    uint8_t st = bootProfile.start("spi_pins");
     pinMode(PIN_RST, OUTPUT); digitalWrite(PIN_RST, LOW);
-    pinMode(PIN_SS,  OUTPUT); digitalWrite(PIN_SS,  HIGH);
-    pinMode(CAN_CS,  OUTPUT); digitalWrite(CAN_CS,  HIGH);
+    // Đăng ký mọi CS trên SPI2 với arbiter (set OUTPUT HIGH luôn)
+    uint8_t spiCsPins[SPI_MAX_CS_PINS] = { PIN_SS };
+    for (int b = 0; b < CAN_BUS_COUNT; b++) spiCsPins[1 + b] = CAN_BUS_CS[b];
+    bool spiOk = spiArbiter.begin(spiCsPins, 1 + CAN_BUS_COUNT);
+#if !BOOT_FAST
     vTaskDelay(pdMS_TO_TICKS(100));
+#endif
+    bootProfile.end(st);
 
-    // Seed mbedTLS CSPRNG
-    mbedtls_entropy_init(&entropy);
-    mbedtls_ctr_drbg_init(&ctr_drbg);
-    const char* pers = "anchor_rtos";
-    if (mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy,
-                               (const unsigned char*)pers, strlen(pers)) != 0) {
-        Serial.println("mbedTLS init failed — halting"); while(1);
-    }
+#if !BOOT_FAST
+    st = bootProfile.start("drbg_seed");
+    seedChallengeDrbg();
+    bootProfile.end(st);
+#endif
+
+    tracer.begin('A');
 
     // Khởi tạo FreeRTOS primitives
+    st = bootProfile.start("rtos_prims");
     sysEvents = xEventGroupCreate();
-    bleQueue  = xQueueCreate(8, sizeof(BleCmdMsg));
-    uwbQueue  = xQueueCreate(4, sizeof(uint8_t));
-    canQueue  = xQueueCreate(4, sizeof(uint8_t));
-    spiMutex  = xSemaphoreCreateMutex();
+    bleQueue  = xQueueCreate(BLE_QUEUE_DEPTH, sizeof(BleCmdMsg));
+    authQueue = xQueueCreate(AUTH_QUEUE_DEPTH, sizeof(AuthJob));
+    keyLock   = xSemaphoreCreateMutex();
 
-    if (!sysEvents || !bleQueue || !uwbQueue || !canQueue || !spiMutex) {
+    if (!sysEvents || !bleQueue || !authQueue || !keyLock || !canScheduler.begin() || !spiOk) {
         Serial.println("FreeRTOS primitives alloc failed — halting"); while(1);
     }
+    bootProfile.end(st);
+    // Trước mọi task khác — log deferred từ lúc init đã có chỗ drain
+    xTaskCreatePinnedToCore(dlogTask, "Log_Task", DLOG_TASK_STACK, NULL, DLOG_TASK_PRIO, NULL, DLOG_TASK_CORE);
 
-    // Load key qua SIM (nếu chưa có trong NVS) rồi start BLE — synchronous trước khi tạo tasks
-    executeMainFlow();
-    
-    SPI.begin();
+    // Key trong NVS (nếu có) rồi start BLE ngay — SIM fetch để provTask làm nền
+    st = bootProfile.start("nvs_keys");
+    loadStoredKeys();
+    bootProfile.end(st);
 
-    // Init CAN
-    pMcp2515   = new MCP2515(CAN_CS);
-    pCanControl = new CANCommands(pMcp2515);
-    if (!pCanControl->initialize(CAN_CS, CAN_100KBPS, MCP_CLOCK))
-        Serial.println("CAN: init failed — continuing without CAN");
+#if BOOT_FAST
+    // BLE init trong bleTask, CAN init trong canTask — 2 core song song
+    xTaskCreatePinnedToCore(canTask, "CAN_Task", CAN_TASK_STACK, NULL, CAN_TASK_PRIO, NULL, CAN_TASK_CORE);
+    xTaskCreatePinnedToCore(bleTask, "BLE_Task", BLE_TASK_STACK, NULL, BLE_TASK_PRIO, NULL, BLE_TASK_CORE);
+#else
+    st = bootProfile.start("ble_init");
+    startBLE();
+    bleStarted = true;
+    bootProfile.end(st);
+
+    initCanBuses();
+#endif
+
+#if TELEMETRY_ENABLE
+    if (telemetry.begin(TELEMETRY_SINKS)) {
+        telemetry.addQueue("bleQueue", bleQueue, BLE_QUEUE_DEPTH);
+        telemetry.addQueue("authQueue", authQueue, AUTH_QUEUE_DEPTH);
+        telemetry.addQueue("canMailbox", canScheduler.queue(), 1);
+        telemetry.setLockSampler(telemetrySampleSpi);
+        telemetry.setUwbSampler(telemetrySampleUwb);
+        xTaskCreatePinnedToCore(telemetryTask, "TLM_Task", TELEMETRY_TASK_STACK, NULL,
+                                TELEMETRY_TASK_PRIO, NULL, TELEMETRY_TASK_CORE);
+    } else {
+        Serial.println("Telemetry: buffer alloc failed — disabled");
+    }
+#endif
 
     // Tạo FreeRTOS tasks và pin vào đúng core
+#if !BOOT_FAST
     xTaskCreatePinnedToCore(bleTask, "BLE_Task", BLE_TASK_STACK, NULL, BLE_TASK_PRIO, NULL, BLE_TASK_CORE);
+#endif
+    xTaskCreatePinnedToCore(authTask, "Auth_Task", AUTH_TASK_STACK, NULL, AUTH_TASK_PRIO, NULL, AUTH_TASK_CORE);
     xTaskCreatePinnedToCore(uwbTask, "UWB_Task", UWB_TASK_STACK, NULL, UWB_TASK_PRIO, NULL, UWB_TASK_CORE);
+#if !BOOT_FAST
     xTaskCreatePinnedToCore(canTask, "CAN_Task", CAN_TASK_STACK, NULL, CAN_TASK_PRIO, NULL, CAN_TASK_CORE);
+#endif
+    xTaskCreatePinnedToCore(provTask, "Prov_Task", PROV_TASK_STACK, NULL, PROV_TASK_PRIO, NULL, PROV_TASK_CORE);
 
     Serial.println("All tasks created — FreeRTOS scheduler running");
-    Serial.printf("Core 0: bleTask(P%d) | Core 1: uwbTask(P%d) + canTask(P%d)\n",
-                  BLE_TASK_PRIO, UWB_TASK_PRIO, CAN_TASK_PRIO);
+    Serial.printf("Core 0: bleTask(P%d) + authTask(P%d) + provTask(P%d) | Core 1: uwbTask(P%d) + canTask(P%d)\n",
+                  BLE_TASK_PRIO, AUTH_TASK_PRIO, PROV_TASK_PRIO, UWB_TASK_PRIO, CAN_TASK_PRIO);
 }
 
 // loop() không còn cần thiết trong kiến trúc FreeRTOS
@@ -11,6 +11,10 @@
 #define SIM_APN          "v-internet"   // Viettel; Mobifone: "m-wap"; Vinaphone: "m3-world"
 #define VEHICLE_ID       "1HGBH41JXMN109186"
 #define SERVER_FALLBACK  "http://139.59.232.153:8000"
+#define SIM_RX_RING_SIZE  (2048)    // byte, lũy thừa 2 — đệm UART RX → simTask
+#define AT_QUEUE_DEPTH    (4)       // AtCmd chờ trong simTask
+#define AT_LINE_MAX       (256)
+#define SIM_AT_LOG        (1)       // log ">> lệnh" / "<< kết quả" mỗi AT command
 
 // ── BLE ───────────────────────────────────────────────────────────────────────
 #define DEVICE_NAME         "SmartCar_Vehicle"
@@ -18,12 +22,61 @@
 #define CHARACTERISTIC_UUID "abcdef12-3456-7890-abcd-ef1234567890"
 #define AUTH_CHAR_UUID      "beb5483e-36e1-4688-b7f5-ea07361b26a8"
 #define CHALLENGE_CHAR_UUID "ceb5483e-36e1-4688-b7f5-ea07361b26a9"
+// Read-only, 8 byte: hash UUID + handle của các characteristic trên. Tag đọc bằng
+// Read-By-Type ngay sau connect để quyết định dùng handle cache hay discovery.
+#define GATT_LAYOUT_CHAR_UUID "5e7a1c3d-9b2f-4d6e-8a1c-2f4b6d8e0a13"
 
-// Delay before sending challenge (gives Tag time to subscribe to notifications).
-// Android BLE stack + S3 service discovery takes ~1.2 s in practice;
-// 2000 ms gives comfortable margin so the notify arrives after CCCD is written.
+// Challenge được notify ngay khi Tag ghi CCCD của challenge characteristic.
+// Fallback: Tag không subscribe (chỉ readValue) → vẫn notify sau khoảng này.
+// Trước đây là delay cố định 2000 ms (discovery Android + S3 ~1.2 s) chặn bleTask.
 #define CHALLENGE_SEND_DELAY_MS (2000U)
 
+// Session resumption (session_ticket.h): sau AUTH_OK cấp ticket dùng 1 lần.
+// Tag reconnect trong TICKET_LIFETIME_MS → 1 write RESUME, không challenge/HMAC,
+// UWB được giữ SUSPEND (không deinit) trong thời gian này.
+#define TICKET_ENABLE       (1)
+#define TICKET_LIFETIME_MS  (30000U)
+#define TICKET_SLOTS        (4)
+
+// Nhiều Tag/điện thoại kết nối cùng lúc (peer_sessions.h) — mỗi connection có
+// challenge/auth/UWB riêng. Không được vượt CONFIG_BT_ACL_CONNECTIONS của Bluedroid.
+#define MAX_BLE_PEERS       (3)
+#define BLE_QUEUE_DEPTH     (16)     // connect/CCCD/write của mọi peer dồn vào đây
+#define AUTH_QUEUE_DEPTH    (MAX_BLE_PEERS)
+
+// Friend key (friend_keys.h): bảng sync từ /friend-sharing/sync cùng lúc lấy pairing
+// key, lưu NVS, validate local lúc unlock. SERVER_SIGNING_PUBKEY_B64 = field
+// "server_public_key_b64" của GET /server-public-key trên server triển khai (SPKI DER,
+// base64 — key sinh riêng mỗi server, không có giá trị mặc định). Rỗng → không sync,
+// không nạp friend key; key đi kèm response sync không bao giờ được tin.
+// FRIEND_SYNC_ON_BOOT: đã có pairing key vẫn sync ngay sau boot (provTask chạy nền,
+// không chặn BLE); tắt thì chỉ sync theo chu kỳ PROV_REFRESH_MS.
+#define FRIEND_SYNC_ENABLE        (1)
+#define FRIEND_SYNC_ON_BOOT       (1)
+#define FRIEND_MAX_KEYS           (32)
+// Đồng hồ friend expiry (friend_keys.h): provTask lưu clock floor vào NVS mỗi
+// FRIEND_CLOCK_SAVE_MS. Chưa sync được trong lần boot này → key còn hạn dưới
+// FRIEND_UNTRUSTED_MARGIN_S bị từ chối (giờ boot chậm hơn thực tế ≤ thời gian mất điện).
+#define FRIEND_CLOCK_SAVE_MS      (3600UL * 1000)
+#define FRIEND_UNTRUSTED_MARGIN_S (86400UL)
+#define SERVER_SIGNING_PUBKEY_B64 ""
+
+// Provisioning nền (provTask): BLE + CAN chạy ngay lúc boot, pairing key tới sau qua
+// EVT_KEY_READY. Chưa có key → thử lại với backoff ×2; có key → fetch lại định kỳ
+// (pairing key đổi = xe được pair lại, ticket cũ bị huỷ) + friend sync.
+#define PROV_RETRY_MIN_MS         (30000UL)
+#define PROV_RETRY_MAX_MS         (600000UL)
+#define PROV_REFRESH_MS           (6UL * 3600 * 1000)   // 0 = chỉ fetch khi chưa có key
+
+// ── Boot (boot_profile.h) ─────────────────────────────────────────────────────
+// Profile từng giai đoạn boot ghi vào RTC memory, in ở lần boot kế tiếp.
+// BOOT_FAST: không còn delay cố định trước advertising (chờ Serial 1 s, giữ reset
+// DW3000 100 ms); BLE init chạy trong bleTask (Core 0) song song với CAN init trong
+// canTask (Core 1); friend table + seed DRBG làm sau khi đã advertise.
+// 0 = thứ tự boot cũ — để so profile 2 chế độ.
+#define BOOT_FAST                 (1)
+#define BOOT_SERIAL_WAIT_MS       (200U)    // chờ host mở USB-CDC tối đa; UART0 không chờ
+
 // ── Hardware pins ─────────────────────────────────────────────────────────────
 #define PIN_RST  (5)
 #define PIN_IRQ  (4)
@@ -34,6 +87,62 @@
 #define PIN_MOSI (11)
 #define MCP_CLOCK MCP_8MHZ
 
+// ── CAN buses ─────────────────────────────────────────────────────────────────
+// Mỗi bus = 1 MCP2515 riêng (chung SPI2 với DW3000 qua spiArbiter, CS riêng).
+// Bus 0 dùng CAN_CS ở trên. Đặt CAN_BUS_COUNT = 2 khi gắn MCP2515 thứ hai.
+#define CAN_BUS_COUNT    (1)
+#define CAN_BUS_MAX      (2)
+#define CAN_BUS_BODY     (0)       // lock/unlock, body status
+#define CAN_BUS_COMFORT  (1)
+#define CAN_BUS_ALL      (0xFFU)   // frame gửi trên mọi bus
+#define CAN0_BITRATE     CAN_100KBPS
+#define CAN1_CS          (14)
+#define CAN1_BITRATE     CAN_500KBPS
+#define CAN_RX_RING_SIZE (8)       // frame/bus đệm giữa MCP2515 và decoder
+#define CAN_RESET_READY_MS (50U)   // chờ MCP2515 vào Configuration mode sau reset
+
+// ── CAN body-state feedback ───────────────────────────────────────────────────
+// Frame broadcast trạng thái khóa/cửa của body ECU — xác định bằng SniffCAN
+// trên xe thật rồi cập nhật ID/byte/mask bên dưới.
+#define CAN_BODY_STATUS_ID        (0x3B3U)
+#define CAN_LOCK_STATE_BYTE       (2)
+#define CAN_LOCK_STATE_MASK       (0x03U)
+#define CAN_LOCK_STATE_UNLOCKED   (0x02U)  // (byte & mask) == giá trị này → unlocked
+#define CAN_DOOR_STATE_BYTE       (3)
+#define CAN_DOOR_STATE_MASK       (0x0FU)  // bit bất kỳ = có cửa đang mở
+#define CAN_STATE_STALE_MS        (2000U)  // state cũ hơn → coi như không biết
+#define CAN_ACK_TIMEOUT_MS        (400U)   // chờ xe đổi state sau 1 sequence
+#define CAN_MAX_SEQUENCE_ATTEMPTS (2)      // gửi lại sequence chỉ khi state không đổi
+#define CAN_RX_POLL_MS            (100U)   // canTask đọc RX khi idle
+#define CAN_FILTER_STATS_MS         (10000U)  // chu kỳ in thống kê RX / đọc cờ overflow
+#define CAN_FILTER_PROBE_INTERVAL_MS (60000U)  // chu kỳ đo tốc độ bus (filter mở hết)
+#define CAN_FILTER_PROBE_WINDOW_MS   (100U)    // thời gian mở filter mỗi lần probe
+
+// ── SPI bus arbiter (spi_arbiter.h) ───────────────────────────────────────────
+#define SPI_MAX_CS_PINS   (1 + CAN_BUS_MAX)
+#define SPI_HIST_BUCKETS  (12)      // log2 bucket: <16 µs, <32 µs, ... <16 ms, ≥16 ms
+#define SPI_HIST_BASE_US  (16U)
+#define UWB_RX_WAIT_MS    (100U)    // chờ Poll tối đa mỗi vòng (bus rảnh cho CAN trong lúc chờ)
+
+// ── UWB sniff mode (uwb_sniff.h) ──────────────────────────────────────────────
+// Receiver bật/tắt theo chu kỳ lúc chờ Poll thay vì bật liên tục.
+// UWB_SNIFF_AB: đổi full/sniff mỗi UWB_SNIFF_AB_WINDOW_MS để đo 2 mode cùng điều kiện.
+#define UWB_SNIFF_MODE          (UWB_SNIFF_ON)   // UWB_SNIFF_OFF / UWB_SNIFF_ON / UWB_SNIFF_AB
+#define UWB_PLEN_SYMBOLS        (1024)    // phải khớp uwbConfig (DWT_PLEN_1024)
+#define UWB_PAC_SYMBOLS         (32)      // phải khớp uwbConfig (DWT_PAC32)
+#define UWB_SNIFF_ON_PACS       (1)       // ON = (1 + 1) PAC ≈ 65 µs
+#define UWB_SNIFF_OFF_UNITS     (255)     // OFF = 255 × 128/125 µs ≈ 261 µs (max)
+#define UWB_SNIFF_MIN_ACQ_PACS  (8)       // preamble tối thiểu còn lại sau detect (tệ nhất)
+#define UWB_SNIFF_AB_WINDOW_MS  (10000U)
+#define UWB_SNIFF_REPORT_MS     (30000U)  // in thống kê lúc RANGING (0 = chỉ khi STOP)
+#define UWB_SNIFF_GAP_MAX_SEQ   (32)      // khoảng trống sequence lớn hơn = Tag vừa resume
+#define UWB_SNIFF_GAP_MAX_MS    (2000U)
+
+// ── UWB link diagnostics (uwb_diag.h) ─────────────────────────────────────────
+// Event counter + CIA diagnostics mỗi session, phát qua telemetry (REC_UWB_*).
+#define UWB_DIAG_SAMPLE_EVERY   (10)      // đọc CIA diag 1/N Poll (0 = chỉ counter + STS)
+#define UWB_DIAG_COUNTER_MS     (1000U)   // đọc + xoá event counter
+
 // ── UWB frame constants ───────────────────────────────────────────────────────
 #define TX_ANT_DLY              (16385U)
 #define RX_ANT_DLY              (16385U)
@@ -53,12 +162,42 @@
 #define UUS_TO_DWT_TIME 63898
 
 // ── FreeRTOS task config ──────────────────────────────────────────────────────
-#define BLE_TASK_STACK   (10240)  // lớn hơn: chứa HMAC verify + BLE stack
+#define BLE_TASK_STACK   (8192)   // BLE stack call + notify — HMAC đã chuyển sang authTask
+#define AUTH_TASK_STACK  (6144)   // mbedTLS HMAC + ticket derive
+#define SIM_TASK_STACK   (8192)   // AtEngine feed + SecureResponse (ECDH P-256 chạy trong sink HTTPREAD)
 #define UWB_TASK_STACK   (8192)
 #define CAN_TASK_STACK   (4096)
+#define PROV_TASK_STACK  (8192)   // simSecurePost: sinh EC key P-256 + JSON request
 #define BLE_TASK_PRIO    (3)
 #define UWB_TASK_PRIO    (4)      // cao nhất → DW3000 không bị preempt
 #define CAN_TASK_PRIO    (2)
+#define AUTH_TASK_PRIO   (2)      // dưới bleTask: verify không trễ notify của peer khác
+#define SIM_TASK_PRIO    (2)
+#define PROV_TASK_PRIO   (1)      // thấp nhất — chỉ chạy khi BLE/auth/CAN rảnh
 #define BLE_TASK_CORE    (0)
 #define UWB_TASK_CORE    (1)
 #define CAN_TASK_CORE    (1)
+#define AUTH_TASK_CORE   (0)
+#define SIM_TASK_CORE    (0)
+#define PROV_TASK_CORE   (0)
+
+// ── Deferred log (dlog.h) ─────────────────────────────────────────────────────
+// Log trong uwbTask/canTask/bleTask/authTask ghi vào ring, dlogTask in sau.
+// DLOG_LVL_DEBUG: in thêm key/challenge/HMAC hex và thống kê challenge.
+#define DLOG_LEVEL            DLOG_LVL_INFO
+#define DLOG_RING_SIZE        (64)     // entry/core, 32 byte/entry
+#define DLOG_DRAIN_MS         (20U)
+#define DLOG_TASK_STACK       (4096)   // snprintf %f
+#define DLOG_TASK_PRIO        (1)
+#define DLOG_TASK_CORE        (0)
+
+// ── Telemetry (telemetry.h, decode bằng Tools/telemetry_decode.py) ────────────
+// Sink BLE: notify trên TELEMETRY_CHAR_UUID. Sink Serial: binary xen lẫn log text
+// — chỉ bật khi đọc bằng decoder, Serial Monitor sẽ hiện ký tự rác.
+#define TELEMETRY_ENABLE      (1)
+#define TELEMETRY_SINKS       (TELEMETRY_SINK_BLE)
+#define TELEMETRY_CHAR_UUID   "d1a6e2f0-5c3b-4e8a-9f1d-7b2c4a6e8d01"
+#define TELEMETRY_PERIOD_MS   (2000U)
+#define TELEMETRY_TASK_STACK  (3072)
+#define TELEMETRY_TASK_PRIO   (1)      // thấp nhất — không ảnh hưởng task đang đo
+#define TELEMETRY_TASK_CORE   (0)
@@ -0,0 +1,298 @@
+#ifndef AT_ENGINE_H
+#define AT_ENGINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+// ==================== AT command engine ====================
+// Thay vòng busy-loop cũ (String += từng byte, indexOf() lại cả buffer sau mỗi
+// byte → O(n²) + heap churn). Không phụ thuộc Arduino/FreeRTOS: sim_modem.h chạy
+// engine trong simTask trên ESP32, Tools/sim_host chạy nguyên file này trên Linux.
+//
+//   UART RX ──► AtRxRing (SPSC, zero-copy span) ──► AtEngine::feed()
+//                                                    │ tokenizer: line / prompt / raw
+//                                                    ├─► AtCmd đang chạy (onLine/onData)
+//                                                    └─► URC handler
+//
+// - Mỗi byte chỉ qua tokenizer 1 lần: memchr tìm '\n', line ghép trong buffer cố định.
+// - Command FIFO AT_QUEUE_DEPTH, mỗi command có timeout riêng; engine không block —
+//   service(now) xử lý timeout, msUntilDeadline() cho task biết ngủ bao lâu.
+// - Command xong khi: "ERROR"/"+CME ERROR"/"+CMS ERROR", hoặc "OK" (+ line `until`
+//   nếu có — URC theo sau OK như +HTTPACTION, +HTTPREAD: 0).
+// - Prompt ("DOWNLOAD", ">") → ghi payload. onLine trả về N > 0 → N byte tiếp theo
+//   là raw data (+HTTPREAD), đi thẳng vào onData, không qua tokenizer.
+//
+// feed()/service()/submit() chỉ gọi từ 1 task. AtRxRing: 1 producer + 1 consumer.
+
+#ifndef AT_LINE_MAX
+#define AT_LINE_MAX    (256)
+#endif
+#ifndef AT_QUEUE_DEPTH
+#define AT_QUEUE_DEPTH (4)
+#endif
+#define AT_NO_DEADLINE (0xFFFFFFFFU)
+
+// ---------------------------------------------------------------------------
+// RX ring buffer — 1 producer (đọc UART) + 1 consumer (task chạy engine)
+// ---------------------------------------------------------------------------
+template <size_t N> class AtRxRing {
+    static_assert((N & (N - 1)) == 0, "AtRxRing size phải là lũy thừa của 2");
+    uint8_t  buf[N];
+    uint32_t head = 0;          // producer ghi, __atomic
+    uint32_t tail = 0;          // consumer ghi, __atomic
+
+public:
+    // Producer: vùng trống liên tục kế tiếp — ghi thẳng vào (vd. uart.read(p, n)) rồi commit()
+    size_t writeSpan(uint8_t** p) {
+        uint32_t h = head, t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        size_t free = N - (h - t), toEnd = N - (h & (N - 1));
+        *p = &buf[h & (N - 1)];
+        return free < toEnd ? free : toEnd;
+    }
+    void commit(size_t n) { __atomic_store_n(&head, head + (uint32_t)n, __ATOMIC_RELEASE); }
+
+    // Consumer: dữ liệu liên tục kế tiếp — dùng xong gọi consume()
+    size_t readSpan(const uint8_t** p) const {
+        uint32_t t = tail, h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+        size_t used = h - t, toEnd = N - (t & (N - 1));
+        *p = &buf[t & (N - 1)];
+        return used < toEnd ? used : toEnd;
+    }
+    void consume(size_t n) { __atomic_store_n(&tail, tail + (uint32_t)n, __ATOMIC_RELEASE); }
+
+    size_t size() const { return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - tail; }
+};
+
+// ---------------------------------------------------------------------------
+// Command
+// ---------------------------------------------------------------------------
+enum AtResult : uint8_t { AT_PENDING = 0, AT_OK, AT_ERROR, AT_TIMEOUT, AT_REJECTED };
+
+struct AtCmd;
+// Line không phải final result: < 0 = không phải của command này (→ URC handler),
+// 0 = đã xử lý, N > 0 = N byte raw data theo sau (→ onData).
+typedef int    (*AtLineFn)(void* ctx, const char* line, size_t len);
+typedef void   (*AtDataFn)(void* ctx, const uint8_t* data, size_t len);
+typedef void   (*AtDoneFn)(AtCmd* cmd, void* ctx);
+typedef size_t (*AtWriteFn)(void* ctx, const uint8_t* data, size_t len);
+
+struct AtCmd {
+    // Caller điền
+    const char*    text       = nullptr;   // không gồm "\r"
+    uint32_t       timeoutMs  = 5000;      // gửi lệnh → xong (gồm cả prompt + URC `until`)
+    const char*    prompt     = nullptr;   // "DOWNLOAD" / ">" → ghi payload
+    const uint8_t* payload    = nullptr;
+    size_t         payloadLen = 0;
+    const char*    until      = nullptr;   // kết thúc ':' → so prefix, không → so cả line
+    AtLineFn       onLine     = nullptr;
+    AtDataFn       onData     = nullptr;
+    void*          ctx        = nullptr;   // cho onLine/onData
+    AtDoneFn       onDone     = nullptr;
+    void*          doneCtx    = nullptr;
+
+    // Engine điền
+    AtResult       result     = AT_PENDING;
+    int16_t        errorCode  = -1;        // +CME/+CMS ERROR: n
+    uint32_t       elapsedMs  = 0;
+    uint8_t        state      = 0;         // AT_ST_*
+};
+
+class AtEngine {
+public:
+    struct Stats {
+        uint32_t bytesIn      = 0;
+        uint32_t rawBytes     = 0;   // phần bytesIn đi qua onData
+        uint32_t lines        = 0;   // line không rỗng
+        uint32_t urcs         = 0;
+        uint32_t commands     = 0;
+        uint32_t ok           = 0;
+        uint32_t errors       = 0;
+        uint32_t timeouts     = 0;
+        uint32_t rejected     = 0;   // FIFO đầy
+        uint32_t longLines    = 0;   // > AT_LINE_MAX - 1, bị cắt
+        uint32_t maxLatencyMs = 0;
+    };
+
+private:
+    enum : uint8_t { AT_ST_FINAL = 1 << 0, AT_ST_UNTIL = 1 << 1, AT_ST_PROMPTED = 1 << 2 };
+
+    AtWriteFn writeFn  = nullptr;
+    void*     writeCtx = nullptr;
+    AtLineFn  urcFn    = nullptr;
+    void*     urcCtx   = nullptr;
+
+    AtCmd*    fifo[AT_QUEUE_DEPTH] = {};
+    uint8_t   fifoHead  = 0, fifoCount = 0;
+    AtCmd*    active    = nullptr;
+    uint32_t  startedAt = 0;
+
+    char      line[AT_LINE_MAX];
+    size_t    lineLen   = 0;
+    bool      lineCut   = false;
+    size_t    rawLeft   = 0;
+    Stats     stats;
+
+    void write(const void* d, size_t n) { if (writeFn && n) writeFn(writeCtx, (const uint8_t*)d, n); }
+
+    static bool startsWith(const char* s, size_t len, const char* p) {
+        size_t pl = strlen(p);
+        return len >= pl && memcmp(s, p, pl) == 0;
+    }
+
+    bool matchUntil(const char* s, size_t len) const {
+        const char* u = active->until;
+        size_t ul = strlen(u);
+        return (ul && u[ul - 1] == ':') ? startsWith(s, len, u) : (len == ul && memcmp(s, u, ul) == 0);
+    }
+
+    void finish(AtResult r, uint32_t now) {
+        AtCmd* c = active;
+        active   = nullptr;
+        rawLeft  = 0;
+        c->result    = r;
+        c->elapsedMs = now - startedAt;
+        if (c->elapsedMs > stats.maxLatencyMs) stats.maxLatencyMs = c->elapsedMs;
+        if (r == AT_OK) stats.ok++; else if (r == AT_ERROR) stats.errors++; else stats.timeouts++;
+        if (c->onDone) c->onDone(c, c->doneCtx);
+        startNext(now);
+    }
+
+    void startNext(uint32_t now) {
+        if (active || !fifoCount) return;
+        active    = fifo[fifoHead];
+        fifoHead  = (fifoHead + 1) % AT_QUEUE_DEPTH;
+        fifoCount--;
+        startedAt = now;
+        lineLen   = 0;                      // mảnh line dở của response cũ (timeout) bỏ đi
+        lineCut   = false;
+        stats.commands++;
+        write(active->text, strlen(active->text));
+        write("\r", 1);
+    }
+
+    void dispatchUrc(const char* s, size_t len) {
+        stats.urcs++;
+        if (urcFn) urcFn(urcCtx, s, len);
+    }
+
+    void handleLine(char* s, size_t len, uint32_t now) {
+        while (len && s[len - 1] == '\r') s[--len] = '\0';    // echo: "AT\r\r\n"
+        if (!len) return;
+        stats.lines++;
+        if (!active) { dispatchUrc(s, len); return; }
+
+        AtCmd* c = active;
+        if (strcmp(s, c->text) == 0) return;                          // echo (trước ATE0)
+        if (c->prompt && !(c->state & AT_ST_PROMPTED) && strcmp(s, c->prompt) == 0) {
+            c->state |= AT_ST_PROMPTED;
+            write(c->payload, c->payloadLen);
+            return;
+        }
+        if (strcmp(s, "OK") == 0) {
+            c->state |= AT_ST_FINAL;
+        } else if (strcmp(s, "ERROR") == 0) {
+            finish(AT_ERROR, now);
+            return;
+        } else if (startsWith(s, len, "+CME ERROR:") || startsWith(s, len, "+CMS ERROR:")) {
+            c->errorCode = (int16_t)atoi(s + 11);
+            finish(AT_ERROR, now);
+            return;
+        } else {
+            bool isUntil = c->until && matchUntil(s, len);
+            int r = c->onLine ? c->onLine(c->ctx, s, len) : (isUntil ? 0 : -1);
+            if (isUntil)   c->state |= AT_ST_UNTIL;
+            else if (r < 0) { dispatchUrc(s, len); return; }
+            if (r > 0) rawLeft = (size_t)r;
+        }
+        if ((c->state & AT_ST_FINAL) && (!c->until || (c->state & AT_ST_UNTIL)) && !rawLeft)
+            finish(AT_OK, now);
+    }
+
+    // '>' prompt không có "\r\n" — kiểm tra line dở
+    void checkPartialPrompt() {
+        if (!active || !active->prompt || (active->state & AT_ST_PROMPTED) || strcmp(active->prompt, ">") != 0) return;
+        if (lineLen >= 1 && line[0] == '>' && (lineLen == 1 || line[1] == ' ')) {
+            active->state |= AT_ST_PROMPTED;
+            lineLen = 0;
+            write(active->payload, active->payloadLen);
+        }
+    }
+
+public:
+    void begin(AtWriteFn fn, void* ctx) { writeFn = fn; writeCtx = ctx; }
+    void onUrc(AtLineFn fn, void* ctx)  { urcFn = fn; urcCtx = ctx; }
+
+    // cmd phải sống tới khi onDone được gọi. false = FIFO đầy (result = AT_REJECTED).
+    bool submit(AtCmd* c, uint32_t now) {
+        c->result    = AT_PENDING;
+        c->errorCode = -1;
+        c->state     = 0;
+        if (fifoCount >= AT_QUEUE_DEPTH) {
+            stats.rejected++;
+            c->result = AT_REJECTED;
+            return false;
+        }
+        fifo[(fifoHead + fifoCount) % AT_QUEUE_DEPTH] = c;
+        fifoCount++;
+        startNext(now);
+        return true;
+    }
+
+    void feed(const uint8_t* d, size_t n, uint32_t now) {
+        stats.bytesIn += (uint32_t)n;
+        while (n) {
+            if (rawLeft) {
+                size_t k = n < rawLeft ? n : rawLeft;
+                if (active && active->onData) active->onData(active->ctx, d, k);
+                stats.rawBytes += (uint32_t)k;
+                rawLeft -= k; d += k; n -= k;
+                if (!rawLeft && active && (active->state & AT_ST_FINAL) &&
+                    (!active->until || (active->state & AT_ST_UNTIL)))
+                    finish(AT_OK, now);
+                continue;
+            }
+            const uint8_t* nl = (const uint8_t*)memchr(d, '\n', n);
+            size_t k    = nl ? (size_t)(nl - d) + 1 : n;
+            size_t body = nl ? k - 1 : k;
+            size_t room = AT_LINE_MAX - 1 - lineLen;
+            if (body > room) { body = room; lineCut = true; }
+            memcpy(line + lineLen, d, body);
+            lineLen += body;
+            d += k; n -= k;
+            if (nl) {
+                line[lineLen] = '\0';
+                if (lineCut) stats.longLines++;
+                size_t len = lineLen;
+                lineLen = 0;
+                lineCut = false;
+                handleLine(line, len, now);
+            } else {
+                checkPartialPrompt();
+            }
+        }
+    }
+
+    // Timeout command đang chạy. Gọi sau feed() và khi msUntilDeadline() hết.
+    void service(uint32_t now) {
+        if (active && (int32_t)(now - startedAt - active->timeoutMs) >= 0) finish(AT_TIMEOUT, now);
+        startNext(now);
+    }
+
+    uint32_t msUntilDeadline(uint32_t now) const {
+        if (!active) return AT_NO_DEADLINE;
+        int32_t left = (int32_t)(startedAt + active->timeoutMs - now);
+        return left > 0 ? (uint32_t)left : 0;
+    }
+
+    bool         busy()     const { return active || fifoCount; }
+    const Stats& getStats() const { return stats; }
+
+    static const char* name(AtResult r) {
+        static const char* NAMES[] = { "PENDING", "OK", "ERROR", "TIMEOUT", "REJECTED" };
+        return r <= AT_REJECTED ? NAMES[r] : "?";
+    }
+};
+
+#endif // AT_ENGINE_H
@@ -0,0 +1,138 @@
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+
+// ==================== Boot profile ====================
+// Mốc thời gian từng giai đoạn boot ghi thẳng vào RTC slow memory (RTC_NOINIT_ATTR):
+// còn nguyên qua soft reset / panic / WDT / deep sleep, mất khi mất nguồn. Boot sau
+// begin() in bảng của lần trước rồi ghi đè — kể cả lần trước crash giữa chừng (in
+// "incomplete"), nên đo được cả boot không tới được advertising.
+// Thời gian = esp_timer_get_time(): µs từ lúc app start (sau ROM + 2nd-stage bootloader).
+// start()/end() gọi được từ nhiều task — stage song song hiện chồng thời gian trong bảng.
+// Dùng chung Anchor + Tag (file giống nhau ở 2 thư mục sketch).
+
+#define BOOT_PROFILE_MAGIC      (0xB0071E44UL)
+#define BOOT_PROFILE_MAX_STAGES (16)
+#define BOOT_STAGE_NAME_LEN     (12)
+#define BOOT_STAGE_NONE         (0xFFU)
+
+struct BootStageRecord {
+    char     name[BOOT_STAGE_NAME_LEN];   // copy — con trỏ flash không còn đúng sau khi nạp firmware mới
+    uint32_t startUs;
+    uint32_t durUs;                       // 0 = chưa end (crash / reset giữa stage)
+    uint8_t  core;
+};
+
+struct BootProfileRecord {
+    uint32_t        magic;
+    uint32_t        bootCount;
+    uint8_t         resetReason;          // esp_reset_reason() của lần boot được ghi
+    uint8_t         fast;
+    uint8_t         count;
+    char            readyName[BOOT_STAGE_NAME_LEN];
+    uint32_t        readyUs;              // 0 = chưa tới mốc ready
+    BootStageRecord stages[BOOT_PROFILE_MAX_STAGES];
+};
+
+RTC_NOINIT_ATTR static BootProfileRecord bootProfileRtc;
+
+class BootProfile {
+private:
+    BootProfileRecord& rec = bootProfileRtc;
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+    static uint32_t nowUs() { return (uint32_t)esp_timer_get_time(); }
+
+    static void copyName(char* dst, const char* src) {
+        strncpy(dst, src, BOOT_STAGE_NAME_LEN - 1);
+        dst[BOOT_STAGE_NAME_LEN - 1] = '\0';
+    }
+
+    // RTC sau power-on / flash mới là rác — chỉ tin khi mọi trường nằm trong giới hạn
+    bool previousValid() const {
+        if (rec.magic != BOOT_PROFILE_MAGIC || rec.count > BOOT_PROFILE_MAX_STAGES) return false;
+        if (memchr(rec.readyName, '\0', BOOT_STAGE_NAME_LEN) == nullptr) return false;
+        for (uint8_t i = 0; i < rec.count; i++)
+            if (memchr(rec.stages[i].name, '\0', BOOT_STAGE_NAME_LEN) == nullptr) return false;
+        return true;
+    }
+
+public:
+    // Gọi đầu setup() sau Serial.begin(): in profile lần trước, bắt đầu profile mới
+    void begin(bool fast) {
+        esp_reset_reason_t reason = esp_reset_reason();
+        uint32_t bootCount = 0;
+        if (reason != ESP_RST_POWERON && reason != ESP_RST_BROWNOUT && previousValid()) {
+            printPrevious();
+            bootCount = rec.bootCount + 1;
+        } else {
+            Serial.println("[BOOT] No previous profile (power-on)");
+        }
+        memset(&rec, 0, sizeof(rec));
+        rec.bootCount   = bootCount;
+        rec.resetReason = (uint8_t)reason;
+        rec.fast        = fast ? 1 : 0;
+        rec.magic       = BOOT_PROFILE_MAGIC;
+    }
+
+    // → slot cho end(); hết slot → BOOT_STAGE_NONE (end() bỏ qua)
+    uint8_t start(const char* name) {
+        uint32_t t = nowUs();
+        uint8_t slot = BOOT_STAGE_NONE;
+        portENTER_CRITICAL(&mux);
+        if (rec.count < BOOT_PROFILE_MAX_STAGES) {
+            slot = rec.count++;
+            BootStageRecord& s = rec.stages[slot];
+            copyName(s.name, name);
+            s.startUs = t;
+            s.durUs   = 0;
+            s.core    = (uint8_t)xPortGetCoreID();
+        }
+        portEXIT_CRITICAL(&mux);
+        return slot;
+    }
+
+    void end(uint8_t slot) {
+        if (slot >= BOOT_PROFILE_MAX_STAGES) return;
+        uint32_t d = nowUs() - rec.stages[slot].startUs;
+        rec.stages[slot].durUs = d ? d : 1;
+    }
+
+    // Mốc mục tiêu (Anchor: advertising, Tag: scan đầu tiên). Chỉ lần gọi đầu được ghi.
+    void ready(const char* what) {
+        uint32_t t = nowUs();
+        portENTER_CRITICAL(&mux);
+        bool first = rec.readyUs == 0;
+        if (first) { copyName(rec.readyName, what); rec.readyUs = t; }
+        portEXIT_CRITICAL(&mux);
+        if (first)
+            Serial.printf("[BOOT] app start -> %s: %lu.%03lu ms (%s boot, profile printed on next reset)\n",
+                          what, (unsigned long)(t / 1000), (unsigned long)(t % 1000), rec.fast ? "fast" : "normal");
+    }
+
+    void printPrevious() const {
+        Serial.printf("[BOOT] Previous boot #%lu (%s, reset %u): ", (unsigned long)rec.bootCount,
+                      rec.fast ? "fast" : "normal", rec.resetReason);
+        if (rec.readyUs)
+            Serial.printf("app start -> %s %lu.%03lu ms\n", rec.readyName,
+                          (unsigned long)(rec.readyUs / 1000), (unsigned long)(rec.readyUs % 1000));
+        else
+            Serial.println("incomplete — never reached ready");
+        Serial.println("[BOOT]   stage        core  start ms     dur ms");
+        for (uint8_t i = 0; i < rec.count; i++) {
+            const BootStageRecord& s = rec.stages[i];
+            if (s.durUs)
+                Serial.printf("[BOOT]   %-12s %4u %9.1f %10.1f\n", s.name, s.core, s.startUs / 1000.0f, s.durUs / 1000.0f);
+            else
+                Serial.printf("[BOOT]   %-12s %4u %9.1f    (no end)\n", s.name, s.core, s.startUs / 1000.0f);
+        }
+    }
+};
+
+static BootProfile bootProfile;
+
+#endif // BOOT_PROFILE_H
@@ -2,77 +2,291 @@
 #define CAN_COMMANDS_H
 
 #include <mcp2515.h>
+#include "anchor_config.h"
 #include "can_frames.h"
+#include "can_filters.h"
+
+// Log: firmware → dlog (deferred, canTask không block trên UART). Tools/can_host
+// không có FreeRTOS → build với -DCAN_LOG_SERIAL, in thẳng Serial.
+#ifdef CAN_LOG_SERIAL
+#define CAN_LOGI(fmt, ...) Serial.printf(fmt "\n", ##__VA_ARGS__)
+#define CAN_LOGW(fmt, ...) Serial.printf("W " fmt "\n", ##__VA_ARGS__)
+#else
+#include "dlog.h"
+#define CAN_LOGI DLOGI
+#define CAN_LOGW DLOGW
+#endif
+
+// ==================== CAN RX ring ====================
+// Đệm frame đã đọc từ 1 MCP2515 (chỉ canTask dùng — không cần lock).
+// Đầy → ghi đè frame cũ nhất, đếm drop.
+
+struct CanRxRing {
+  struct can_frame buf[CAN_RX_RING_SIZE];
+  uint8_t  head  = 0;
+  uint8_t  count = 0;
+  uint32_t drops = 0;
+
+  void push(const struct can_frame& f) {
+    if (count == CAN_RX_RING_SIZE) {
+      head = (head + 1) % CAN_RX_RING_SIZE;
+      count--;
+      drops++;
+    }
+    buf[(head + count) % CAN_RX_RING_SIZE] = f;
+    count++;
+  }
+
+  bool pop(struct can_frame& f) {
+    if (count == 0) return false;
+    f = buf[head];
+    head = (head + 1) % CAN_RX_RING_SIZE;
+    count--;
+    return true;
+  }
+};
 
 // ==================== CAN Commands API ====================
+// Quản lý 1..CAN_BUS_MAX MCP2515 (mỗi bus 1 chip, bitrate riêng). Frame trong
+// can_frames.h mang field bus → gửi đúng bus; CAN_BUS_ALL → gửi trên mọi bus.
+// Các bus gửi xen kẽ: mỗi nhịp 10 ms, mỗi bus phát frame kế tiếp của nó, nên
+// thời gian sequence = bus dài nhất chứ không phải tổng các bus.
+// Tất cả MCP2515 chung SPI bus với DW3000: sequence lấy bus qua setBusLock() cho
+// từng frame; các API còn lại caller phải giữ bus (spi_arbiter.h).
 
 class CANCommands {
+public:
+  typedef bool (*AbortCheck)();
+  typedef bool (*BusLock)();
+  typedef void (*BusUnlock)();
+
+  struct BusStats {
+    uint32_t txFrames  = 0;
+    uint32_t txFailed  = 0;
+    uint32_t rxFrames  = 0;   // frame đọc từ chip vào ring
+  };
+
 private:
-  MCP2515* mcp;
-  
+  MCP2515*  mcp[CAN_BUS_MAX];
+  uint8_t   busCount;
+  bool      online[CAN_BUS_MAX];
+  CanRxRing rxRing[CAN_BUS_MAX];
+  BusStats  stats[CAN_BUS_MAX];
+
+  AbortCheck abortCheck = nullptr;
+  bool       aborted    = false;
+  BusLock    busLock    = nullptr;   // null → caller tự giữ SPI cả sequence
+  BusUnlock  busUnlock  = nullptr;
+
+  static bool routedTo(const CANFrames::FrameData& f, uint8_t bus) {
+    return f.bus == bus || f.bus == CAN_BUS_ALL;
+  }
+
   // Helper function để gửi sequence of frames
   bool sendFrameSequence(const char* action, int frameCount,
-                         const CANFrames::FrameData* frames,
-                         const char** frameIDs) {
-    int failed = 0;
+                         const CANFrames::FrameData* frames) {
+    int failed = 0, sent = 0;
+    int next[CAN_BUS_MAX] = {0};   // vị trí frame kế tiếp của từng bus
     struct can_frame frame;
+    aborted = false;
 
+    // Frame gửi tới bus không tồn tại/không init được → tính là lỗi
     for (int i = 0; i < frameCount; i++) {
-      frame.can_id  = frames[i].id;
-      frame.can_dlc = frames[i].dlc;
-      memcpy(frame.data, frames[i].data, 8);
-      if (mcp->sendMessage(&frame) != MCP2515::ERROR_OK) failed++;
+      if (frames[i].bus != CAN_BUS_ALL &&
+          (frames[i].bus >= busCount || !online[frames[i].bus])) failed++;
+    }
+
+    for (;;) {
+      // Dừng giữa 2 nhịp nếu scheduler có command ưu tiên hơn
+      if (abortCheck && abortCheck()) {
+        aborted = true;
+        CAN_LOGI("%s aborted after %d/%d frames", action, sent, frameCount);
+        return false;
+      }
+
+      bool any = false;
+      for (uint8_t b = 0; b < busCount; b++) {
+        if (!online[b]) continue;
+        while (next[b] < frameCount && !routedTo(frames[next[b]], b)) next[b]++;
+        if (next[b] >= frameCount) continue;
+
+        const CANFrames::FrameData& fd = frames[next[b]++];
+        frame.can_id  = fd.id;
+        frame.can_dlc = fd.dlc;
+        memcpy(frame.data, fd.data, 8);
+        bool locked = !busLock || busLock();   // mỗi frame 1 lần giữ SPI ngắn
+        if (locked && mcp[b]->sendMessage(&frame) == MCP2515::ERROR_OK) {
+          stats[b].txFrames++;
+        } else {
+          stats[b].txFailed++;
+          failed++;
+        }
+        if (locked && busUnlock) busUnlock();
+        sent++;
+        any = true;
+      }
+      if (!any) break;
       delay(10);
     }
 
     if (failed == 0)
-      Serial.printf("%s OK\n", action);
+      CAN_LOGI("%s OK", action);
     else
-      Serial.printf("%s: %d/%d frames failed\n", action, failed, frameCount);
+      CAN_LOGW("%s: %d/%d frames failed", action, failed, frameCount);
 
     return (failed == 0);
   }
 
+  // Chuyển frame từ RXB0/RXB1 của 1 chip vào ring của bus đó
+  void pollRx(uint8_t bus) {
+    struct can_frame f;
+    for (int i = 0; i < 2 && mcp[bus]->readMessage(&f) == MCP2515::ERROR_OK; i++) {
+      rxRing[bus].push(f);
+      stats[bus].rxFrames++;
+    }
+  }
+
 public:
-  CANCommands(MCP2515* mcpInstance) : mcp(mcpInstance) {}
-  
+  CANCommands(MCP2515* mcpInstance) : busCount(1) {
+    mcp[0] = mcpInstance;
+    online[0] = true;
+    for (int b = 1; b < CAN_BUS_MAX; b++) { mcp[b] = nullptr; online[b] = false; }
+  }
+
+  CANCommands(MCP2515* const* instances, uint8_t count)
+    : busCount(count > CAN_BUS_MAX ? CAN_BUS_MAX : count) {
+    for (int b = 0; b < CAN_BUS_MAX; b++) {
+      mcp[b]    = (b < busCount) ? instances[b] : nullptr;
+      online[b] = (b < busCount);
+    }
+  }
+
+  uint8_t getBusCount() const { return busCount; }
+  bool    isOnline(uint8_t bus) const { return bus < busCount && online[bus]; }
+
+  // API: Callback kiểm tra giữa các frame — trả về true để dừng sequence
+  void setAbortCheck(AbortCheck fn) { abortCheck = fn; }
+
+  // API: Lấy/nhả SPI quanh từng frame của sequence (delay giữa các frame không giữ bus)
+  void setBusLock(BusLock lock, BusUnlock unlock) { busLock = lock; busUnlock = unlock; }
+  bool wasAborted() const { return aborted; }
+
   // API: Mở khóa xe (15 frames)
   bool unlockCar() {
     return sendFrameSequence(
       "UNLOCKING CAR",
       CANFrames::UNLOCK_FRAME_COUNT,
-      CANFrames::UNLOCK_FRAMES,
-      CANFrames::UNLOCK_FRAME_IDS
+      CANFrames::UNLOCK_FRAMES
     );
   }
-  
+
   // API: Khóa xe (16 frames)
   bool lockCar() {
     return sendFrameSequence(
       "LOCKING CAR",
       CANFrames::LOCK_FRAME_COUNT,
-      CANFrames::LOCK_FRAMES,
-      CANFrames::LOCK_FRAME_IDS
+      CANFrames::LOCK_FRAMES
     );
   }
-  
-  // API: Khởi tạo MCP2515
-  bool initialize(uint8_t csPin, CAN_SPEED bitrate, CAN_CLOCK clock) {
-    mcp->reset();
-    delay(100);
 
-    if (mcp->setBitrate(bitrate, clock) != MCP2515::ERROR_OK) {
-      Serial.println("CAN: setBitrate failed");
+  // API: Khởi tạo MCP2515 của 1 bus. Bus lỗi → offline, các bus khác vẫn chạy.
+  bool initializeBus(uint8_t bus, CAN_SPEED bitrate, CAN_CLOCK clock) {
+    if (bus >= busCount) return false;
+    online[bus] = false;
+    mcp[bus]->reset();
+    // Sau reset MCP2515 tự vào Configuration mode khi oscillator ổn định — poll
+    // CANSTAT (setConfigMode) thay vì chờ cố định 100 ms
+    uint32_t t0 = millis();
+    while (mcp[bus]->setConfigMode() != MCP2515::ERROR_OK) {
+      if (millis() - t0 > CAN_RESET_READY_MS) {
+        Serial.printf("CAN%u: no response after reset\n", bus);
+        return false;
+      }
+      delay(1);
+    }
+
+    if (mcp[bus]->setBitrate(bitrate, clock) != MCP2515::ERROR_OK) {
+      Serial.printf("CAN%u: setBitrate failed\n", bus);
       return false;
     }
-    if (mcp->setNormalMode() != MCP2515::ERROR_OK) {
-      Serial.println("CAN: setNormalMode failed");
+    if (mcp[bus]->setNormalMode() != MCP2515::ERROR_OK) {
+      Serial.printf("CAN%u: setNormalMode failed\n", bus);
       return false;
     }
 
-    Serial.println("CAN: initialized");
+    online[bus] = true;
+    Serial.printf("CAN%u: initialized\n", bus);
     return true;
   }
+
+  // API: Khởi tạo bus 0 (sketch 1 bus). Chân CS thuộc MCP2515 truyền vào constructor.
+  bool initialize(CAN_SPEED bitrate, CAN_CLOCK clock) {
+    return initializeBus(0, bitrate, clock);
+  }
+
+  // API: Nạp bảng acceptance filter đã compile (1 lần vào config mode) rồi quay lại normal mode
+  bool applyFilters(const CANFilters::Compiled& cfg, uint8_t bus = 0) {
+    if (!isOnline(bus)) return false;
+    bool ok = mcp[bus]->setFilterBank(false, cfg.masks, cfg.filters) == MCP2515::ERROR_OK;
+    if (mcp[bus]->setNormalMode() != MCP2515::ERROR_OK) {
+      Serial.printf("CAN%u: setNormalMode failed\n", bus);
+      return false;
+    }
+    if (!ok) Serial.printf("CAN%u: filter setup failed\n", bus);
+    return ok;
+  }
+
+  // API: Mở filter nhận tất cả trong windowMs, đếm frame trên bus, rồi nạp lại cfg.
+  // Trả về tốc độ bus (frame/s). Giữ SPI suốt window — chỉ gọi khi UWB không active.
+  uint32_t probeBusRate(uint32_t windowMs, const CANFilters::Compiled& cfg, uint8_t bus = 0) {
+    static const uint32_t acceptAll[6] = {0, 0, 0, 0, 0, 0};
+    if (!isOnline(bus)) return 0;
+    if (mcp[bus]->setFilterBank(false, acceptAll, acceptAll) != MCP2515::ERROR_OK ||
+        mcp[bus]->setNormalMode() != MCP2515::ERROR_OK) {
+      applyFilters(cfg, bus);
+      return 0;
+    }
+    struct can_frame frame;
+    uint32_t count = 0;
+    unsigned long t0 = millis();
+    while (millis() - t0 < windowMs) {
+      if (mcp[bus]->readMessage(&frame) == MCP2515::ERROR_OK) count++;
+    }
+    applyFilters(cfg, bus);
+    return windowMs ? count * 1000U / windowMs : 0;
+  }
+
+  // API: Trả về số RX buffer bị overflow từ lần gọi trước (và xóa cờ)
+  uint8_t takeRxOverflows(uint8_t bus = 0) {
+    if (!isOnline(bus)) return 0;
+    uint8_t eflg = mcp[bus]->getErrorFlags() & (MCP2515::EFLG_RX0OVR | MCP2515::EFLG_RX1OVR);
+    if (eflg) mcp[bus]->clearRXnOVR();
+    return ((eflg & MCP2515::EFLG_RX0OVR) ? 1 : 0) + ((eflg & MCP2515::EFLG_RX1OVR) ? 1 : 0);
+  }
+
+  // API: Đọc 1 frame nhận được (nếu có) từ bất kỳ bus nào; busOut = bus nguồn
+  bool readFrame(struct can_frame* frame, uint8_t* busOut = nullptr) {
+    for (uint8_t b = 0; b < busCount; b++)
+      if (online[b]) pollRx(b);
+    for (uint8_t b = 0; b < busCount; b++) {
+      if (rxRing[b].pop(*frame)) {
+        if (busOut) *busOut = b;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const BusStats& getStats(uint8_t bus) const { return stats[bus]; }
+  uint32_t getRingDrops(uint8_t bus) const { return rxRing[bus].drops; }
+
+  void printStats() const {
+    for (uint8_t b = 0; b < busCount; b++) {
+      Serial.printf("CAN%u%s: tx=%lu failed=%lu rx=%lu ring-drop=%lu\n", b, online[b] ? "" : " (offline)",
+                    (unsigned long)stats[b].txFrames, (unsigned long)stats[b].txFailed,
+                    (unsigned long)stats[b].rxFrames, (unsigned long)rxRing[b].drops);
+    }
+  }
 };
 
 #endif // CAN_COMMANDS_H
@@ -0,0 +1,134 @@
+#ifndef CAN_FILTERS_H
+#define CAN_FILTERS_H
+
+#include <mcp2515.h>
+#include "anchor_config.h"
+
+// ==================== CAN Acceptance Filter Table ====================
+// Khai báo các ID anchor cần nhận. compile() chuyển bảng này thành
+// RXM0/RXM1 + RXF0..RXF5 của MCP2515; frame không khớp bị MCP2515 bỏ ngay
+// trên chip, không tốn SPI transaction nào của ESP32.
+//
+// RXB0: RXM0 + RXF0..RXF1 (2 slot) | RXB1: RXM1 + RXF2..RXF5 (4 slot)
+// Mask bit = 1 → bit ID tương ứng phải khớp filter.
+
+namespace CANFilters {
+
+struct Rule {
+  uint32_t id;
+  uint32_t mask;   // CAN_SFF_MASK = khớp chính xác 1 ID
+  uint8_t  bus;    // MCP2515 nào nạp rule này
+};
+
+// Bảng khai báo — thêm ID mới vào đây
+const Rule RX_RULES[] = {
+  { CAN_BODY_STATUS_ID, CAN_SFF_MASK, CAN_BUS_BODY },   // body ECU lock/door status
+};
+const int RX_RULE_COUNT = sizeof(RX_RULES) / sizeof(RX_RULES[0]);
+const int CAN_FILTER_MAX_RULES = 16;
+
+struct Compiled {
+  uint32_t masks[2];
+  uint32_t filters[6];
+  bool     exact;     // false → có slot bị gộp (nhận dư ID, decoder tự lọc lại)
+};
+
+// Gộp nhiều rule vào 1 slot: chỉ giữ các bit mà mọi rule đều quan tâm và có cùng giá trị
+static inline void mergeRule(uint32_t& id, uint32_t& mask, const Rule& r) {
+  mask &= r.mask & ~(id ^ r.id);
+  id   &= mask;
+}
+
+// Nạp tối đa `slots` rule vào 1 RX buffer. Dư rule → gộp vào slot cuối.
+// Mask của buffer = AND mask của mọi rule trong buffer (dùng chung 1 RXMn).
+static inline bool compileBank(const Rule* rules, int n, int slots,
+                               uint32_t& maskOut, uint32_t* filtersOut) {
+  bool exact = true;
+  uint32_t mask = CAN_SFF_MASK;
+  uint32_t ids[4];
+  int used = 0;
+  for (int i = 0; i < n; i++) {
+    if (used < slots) {
+      ids[used++] = rules[i].id;
+      mask &= rules[i].mask;
+    } else {
+      uint32_t id = ids[slots - 1];
+      mergeRule(id, mask, rules[i]);
+      ids[slots - 1] = id;
+      exact = false;
+    }
+  }
+  for (int i = 0; i < n; i++)
+    if (rules[i].mask != mask) exact = false;  // mask chung rộng hơn mask của rule
+  for (int i = 0; i < slots; i++)
+    filtersOut[i] = (i < used ? ids[i] : ids[0]) & mask;  // slot trống lặp lại slot 0
+  maskOut = mask;
+  return exact;
+}
+
+// 0 rule → nhận tất cả (giống sau reset()).
+static inline Compiled compile(const Rule* rules, int n) {
+  Compiled c = {};
+  c.exact = true;
+  if (n <= 0) return c;
+  int bank0 = (n < 2) ? n : 2;
+  c.exact &= compileBank(rules, bank0, 2, c.masks[0], &c.filters[0]);
+  if (n > bank0) {
+    c.exact &= compileBank(rules + bank0, n - bank0, 4, c.masks[1], &c.filters[2]);
+  } else {
+    // RXB1 chỉ nhận rollover từ RXB0 — cấu hình giống RXB0
+    c.masks[1] = c.masks[0];
+    for (int i = 2; i < 6; i++) c.filters[i] = c.filters[0];
+  }
+  return c;
+}
+
+// Chỉ lấy các rule của 1 bus
+static inline Compiled compileForBus(const Rule* rules, int n, uint8_t bus) {
+  Rule picked[CAN_FILTER_MAX_RULES];
+  int m = 0;
+  for (int i = 0; i < n && m < CAN_FILTER_MAX_RULES; i++)
+    if (rules[i].bus == bus) picked[m++] = rules[i];
+  return compile(picked, m);
+}
+
+static inline void print(const Compiled& c) {
+  Serial.printf("CAN filter: RXM0=0x%03lX RXF0=0x%03lX RXF1=0x%03lX | RXM1=0x%03lX RXF2..5=0x%03lX 0x%03lX 0x%03lX 0x%03lX%s\n",
+                (unsigned long)c.masks[0], (unsigned long)c.filters[0], (unsigned long)c.filters[1],
+                (unsigned long)c.masks[1], (unsigned long)c.filters[2], (unsigned long)c.filters[3],
+                (unsigned long)c.filters[4], (unsigned long)c.filters[5], c.exact ? "" : " (merged)");
+}
+
+// ==================== Runtime statistics ====================
+// MCP2515 không đếm frame bị filter loại. Số frame bị bỏ trên chip được ước lượng
+// bằng probe: thỉnh thoảng mở filter nhận tất cả trong CAN_FILTER_PROBE_WINDOW_MS,
+// đếm tốc độ bus, rồi so với tốc độ frame đã chấp nhận.
+
+struct Stats {
+  uint32_t accepted      = 0;   // frame đã đọc qua SPI (đã qua filter)
+  uint32_t overflows     = 0;   // RX0OVR/RX1OVR — frame khớp filter nhưng mất do buffer đầy
+  uint32_t sinceMs       = 0;   // mốc bắt đầu đếm accepted
+  uint32_t probeBusFps   = 0;   // tốc độ bus đo được ở lần probe gần nhất (frame/s)
+  uint32_t probeCount    = 0;
+
+  // Ước lượng frame bị filter loại kể từ sinceMs
+  uint32_t estimatedDropped(uint32_t nowMs) const {
+    if (probeCount == 0) return 0;
+    uint64_t busFrames = (uint64_t)probeBusFps * (nowMs - sinceMs) / 1000U;
+    return busFrames > accepted ? (uint32_t)(busFrames - accepted) : 0;
+  }
+
+  void print(uint32_t nowMs) const {
+    uint32_t elapsed = nowMs - sinceMs;
+    Serial.printf("CAN RX: accepted=%lu (%lu fps) overflow=%lu | bus~%lu fps, hw-dropped~%lu%s\n",
+                  (unsigned long)accepted,
+                  (unsigned long)(elapsed ? (uint64_t)accepted * 1000U / elapsed : 0),
+                  (unsigned long)overflows, (unsigned long)probeBusFps,
+                  (unsigned long)estimatedDropped(nowMs),
+                  probeCount ? "" : " (no probe yet)");
+  }
+};
+
+} // namespace CANFilters
+
+#endif // CAN_FILTERS_H
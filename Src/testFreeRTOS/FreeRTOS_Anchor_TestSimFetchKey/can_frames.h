@@ -2,6 +2,7 @@
 #define CAN_FRAMES_H
 
 #include <mcp2515.h>
+#include "anchor_config.h"
 
 // ==================== CAN Frame Definitions ====================
 
@@ -12,6 +13,7 @@ struct FrameData {
   uint32_t id;
   uint8_t dlc;
   uint8_t data[8];
+  uint8_t bus;   // CAN_BUS_BODY / CAN_BUS_COMFORT / CAN_BUS_ALL
 };
 
 // Số lượng frames cho mỗi command
@@ -21,83 +23,71 @@ const int LOCK_FRAME_COUNT = 16;
 // Unlock frames data (15 frames)
 const FrameData UNLOCK_FRAMES[UNLOCK_FRAME_COUNT] = {
   // Frame 1: 0x003
-  {0x003, 8, {0x00, 0x00, 0x12, 0x00, 0x00, 0x00, 0x00, 0x00}},
+  {0x003, 8, {0x00, 0x00, 0x12, 0x00, 0x00, 0x00, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 2: 0x501
-  {0x501, 8, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+  {0x501, 8, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 3: 0x400
-  {0x400, 8, {0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF}},
+  {0x400, 8, {0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF}, CAN_BUS_BODY},
   // Frame 4: 0x101
-  {0x101, 8, {0x40, 0x80, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00}},
+  {0x101, 8, {0x40, 0x80, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 5: 0x100
-  {0x100, 8, {0x01, 0x00, 0x00, 0x06, 0x00, 0x20, 0x00, 0x00}},
+  {0x100, 8, {0x01, 0x00, 0x00, 0x06, 0x00, 0x20, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 6: 0x104
-  {0x104, 8, {0x00, 0x14, 0x01, 0x03, 0x3C, 0x81, 0x00, 0x00}},
+  {0x104, 8, {0x00, 0x14, 0x01, 0x03, 0x3C, 0x81, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 7: 0x003
-  {0x003, 8, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+  {0x003, 8, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 8: 0x100
-  {0x100, 8, {0x07, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00}},
+  {0x100, 8, {0x07, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 9: 0x101
-  {0x101, 8, {0x40, 0x80, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00}},
+  {0x101, 8, {0x40, 0x80, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 10: 0x104
-  {0x104, 8, {0x00, 0x04, 0x01, 0x00, 0x3C, 0x81, 0x00, 0x00}},
+  {0x104, 8, {0x00, 0x04, 0x01, 0x00, 0x3C, 0x81, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 11: 0x40F
-  {0x40F, 8, {0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF}},
+  {0x40F, 8, {0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF}, CAN_BUS_BODY},
   // Frame 12: 0x100
-  {0x100, 8, {0x07, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00}},
+  {0x100, 8, {0x07, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 13: 0x104
-  {0x104, 8, {0x05, 0x0E, 0x01, 0x00, 0x3C, 0x81, 0x00, 0x00}},
+  {0x104, 8, {0x05, 0x0E, 0x01, 0x00, 0x3C, 0x81, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 14: 0x100
-  {0x100, 8, {0x21, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00}},
+  {0x100, 8, {0x21, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 15: 0x104
-  {0x104, 8, {0x05, 0x0E, 0x01, 0x00, 0x3C, 0x81, 0x00, 0x00}}
+  {0x104, 8, {0x05, 0x0E, 0x01, 0x00, 0x3C, 0x81, 0x00, 0x00}, CAN_BUS_BODY}
 };
 
 // Lock frames data (16 frames)
 const FrameData LOCK_FRAMES[LOCK_FRAME_COUNT] = {
   // Frame 1: 0x003
-  {0x003, 8, {0x00, 0x00, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00}},
+  {0x003, 8, {0x00, 0x00, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 2: 0x501
-  {0x501, 8, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+  {0x501, 8, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 3: 0x400
-  {0x400, 8, {0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF}},
+  {0x400, 8, {0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF}, CAN_BUS_BODY},
   // Frame 4: 0x101
-  {0x101, 8, {0x40, 0x80, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00}},
+  {0x101, 8, {0x40, 0x80, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 5: 0x100
-  {0x100, 8, {0x02, 0x80, 0x00, 0x10, 0x00, 0x20, 0x00, 0x00}},
+  {0x100, 8, {0x02, 0x80, 0x00, 0x10, 0x00, 0x20, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 6: 0x104
-  {0x104, 8, {0x00, 0x04, 0x01, 0x03, 0x3C, 0x81, 0x00, 0x00}},
+  {0x104, 8, {0x00, 0x04, 0x01, 0x03, 0x3C, 0x81, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 7: 0x003
-  {0x003, 8, {0x00, 0x00, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00}},
+  {0x003, 8, {0x00, 0x00, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 8: 0x100
-  {0x100, 8, {0x02, 0x80, 0x00, 0x10, 0x00, 0x20, 0x00, 0x00}},
+  {0x100, 8, {0x02, 0x80, 0x00, 0x10, 0x00, 0x20, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 9: 0x101
-  {0x101, 8, {0x40, 0x80, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00}},
+  {0x101, 8, {0x40, 0x80, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 10: 0x104
-  {0x104, 8, {0x00, 0x04, 0x01, 0x03, 0x3C, 0x81, 0x00, 0x00}},
+  {0x104, 8, {0x00, 0x04, 0x01, 0x03, 0x3C, 0x81, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 11: 0x40F
-  {0x40F, 8, {0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF}},
+  {0x40F, 8, {0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF}, CAN_BUS_BODY},
   // Frame 12: 0x003
-  {0x003, 8, {0x00, 0x00, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00}},
+  {0x003, 8, {0x00, 0x00, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 13: 0x100
-  {0x100, 8, {0x02, 0x80, 0x00, 0x10, 0x00, 0x20, 0x00, 0x00}},
+  {0x100, 8, {0x02, 0x80, 0x00, 0x10, 0x00, 0x20, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 14: 0x101
-  {0x101, 8, {0x40, 0x80, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00}},
+  {0x101, 8, {0x40, 0x80, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 15: 0x104
-  {0x104, 8, {0x00, 0x04, 0x01, 0x03, 0x3C, 0x81, 0x00, 0x00}},
+  {0x104, 8, {0x00, 0x04, 0x01, 0x03, 0x3C, 0x81, 0x00, 0x00}, CAN_BUS_BODY},
   // Frame 16: 0x003
-  {0x003, 8, {0x00, 0x00, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00}}
-};
-
-// Frame ID strings cho debug
-const char* UNLOCK_FRAME_IDS[UNLOCK_FRAME_COUNT] = {
-  "0x003", "0x501", "0x400", "0x101", "0x100",
-  "0x104", "0x003", "0x100", "0x101", "0x104",
-  "0x40F", "0x100", "0x104", "0x100", "0x104"
-};
-
-const char* LOCK_FRAME_IDS[LOCK_FRAME_COUNT] = {
-  "0x003", "0x501", "0x400", "0x101", "0x100", "0x104", "0x003", "0x100",
-  "0x101", "0x104", "0x40F", "0x003", "0x100", "0x101", "0x104", "0x003"
+  {0x003, 8, {0x00, 0x00, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00}, CAN_BUS_BODY}
 };
 
 } // namespace CANFrames
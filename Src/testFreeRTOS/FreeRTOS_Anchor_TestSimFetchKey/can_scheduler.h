@@ -0,0 +1,160 @@
+#ifndef CAN_SCHEDULER_H
+#define CAN_SCHEDULER_H
+
+#include <Arduino.h>
+
+// Log như can_commands.h: dlog trên Anchor (canTask không chờ Serial), Serial trên host
+#ifndef CAN_LOGI
+#ifdef CAN_LOG_SERIAL
+#define CAN_LOGI(fmt, ...) Serial.printf(fmt "\n", ##__VA_ARGS__)
+#else
+#include "dlog.h"
+#define CAN_LOGI DLOGI
+#endif
+#endif
+
+// ==================== CAN Command Scheduler ====================
+// Thay FIFO LOCK/UNLOCK cũ (depth 4): khi BLE flapping (VERIFIED/WARNING liên tục,
+// disconnect, UWB_STOP) FIFO phát lại từng sequence đầy đủ một, xe đổi state
+// nhiều lần trước khi tới state cuối cùng.
+//
+// - Mailbox depth 1 (xQueueOverwrite): command mới ghi đè command đang chờ
+//   → canTask chỉ thấy desired state mới nhất.
+// - Command trùng với sequence đang chạy (và không có gì chờ) → bỏ.
+// - LOCK ưu tiên: LOCK tới khi UNLOCK đang gửi → UNLOCK dừng giữa 2 frame.
+//   UNLOCK tới khi LOCK đang gửi → LOCK chạy xong rồi mới tới UNLOCK.
+// - Đo latency mỗi command: request → bắt đầu gửi, request → xong.
+// - request() (peek → quyết định → overwrite) và phần nhận của take() (receive +
+//   đặt inFlight) chạy dưới 1 mutex: 2 producer cùng thấy mailbox trống không thể
+//   ghi đè mất LOCK, producer cũng không thấy khoảng trống giữa receive và inFlight.
+//   Producer quyết định desired state; bỏ command trùng state xe là việc của canActuate.
+
+#define CAN_CMD_LOCK   (0U)
+#define CAN_CMD_UNLOCK (1U)
+#define CAN_CMD_NONE   (0xFFU)
+
+struct CanCmdMsg {
+    uint8_t  cmd;
+    uint32_t requestedAtMs;  // millis() lúc request đầu tiên của desired state này
+};
+
+class CanScheduler {
+public:
+    struct CmdStats {
+        uint32_t requested   = 0;
+        uint32_t coalesced   = 0;   // bị ghi đè hoặc trùng sequence đang chạy
+        uint32_t executed    = 0;
+        uint32_t aborted     = 0;   // bị LOCK preempt giữa sequence
+        uint32_t queueMaxMs  = 0;   // request → canTask bắt đầu
+        uint32_t queueSumMs  = 0;
+        uint32_t finalMaxMs  = 0;   // request → canActuate xong
+        uint32_t finalSumMs  = 0;
+    };
+
+private:
+    QueueHandle_t     mailbox  = nullptr;
+    SemaphoreHandle_t lock     = nullptr;
+    volatile uint8_t inFlight = CAN_CMD_NONE;
+    uint32_t         inFlightRequestedAt = 0;
+    uint32_t         inFlightStartedAt   = 0;
+    CmdStats         stats[2];
+
+public:
+    bool begin() {
+        mailbox = xQueueCreate(1, sizeof(CanCmdMsg));
+        lock    = xSemaphoreCreateMutex();
+        return mailbox && lock;
+    }
+
+    // Producer (BLE callback / task bất kỳ). Không dùng trong ISR.
+    void request(uint8_t cmd) {
+        if (!mailbox || cmd > CAN_CMD_UNLOCK) return;
+        CanCmdMsg msg = { cmd, (uint32_t)millis() };
+        CanCmdMsg prev;
+        xSemaphoreTake(lock, portMAX_DELAY);
+        stats[cmd].requested++;
+        if (xQueuePeek(mailbox, &prev, 0) == pdTRUE) {
+            if (prev.cmd == cmd) {
+                stats[cmd].coalesced++;       // đã chờ sẵn — giữ timestamp cũ
+                xSemaphoreGive(lock);
+                return;
+            }
+            stats[prev.cmd].coalesced++;      // desired state đổi → command cũ bị thay
+        } else if (inFlight == cmd) {
+            stats[cmd].coalesced++;           // sequence y hệt đang chạy
+            xSemaphoreGive(lock);
+            return;
+        }
+        xQueueOverwrite(mailbox, &msg);
+        xSemaphoreGive(lock);
+    }
+
+    // canTask: chờ desired state tiếp theo (timeout → false, dùng cho RX poll)
+    // Chờ bằng peek (không giữ mutex), lấy ra dưới mutex.
+    bool take(CanCmdMsg& out, TickType_t wait) {
+        if (xQueuePeek(mailbox, &out, wait) != pdTRUE) return false;
+        xSemaphoreTake(lock, portMAX_DELAY);
+        if (xQueueReceive(mailbox, &out, 0) != pdTRUE) {
+            xSemaphoreGive(lock);
+            return false;
+        }
+        uint32_t now = millis();
+        uint32_t queued = now - out.requestedAtMs;
+        CmdStats& s = stats[out.cmd];
+        s.queueSumMs += queued;
+        if (queued > s.queueMaxMs) s.queueMaxMs = queued;
+        inFlight            = out.cmd;
+        inFlightRequestedAt = out.requestedAtMs;
+        inFlightStartedAt   = now;
+        xSemaphoreGive(lock);
+        return true;
+    }
+
+    // Gọi giữa các frame / trong lúc chờ feedback: true → dừng sequence hiện tại
+    bool shouldAbort() const {
+        if (inFlight != CAN_CMD_UNLOCK) return false;
+        CanCmdMsg next;
+        return xQueuePeek(mailbox, &next, 0) == pdTRUE && next.cmd == CAN_CMD_LOCK;
+    }
+
+    void finish(bool aborted) {
+        if (inFlight == CAN_CMD_NONE) return;
+        uint32_t now = millis();
+        CmdStats& s = stats[inFlight];
+        uint32_t total = now - inFlightRequestedAt;
+        if (aborted) {
+            s.aborted++;
+        } else {
+            s.executed++;
+            s.finalSumMs += total;
+            if (total > s.finalMaxMs) s.finalMaxMs = total;
+        }
+        // dlog: tối đa 4 tham số, %s phải là chuỗi hằng
+        static const char* const WHAT[2][2] = { { "LOCK done", "LOCK aborted" }, { "UNLOCK done", "UNLOCK aborted" } };
+        CAN_LOGI("[CANSCHED] %s: queued %lu ms, run %lu ms, total %lu ms", WHAT[inFlight & 1][aborted ? 1 : 0],
+                 (unsigned long)(inFlightStartedAt - inFlightRequestedAt),
+                 (unsigned long)(now - inFlightStartedAt), (unsigned long)total);
+        xSemaphoreTake(lock, portMAX_DELAY);
+        inFlight = CAN_CMD_NONE;
+        xSemaphoreGive(lock);
+    }
+
+    uint8_t current() const { return inFlight; }
+    QueueHandle_t queue() const { return mailbox; }   // cho telemetry đọc depth
+    const CmdStats& get(uint8_t cmd) const { return stats[cmd & 1]; }
+
+    void print() const {
+        static const char* NAMES[2] = { "LOCK", "UNLOCK" };
+        for (int i = 0; i < 2; i++) {
+            const CmdStats& s = stats[i];
+            uint32_t started = s.executed + s.aborted;
+            Serial.printf("[CANSCHED] %-6s req=%lu coalesced=%lu run=%lu aborted=%lu | queue avg %lu max %lu ms | final avg %lu max %lu ms\n",
+                          NAMES[i], (unsigned long)s.requested, (unsigned long)s.coalesced,
+                          (unsigned long)s.executed, (unsigned long)s.aborted,
+                          (unsigned long)(started ? s.queueSumMs / started : 0), (unsigned long)s.queueMaxMs,
+                          (unsigned long)(s.executed ? s.finalSumMs / s.executed : 0), (unsigned long)s.finalMaxMs);
+        }
+    }
+};
+
+#endif // CAN_SCHEDULER_H
@@ -0,0 +1,248 @@
+#ifndef FRIEND_KEYS_H
+#define FRIEND_KEYS_H
+
+#include <Arduino.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+#include "hmac_engine.h"
+
+// ==================== Friend key table ====================
+// Server (/friend-sharing/sync) gửi bảng friend key của xe dạng binary, ký
+// ECDSA P-256 bằng server signing key và mã hoá ECDH + AES-GCM như pairing key.
+// Chữ ký chỉ kiểm 1 lần lúc sync; blob lưu trong key store (key_store.h), lúc boot
+// load vào bảng open-addressing trong RAM → validate friend key không cần mạng.
+//
+// Blob (little-endian):
+//   header 16 byte: "FKT1" | version(1) | count(1) | reserved(2) | generated_at(4, unix)
+//                   | vehicle_tag(4) = SHA-256(vehicle_id)[0..4]
+//   entry  32 byte: id_hash(8) = SHA-256("friend-id:" | friend_id)[0..8]
+//                   | expires_at(4, unix) | flags(1) | reserved(3) | key(16)
+//
+// Friend (Tag/điện thoại) chọn key bằng 1 write lên auth characteristic trước
+// HMAC response: 'F' | id_hash(8). Sau đó challenge/HMAC như chủ xe, bằng friend key.
+//
+// Lookup: index = id_hash[0..4] & (slots-1), luôn dò đủ FRIEND_PROBE_LIMIT slot
+// và so sánh constant-time — thời gian không phụ thuộc key có trong bảng hay không.
+// Mỗi slot giữ key schedule HMAC tính sẵn (hmac_engine.h), không giữ key thô →
+// verify friend tốn đúng bằng verify chủ xe, bảng lớn cỡ nào cũng vậy.
+//
+// Đồng hồ: Anchor không có RTC. Giờ unix = mốc cao nhất đã biết + uptime từ mốc đó.
+// Mốc: generated_at của blob (ký bởi server) và clock floor trong key store
+// (KeyStore::clockFloor, provTask lưu định kỳ qua checkpoint()) — đồng hồ không lùi
+// qua reboot, nhưng vẫn chậm hơn thực tế đúng bằng thời gian mất điện / giữa 2 lần
+// lưu. Vì vậy trước khi có sync thành công trong lần boot này (giờ tin được), key
+// còn hạn dưới FRIEND_UNTRUSTED_MARGIN_S cũng bị từ chối (FRIEND_EXPIRING).
+// Revoke có hiệu lực ở lần sync kế tiếp. Blob sync có generated_at cũ hơn bảng đang
+// nạp hoặc clock floor bị từ chối — replay blob cũ (chữ ký vẫn hợp lệ) qua đường SIM
+// không mang lại được friend đã revoke / hết hạn.
+
+#ifndef FRIEND_MAX_KEYS
+#define FRIEND_MAX_KEYS     (32)
+#endif
+#ifndef FRIEND_UNTRUSTED_MARGIN_S
+#define FRIEND_UNTRUSTED_MARGIN_S (86400UL)
+#endif
+#define FRIEND_TABLE_SLOTS  (FRIEND_MAX_KEYS * 2)      // load ≤ 0.5
+#define FRIEND_PROBE_LIMIT  (8)
+#define FRIEND_ID_HASH_LEN  (8)
+#define FRIEND_HEADER_LEN   (16)
+#define FRIEND_ENTRY_LEN    (32)
+#define FRIEND_BLOB_MAX     (FRIEND_HEADER_LEN + FRIEND_MAX_KEYS * FRIEND_ENTRY_LEN)
+#define FRIEND_FLAG_REVOKED (0x01)
+#define FRIEND_HELLO_TAG    ('F')
+#define FRIEND_HELLO_LEN    (1 + FRIEND_ID_HASH_LEN)
+
+static_assert((FRIEND_TABLE_SLOTS & (FRIEND_TABLE_SLOTS - 1)) == 0, "FRIEND_TABLE_SLOTS phải là lũy thừa của 2");
+
+class FriendKeyTable {
+public:
+    enum Result : uint8_t { FRIEND_OK = 0, FRIEND_UNKNOWN, FRIEND_EXPIRED, FRIEND_REVOKED, FRIEND_EXPIRING };
+
+private:
+    struct Slot {
+        uint8_t  idHash[FRIEND_ID_HASH_LEN];
+        uint32_t expiresAt;
+        uint8_t  flags;
+        bool     used;
+        HmacSha256Key hmac;
+    };
+
+    Slot     slots[FRIEND_TABLE_SLOTS] = {};
+    uint8_t  count        = 0;
+    uint8_t  dropped      = 0;   // vượt FRIEND_PROBE_LIMIT lúc insert
+    uint32_t generatedAt  = 0;   // của bảng hiện tại
+    uint32_t floorAt      = 0;   // clock floor đã lưu (restoreClock / checkpoint)
+    uint32_t clockBase    = 0;   // giờ unix tại clockMillis, 0 = chưa biết giờ
+    uint32_t clockMillis  = 0;
+    bool     clockTrusted = false;
+    uint32_t lookups = 0, hits = 0;
+
+    static uint32_t rd32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    static uint32_t home(const uint8_t* idHash) { return rd32(idHash) & (FRIEND_TABLE_SLOTS - 1); }
+
+    // Đồng hồ chỉ tiến: mốc cũ hơn giờ đang chạy bị bỏ qua
+    void advanceClock(uint32_t t) {
+        if (t > now()) { clockBase = t; clockMillis = millis(); }
+    }
+
+    static bool sha256(const uint8_t* a, size_t aLen, const uint8_t* b, size_t bLen, uint8_t out[32]) {
+        mbedtls_md_context_t ctx;
+        mbedtls_md_init(&ctx);
+        bool ok = mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0) == 0 &&
+                  mbedtls_md_starts(&ctx) == 0 &&
+                  mbedtls_md_update(&ctx, a, aLen) == 0 &&
+                  (!bLen || mbedtls_md_update(&ctx, b, bLen) == 0) &&
+                  mbedtls_md_finish(&ctx, out) == 0;
+        mbedtls_md_free(&ctx);
+        return ok;
+    }
+
+    static uint32_t vehicleTag(const char* vehicleId) {
+        uint8_t h[32];
+        if (!sha256((const uint8_t*)vehicleId, strlen(vehicleId), nullptr, 0, h)) return 0;
+        return rd32(h);
+    }
+
+    bool insert(const uint8_t* e) {
+        uint32_t i = home(e);
+        for (uint8_t n = 0; n < FRIEND_PROBE_LIMIT; n++, i = (i + 1) & (FRIEND_TABLE_SLOTS - 1)) {
+            Slot& s = slots[i];
+            if (s.used) continue;
+            memcpy(s.idHash, e, FRIEND_ID_HASH_LEN);
+            s.expiresAt = rd32(e + 8);
+            s.flags     = e[12];
+            // Revoked: server gửi key 0 — không dựng schedule
+            s.used      = (s.flags & FRIEND_FLAG_REVOKED) || s.hmac.begin(e + 16, 16);
+            return s.used;
+        }
+        return false;
+    }
+
+public:
+    // friend_id (chuỗi hex server cấp) → id_hash gửi trong FRIEND hello
+    static bool hashId(const char* friendId, uint8_t out[FRIEND_ID_HASH_LEN]) {
+        static const char PREFIX[] = "friend-id:";
+        uint8_t h[32];
+        if (!sha256((const uint8_t*)PREFIX, sizeof(PREFIX) - 1, (const uint8_t*)friendId, strlen(friendId), h)) return false;
+        memcpy(out, h, FRIEND_ID_HASH_LEN);
+        return true;
+    }
+
+    static const char* name(Result r) {
+        static const char* NAMES[] = { "OK", "unknown", "expired", "revoked", "expiring, clock untrusted" };
+        return r <= FRIEND_EXPIRING ? NAMES[r] : "?";
+    }
+
+    // ECDSA P-256 / SHA-256, pubDer = SubjectPublicKeyInfo DER. Chỉ gọi lúc sync.
+    static bool verifySignature(const uint8_t* blob, size_t len, const uint8_t* sig, size_t sigLen,
+                                const uint8_t* pubDer, size_t pubLen) {
+        uint8_t digest[32];
+        if (!sha256(blob, len, nullptr, 0, digest)) return false;
+        mbedtls_pk_context pk;
+        mbedtls_pk_init(&pk);
+        bool ok = mbedtls_pk_parse_public_key(&pk, pubDer, pubLen) == 0 &&
+                  mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, digest, sizeof(digest), sig, sigLen) == 0;
+        mbedtls_pk_free(&pk);
+        return ok;
+    }
+
+    // Parse blob + dựng lại bảng. Blob lỗi / của xe khác → giữ bảng cũ.
+    // synced: blob vừa kiểm chữ ký từ server → generated_at là giờ tin được.
+    bool load(const uint8_t* blob, size_t len, const char* vehicleId, bool synced = false) {
+        if (len < FRIEND_HEADER_LEN || memcmp(blob, "FKT1", 4) != 0 || blob[4] != 1) {
+            Serial.println("[FRIEND] LOI: blob header");
+            return false;
+        }
+        uint8_t n = blob[5];
+        if (n > FRIEND_MAX_KEYS || len != FRIEND_HEADER_LEN + (size_t)n * FRIEND_ENTRY_LEN) {
+            Serial.printf("[FRIEND] LOI: blob %u keys / %u byte\n", n, (unsigned)len);
+            return false;
+        }
+        if (rd32(blob + 12) != vehicleTag(vehicleId)) {
+            Serial.println("[FRIEND] LOI: blob cua xe khac");
+            return false;
+        }
+        // Sync lại đúng bảng đang nạp (server trả blob cũ khi không đổi gì) thì được,
+        // floor lúc đó có thể đã vượt generated_at của nó
+        uint32_t gen = rd32(blob + 8);
+        if (synced && (gen < generatedAt || (gen != generatedAt && gen < floorAt))) {
+            Serial.printf("[FRIEND] LOI: blob cu (generated %lu < table %lu / floor %lu)\n",
+                          (unsigned long)gen, (unsigned long)generatedAt, (unsigned long)floorAt);
+            return false;
+        }
+
+        for (Slot& s : slots) {
+            s.hmac.end();
+            memset(s.idHash, 0, sizeof(s.idHash));
+            s.expiresAt = 0;
+            s.flags     = 0;
+            s.used      = false;
+        }
+        count   = 0;
+        dropped = 0;
+        for (uint8_t i = 0; i < n; i++) {
+            if (insert(blob + FRIEND_HEADER_LEN + i * FRIEND_ENTRY_LEN)) count++;
+            else                                                          dropped++;
+        }
+        generatedAt = gen;
+        advanceClock(generatedAt);
+        if (synced) clockTrusted = true;
+        return true;
+    }
+
+    // Boot: clock floor từ key store, trước load()
+    void restoreClock(uint32_t floor) {
+        if (floor > floorAt) floorAt = floor;
+        advanceClock(floor);
+    }
+
+    // Dời mốc về hiện tại (millis() tràn sau 49 ngày) và trả về giờ để lưu làm floor
+    uint32_t checkpoint() {
+        uint32_t t = now();
+        if (t) { clockBase = t; clockMillis = millis(); }
+        if (t > floorAt) floorAt = t;
+        return t;
+    }
+
+    // Giờ unix ước lượng (0 = chưa biết giờ)
+    uint32_t now() const {
+        return clockBase ? clockBase + (millis() - clockMillis) / 1000 : 0;
+    }
+
+    // keyOut chỉ được ghi khi FRIEND_OK — trỏ vào bảng, hợp lệ tới lần load() sau.
+    // Dò đủ FRIEND_PROBE_LIMIT slot, không thoát sớm.
+    Result lookup(const uint8_t* idHash, const HmacSha256Key** keyOut) {
+        const Slot* found = nullptr;
+        uint32_t i = home(idHash);
+        for (uint8_t n = 0; n < FRIEND_PROBE_LIMIT; n++, i = (i + 1) & (FRIEND_TABLE_SLOTS - 1)) {
+            const Slot& s = slots[i];
+            uint8_t d = 0;
+            for (uint8_t k = 0; k < FRIEND_ID_HASH_LEN; k++) d |= s.idHash[k] ^ idHash[k];
+            if (s.used && d == 0) found = &s;
+        }
+        lookups++;
+        if (!found)                               return FRIEND_UNKNOWN;
+        if (found->flags & FRIEND_FLAG_REVOKED)   return FRIEND_REVOKED;
+        uint32_t t = now();
+        if (t >= found->expiresAt)                return FRIEND_EXPIRED;
+        // Giờ chỉ là cận dưới → key sắp hết hạn có thể đã hết hạn thật
+        if (!clockTrusted && found->expiresAt - t <= FRIEND_UNTRUSTED_MARGIN_S) return FRIEND_EXPIRING;
+        *keyOut = &found->hmac;
+        hits++;
+        return FRIEND_OK;
+    }
+
+    uint8_t size() const { return count; }
+
+    void print() const {
+        Serial.printf("[FRIEND] %u keys (%u dropped) generated=%lu now=%lu%s lookups=%lu hits=%lu\n",
+                      count, dropped, (unsigned long)generatedAt, (unsigned long)now(),
+                      clockTrusted ? "" : " (untrusted)",
+                      (unsigned long)lookups, (unsigned long)hits);
+    }
+};
+
+#endif // FRIEND_KEYS_H
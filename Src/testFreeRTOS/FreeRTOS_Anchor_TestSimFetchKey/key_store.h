@@ -0,0 +1,240 @@
+#ifndef KEY_STORE_H
+#define KEY_STORE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_rom_crc.h>
+#include <mbedtls/md.h>
+
+// ==================== Key store ====================
+// Mọi key lâu dài nằm trong 1 record binary có version + CRC32, NVS "keystore"/"rec":
+//   pairing key (16 byte) + key id + STS key/IV dẫn xuất sẵn + nguồn key,
+//   blob friend table (friend_keys.h) — chỉ Anchor. signPub là chỗ của signing key
+//   bản cũ tự pin ở lần sync đầu: không còn dùng (key chỉ lấy từ config), giữ để
+//   layout record không đổi.
+// Boot: begin() đọc record bằng đúng 1 getBytes vào RAM và giữ ở đó; HMAC/ticket/STS
+// lấy key binary từ RAM — không còn parse hex hay dẫn xuất lại mỗi boot.
+// Ghi: sửa RAM rồi commit() = 1 putBytes. NVS chỉ xoá entry cũ sau khi entry mới
+// ghi xong → mất điện giữa chừng vẫn còn nguyên record cũ; CRC bắt phần còn lại.
+// Chỉ 1 task được gọi set*/commit (Anchor: provTask); task khác chỉ đọc.
+// Anchor còn giữ clock floor (friend_keys.h) ở NVS key riêng "clock", 4 byte: ghi
+// định kỳ mà không phải ghi lại cả record; chỉ tăng, không bao giờ lùi.
+//
+// Record cũ (ble-keys/bleKey hex, friend-keys/table, friend-keys/signPub) được
+// chuyển sang 1 lần ở boot đầu tiên rồi xoá.
+// File giống nhau ở Anchor và Tag; kích thước phần friend/signing theo config
+// (include sau friend_keys.h để lấy FRIEND_BLOB_MAX).
+
+#define KEYSTORE_MAGIC    (0x3154534BUL)     // "KST1"
+#define KEYSTORE_VERSION  (1)
+#define KEYSTORE_NS       "keystore"
+#define KEYSTORE_KEY_LEN  (16)
+
+#ifndef KEYSTORE_FRIEND_MAX
+#ifdef FRIEND_BLOB_MAX
+#define KEYSTORE_FRIEND_MAX  FRIEND_BLOB_MAX
+#define KEYSTORE_SIGN_MAX    (128)
+#else
+#define KEYSTORE_FRIEND_MAX  (0)
+#define KEYSTORE_SIGN_MAX    (0)
+#endif
+#endif
+
+#define KS_HAS_PAIRING  (0x01)
+#define KS_HAS_SIGNING  (0x02)
+
+struct KeyStoreRecord {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;                          // sizeof lúc ghi — đổi config = record mới
+    uint32_t generation;                      // +1 mỗi commit
+    uint32_t source;                          // nguồn pairing key: 0 = server, khác = KeyStore::sourceId(config)
+    uint8_t  flags;
+    uint8_t  reserved;
+    uint16_t friendLen;
+    uint16_t signLen;
+    uint16_t reserved2;
+    uint8_t  pairingKey[KEYSTORE_KEY_LEN];
+    uint8_t  keyId[4];                        // SHA-256(pairingKey)[0..4] — để log thay cho key
+    uint8_t  stsKey[16];                      // layout dwt_sts_cp_key_t
+    uint8_t  stsIv[16];                       // layout dwt_sts_cp_iv_t (IV đầu mỗi lần init)
+#if KEYSTORE_SIGN_MAX
+    uint8_t  signPub[KEYSTORE_SIGN_MAX];
+#endif
+#if KEYSTORE_FRIEND_MAX
+    uint8_t  friendBlob[KEYSTORE_FRIEND_MAX];
+#endif
+    uint32_t crc;                             // CRC32 mọi byte phía trước
+};
+
+class KeyStore {
+private:
+    KeyStoreRecord rec = {};
+#if KEYSTORE_FRIEND_MAX
+    uint32_t       clock = 0;                 // clock floor, giờ unix
+#endif
+
+    static uint32_t crcOf(const KeyStoreRecord& r) {
+        return esp_rom_crc32_le(0, (const uint8_t*)&r, offsetof(KeyStoreRecord, crc));
+    }
+
+    bool valid() const {
+        return rec.magic == KEYSTORE_MAGIC && rec.version == KEYSTORE_VERSION &&
+               rec.length == sizeof(KeyStoreRecord) && rec.friendLen <= KEYSTORE_FRIEND_MAX &&
+               rec.signLen <= KEYSTORE_SIGN_MAX && rec.crc == crcOf(rec);
+    }
+
+    void reset() {
+        memset(&rec, 0, sizeof(rec));
+        rec.magic   = KEYSTORE_MAGIC;
+        rec.version = KEYSTORE_VERSION;
+        rec.length  = sizeof(KeyStoreRecord);
+    }
+
+    // STS dẫn xuất lúc đổi key, không phải lúc init UWB. Phải khớp Tag/Central:
+    // key = pairing key (4 × uint32 LE), IV = {1, 0, 0, 0}.
+    void deriveSts() {
+        memcpy(rec.stsKey, rec.pairingKey, sizeof(rec.stsKey));
+        memset(rec.stsIv, 0, sizeof(rec.stsIv));
+        rec.stsIv[0] = 0x01;
+    }
+
+    void deriveKeyId() {
+        uint8_t h[32];
+        mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), rec.pairingKey, KEYSTORE_KEY_LEN, h);
+        memcpy(rec.keyId, h, sizeof(rec.keyId));
+    }
+
+    static bool parseHex(const char* hex, uint8_t* out, size_t n) {
+        if (!hex || strlen(hex) != 2 * n) return false;
+        for (size_t i = 0; i < n; i++) {
+            uint8_t b = 0;
+            for (int k = 0; k < 2; k++) {
+                char c = hex[2 * i + k];
+                uint8_t v = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+                            (c >= 'A' && c <= 'F') ? c - 'A' + 10 : 0xFF;
+                if (v == 0xFF) return false;
+                b = (uint8_t)(b << 4 | v);
+            }
+            out[i] = b;
+        }
+        return true;
+    }
+
+    // Format trước key store — chỉ chạy khi chưa có record
+    bool migrateLegacy() {
+        bool any = false;
+        Preferences prefs;
+        char hex[33] = "";
+        uint8_t key[KEYSTORE_KEY_LEN];
+        if (prefs.begin("ble-keys", true)) {
+            if (prefs.isKey("bleKey")) prefs.getString("bleKey", hex, sizeof(hex));
+            prefs.end();
+        }
+        if (parseHex(hex, key, sizeof(key))) { setPairingKey(key, 0); any = true; }
+        memset(key, 0, sizeof(key));
+#if KEYSTORE_FRIEND_MAX
+        if (prefs.begin("friend-keys", true)) {
+            if (prefs.isKey("table"))   rec.friendLen = prefs.getBytes("table", rec.friendBlob, sizeof(rec.friendBlob));
+            if (prefs.isKey("signPub")) rec.signLen   = prefs.getBytes("signPub", rec.signPub, sizeof(rec.signPub));
+            prefs.end();
+        }
+        if (rec.signLen) rec.flags |= KS_HAS_SIGNING;
+        any |= rec.friendLen || rec.signLen;
+#endif
+        if (!any || !commit()) return false;
+        if (prefs.begin("ble-keys", false))    { prefs.clear(); prefs.end(); }
+#if KEYSTORE_FRIEND_MAX
+        if (prefs.begin("friend-keys", false)) { prefs.clear(); prefs.end(); }
+#endif
+        Serial.println("[KEYSTORE] Migrated legacy NVS keys");
+        return true;
+    }
+
+public:
+    // FNV-1a của chuỗi config (vd. PAIRING_KEY_HEX) lúc compile — đổi config → khác source
+    static constexpr uint32_t sourceId(const char* s, uint32_t h = 2166136261UL) {
+        return *s ? sourceId(s + 1, (h ^ (uint8_t)*s) * 16777619UL) : (h ? h : 1);
+    }
+
+    // 1 lần đọc NVS. false = chưa có record hợp lệ (RAM rỗng, chờ set + commit).
+    bool begin() {
+        Preferences prefs;
+        size_t n = 0;
+        if (prefs.begin(KEYSTORE_NS, true)) {
+            n = prefs.getBytes("rec", &rec, sizeof(rec));
+#if KEYSTORE_FRIEND_MAX
+            if (prefs.isKey("clock")) clock = prefs.getUInt("clock", 0);
+#endif
+            prefs.end();
+        }
+        if (n == sizeof(rec) && valid()) return true;
+        if (n) Serial.printf("[KEYSTORE] Record invalid (%u B, v%u) — discarded\n", (unsigned)n, rec.version);
+        reset();
+        return migrateLegacy();
+    }
+
+    bool           hasPairingKey() const { return rec.flags & KS_HAS_PAIRING; }
+    const uint8_t* pairingKey()    const { return rec.pairingKey; }
+    const uint8_t* stsKey()        const { return rec.stsKey; }
+    const uint8_t* stsIv()         const { return rec.stsIv; }
+    uint32_t       source()        const { return rec.source; }
+    uint32_t keyId() const {
+        return (uint32_t)rec.keyId[0] << 24 | (uint32_t)rec.keyId[1] << 16 | (uint32_t)rec.keyId[2] << 8 | rec.keyId[3];
+    }
+
+    // Chỉ sửa RAM (+ dẫn xuất STS/key id). true = key khác key cũ.
+    bool setPairingKey(const uint8_t* key, uint32_t source) {
+        bool changed = !hasPairingKey() || memcmp(rec.pairingKey, key, KEYSTORE_KEY_LEN) != 0;
+        memcpy(rec.pairingKey, key, KEYSTORE_KEY_LEN);
+        rec.source = source;
+        rec.flags |= KS_HAS_PAIRING;
+        deriveSts();
+        deriveKeyId();
+        return changed;
+    }
+
+#if KEYSTORE_FRIEND_MAX
+    const uint8_t* friendBlob(size_t* len) const { *len = rec.friendLen; return rec.friendBlob; }
+
+    bool setFriendBlob(const uint8_t* blob, size_t len) {
+        if (len > sizeof(rec.friendBlob)) return false;
+        memcpy(rec.friendBlob, blob, len);
+        rec.friendLen = (uint16_t)len;
+        return true;
+    }
+
+    uint32_t clockFloor() const { return clock; }
+
+    // Ghi ngay (không qua commit). Giờ không mới hơn floor hiện tại → bỏ qua.
+    bool saveClockFloor(uint32_t t) {
+        if (t <= clock) return true;
+        Preferences prefs;
+        if (!prefs.begin(KEYSTORE_NS, false)) return false;
+        bool ok = prefs.putUInt("clock", t) == sizeof(t);
+        prefs.end();
+        if (ok) clock = t;
+        return ok;
+    }
+#endif
+
+    // Ghi cả record bằng 1 putBytes
+    bool commit() {
+        rec.generation++;
+        rec.crc = crcOf(rec);
+        Preferences prefs;
+        if (!prefs.begin(KEYSTORE_NS, false)) return false;
+        bool ok = prefs.putBytes("rec", &rec, sizeof(rec)) == sizeof(rec);
+        prefs.end();
+        if (!ok) Serial.println("[KEYSTORE] LOI: ghi NVS");
+        return ok;
+    }
+
+    void print() const {
+        Serial.printf("[KEYSTORE] gen=%lu key=%s id=%08lx src=%08lx friend=%u B signing=%u B (%u B record)\n",
+                      (unsigned long)rec.generation, hasPairingKey() ? "yes" : "no", (unsigned long)keyId(),
+                      (unsigned long)rec.source, rec.friendLen, rec.signLen, (unsigned)sizeof(rec));
+    }
+};
+
+#endif // KEY_STORE_H
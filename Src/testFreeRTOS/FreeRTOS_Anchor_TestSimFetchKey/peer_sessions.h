@@ -0,0 +1,122 @@
+#ifndef PEER_SESSIONS_H
+#define PEER_SESSIONS_H
+
+#include <Arduino.h>
+#include "esp_gatts_api.h"
+#include "hmac_engine.h"
+
+// ==================== Per-connection BLE sessions ====================
+// Mỗi Tag/điện thoại kết nối = 1 PeerSession theo conn_id: challenge, auth,
+// CCCD và trạng thái UWB/unlock riêng. Bảng chỉ do bleTask sửa — BLE callback
+// chỉ gửi message (conn_id + data) vào bleQueue.
+//
+// Ngoại lệ: onRead của challenge/auth characteristic (BLE stack task) đọc
+// challenge/authReply qua readable() — chỉ đọc, bleTask ghi xong mới set cờ.
+
+#ifndef MAX_BLE_PEERS
+#define MAX_BLE_PEERS (3)
+#endif
+
+#if defined(CONFIG_BT_ACL_CONNECTIONS) && (MAX_BLE_PEERS > CONFIG_BT_ACL_CONNECTIONS)
+#error "MAX_BLE_PEERS vượt CONFIG_BT_ACL_CONNECTIONS của Bluedroid (sdkconfig)"
+#endif
+
+// Bit CCCD mỗi session đã bật notify
+#define PEER_CCCD_CHALLENGE (1 << 0)
+#define PEER_CCCD_AUTH      (1 << 1)
+#define PEER_CCCD_DATA      (1 << 2)
+
+struct PeerSession {
+    bool          inUse;
+    uint16_t      connId;
+    uint8_t       gen;                 // tăng mỗi connect — kết quả auth cũ bị bỏ
+    esp_bd_addr_t bda;
+    uint8_t       cccd;                // PEER_CCCD_*
+
+    // Auth
+    bool          authed;
+    bool          authBusy;            // job đang ở authTask
+    bool          friendKey;           // FRIEND hello hợp lệ → HMAC bằng authKey thay pairing key
+    const HmacSha256Key* authKey;      // key schedule trong FriendKeyTable (chỉ load() lúc boot)
+    uint8_t       challenge[16];
+    volatile bool challengeReady;      // challenge hợp lệ cho onRead
+    bool          challengePending;    // đã set, chưa notify (chờ CCCD / fallback)
+    uint32_t      challengeSetAt;
+    uint8_t       resp[32];            // mảnh HMAC response (MTU nhỏ → nhiều write)
+    uint8_t       respLen;
+    uint8_t       authReply[16];       // giá trị auth characteristic khi peer này đọc
+    volatile uint8_t authReplyLen;
+
+    // UWB + unlock
+    bool          uwbWanted;           // TAG_UWB_READY, xoá khi UWB_STOP
+    bool          inZone;              // VERIFIED gần nhất chưa bị WARNING/UWB_STOP
+
+    uint32_t      connectedAt;
+};
+
+class PeerTable {
+private:
+    PeerSession s[MAX_BLE_PEERS] = {};
+    uint8_t     genCounter = 0;
+
+public:
+    PeerSession* find(uint16_t connId) {
+        for (PeerSession& p : s) if (p.inUse && p.connId == connId) return &p;
+        return nullptr;
+    }
+
+    // BLE stack task — chỉ đọc
+    const PeerSession* readable(uint16_t connId) const {
+        for (const PeerSession& p : s) if (p.inUse && p.connId == connId) return &p;
+        return nullptr;
+    }
+
+    PeerSession* open(uint16_t connId, const uint8_t* bda) {
+        PeerSession* p = find(connId);
+        if (!p) {
+            for (PeerSession& q : s) if (!q.inUse) { p = &q; break; }
+            if (!p) return nullptr;
+        }
+        *p = PeerSession{};
+        p->connId      = connId;
+        p->gen         = ++genCounter;
+        p->connectedAt = millis();
+        if (bda) memcpy(p->bda, bda, sizeof(p->bda));
+        p->inUse       = true;
+        return p;
+    }
+
+    void close(PeerSession* p) {
+        p->challengeReady = false;
+        p->authReplyLen   = 0;
+        p->inUse          = false;
+    }
+
+    uint8_t count() const {
+        uint8_t n = 0;
+        for (const PeerSession& p : s) n += p.inUse;
+        return n;
+    }
+
+    bool any(bool PeerSession::*flag) const {
+        for (const PeerSession& p : s) if (p.inUse && p.*flag) return true;
+        return false;
+    }
+
+    template <typename Fn> void forEach(Fn fn) {
+        for (PeerSession& p : s) if (p.inUse) fn(p);
+    }
+
+    void print() const {
+        Serial.printf("[PEERS] %u/%u connected\n", count(), (unsigned)MAX_BLE_PEERS);
+        for (const PeerSession& p : s) {
+            if (!p.inUse) continue;
+            Serial.printf("  conn=%u gen=%u %02x:%02x:%02x:%02x:%02x:%02x authed=%d%s uwb=%d zone=%d cccd=%x age=%lus\n",
+                          p.connId, p.gen, p.bda[0], p.bda[1], p.bda[2], p.bda[3], p.bda[4], p.bda[5],
+                          p.authed, p.friendKey ? "(friend)" : "", p.uwbWanted, p.inZone, p.cccd,
+                          (unsigned long)((millis() - p.connectedAt) / 1000));
+        }
+    }
+};
+
+#endif // PEER_SESSIONS_H
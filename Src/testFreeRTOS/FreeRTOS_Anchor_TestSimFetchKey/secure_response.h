@@ -0,0 +1,270 @@
+#ifndef SECURE_RESPONSE_H
+#define SECURE_RESPONSE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <mbedtls/version.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/ecp.h>
+#include <mbedtls/ecdh.h>
+#include <mbedtls/gcm.h>
+#include "stream_decode.h"
+
+// ==================== Secure response giải mã theo luồng ====================
+// Response {server_public_key_b64, nonce_b64, encrypted_data_b64[, signing_public_key_b64]}
+// của /secure-check-pairing và /friend-sharing/sync. feed() nhận từng mảnh
+// +HTTPREAD (sink của SimModem::httpPost, chạy trong simTask):
+//   server_public_key_b64 xong → ECDH P-256 + HKDF → KEK, gcm_setkey (trong lúc
+//                                modem còn đang gửi phần còn lại)
+//   nonce_b64 xong             → gcm_starts
+//   encrypted_data_b64         → base64 decode thẳng vào out, GCM decrypt in-place
+//                                từng bội 16 byte, giữ lại 16 byte cuối (có thể là tag)
+// finish() decrypt phần dư + kiểm tag. Không có bản sao body / JSON document nào.
+// Field tới sai thứ tự (ciphertext trước nonce) vẫn đúng, chỉ là decrypt dồn về finish().
+
+#ifndef SECURE_PUBKEY_DER_MAX
+#define SECURE_PUBKEY_DER_MAX (128)
+#endif
+
+// HKDF-SHA256 theo RFC 5869 — thay thế mbedtls_hkdf() không có trong SDK cũ.
+// salt=NULL/0 → dùng 32 zero bytes (RFC 5869 §2.2).
+// Chỉ cần output <= 32 bytes (1 block SHA-256).
+static inline bool hkdfSha256(const uint8_t* salt, size_t saltLen,
+                              const uint8_t* ikm,  size_t ikmLen,
+                              const uint8_t* info, size_t infoLen,
+                              uint8_t* out, size_t outLen) {
+    if (outLen > 32) return false;
+    const mbedtls_md_info_t* md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+
+    // Extract: PRK = HMAC-SHA256(salt, IKM)
+    uint8_t zeros[32] = {};
+    const uint8_t* s  = (salt && saltLen > 0) ? salt : zeros;
+    size_t         sl = (salt && saltLen > 0) ? saltLen : 32;
+    uint8_t prk[32];
+    if (mbedtls_md_hmac(md, s, sl, ikm, ikmLen, prk) != 0) return false;
+
+    // Expand: T(1) = HMAC-SHA256(PRK, info || 0x01)
+    uint8_t counter = 0x01;
+    mbedtls_md_context_t ctx;
+    mbedtls_md_init(&ctx);
+    if (mbedtls_md_setup(&ctx, md, 1) != 0) { mbedtls_md_free(&ctx); return false; }
+    mbedtls_md_hmac_starts(&ctx, prk, 32);
+    mbedtls_md_hmac_update(&ctx, info, infoLen);
+    mbedtls_md_hmac_update(&ctx, &counter, 1);
+    uint8_t t1[32];
+    mbedtls_md_hmac_finish(&ctx, t1);
+    mbedtls_md_free(&ctx);
+
+    memcpy(out, t1, outLen);
+    return true;
+}
+
+class SecureResponse {
+public:
+    typedef int (*RngFn)(void*, unsigned char*, size_t);
+
+private:
+    enum Field { F_SERVER_PUB, F_NONCE, F_CIPHERTEXT, F_SIGNING_PUB, F_COUNT };
+
+    mbedtls_pk_context*  ours;
+    const char*          kekInfo;
+    RngFn                rng;
+    void*                rngCtx;
+    uint8_t*             out;
+    size_t               outMax;
+    uint8_t*             signDer    = nullptr;
+    size_t               signMax    = 0;
+    size_t               signLen    = 0;
+
+    JsonFieldStream      json;
+    Base64Stream         b64;                 // field đang decode (mỗi lúc 1 field)
+    uint8_t              srvDer[SECURE_PUBKEY_DER_MAX];
+    size_t               srvLen     = 0;
+    uint8_t              nonce[16];           // 12 byte, dư để bắt nonce sai độ dài
+    size_t               nonceLen   = 0;
+    size_t               encLen     = 0;      // ciphertext + tag, khi field đã xong
+    uint8_t              seen       = 0;      // bit theo Field
+
+    mbedtls_gcm_context  gcm;
+    bool                 kekReady   = false;
+    bool                 gcmStarted = false;
+    size_t               gcmDone    = 0;      // byte đã decrypt in-place
+    size_t               streamedLen = 0;     // phần decrypt trong lúc download
+    const char*          err        = nullptr;
+
+    bool fail(const char* why) { if (!err) err = why; return false; }
+
+    static int onKey(void* ctx, const char* key) {
+        SecureResponse* r = (SecureResponse*)ctx;
+        int f = !strcmp(key, "server_public_key_b64")  ? F_SERVER_PUB
+              : !strcmp(key, "nonce_b64")              ? F_NONCE
+              : !strcmp(key, "encrypted_data_b64")     ? F_CIPHERTEXT
+              : !strcmp(key, "signing_public_key_b64") ? F_SIGNING_PUB : -1;
+        if (f < 0 || (f == F_SIGNING_PUB && !r->signDer)) return -1;
+        if (r->seen & (1u << f)) { r->fail("trung truong JSON"); return -1; }
+        switch (f) {
+        case F_SERVER_PUB:  r->b64.begin(r->srvDer, sizeof(r->srvDer)); break;
+        case F_NONCE:       r->b64.begin(r->nonce, sizeof(r->nonce)); break;
+        case F_CIPHERTEXT:  r->b64.begin(r->out, r->outMax); break;
+        case F_SIGNING_PUB: r->b64.begin(r->signDer, r->signMax); break;
+        }
+        return f;
+    }
+
+    static bool onChunk(void* ctx, int field, const char* s, size_t n) {
+        SecureResponse* r = (SecureResponse*)ctx;
+        if (!r->b64.feed(s, n)) return r->fail(field == F_CIPHERTEXT ? "ciphertext > buffer / base64" : "base64 decode");
+        if (field == F_CIPHERTEXT && r->gcmStarted) return r->decrypt(r->b64.length(), false);
+        return true;
+    }
+
+    static bool onEnd(void* ctx, int field) {
+        SecureResponse* r = (SecureResponse*)ctx;
+        if (!r->b64.finish()) return r->fail("base64 decode");
+        r->seen |= 1u << field;
+        size_t len = r->b64.length();
+        switch (field) {
+        case F_SERVER_PUB:
+            r->srvLen = len;
+            if (!r->deriveKek()) return false;
+            break;
+        case F_NONCE:
+            r->nonceLen = len;
+            if (len != 12) return r->fail("nonce != 12 byte");
+            break;
+        case F_CIPHERTEXT:
+            r->encLen = len;
+            if (len < 17) return r->fail("kich thuoc payload");
+            break;
+        case F_SIGNING_PUB:
+            r->signLen = len;
+            break;
+        }
+        return r->startGcm();
+    }
+
+    // ECDH(ours, server) → HKDF(kekInfo) → AES-128 key cho GCM
+    bool deriveKek() {
+        mbedtls_pk_context srv;
+        mbedtls_pk_init(&srv);
+        if (mbedtls_pk_parse_public_key(&srv, srvDer, srvLen) != 0) {
+            mbedtls_pk_free(&srv);
+            return fail("parse server pubkey");
+        }
+        mbedtls_ecdh_context ecdh;
+        mbedtls_ecdh_init(&ecdh);
+        uint8_t shared[32];
+        size_t  sharedLen = 0;
+        bool ok = mbedtls_ecdh_get_params(&ecdh, mbedtls_pk_ec(*ours), MBEDTLS_ECDH_OURS) == 0 &&
+                  mbedtls_ecdh_get_params(&ecdh, mbedtls_pk_ec(srv), MBEDTLS_ECDH_THEIRS) == 0 &&
+                  mbedtls_ecdh_calc_secret(&ecdh, &sharedLen, shared, sizeof(shared), rng, rngCtx) == 0 &&
+                  sharedLen == 32;
+        mbedtls_ecdh_free(&ecdh);
+        mbedtls_pk_free(&srv);
+        if (!ok) return fail("ECDH");
+
+        uint8_t kek[16];
+        ok = hkdfSha256(NULL, 0, shared, 32, (const uint8_t*)kekInfo, strlen(kekInfo), kek, 16) &&
+             mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, kek, 128) == 0;
+        memset(shared, 0, sizeof(shared));
+        memset(kek, 0, sizeof(kek));
+        if (!ok) return fail("HKDF / GCM key");
+        kekReady = true;
+        return true;
+    }
+
+    // KEK + nonce đủ → bắt đầu GCM. Ciphertext chỉ có thể đã xong trọn (field tới
+    // trước) hoặc chưa bắt đầu — cả 2 trường hợp không có gì decrypt ngay.
+    bool startGcm() {
+        if (gcmStarted || !kekReady || !(seen & (1u << F_NONCE))) return true;
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+        if (mbedtls_gcm_starts(&gcm, MBEDTLS_GCM_DECRYPT, nonce, 12) != 0) return fail("GCM start");
+#else
+        if (mbedtls_gcm_starts(&gcm, MBEDTLS_GCM_DECRYPT, nonce, 12, NULL, 0) != 0) return fail("GCM start");
+#endif
+        gcmStarted = true;
+        return true;
+    }
+
+    // Decrypt in-place out[gcmDone..]. Chưa hết field: chỉ bội 16 byte (mbedtls 2.x
+    // chỉ cho phép mảnh lẻ ở lần update cuối) và chừa 16 byte cuối vì có thể là tag.
+    bool decrypt(size_t avail, bool last) {
+        size_t n;
+        if (last) {
+            n = avail - gcmDone;
+        } else {
+            if (avail < gcmDone + 32) return true;
+            n = (avail - 16 - gcmDone) & ~(size_t)15;
+        }
+        if (!n) return true;
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+        size_t olen;
+        if (mbedtls_gcm_update(&gcm, out + gcmDone, n, out + gcmDone, n, &olen) != 0) return fail("AES-GCM decrypt");
+#else
+        if (mbedtls_gcm_update(&gcm, n, out + gcmDone, out + gcmDone) != 0) return fail("AES-GCM decrypt");
+#endif
+        gcmDone += n;
+        if (!last) streamedLen = gcmDone;
+        return true;
+    }
+
+public:
+    // ours: EC key pair đã gửi server (client_public_key_b64). out giữ ciphertext + tag
+    // đã decode rồi plaintext (kết thúc '\0' nếu còn chỗ).
+    SecureResponse(mbedtls_pk_context* ourKey, const char* info, uint8_t* outBuf, size_t outBufMax,
+                   RngFn f_rng, void* p_rng)
+        : ours(ourKey), kekInfo(info), rng(f_rng), rngCtx(p_rng), out(outBuf), outMax(outBufMax) {
+        mbedtls_gcm_init(&gcm);
+        json.begin(onKey, onChunk, onEnd, this);
+    }
+    ~SecureResponse() { mbedtls_gcm_free(&gcm); }
+    SecureResponse(const SecureResponse&) = delete;
+    SecureResponse& operator=(const SecureResponse&) = delete;
+
+    // Field "signing_public_key_b64" (ngoài phần mã hoá) decode vào der — tuỳ chọn
+    void captureSigningKey(uint8_t* der, size_t derMax) { signDer = der; signMax = derMax; }
+
+    bool feed(const uint8_t* d, size_t n) {
+        if (err) return false;
+        if (!json.feed((const char*)d, n)) return fail("parse JSON response");
+        return true;
+    }
+
+    // AtDataFn cho SimModem::httpPost
+    static void sink(void* ctx, const uint8_t* d, size_t n) { ((SecureResponse*)ctx)->feed(d, n); }
+
+    // Hết body: decrypt phần còn lại, kiểm tag. Trả về số byte plaintext, 0 nếu lỗi.
+    size_t finish() {
+        if (err) return 0;
+        if (!json.done()) { fail("JSON response bi cat"); return 0; }
+        const uint8_t need = (1u << F_SERVER_PUB) | (1u << F_NONCE) | (1u << F_CIPHERTEXT);
+        if ((seen & need) != need) { fail("thieu truong JSON"); return 0; }
+        if (!gcmStarted) { fail("GCM start"); return 0; }
+
+        size_t ctLen = encLen - 16;
+        if (!decrypt(ctLen, true)) return 0;
+        uint8_t tag[16];
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+        size_t olen;
+        if (mbedtls_gcm_finish(&gcm, NULL, 0, &olen, tag, sizeof(tag)) != 0) { fail("AES-GCM tag"); return 0; }
+#else
+        if (mbedtls_gcm_finish(&gcm, tag, sizeof(tag)) != 0) { fail("AES-GCM tag"); return 0; }
+#endif
+        uint8_t diff = 0;
+        for (size_t i = 0; i < 16; i++) diff |= tag[i] ^ out[ctLen + i];
+        if (diff) {
+            memset(out, 0, ctLen);                                         // không trả plaintext chưa xác thực
+            fail("AES-GCM tag");
+            return 0;
+        }
+        out[ctLen] = '\0';
+        return ctLen;
+    }
+
+    const char* error()          const { return err ? err : "ok"; }
+    size_t      streamedBytes()  const { return streamedLen; }    // decrypt trước khi hết body
+    size_t      signingKeyLen()  const { return signLen; }
+};
+
+#endif // SECURE_RESPONSE_H
@@ -0,0 +1,338 @@
+#ifndef SIM_MODEM_H
+#define SIM_MODEM_H
+
+#include <Arduino.h>
+#include <HardwareSerial.h>
+#include "at_engine.h"
+
+// ==================== SIM A7680C qua AtEngine ====================
+// simTask sở hữu AtEngine. UART RX callback (task sự kiện UART của core) copy
+// byte vào AtRxRing rồi đánh thức simTask; simTask ngủ tới byte mới / deadline
+// của command, không poll available().
+//
+// Task khác gửi AtCmd* qua cmdQueue: submit() async (onDone chạy trong simTask),
+// exec() block tới khi command xong — task gọi ngủ trên semaphore, không spin.
+// exec() của nhiều task được xếp hàng bằng callLock.
+
+#ifndef SIM_RX_RING_SIZE
+#define SIM_RX_RING_SIZE   (2048)
+#endif
+#ifndef SIM_TASK_STACK
+#define SIM_TASK_STACK     (4096)
+#endif
+#ifndef SIM_TASK_PRIO
+#define SIM_TASK_PRIO      (2)
+#endif
+#ifndef SIM_TASK_CORE
+#define SIM_TASK_CORE      (0)
+#endif
+#ifndef SIM_AT_LOG
+#define SIM_AT_LOG         (1)
+#endif
+
+class SimModem {
+private:
+    HardwareSerial&            uart;
+    AtEngine                   engine;
+    AtRxRing<SIM_RX_RING_SIZE> ring;
+    QueueHandle_t              cmdQueue = nullptr;
+    SemaphoreHandle_t          callLock = nullptr;
+    SemaphoreHandle_t          doneSem  = nullptr;
+    SemaphoreHandle_t          rxLock   = nullptr;
+    TaskHandle_t               task     = nullptr;
+    uint32_t                   parseUs  = 0;     // thời gian trong feed() (simTask)
+
+    // exec(): gom các line thông tin vào resp, cách nhau '\n'
+    struct Collect { char* buf; size_t max, len; };
+
+    // HTTP: +HTTPACTION và +HTTPREAD
+    struct HttpCtx {
+        int      status;
+        int      length;
+        AtDataFn sink;
+        void*    sinkCtx;
+        size_t   len;
+    };
+
+    // httpPost(buffer): sink ghi vào buffer cố định
+    struct BufSink { uint8_t* out; size_t max, len; bool truncated; };
+
+    static size_t writeUart(void* ctx, const uint8_t* d, size_t n) {
+        return ((SimModem*)ctx)->uart.write(d, n);
+    }
+
+    static void signalDone(AtCmd*, void* ctx) { xSemaphoreGive((SemaphoreHandle_t)ctx); }
+
+    static int collectLine(void* ctx, const char* line, size_t len) {
+        Collect* c = (Collect*)ctx;
+        if (!c->buf || !c->max) return 0;
+        if (c->len && c->len + 1 < c->max) c->buf[c->len++] = '\n';
+        size_t n = min(len, c->max - 1 - c->len);
+        memcpy(c->buf + c->len, line, n);
+        c->len += n;
+        c->buf[c->len] = '\0';
+        return 0;
+    }
+
+    static int logUrc(void*, const char* line, size_t) {
+#if SIM_AT_LOG
+        Serial.printf("[AT] URC %s\n", line);
+#endif
+        return 0;
+    }
+
+    // "+HTTPACTION: <method>,<status>,<len>"
+    static int httpActionLine(void* ctx, const char* line, size_t) {
+        HttpCtx* h = (HttpCtx*)ctx;
+        if (strncmp(line, "+HTTPACTION:", 12) != 0) return -1;
+        const char* c1 = strchr(line, ',');
+        const char* c2 = c1 ? strchr(c1 + 1, ',') : nullptr;
+        if (c1 && c2) { h->status = atoi(c1 + 1); h->length = atoi(c2 + 1); }
+        return 0;
+    }
+
+    // "+HTTPREAD: <n>" → n byte data theo sau; "+HTTPREAD: 0" = hết (until)
+    static int httpReadLine(void*, const char* line, size_t) {
+        if (strncmp(line, "+HTTPREAD:", 10) != 0) return -1;
+        int n = atoi(line + 10);
+        return n > 0 ? n : 0;
+    }
+
+    static void httpReadData(void* ctx, const uint8_t* d, size_t n) {
+        HttpCtx* h = (HttpCtx*)ctx;
+        h->len += n;
+        h->sink(h->sinkCtx, d, n);
+    }
+
+    static void bufSinkData(void* ctx, const uint8_t* d, size_t n) {
+        BufSink* b = (BufSink*)ctx;
+        size_t k = min(n, b->max - b->len);
+        memcpy(b->out + b->len, d, k);
+        b->len += k;
+        if (k < n) b->truncated = true;
+    }
+
+    // UART driver buffer → ring. Gọi từ UART event task (onReceive) và từ simTask khi
+    // ring vừa đầy — rxLock giữ 1 producer tại 1 thời điểm. Ring đầy → byte nằm lại
+    // trong buffer driver (không mất), simTask kéo tiếp sau khi feed.
+    size_t fillFromUart() {
+        size_t moved = 0;
+        xSemaphoreTake(rxLock, portMAX_DELAY);
+        int avail;
+        uint8_t* p;
+        size_t span;
+        while ((avail = uart.available()) > 0 && (span = ring.writeSpan(&p)) > 0) {
+            size_t n = uart.read(p, min((size_t)avail, span));
+            if (!n) break;
+            ring.commit(n);
+            moved += n;
+        }
+        xSemaphoreGive(rxLock);
+        return moved;
+    }
+
+    void drainRx() {
+        const uint8_t* p;
+        size_t n;
+        do {
+            while ((n = ring.readSpan(&p)) > 0) {
+                uint32_t t0 = micros();
+                engine.feed(p, n, millis());
+                parseUs += micros() - t0;
+                ring.consume(n);
+            }
+        } while (fillFromUart());
+    }
+
+    static void taskEntry(void* arg) { ((SimModem*)arg)->run(); }
+
+    void run() {
+        for (;;) {
+            uint32_t left = engine.msUntilDeadline(millis());
+            ulTaskNotifyTake(pdTRUE, left == AT_NO_DEADLINE ? portMAX_DELAY : pdMS_TO_TICKS(left) + 1);
+
+            AtCmd* c;
+            while (xQueueReceive(cmdQueue, &c, 0) == pdTRUE) {
+                if (!engine.submit(c, millis()) && c->onDone) c->onDone(c, c->doneCtx);
+            }
+            drainRx();
+            engine.service(millis());
+        }
+    }
+
+public:
+    explicit SimModem(HardwareSerial& port) : uart(port) {}
+
+    bool begin(unsigned long baud, int8_t rxPin, int8_t txPin) {
+        if (task) return true;
+        cmdQueue = xQueueCreate(AT_QUEUE_DEPTH, sizeof(AtCmd*));
+        callLock = xSemaphoreCreateMutex();
+        doneSem  = xSemaphoreCreateBinary();
+        rxLock   = xSemaphoreCreateMutex();
+        if (!cmdQueue || !callLock || !doneSem || !rxLock) return false;
+        engine.begin(writeUart, this);
+        engine.onUrc(logUrc, nullptr);
+        if (xTaskCreatePinnedToCore(taskEntry, "SIM_Task", SIM_TASK_STACK, this,
+                                    SIM_TASK_PRIO, &task, SIM_TASK_CORE) != pdPASS) return false;
+        uart.setRxBufferSize(1024);
+        uart.begin(baud, SERIAL_8N1, rxPin, txPin);
+        uart.onReceive([this]() { if (fillFromUart()) xTaskNotifyGive(task); });
+        return true;
+    }
+
+    // Async: cmd sống tới onDone (chạy trong simTask)
+    bool submit(AtCmd* c) {
+        if (xQueueSend(cmdQueue, &c, 0) != pdTRUE) return false;
+        xTaskNotifyGive(task);
+        return true;
+    }
+
+    // Block tới khi xong (engine luôn kết thúc bằng OK/ERROR/TIMEOUT)
+    AtResult exec(AtCmd& c) {
+        xSemaphoreTake(callLock, portMAX_DELAY);
+        c.onDone  = signalDone;
+        c.doneCtx = doneSem;
+#if SIM_AT_LOG
+        Serial.printf("[AT] >> %s\n", c.text);
+#endif
+        AtCmd* p = &c;
+        if (xQueueSend(cmdQueue, &p, portMAX_DELAY) == pdTRUE) {
+            xTaskNotifyGive(task);
+            xSemaphoreTake(doneSem, portMAX_DELAY);
+        } else {
+            c.result = AT_REJECTED;
+        }
+        xSemaphoreGive(callLock);
+#if SIM_AT_LOG
+        Serial.printf("[AT] << %s (%lu ms)\n", AtEngine::name(c.result), (unsigned long)c.elapsedMs);
+#endif
+        return c.result;
+    }
+
+    // Lệnh đơn giản; resp (tuỳ chọn) nhận các line thông tin
+    AtResult exec(const char* text, uint32_t timeoutMs = 5000, char* resp = nullptr, size_t respMax = 0) {
+        Collect col = { resp, respMax, 0 };
+        if (resp && respMax) resp[0] = '\0';
+        AtCmd c;
+        c.text      = text;
+        c.timeoutMs = timeoutMs;
+        c.onLine    = collectLine;
+        c.ctx       = &col;
+        AtResult r = exec(c);
+#if SIM_AT_LOG
+        if (resp && col.len) Serial.printf("[AT] << %s\n", resp);
+#endif
+        return r;
+    }
+
+    bool ok(const char* text, uint32_t timeoutMs = 5000) { return exec(text, timeoutMs) == AT_OK; }
+
+    // Bật module, chờ đăng ký mạng, mở PDP context
+    bool attach(const char* apn) {
+        vTaskDelay(pdMS_TO_TICKS(500));
+        bool alive = false;
+        for (int i = 0; i < 5 && !alive; i++) {
+            alive = exec("AT", 1000) == AT_OK;
+            if (!alive) vTaskDelay(pdMS_TO_TICKS(50));
+        }
+        if (!alive) { Serial.println("[SIM] LOI: AT khong phan hoi"); return false; }
+        ok("ATE0");
+
+        Serial.println("[SIM] Cho dang ky mang...");
+        uint32_t t = millis();
+        bool netOk = false;
+        char resp[64];
+        while (!netOk && millis() - t < 30000) {
+            // +CREG: <n>,<stat> — 1 = home, 5 = roaming
+            if (exec("AT+CREG?", 3000, resp, sizeof(resp)) == AT_OK) {
+                const char* c = strchr(resp, ',');
+                netOk = c && (atoi(c + 1) == 1 || atoi(c + 1) == 5);
+            }
+            if (!netOk) vTaskDelay(pdMS_TO_TICKS(1000));
+        }
+        if (!netOk) { Serial.println("[SIM] LOI: khong co mang"); return false; }
+
+        char cmd[96];
+        snprintf(cmd, sizeof(cmd), "AT+CGDCONT=1,\"IP\",\"%s\"", apn);
+        ok(cmd);
+        ok("AT+CGACT=1,1", 10000);
+        exec("AT+CGPADDR=1", 5000, resp, sizeof(resp));
+        return true;
+    }
+
+    // HTTP POST JSON. Response body đi ra sink theo từng mảnh +HTTPREAD (trong simTask,
+    // ngay khi nhận) — không buffer body. Trả về số byte body, 0 nếu lỗi.
+    size_t httpPost(const char* url, const char* body, AtDataFn sink, void* sinkCtx) {
+        exec("AT+HTTPTERM", 3000);             // session cũ (nếu có) — ERROR là bình thường
+        if (!ok("AT+HTTPINIT")) { Serial.println("[HTTP] HTTPINIT failed"); return 0; }
+
+        char cmd[192];
+        size_t bodyLen = strlen(body);
+        HttpCtx h = { 0, 0, sink, sinkCtx, 0 };
+        bool okSoFar = snprintf(cmd, sizeof(cmd), "AT+HTTPPARA=\"URL\",\"%s\"", url) < (int)sizeof(cmd) &&
+                       ok(cmd) && ok("AT+HTTPPARA=\"CONTENT\",\"application/json\"");
+
+        if (okSoFar) {
+            // "DOWNLOAD" → ghi body → OK
+            snprintf(cmd, sizeof(cmd), "AT+HTTPDATA=%u,10000", (unsigned)bodyLen);
+            AtCmd data;
+            data.text       = cmd;
+            data.timeoutMs  = 13000;
+            data.prompt     = "DOWNLOAD";
+            data.payload    = (const uint8_t*)body;
+            data.payloadLen = bodyLen;
+            okSoFar = exec(data) == AT_OK;
+        }
+        if (okSoFar) {
+            // OK ngay, +HTTPACTION: 1,<status>,<len> khi server trả lời
+            AtCmd action;
+            action.text      = "AT+HTTPACTION=1";
+            action.timeoutMs = 30000;
+            action.until     = "+HTTPACTION:";
+            action.onLine    = httpActionLine;
+            action.ctx       = &h;
+            okSoFar = exec(action) == AT_OK;
+            Serial.printf("[HTTP] Status: %d, Len: %d\n", h.status, h.length);
+            okSoFar = okSoFar && h.status == 200 && h.length > 0;
+        }
+        if (okSoFar) {
+            // OK, +HTTPREAD: <n>, <n byte>, ..., +HTTPREAD: 0 — data base64 chứa "OK" cũng không sao
+            snprintf(cmd, sizeof(cmd), "AT+HTTPREAD=0,%d", h.length);
+            AtCmd read;
+            read.text      = cmd;
+            read.timeoutMs = 10000;
+            read.until     = "+HTTPREAD: 0";
+            read.onLine    = httpReadLine;
+            read.onData    = httpReadData;
+            read.ctx       = &h;
+            okSoFar = exec(read) == AT_OK && h.len == (size_t)h.length;
+        }
+        exec("AT+HTTPTERM", 2000);
+        return okSoFar ? h.len : 0;
+    }
+
+    // Body ghi vào out (không '\0')
+    size_t httpPost(const char* url, const char* body, uint8_t* out, size_t outMax) {
+        BufSink b = { out, outMax, 0, false };
+        size_t n = httpPost(url, body, bufSinkData, &b);
+        if (b.truncated) Serial.printf("[HTTP] LOI: response %u byte > buffer %u\n", (unsigned)n, (unsigned)outMax);
+        return b.truncated ? 0 : n;
+    }
+
+    void printStats() const {
+        const AtEngine::Stats& s = engine.getStats();
+        uint32_t done = s.ok + s.errors + s.timeouts;
+        Serial.printf("[SIM] AT: %lu cmd (ok %lu, err %lu, timeout %lu, rejected %lu), max %lu ms\n",
+                      (unsigned long)s.commands, (unsigned long)s.ok, (unsigned long)s.errors,
+                      (unsigned long)s.timeouts, (unsigned long)s.rejected, (unsigned long)s.maxLatencyMs);
+        Serial.printf("[SIM] RX: %lu B (%lu raw), %lu lines, %lu URC, %lu long, parse %lu us (%lu us/resp)\n",
+                      (unsigned long)s.bytesIn, (unsigned long)s.rawBytes, (unsigned long)s.lines,
+                      (unsigned long)s.urcs, (unsigned long)s.longLines,
+                      (unsigned long)parseUs, (unsigned long)(done ? parseUs / done : 0));
+    }
+
+    const AtEngine::Stats& stats() const { return engine.getStats(); }
+    uint32_t parseMicros() const { return parseUs; }
+};
+
+#endif // SIM_MODEM_H
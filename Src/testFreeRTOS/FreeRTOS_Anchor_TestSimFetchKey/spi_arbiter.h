@@ -0,0 +1,132 @@
+#ifndef SPI_ARBITER_H
+#define SPI_ARBITER_H
+
+#include <Arduino.h>
+#include "anchor_config.h"
+
+// ==================== SPI Bus Arbiter ====================
+// DW3000 và các MCP2515 dùng chung SPI2. Arbiter cấp quyền theo từng
+// transaction ngắn thay vì cả vòng ranging:
+//  - uwbTask chỉ giữ bus khi arm RX và khi xử lý Poll → gửi Response;
+//    trong lúc DW3000 chờ frame (tối đa UWB_RX_WAIT_MS) uwbTask block trên IRQ,
+//    không lấy bus — chỉ đọc status khi có IRQ / lệnh dừng / hết hạn → bus rảnh cho CAN
+//    và histogram UWB chỉ đếm transaction thật.
+//  - canTask lấy bus cho từng frame / từng lần đọc RX, không giữ cả sequence.
+//  - Ưu tiên: FreeRTOS mutex đánh thức task waiter có priority cao nhất trước
+//    (uwbTask P4 > canTask P2) + priority inheritance khi CAN đang giữ bus.
+//    CAN loop dài gọi contended() để nhả bus sớm khi UWB đang chờ.
+//  - CS tập trung: mọi chân CS đăng ký bị kéo HIGH mỗi lần cấp/nhả bus.
+//  - Histogram thời gian chờ (log2, µs) cho từng client.
+
+enum SpiClient : uint8_t {
+  SPI_CLIENT_UWB   = 0,   // priority cao nhất
+  SPI_CLIENT_CAN   = 1,
+  SPI_CLIENT_COUNT = 2
+};
+
+struct SpiWaitHistogram {
+  uint32_t bucket[SPI_HIST_BUCKETS] = {};   // bucket i: < (SPI_HIST_BASE_US << i) µs, bucket cuối: còn lại
+  uint32_t count    = 0;
+  uint32_t timeouts = 0;
+  uint32_t maxUs    = 0;
+  uint64_t sumUs    = 0;
+
+  void add(uint32_t us) {
+    int i = 0;
+    while (i < SPI_HIST_BUCKETS - 1 && us >= ((uint32_t)SPI_HIST_BASE_US << i)) i++;
+    bucket[i]++;
+    count++;
+    sumUs += us;
+    if (us > maxUs) maxUs = us;
+  }
+
+  // Percentile theo biên trên của bucket (ước lượng)
+  uint32_t percentileUs(uint8_t pct) const {
+    if (count == 0) return 0;
+    uint32_t target = (uint32_t)(((uint64_t)count * pct + 99) / 100), acc = 0;
+    for (int i = 0; i < SPI_HIST_BUCKETS; i++) {
+      acc += bucket[i];
+      if (acc >= target) return (i < SPI_HIST_BUCKETS - 1) ? ((uint32_t)SPI_HIST_BASE_US << i) : maxUs;
+    }
+    return maxUs;
+  }
+};
+
+class SpiArbiter {
+private:
+  SemaphoreHandle_t mutex = nullptr;
+  uint8_t  csPins[SPI_MAX_CS_PINS];
+  uint8_t  csCount = 0;
+  volatile uint8_t waiting[SPI_CLIENT_COUNT] = {};
+  volatile uint8_t owner = SPI_CLIENT_COUNT;
+  uint32_t holdStartUs = 0;
+  uint32_t holdMaxUs[SPI_CLIENT_COUNT] = {};
+  SpiWaitHistogram hist[SPI_CLIENT_COUNT];
+
+  void deselectAll() {
+    for (uint8_t i = 0; i < csCount; i++) digitalWrite(csPins[i], HIGH);
+  }
+
+public:
+  // Đăng ký mọi chân CS trên bus — tất cả được set OUTPUT HIGH ngay
+  bool begin(const uint8_t* pins, uint8_t count) {
+    mutex = xSemaphoreCreateMutex();
+    csCount = count > SPI_MAX_CS_PINS ? SPI_MAX_CS_PINS : count;
+    for (uint8_t i = 0; i < csCount; i++) {
+      csPins[i] = pins[i];
+      pinMode(csPins[i], OUTPUT);
+    }
+    deselectAll();
+    return mutex != nullptr;
+  }
+
+  bool acquire(SpiClient c, TickType_t timeout) {
+    uint32_t t0 = micros();
+    waiting[c]++;
+    bool ok = xSemaphoreTake(mutex, timeout) == pdTRUE;
+    waiting[c]--;
+    if (!ok) {
+      hist[c].timeouts++;
+      return false;
+    }
+    hist[c].add(micros() - t0);
+    deselectAll();
+    owner = c;
+    holdStartUs = micros();
+    return true;
+  }
+
+  void release(SpiClient c) {
+    if (owner != c) return;
+    uint32_t held = micros() - holdStartUs;
+    if (held > holdMaxUs[c]) holdMaxUs[c] = held;
+    deselectAll();
+    owner = SPI_CLIENT_COUNT;
+    xSemaphoreGive(mutex);
+  }
+
+  // true nếu client priority cao hơn c đang chờ bus → c nên release sớm
+  bool contended(SpiClient c) const {
+    for (int i = 0; i < c; i++)
+      if (waiting[i]) return true;
+    return false;
+  }
+
+  const SpiWaitHistogram& getHistogram(SpiClient c) const { return hist[c]; }
+
+  void print() const {
+    static const char* NAMES[SPI_CLIENT_COUNT] = { "UWB", "CAN" };
+    for (int c = 0; c < SPI_CLIENT_COUNT; c++) {
+      const SpiWaitHistogram& h = hist[c];
+      Serial.printf("[SPI] %s wait: n=%lu avg=%lu p50<%lu p99<%lu max=%lu us, timeouts=%lu, hold max=%lu us |",
+                    NAMES[c], (unsigned long)h.count,
+                    (unsigned long)(h.count ? h.sumUs / h.count : 0),
+                    (unsigned long)h.percentileUs(50), (unsigned long)h.percentileUs(99),
+                    (unsigned long)h.maxUs, (unsigned long)h.timeouts, (unsigned long)holdMaxUs[c]);
+      for (int i = 0; i < SPI_HIST_BUCKETS; i++) Serial.printf(" %lu", (unsigned long)h.bucket[i]);
+      Serial.println();
+    }
+  }
+};
+
+#endif // SPI_ARBITER_H
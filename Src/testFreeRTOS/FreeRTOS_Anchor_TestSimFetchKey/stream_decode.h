@@ -0,0 +1,208 @@
+#ifndef STREAM_DECODE_H
+#define STREAM_DECODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ==================== Streaming JSON field + base64 decoder ====================
+// Response của server (/secure-check-pairing, /friend-sharing/sync) là 1 object
+// phẳng gồm các string base64. Parse theo từng mảnh +HTTPREAD, không giữ body:
+//   JsonFieldStream — tokenizer 1 object: mỗi key gọi onKey() chọn field, value
+//                     string đi ra onChunk() theo mảnh (trỏ thẳng vào input),
+//                     value khác / object / array lồng nhau bị bỏ qua.
+//   Base64Stream    — decode base64 tăng dần vào buffer đích.
+// Không phụ thuộc Arduino — Tools/sim_host/sim_replay dùng nguyên file.
+
+#ifndef JSON_KEY_MAX
+#define JSON_KEY_MAX (40)
+#endif
+
+class JsonFieldStream {
+public:
+    typedef int  (*KeyFn)(void* ctx, const char* key);                     // field ≥ 0, -1 = bỏ qua value
+    typedef bool (*ChunkFn)(void* ctx, int field, const char* s, size_t n); // false → dừng (lỗi)
+    typedef bool (*EndFn)(void* ctx, int field);
+
+private:
+    enum State : uint8_t {
+        ST_START, ST_KEY_OR_END, ST_KEY, ST_KEY_ESC, ST_COLON, ST_VALUE,
+        ST_STR, ST_STR_ESC, ST_SCALAR, ST_NESTED, ST_NESTED_STR, ST_NESTED_ESC,
+        ST_NEXT, ST_DONE, ST_ERROR
+    };
+
+    KeyFn   keyFn   = nullptr;
+    ChunkFn chunkFn = nullptr;
+    EndFn   endFn   = nullptr;
+    void*   ctx     = nullptr;
+    State   st      = ST_START;
+    char    key[JSON_KEY_MAX];
+    uint8_t keyLen  = 0;
+    int     field   = -1;
+    uint8_t depth   = 0;
+
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+    bool fail() { st = ST_ERROR; return false; }
+
+public:
+    void begin(KeyFn k, ChunkFn c, EndFn e, void* context) {
+        keyFn = k; chunkFn = c; endFn = e; ctx = context;
+        st = ST_START; keyLen = 0; field = -1; depth = 0;
+    }
+
+    bool feed(const char* s, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            char c = s[i];
+            switch (st) {
+            case ST_START:
+                if (c == '{') st = ST_KEY_OR_END;
+                else if (!isSpace(c)) return fail();
+                break;
+            case ST_KEY_OR_END:
+                if (c == '"') { st = ST_KEY; keyLen = 0; }
+                else if (c == '}') st = ST_DONE;
+                else if (!isSpace(c)) return fail();
+                break;
+            case ST_KEY:
+                if (c == '"') { key[keyLen] = '\0'; st = ST_COLON; }
+                else if (c == '\\') st = ST_KEY_ESC;
+                else if (keyLen < JSON_KEY_MAX - 1) key[keyLen++] = c;     // key dài hơn: cắt, không khớp field nào
+                break;
+            case ST_KEY_ESC:
+                if (keyLen < JSON_KEY_MAX - 1) key[keyLen++] = c;
+                st = ST_KEY;
+                break;
+            case ST_COLON:
+                if (c == ':') { st = ST_VALUE; field = keyFn ? keyFn(ctx, key) : -1; }
+                else if (!isSpace(c)) return fail();
+                break;
+            case ST_VALUE:
+                if (isSpace(c)) break;
+                if (c == '"') {
+                    st = ST_STR;
+                    // Chạy ký tự thường liên tiếp → 1 chunk trỏ thẳng vào input
+                    size_t j = i + 1;
+                    while (j < n && s[j] != '"' && s[j] != '\\') j++;
+                    if (field >= 0 && j > i + 1 && !chunkFn(ctx, field, s + i + 1, j - i - 1)) return fail();
+                    i = j - 1;
+                } else if (c == '{' || c == '[') {
+                    if (field >= 0) return fail();                       // field cần string
+                    st = ST_NESTED; depth = 1;
+                } else {
+                    if (field >= 0) return fail();
+                    st = ST_SCALAR;
+                }
+                break;
+            case ST_STR: {
+                if (c == '"') {
+                    if (field >= 0 && endFn && !endFn(ctx, field)) return fail();
+                    st = ST_NEXT;
+                    break;
+                }
+                if (c == '\\') { st = ST_STR_ESC; break; }
+                size_t j = i;
+                while (j < n && s[j] != '"' && s[j] != '\\') j++;
+                if (field >= 0 && !chunkFn(ctx, field, s + i, j - i)) return fail();
+                i = j - 1;
+                break;
+            }
+            case ST_STR_ESC: {
+                // Base64 không có escape; "\/" (một số encoder) thì chấp nhận. \uXXXX → lỗi nếu là field.
+                char out = c == 'n' ? '\n' : c == 'r' ? '\r' : c == 't' ? '\t' : c;
+                if (field >= 0 && (c == 'u' || !chunkFn(ctx, field, &out, 1))) return fail();
+                st = ST_STR;
+                break;
+            }
+            case ST_SCALAR:
+                if (c == ',') st = ST_KEY_OR_END;
+                else if (c == '}') st = ST_DONE;
+                break;
+            case ST_NESTED:
+                if (c == '"') st = ST_NESTED_STR;
+                else if (c == '{' || c == '[') depth++;
+                else if ((c == '}' || c == ']') && --depth == 0) st = ST_NEXT;
+                break;
+            case ST_NESTED_STR:
+                if (c == '\\') st = ST_NESTED_ESC;
+                else if (c == '"') st = ST_NESTED;
+                break;
+            case ST_NESTED_ESC:
+                st = ST_NESTED_STR;
+                break;
+            case ST_NEXT:
+                if (c == ',') st = ST_KEY_OR_END;
+                else if (c == '}') st = ST_DONE;
+                else if (!isSpace(c)) return fail();
+                break;
+            case ST_DONE:
+                if (!isSpace(c)) return fail();                          // dữ liệu sau '}'
+                break;
+            case ST_ERROR:
+                return false;
+            }
+        }
+        return st != ST_ERROR;
+    }
+
+    bool done()   const { return st == ST_DONE; }
+    bool failed() const { return st == ST_ERROR; }
+};
+
+class Base64Stream {
+private:
+    uint8_t* out   = nullptr;
+    size_t   max   = 0;
+    size_t   len   = 0;
+    uint32_t acc   = 0;
+    uint8_t  nAcc  = 0;     // ký tự trong nhóm 4 hiện tại
+    uint8_t  pad   = 0;
+    bool     err   = false;
+
+    static int8_t value(char c) {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '+') return 62;
+        if (c == '/') return 63;
+        return -1;
+    }
+
+public:
+    void begin(uint8_t* dst, size_t dstMax) {
+        out = dst; max = dstMax; len = 0; acc = 0; nAcc = 0; pad = 0; err = false;
+    }
+
+    bool feed(const char* s, size_t n) {
+        for (size_t i = 0; i < n && !err; i++) {
+            char c = s[i];
+            if (c == '=') {
+                if (nAcc < 2) { err = true; break; }
+                pad++;
+                acc <<= 6;
+            } else {
+                int8_t v = value(c);
+                if (v < 0 || pad) { err = true; break; }                 // ký tự lạ / data sau '='
+                acc = (acc << 6) | (uint32_t)v;
+            }
+            if (++nAcc == 4) {
+                uint8_t b[3] = { (uint8_t)(acc >> 16), (uint8_t)(acc >> 8), (uint8_t)acc };
+                size_t k = 3 - pad;
+                if (len + k > max) { err = true; break; }
+                memcpy(out + len, b, k);
+                len += k;
+                acc = 0;
+                nAcc = 0;
+            }
+        }
+        return !err;
+    }
+
+    // Hết field: phải trọn nhóm 4 ký tự
+    bool finish() { if (nAcc) err = true; return !err; }
+
+    size_t length() const { return len; }
+    bool   failed() const { return err; }
+};
+
+#endif // STREAM_DECODE_H
@@ -0,0 +1,336 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <freertos/message_buffer.h>
+
+// ==================== Runtime telemetry ====================
+// Task riêng priority thấp lấy mẫu định kỳ rồi phát record nhị phân gọn:
+//  - mỗi task: CPU share (‰ của 1 core, từ run-time counter), stack high-water mark
+//  - queue đăng ký: depth hiện tại, depth max, chuỗi "đầy" dài nhất (lấy mẫu
+//    mỗi TELEMETRY_QUEUE_SAMPLE_MS giữa 2 lần phát)
+//  - lock (SPI arbiter): số lần chờ, timeout, p50/p99/max wait — qua callback
+//  - heap internal + PSRAM: free, largest block, min free ever
+//  - UWB link (Anchor, uwb_diag.h): event counter + RX/first-path power + STS quality
+//    của session ranging hiện tại — qua callback
+// Sink: Serial (xen lẫn log text — decoder resync bằng sync word + CRC) và/hoặc
+// message buffer để bleTask gom vào notify của characteristic diag.
+// Decoder: Tools/telemetry_decode.py
+//
+// Frame: A5 5A | type | len | ts_ms (u32) | payload[len] | crc8(type..payload)
+// Mọi field little-endian, struct packed.
+
+#ifndef TELEMETRY_PERIOD_MS
+#define TELEMETRY_PERIOD_MS        (2000U)
+#endif
+#ifndef TELEMETRY_QUEUE_SAMPLE_MS
+#define TELEMETRY_QUEUE_SAMPLE_MS  (10U)
+#endif
+#ifndef TELEMETRY_MAX_TASKS
+#define TELEMETRY_MAX_TASKS        (20)
+#endif
+#ifndef TELEMETRY_MAX_QUEUES
+#define TELEMETRY_MAX_QUEUES       (4)
+#endif
+#ifndef TELEMETRY_NAME_EVERY
+#define TELEMETRY_NAME_EVERY       (10)    // phát lại bảng tên mỗi N lần lấy mẫu
+#endif
+#ifndef TELEMETRY_BLE_BUF
+#define TELEMETRY_BLE_BUF          (1024)
+#endif
+
+#define TELEMETRY_SINK_SERIAL  (1U << 0)
+#define TELEMETRY_SINK_BLE     (1U << 1)
+
+namespace Tlm {
+
+enum RecordType : uint8_t {
+    REC_TASK  = 0x01,
+    REC_QUEUE = 0x02,
+    REC_LOCK  = 0x03,
+    REC_HEAP  = 0x04,
+    REC_NAME  = 0x05,
+    REC_END   = 0x06,   // kết thúc 1 lần lấy mẫu
+    REC_UWB_CNT  = 0x07,
+    REC_UWB_LINK = 0x08,
+};
+
+enum NameKind : uint8_t { NAME_TASK = 0, NAME_QUEUE = 1, NAME_LOCK = 2 };
+
+#pragma pack(push, 1)
+struct TaskRec {
+    uint8_t  id;          // xTaskNumber
+    int8_t   core;        // -1 = không pin
+    uint8_t  prio;
+    uint8_t  state;       // eTaskState
+    uint16_t cpuPermille; // 0xFFFF = không có run-time stats
+    uint16_t stackFree;   // bytes còn lại thấp nhất từng thấy
+};
+struct QueueRec {
+    uint8_t  id;
+    uint8_t  depth;
+    uint8_t  capacity;
+    uint8_t  maxDepth;    // trong chu kỳ vừa qua
+    uint16_t fullMaxMs;   // chuỗi đầy dài nhất trong chu kỳ
+    uint16_t fullSamples; // số mẫu thấy đầy
+};
+struct LockRec {
+    uint8_t  id;
+    uint32_t waits;       // cộng dồn từ boot
+    uint32_t timeouts;
+    uint32_t p50Us;
+    uint32_t p99Us;
+    uint32_t maxUs;
+};
+struct HeapRec {
+    uint32_t intFree, intLargest, intMinFree;
+    uint32_t psramFree, psramLargest, psramMinFree;
+};
+// Cộng dồn trong session; u16 bão hoà ở 0xFFFF
+struct UwbCntRec {
+    uint16_t session;
+    uint32_t rxGood;
+    uint32_t tx;
+    uint16_t crcBad, phrErr, syncLoss, sfdTimeout, preambleTimeout, preambleReject;
+    uint16_t rxTimeout, filterReject, overrun, halfPeriodWarn, spiCrcErr;
+};
+// Power: dBm × 10, INT16_MIN = chưa có mẫu
+struct UwbLinkRec {
+    uint16_t session;
+    uint16_t samples;     // số lần đọc CIA diag
+    int16_t  rxAvg, rxMin, rxMax;
+    int16_t  fpAvg, fpMin, fpMax;
+    int16_t  stsAvg, stsMin;
+    uint32_t stsFrames;
+    uint16_t stsRejected;
+};
+struct EndRec {
+    uint16_t seq;
+    uint16_t dropped;     // frame không vào được BLE buffer
+    uint8_t  taskCount;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(UwbCntRec) <= 40 && sizeof(UwbLinkRec) <= 40, "Telemetry payload tối đa 40 byte");
+
+inline uint16_t sat16(uint32_t v) { return v > 0xFFFF ? 0xFFFF : (uint16_t)v; }
+
+} // namespace Tlm
+
+class Telemetry {
+public:
+    typedef void (*LockSampler)(Telemetry& t);
+    typedef void (*UwbSampler)(Telemetry& t);
+
+private:
+    struct QueueSlot {
+        QueueHandle_t q = nullptr;
+        const char*   name = nullptr;
+        uint8_t       capacity = 0;
+        uint8_t       maxDepth = 0;
+        uint16_t      fullRun = 0, fullMaxRun = 0, fullSamples = 0;
+    };
+
+    uint8_t   sinks = TELEMETRY_SINK_SERIAL;
+    QueueSlot queues[TELEMETRY_MAX_QUEUES];
+    uint8_t   queueCount = 0;
+    LockSampler lockSampler = nullptr;
+    UwbSampler  uwbSampler  = nullptr;
+    MessageBufferHandle_t bleBuf = nullptr;
+    uint16_t  seq = 0;
+    uint16_t  dropped = 0;
+    uint32_t  nowMs = 0;
+
+#if configUSE_TRACE_FACILITY
+    TaskStatus_t status[TELEMETRY_MAX_TASKS];
+#if configGENERATE_RUN_TIME_STATS
+    struct { UBaseType_t id; uint32_t rt; } prevRt[TELEMETRY_MAX_TASKS];
+    uint8_t  prevCount = 0;
+    uint32_t prevTotal = 0;
+#endif
+#endif
+
+    static uint8_t crc8(const uint8_t* p, size_t n) {
+        uint8_t c = 0;
+        while (n--) {
+            c ^= *p++;
+            for (int i = 0; i < 8; i++) c = (c & 0x80) ? (uint8_t)((c << 1) ^ 0x07) : (uint8_t)(c << 1);
+        }
+        return c;
+    }
+
+    void emit(uint8_t type, const void* payload, uint8_t len) {
+        uint8_t f[2 + 2 + 4 + 40 + 1];
+        if (len > 40) return;
+        f[0] = 0xA5; f[1] = 0x5A; f[2] = type; f[3] = len;
+        memcpy(&f[4], &nowMs, 4);
+        memcpy(&f[8], payload, len);
+        f[8 + len] = crc8(&f[2], 6 + len);
+        size_t n = 9 + len;
+        if (sinks & TELEMETRY_SINK_SERIAL) Serial.write(f, n);
+        if ((sinks & TELEMETRY_SINK_BLE) && bleBuf && xMessageBufferSend(bleBuf, f, n, 0) != n) dropped++;
+    }
+
+    void emitName(uint8_t kind, uint8_t id, const char* name) {
+        uint8_t p[2 + 16];
+        size_t n = strnlen(name ? name : "", 16);
+        p[0] = kind; p[1] = id;
+        memcpy(&p[2], name ? name : "", n);
+        emit(Tlm::REC_NAME, p, (uint8_t)(2 + n));
+    }
+
+    void sampleTasks(bool names, uint8_t& countOut) {
+        countOut = 0;
+#if configUSE_TRACE_FACILITY
+        uint32_t total = 0;
+        UBaseType_t n = uxTaskGetSystemState(status, TELEMETRY_MAX_TASKS, &total);
+        countOut = (uint8_t)n;
+#if configGENERATE_RUN_TIME_STATS
+        // ESP32 SMP: total = thời gian chạy của 1 core → ‰ tính trên 1 core
+        uint32_t dTotal = total - prevTotal;
+#endif
+        for (UBaseType_t i = 0; i < n; i++) {
+            const TaskStatus_t& s = status[i];
+            Tlm::TaskRec r;
+            r.id    = (uint8_t)s.xTaskNumber;
+            r.core  = (s.xCoreID == tskNO_AFFINITY) ? -1 : (int8_t)s.xCoreID;
+            r.prio  = (uint8_t)s.uxCurrentPriority;
+            r.state = (uint8_t)s.eCurrentState;
+            r.stackFree = (uint16_t)(s.usStackHighWaterMark > 0xFFFF ? 0xFFFF : s.usStackHighWaterMark);
+            r.cpuPermille = 0xFFFF;
+#if configGENERATE_RUN_TIME_STATS
+            for (uint8_t k = 0; k < prevCount && dTotal; k++) {
+                if (prevRt[k].id != s.xTaskNumber) continue;
+                uint64_t pm = (uint64_t)(s.ulRunTimeCounter - prevRt[k].rt) * 1000U / dTotal;
+                r.cpuPermille = (uint16_t)(pm > 1000 ? 1000 : pm);
+                break;
+            }
+#endif
+            if (names) emitName(Tlm::NAME_TASK, r.id, s.pcTaskName);
+            emit(Tlm::REC_TASK, &r, sizeof(r));
+        }
+#if configGENERATE_RUN_TIME_STATS
+        for (UBaseType_t i = 0; i < n; i++) {
+            prevRt[i].id = status[i].xTaskNumber;
+            prevRt[i].rt = status[i].ulRunTimeCounter;
+        }
+        prevCount = (uint8_t)n;
+        prevTotal = total;
+#endif
+#endif
+    }
+
+    void sampleHeap() {
+        Tlm::HeapRec h;
+        h.intFree      = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+        h.intLargest   = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+        h.intMinFree   = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+        h.psramFree    = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+        h.psramLargest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+        h.psramMinFree = heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+        emit(Tlm::REC_HEAP, &h, sizeof(h));
+    }
+
+    // Gọi mỗi TELEMETRY_QUEUE_SAMPLE_MS — chỉ đọc depth, rẻ
+    void sampleQueuesFast() {
+        for (uint8_t i = 0; i < queueCount; i++) {
+            QueueSlot& q = queues[i];
+            UBaseType_t d = uxQueueMessagesWaiting(q.q);
+            if (d > q.maxDepth) q.maxDepth = (uint8_t)d;
+            if (d >= q.capacity) {
+                q.fullSamples++;
+                if (++q.fullRun > q.fullMaxRun) q.fullMaxRun = q.fullRun;
+            } else {
+                q.fullRun = 0;
+            }
+        }
+    }
+
+    void flushQueues(bool names) {
+        for (uint8_t i = 0; i < queueCount; i++) {
+            QueueSlot& q = queues[i];
+            Tlm::QueueRec r;
+            r.id          = i;
+            r.depth       = (uint8_t)uxQueueMessagesWaiting(q.q);
+            r.capacity    = q.capacity;
+            r.maxDepth    = q.maxDepth;
+            uint32_t ms   = (uint32_t)q.fullMaxRun * TELEMETRY_QUEUE_SAMPLE_MS;
+            r.fullMaxMs   = (uint16_t)(ms > 0xFFFF ? 0xFFFF : ms);
+            r.fullSamples = q.fullSamples;
+            if (names) emitName(Tlm::NAME_QUEUE, i, q.name);
+            emit(Tlm::REC_QUEUE, &r, sizeof(r));
+            q.maxDepth = 0; q.fullMaxRun = q.fullRun; q.fullSamples = 0;
+        }
+    }
+
+public:
+    // sinkMask: TELEMETRY_SINK_SERIAL | TELEMETRY_SINK_BLE
+    bool begin(uint8_t sinkMask) {
+        sinks = sinkMask;
+        if (sinks & TELEMETRY_SINK_BLE) bleBuf = xMessageBufferCreate(TELEMETRY_BLE_BUF);
+        return !(sinks & TELEMETRY_SINK_BLE) || bleBuf != nullptr;
+    }
+
+    void addQueue(const char* name, QueueHandle_t q, uint8_t capacity) {
+        if (!q || queueCount >= TELEMETRY_MAX_QUEUES) return;
+        queues[queueCount].q = q;
+        queues[queueCount].name = name;
+        queues[queueCount].capacity = capacity;
+        queueCount++;
+    }
+
+    void setLockSampler(LockSampler fn) { lockSampler = fn; }
+    void setUwbSampler(UwbSampler fn)   { uwbSampler = fn; }
+
+    // Dùng trong LockSampler
+    void emitLock(uint8_t id, const char* name, uint32_t waits, uint32_t timeouts,
+                  uint32_t p50Us, uint32_t p99Us, uint32_t maxUs) {
+        if (seq % TELEMETRY_NAME_EVERY == 0) emitName(Tlm::NAME_LOCK, id, name);
+        Tlm::LockRec r = { id, waits, timeouts, p50Us, p99Us, maxUs };
+        emit(Tlm::REC_LOCK, &r, sizeof(r));
+    }
+
+    // Dùng trong UwbSampler
+    void emitUwb(const Tlm::UwbCntRec& c, const Tlm::UwbLinkRec& l) {
+        emit(Tlm::REC_UWB_CNT, &c, sizeof(c));
+        emit(Tlm::REC_UWB_LINK, &l, sizeof(l));
+    }
+
+    // bleTask: lấy các frame đã xếp hàng, ghép nguyên frame vào out (≤ max byte)
+    size_t takeBle(uint8_t* out, size_t max) {
+        if (!bleBuf) return 0;
+        size_t used = 0;
+        while (max - used >= 9 + 40 && !xMessageBufferIsEmpty(bleBuf)) {
+            size_t n = xMessageBufferReceive(bleBuf, out + used, max - used, 0);
+            if (!n) break;
+            used += n;
+        }
+        return used;
+    }
+
+    // Vòng lặp của telemetryTask — không return
+    void run() {
+        TickType_t last = xTaskGetTickCount();
+        uint32_t fastPerPeriod = TELEMETRY_PERIOD_MS / TELEMETRY_QUEUE_SAMPLE_MS;
+        for (;;) {
+            for (uint32_t i = 0; i < fastPerPeriod; i++) {
+                vTaskDelayUntil(&last, pdMS_TO_TICKS(TELEMETRY_QUEUE_SAMPLE_MS));
+                sampleQueuesFast();
+            }
+            nowMs = millis();
+            bool names = (seq % TELEMETRY_NAME_EVERY) == 0;
+            Tlm::EndRec end;
+            sampleTasks(names, end.taskCount);
+            flushQueues(names);
+            if (lockSampler) lockSampler(*this);
+            if (uwbSampler) uwbSampler(*this);
+            sampleHeap();
+            end.seq = seq++;
+            end.dropped = dropped;
+            emit(Tlm::REC_END, &end, sizeof(end));
+        }
+    }
+};
+
+#endif // TELEMETRY_H
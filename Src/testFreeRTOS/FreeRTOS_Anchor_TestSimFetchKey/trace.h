@@ -0,0 +1,161 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+// ==================== Unlock latency trace ====================
+// Trace point có timestamp µs + session ID, ghi từ mọi task/callback (và ISR)
+// vào ring lock-free. Task priority thấp gọi flush() để in ra Serial dạng:
+//   TRC <side> <session> <point> <t_us> <arg>
+// Tools/trace_merge.py ghép log Tag + Anchor theo SESSION_BIND (4 byte đầu của
+// challenge — 2 bên cùng biết), căn đồng hồ bằng cặp AUTH (NTP-style) và báo
+// latency từng stage + percentile qua nhiều session.
+//
+// Cùng enum cho cả Tag và Anchor — file này giống nhau ở 2 sketch.
+
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE (128)   // lũy thừa của 2
+#endif
+
+enum TracePoint : uint8_t {
+    // Tag
+    TP_T_SCAN_START = 0,
+    TP_T_DEVICE_FOUND,
+    TP_T_CONNECTED,
+    TP_T_SERVICES_READY,     // discovery xong; arg = 1 nếu dùng GATT cache (fast reconnect)
+    TP_T_CHALLENGE_RX,
+    TP_T_AUTH_TX,
+    TP_T_AUTH_OK_RX,
+    TP_T_UWB_READY_TX,
+    TP_T_UWB_ACTIVE_RX,
+    TP_T_UWB_RANGING,        // uwbTask vào RANGING
+    TP_T_RANGE_OK,           // arg = khoảng cách filtered (cm), chỉ range đầu + range quyết định
+    TP_T_VERIFIED_TX,        // arg = khoảng cách (cm)
+    TP_T_RESUME_TX,          // gửi RESUME (session_ticket.h) thay vì chờ challenge
+    TP_T_SESSION_READY,      // auth xong; arg = 1 nếu resume bằng ticket
+    // Anchor
+    TP_A_CONNECTED = 32,
+    TP_A_CHALLENGE_SET,
+    TP_A_CHALLENGE_NOTIFY,
+    TP_A_AUTH_RX,
+    TP_A_AUTH_OK_TX,
+    TP_A_UWB_READY_RX,
+    TP_A_UWB_RANGING,        // uwbTask vào RANGING (sau initUWB)
+    TP_A_UWB_ACTIVE_TX,
+    TP_A_VERIFIED_RX,
+    TP_A_CAN_START,          // arg = CAN_CMD_*
+    TP_A_CAN_DONE,           // arg = carUnlocked sau sequence
+    TP_A_RESUME_RX,
+    TP_A_RESUME_DONE,        // arg = TicketIssuer::Result (0 = OK)
+    // Chung
+    TP_SESSION_BIND = 64,    // arg = 4 byte đầu challenge, hoặc nonce RESUME (little-endian)
+    TP_SESSION_END,
+};
+
+class Tracer {
+private:
+    struct Slot {
+        volatile uint32_t seq;   // = index + 1 khi đã ghi xong
+        uint32_t tUs;
+        uint32_t arg;
+        uint16_t session;
+        uint8_t  point;
+    };
+
+    Slot     ring[TRACE_RING_SIZE];
+    uint32_t head = 0;           // __atomic, nhiều producer
+    uint32_t tail = 0;           // chỉ flush() dùng
+    uint32_t dropped = 0;
+    volatile uint16_t session = 0;
+    char     side = '?';
+
+public:
+    static const char* name(uint8_t p) {
+        switch (p) {
+            case TP_T_SCAN_START:      return "T_SCAN_START";
+            case TP_T_DEVICE_FOUND:    return "T_DEVICE_FOUND";
+            case TP_T_CONNECTED:       return "T_CONNECTED";
+            case TP_T_SERVICES_READY:  return "T_SERVICES_READY";
+            case TP_T_CHALLENGE_RX:    return "T_CHALLENGE_RX";
+            case TP_T_AUTH_TX:         return "T_AUTH_TX";
+            case TP_T_AUTH_OK_RX:      return "T_AUTH_OK_RX";
+            case TP_T_UWB_READY_TX:    return "T_UWB_READY_TX";
+            case TP_T_UWB_ACTIVE_RX:   return "T_UWB_ACTIVE_RX";
+            case TP_T_UWB_RANGING:     return "T_UWB_RANGING";
+            case TP_T_RANGE_OK:        return "T_RANGE_OK";
+            case TP_T_VERIFIED_TX:     return "T_VERIFIED_TX";
+            case TP_T_RESUME_TX:       return "T_RESUME_TX";
+            case TP_T_SESSION_READY:   return "T_SESSION_READY";
+            case TP_A_CONNECTED:       return "A_CONNECTED";
+            case TP_A_CHALLENGE_SET:   return "A_CHALLENGE_SET";
+            case TP_A_CHALLENGE_NOTIFY:return "A_CHALLENGE_NOTIFY";
+            case TP_A_AUTH_RX:         return "A_AUTH_RX";
+            case TP_A_AUTH_OK_TX:      return "A_AUTH_OK_TX";
+            case TP_A_UWB_READY_RX:    return "A_UWB_READY_RX";
+            case TP_A_UWB_RANGING:     return "A_UWB_RANGING";
+            case TP_A_UWB_ACTIVE_TX:   return "A_UWB_ACTIVE_TX";
+            case TP_A_VERIFIED_RX:     return "A_VERIFIED_RX";
+            case TP_A_CAN_START:       return "A_CAN_START";
+            case TP_A_CAN_DONE:        return "A_CAN_DONE";
+            case TP_A_RESUME_RX:       return "A_RESUME_RX";
+            case TP_A_RESUME_DONE:     return "A_RESUME_DONE";
+            case TP_SESSION_BIND:      return "SESSION_BIND";
+            case TP_SESSION_END:       return "SESSION_END";
+            default:                   return "?";
+        }
+    }
+
+    void begin(char sideId) { side = sideId; }
+
+    // Bắt đầu session mới (Tag: lúc scan, Anchor: lúc Tag connect)
+    uint16_t newSession() { return ++session; }
+    uint16_t currentSession() const { return session; }
+
+    // Gọi được từ task, BLE callback và ISR — không lock, không block
+    void IRAM_ATTR mark(TracePoint p, uint32_t arg = 0) {
+        uint32_t i = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+        Slot& s = ring[i & (TRACE_RING_SIZE - 1)];
+        s.seq     = 0;
+        s.tUs     = (uint32_t)micros();
+        s.arg     = arg;
+        s.session = session;
+        s.point   = p;
+        __atomic_store_n(&s.seq, i + 1, __ATOMIC_RELEASE);
+    }
+
+    // Gắn session local với ID chung (4 byte đầu challenge)
+    void bind(const uint8_t* challenge) {
+        uint32_t id;
+        memcpy(&id, challenge, 4);
+        mark(TP_SESSION_BIND, id);
+    }
+
+    // Consumer duy nhất (task priority thấp). In tối đa maxLines dòng.
+    void flush(uint8_t maxLines) {
+        uint32_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+        if (h - tail > TRACE_RING_SIZE) {            // producer đã ghi đè phần chưa đọc
+            dropped += h - tail - TRACE_RING_SIZE;
+            tail = h - TRACE_RING_SIZE;
+        }
+        while (maxLines && tail != h) {
+            const Slot& s = ring[tail & (TRACE_RING_SIZE - 1)];
+            uint32_t seq = __atomic_load_n(&s.seq, __ATOMIC_ACQUIRE);
+            if (seq != tail + 1) {
+                if ((int32_t)(seq - (tail + 1)) > 0) { dropped++; tail++; continue; }  // đã bị ghi đè
+                break;                                                              // đang ghi dở
+            }
+            uint32_t tUs = s.tUs, arg = s.arg;
+            uint16_t sess = s.session;
+            uint8_t  p = s.point;
+            if (__atomic_load_n(&s.seq, __ATOMIC_ACQUIRE) != tail + 1) { dropped++; tail++; continue; }
+            Serial.printf("TRC %c %u %s %lu %lu\n", side, (unsigned)sess, name(p),
+                          (unsigned long)tUs, (unsigned long)arg);
+            tail++;
+            maxLines--;
+        }
+    }
+
+    uint32_t getDropped() const { return dropped; }
+};
+
+#endif // TRACE_H
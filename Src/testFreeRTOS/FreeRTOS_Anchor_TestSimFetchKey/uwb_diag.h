@@ -0,0 +1,186 @@
+#ifndef UWB_DIAG_H
+#define UWB_DIAG_H
+
+#include <Arduino.h>
+#include <math.h>
+#include "dlog.h"
+
+// ==================== UWB link diagnostics ====================
+// Thống kê link UWB theo session (initUWB → STOP), gần như không tốn gì trong vòng đo:
+//  - Event counter DW3000 (dwt_configeventcounters): RX good / CRC lỗi / PHR lỗi /
+//    sync loss / SFD timeout / preamble reject / TX... Chip tự đếm; uwbTask đọc + xoá
+//    mỗi UWB_DIAG_COUNTER_MS giữa 2 vòng responder (RX đã tắt) và cộng dồn vào u32
+//    — counter 8/12 bit không kịp bão hoà.
+//  - CIA diagnostics: mặc định CIA chỉ log tập rút gọn (DW_CIA_DIAG_LOG_OFF). Cứ
+//    UWB_DIAG_SAMPLE_EVERY Poll, arm() bật DW_CIA_DIAG_LOG_ALL cho đúng 1 lần RX;
+//    collect() đọc sau khi Response đã phát xong (ngoài cửa sổ Poll RX → Response TX),
+//    tính first-path / RX power rồi tắt lại.
+//  - STS quality: uwbRespond đọc sẵn mỗi frame; stsOk() chỉ gọi sau khi header Poll
+//    khớp → frame lạ không vào thống kê và không chiếm lượt CIA sample.
+// Công thức (DW3000 User Manual 4.7), N = số symbol tích luỹ, A = 121.7 (PRF 64),
+// D = DGC decision (DGC_DBG[30:28], 0 nếu DGC tắt):
+//   RX = 10·log10(C·2^21 / N²) + 6D − A
+//   FP = 10·log10((F1² + F2² + F3²) / N²) + 6D − A     (F có 2 bit thập phân)
+// RX − FP lớn (> ~6 dB) thường là NLOS / multipath mạnh.
+// uwbTask ghi; task khác chỉ đọc qua snapshot() (bản publish mỗi lần đọc counter).
+
+#ifndef DGC_DBG_ID
+#define DGC_DBG_ID              (0x30060)
+#endif
+#define DGC_DBG_DECISION_SHIFT  (28U)
+#define DGC_DBG_DECISION_MASK   (0x70000000UL)
+#define UWB_DIAG_A_PRF64        (121.7f)
+
+// dBm × 10 (hoặc STS quality index) — min/avg/max
+struct UwbLevel {
+    int16_t  min = INT16_MAX;
+    int16_t  max = INT16_MIN;
+    int64_t  sum = 0;
+    uint32_t n   = 0;
+
+    void add(int16_t v) {
+        if (v < min) min = v;
+        if (v > max) max = v;
+        sum += v;
+        n++;
+    }
+    int16_t avg() const { return n ? (int16_t)(sum / (int64_t)n) : 0; }
+};
+
+// Cộng dồn dwt_deviceentcnts_t trong 1 session
+struct UwbEventTotals {
+    uint32_t rxGood, crcBad, phrErr, syncLoss, sfdTimeout, preambleTimeout, preambleReject;
+    uint32_t rxTimeout, filterReject, overrun, tx, halfPeriodWarn, spiCrcErr;
+};
+
+class UwbDiag {
+public:
+    struct Session {
+        uint16_t       id = 0;        // 0 = chưa có session
+        uint32_t       startMs = 0;
+        UwbEventTotals ev = {};
+        UwbLevel       fp, rx, sts;   // fp/rx: dBm × 10, sts: quality index
+        uint32_t       stsRejected = 0;
+    };
+
+private:
+    Session      cur;
+    Session      pub;
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+    dwt_rxdiag_t diag;              // ~200 byte — không để trên stack uwbTask
+    uint16_t     nextId      = 0;
+    uint16_t     sinceSample = 0;
+    bool         logAll      = false;
+    bool         gotPoll     = false;
+    uint32_t     counterAt   = 0;
+
+    void publish() {
+        portENTER_CRITICAL(&mux);
+        pub = cur;
+        portEXIT_CRITICAL(&mux);
+    }
+
+    static int16_t dbm10(float linear, float corr) {
+        return (int16_t)lroundf((10.0f * log10f(linear) + corr) * 10.0f);
+    }
+
+public:
+    // initUWB, sau dwt_configure: session mới, counter xoá + bật, CIA log rút gọn
+    void begin() {
+        cur         = Session();
+        if (++nextId == 0) nextId = 1;
+        cur.id      = nextId;
+        cur.startMs = millis();
+        dwt_configeventcounters(1);
+        dwt_configciadiag(DW_CIA_DIAG_LOG_OFF);
+        logAll      = false;
+        sinceSample = 0;
+        counterAt   = millis();
+        publish();
+    }
+
+    // Trước dwt_rxenable, caller giữ bus SPI
+    void arm() {
+        gotPoll = false;
+        if (UWB_DIAG_SAMPLE_EVERY && !logAll && sinceSample + 1U >= UWB_DIAG_SAMPLE_EVERY) {
+            dwt_configciadiag(DW_CIA_DIAG_LOG_ALL);
+            logAll = true;
+        }
+    }
+
+    // uwbRespond, sau check header Poll — chỉ cộng số, không SPI
+    void stsOk(int16_t quality) { cur.sts.add(quality); gotPoll = true; sinceSample++; }
+    void stsReject()            { cur.stsRejected++; }
+
+    // Sau uwbRespond (Response đã phát xong), caller giữ bus SPI.
+    // Chỉ làm việc ở Poll được chọn: 216 byte CIA + 4 byte DGC.
+    void collect() {
+        if (!logAll || !gotPoll) return;
+        dwt_readdiagnostics(&diag);
+        uint32_t dgc = (dwt_read32bitoffsetreg(DGC_DBG_ID, 0) & DGC_DBG_DECISION_MASK) >> DGC_DBG_DECISION_SHIFT;
+        dwt_configciadiag(DW_CIA_DIAG_LOG_OFF);
+        logAll      = false;
+        sinceSample = 0;
+
+        if (!diag.ipatovAccumCount || !diag.ipatovPower) return;
+        float n2   = (float)diag.ipatovAccumCount * diag.ipatovAccumCount;
+        float corr = 6.0f * dgc - UWB_DIAG_A_PRF64;
+        float f1 = diag.ipatovF1 / 4.0f, f2 = diag.ipatovF2 / 4.0f, f3 = diag.ipatovF3 / 4.0f;
+        cur.rx.add(dbm10((float)diag.ipatovPower * 2097152.0f / n2, corr));
+        float fpe = f1 * f1 + f2 * f2 + f3 * f3;
+        if (fpe > 0) cur.fp.add(dbm10(fpe / n2, corr));
+    }
+
+    bool counterDue() const { return millis() - counterAt >= UWB_DIAG_COUNTER_MS; }
+
+    // Giữa 2 vòng responder (RX tắt) hoặc trước deinit, caller giữ bus SPI.
+    // Đọc rồi xoá: sự kiện rơi đúng giữa 2 lệnh bị mất — chấp nhận được cho thống kê.
+    void readCounters() {
+        dwt_deviceentcnts_t c;
+        dwt_readeventcounters(&c);
+        dwt_configeventcounters(1);
+        counterAt = millis();
+        UwbEventTotals& e = cur.ev;
+        e.rxGood          += c.CRCG;
+        e.crcBad          += c.CRCB;
+        e.phrErr          += c.PHE;
+        e.syncLoss        += c.RSL;
+        e.sfdTimeout      += c.SFDTO;
+        e.preambleTimeout += c.PTO;
+        e.preambleReject  += c.PREJ;
+        e.rxTimeout       += c.RTO;
+        e.filterReject    += c.ARFE;
+        e.overrun         += c.OVER;
+        e.tx              += c.TXF;
+        e.halfPeriodWarn  += c.HPW;
+        e.spiCrcErr       += c.CRCE;
+        publish();
+    }
+
+    // Task bất kỳ
+    void snapshot(Session& out) {
+        portENTER_CRITICAL(&mux);
+        out = pub;
+        portEXIT_CRITICAL(&mux);
+    }
+
+    void print() const {
+        const Session& s = cur;
+        if (!s.id) return;
+        const UwbEventTotals& e = s.ev;
+        DLOGI("[UWBDIAG] session %u (%lu s): rx ok %lu tx %lu", s.id, (unsigned long)((millis() - s.startMs) / 1000U),
+              (unsigned long)e.rxGood, (unsigned long)e.tx);
+        DLOGI("[UWBDIAG] crc-bad %lu phr-err %lu sync-loss %lu sfd-to %lu", (unsigned long)e.crcBad,
+              (unsigned long)e.phrErr, (unsigned long)e.syncLoss, (unsigned long)e.sfdTimeout);
+        DLOGI("[UWBDIAG] preamble-to %lu preamble-rej %lu overrun %lu spi-crc %lu", (unsigned long)e.preambleTimeout,
+              (unsigned long)e.preambleReject, (unsigned long)e.overrun, (unsigned long)e.spiCrcErr);
+        if (s.rx.n)
+            DLOGI("[UWBDIAG] rx %d / fp %d dBm x10 (avg), fp min %d, %lu samples", s.rx.avg(), s.fp.avg(),
+                  s.fp.min, (unsigned long)s.rx.n);
+        if (s.sts.n || s.stsRejected)
+            DLOGI("[UWBDIAG] sts quality min %d avg %d max %d, %lu rejected", s.sts.min, s.sts.avg(), s.sts.max,
+                  (unsigned long)s.stsRejected);
+    }
+};
+
+#endif // UWB_DIAG_H
@@ -0,0 +1,152 @@
+#ifndef UWB_SNIFF_H
+#define UWB_SNIFF_H
+
+#include <Arduino.h>
+#include "dlog.h"
+
+// ==================== UWB sniff mode ====================
+// Anchor chờ Poll gần như suốt thời gian RANGING — RX bật liên tục là phần tốn
+// điện nhất của DW3000. SNIFF (dwt_setsniffmode, User Manual 4.5): receiver bật
+// (timeOn+1) PAC rồi tắt timeOff × 128/125 µs, lặp lại tới khi bắt được preamble;
+// bắt được thì RX bật hẳn tới hết frame như bình thường.
+//
+// Tuning theo uwbConfig (PLEN 1024, PAC 32, PRF 64 → symbol 1017.63 ns):
+//   ON  = 2 PAC = 65 µs, OFF = 255 → 261 µs  → RX bật ~20% lúc chờ.
+//   Tệ nhất: preamble tới ngay sau khi 1 cửa sổ ON bắt đầu (không đủ để detect)
+//   → detect ở cửa sổ ON kế tiếp, đã tiêu ON + OFF + ON = 391 µs của preamble
+//   1042 µs → còn 19 PAC cho acquisition/SFD (UWB_SNIFF_MIN_ACQ_PACS, kiểm lúc compile).
+//   Timestamp lấy ở RMARKER (sau SFD) → không thêm latency cho Poll bắt được;
+//   cái giá duy nhất là Poll bị lỡ, Tag đo lại ở slot sau.
+//
+// Đo: Tag tăng sequence number (byte ALL_MSG_SN_IDX) mỗi Poll, kể cả Poll không
+// tới → khoảng trống sequence = Poll bị lỡ. Mỗi mode (FULL / SNIFF) có thống kê
+// riêng: detection probability = nhận / (nhận + lỡ), khoảng cách trung bình giữa
+// 2 Poll liên tiếp (chênh lệch giữa 2 mode = latency thêm), RX-on ước lượng.
+// UWB_SNIFF_AB: đổi mode mỗi UWB_SNIFF_AB_WINDOW_MS → so 2 mode cùng điều kiện.
+// Chỉ đúng khi 1 Tag ranging (Poll không mang địa chỉ Tag).
+// Chỉ uwbTask dùng.
+
+#define UWB_SNIFF_OFF  (0)
+#define UWB_SNIFF_ON   (1)
+#define UWB_SNIFF_AB   (2)
+
+#define UWB_PRF64_SYMBOL_PS   (1017630UL)   // 1 preamble symbol, PRF 64 MHz
+#define UWB_SNIFF_OFF_UNIT_PS (1024000UL)   // 128/125 µs
+
+#define UWB_PAC_NS           ((uint32_t)(UWB_PAC_SYMBOLS * UWB_PRF64_SYMBOL_PS / 1000UL))
+#define UWB_SNIFF_ON_NS      ((uint32_t)((UWB_SNIFF_ON_PACS + 1) * UWB_PAC_NS))
+#define UWB_SNIFF_OFF_NS     ((uint32_t)(UWB_SNIFF_OFF_UNITS * UWB_SNIFF_OFF_UNIT_PS / 1000UL))
+#define UWB_PREAMBLE_NS      ((uint32_t)(UWB_PLEN_SYMBOLS * UWB_PRF64_SYMBOL_PS / 1000UL))
+#define UWB_SNIFF_WORST_NS   (2 * UWB_SNIFF_ON_NS + UWB_SNIFF_OFF_NS)
+#define UWB_POLL_AIR_US      (UWB_PREAMBLE_NS / 1000U + 350U)   // preamble + SFD/PHR/payload/STS
+
+static_assert(UWB_SNIFF_ON_PACS >= 1 && UWB_SNIFF_ON_PACS <= 15, "UWB_SNIFF_ON_PACS: 1..15");
+static_assert(UWB_SNIFF_OFF_UNITS <= 255, "UWB_SNIFF_OFF_UNITS: tối đa 255");
+static_assert(UWB_PREAMBLE_NS > UWB_SNIFF_WORST_NS &&
+              (UWB_PREAMBLE_NS - UWB_SNIFF_WORST_NS) / UWB_PAC_NS >= UWB_SNIFF_MIN_ACQ_PACS,
+              "Sniff OFF quá dài so với preamble — Poll sẽ bị lỡ");
+
+class UwbSniff {
+public:
+    enum Mode : uint8_t { FULL = 0, SNIFF, MODES };
+
+    struct Stats {
+        uint32_t polls     = 0;   // Poll hợp lệ
+        uint32_t missed    = 0;   // khoảng trống sequence
+        uint32_t rxErrors  = 0;   // có frame nhưng PHR/CRC/STS lỗi
+        uint64_t listenUs  = 0;   // thời gian RX armed chờ frame
+        uint64_t gapUsSum  = 0;   // Poll → Poll kế (cặp liên tiếp hợp lệ)
+        uint32_t gapCount  = 0;
+    };
+
+private:
+    Stats    stats[MODES];
+    Mode     cur        = FULL;
+    int8_t   applied    = -1;     // mode đang ghi trong DW3000, -1 = chưa (sau reset)
+    uint32_t windowAt   = 0;
+    bool     havePrev   = false;
+    uint8_t  prevSeq    = 0;
+    uint32_t prevPollUs = 0;
+
+    static Mode configured() { return UWB_SNIFF_MODE == UWB_SNIFF_OFF ? FULL : SNIFF; }
+
+public:
+    static const char* name(Mode m) { return m == SNIFF ? "sniff" : "full"; }
+
+    static uint16_t dutyPermille() {
+        return (uint16_t)((uint64_t)UWB_SNIFF_ON_NS * 1000U / (UWB_SNIFF_ON_NS + UWB_SNIFF_OFF_NS));
+    }
+
+    // Sau dwt_configure (DW3000 vừa reset → thanh ghi SNIFF = 0)
+    void begin() {
+        applied  = -1;
+        havePrev = false;
+        cur      = configured();
+        windowAt = millis();
+        DLOGI("[SNIFF] on %lu ns off %lu ns duty %u/1000, worst-case %lu PAC left for acquisition",
+              (unsigned long)UWB_SNIFF_ON_NS, (unsigned long)UWB_SNIFF_OFF_NS, dutyPermille(),
+              (unsigned long)((UWB_PREAMBLE_NS - UWB_SNIFF_WORST_NS) / UWB_PAC_NS));
+    }
+
+    // Trước dwt_rxenable, caller giữ bus SPI. Chỉ ghi thanh ghi khi mode đổi.
+    void arm() {
+#if UWB_SNIFF_MODE == UWB_SNIFF_AB
+        if (millis() - windowAt >= UWB_SNIFF_AB_WINDOW_MS) {
+            windowAt = millis();
+            cur      = cur == FULL ? SNIFF : FULL;
+            havePrev = false;   // không tính khoảng cách vắt qua 2 mode
+        }
+#endif
+        if (applied == (int8_t)cur) return;
+        if (cur == SNIFF) dwt_setsniffmode(1, UWB_SNIFF_ON_PACS, UWB_SNIFF_OFF_UNITS);
+        else              dwt_setsniffmode(0, 0, 0);
+        applied = (int8_t)cur;
+    }
+
+    void listened(uint32_t us) { stats[cur].listenUs += us; }
+    void rxError()             { stats[cur].rxErrors++; }
+
+    // Poll hợp lệ, seq = byte sequence Tag gửi
+    void poll(uint8_t seq) {
+        Stats&   s   = stats[cur];
+        uint32_t now = micros();
+        s.polls++;
+        if (havePrev && now - prevPollUs < UWB_SNIFF_GAP_MAX_MS * 1000UL) {
+            uint8_t gap = (uint8_t)(seq - prevSeq);
+            if (gap >= 1 && gap <= UWB_SNIFF_GAP_MAX_SEQ) {
+                s.missed   += gap - 1;
+                s.gapUsSum += now - prevPollUs;
+                s.gapCount++;
+            }
+        }
+        havePrev   = true;
+        prevSeq    = seq;
+        prevPollUs = now;
+    }
+
+    // Tag SUSPEND/STOP: khoảng trống sau đó không phải Poll bị lỡ
+    void pause() { havePrev = false; }
+
+    const Stats& get(Mode m) const { return stats[m]; }
+
+    void print() const {
+        for (int m = 0; m < MODES; m++) {
+            const Stats& s = stats[m];
+            if (!s.polls && !s.listenUs) continue;
+            uint32_t seen   = s.polls + s.missed;
+            uint32_t pDet   = seen ? (uint32_t)((uint64_t)s.polls * 1000U / seen) : 0;
+            uint32_t gapMs  = s.gapCount ? (uint32_t)(s.gapUsSum / s.gapCount / 1000U) : 0;
+            // RX-on / thời gian chờ: FULL = 1000; SNIFF = phần chờ × duty + frame nhận (RX bật hẳn)
+            uint64_t air    = (uint64_t)(s.polls + s.rxErrors) * UWB_POLL_AIR_US;
+            if (air > s.listenUs) air = s.listenUs;
+            uint64_t rxOn   = m == SNIFF ? (s.listenUs - air) * dutyPermille() / 1000U + air : s.listenUs;
+            uint32_t rxOnPm = s.listenUs ? (uint32_t)(rxOn * 1000U / s.listenUs) : 0;
+            DLOGI("[SNIFF] %s: polls %lu missed %lu rx-err %lu", name((Mode)m),
+                  (unsigned long)s.polls, (unsigned long)s.missed, (unsigned long)s.rxErrors);
+            DLOGI("[SNIFF] %s: detect %lu/1000 poll gap %lu ms rx-on %lu/1000", name((Mode)m),
+                  (unsigned long)pDet, (unsigned long)gapMs, (unsigned long)rxOnPm);
+        }
+    }
+};
+
+#endif // UWB_SNIFF_H
@@ -0,0 +1,59 @@
+#ifndef VEHICLE_STATE_H
+#define VEHICLE_STATE_H
+
+#include <mcp2515.h>
+#include "anchor_config.h"
+
+// ==================== Vehicle State Decoder ====================
+// Giải mã frame broadcast của body ECU (CAN_BODY_STATUS_ID) để biết trạng thái
+// khóa/cửa thật của xe thay vì tin vào kết quả TX của MCP2515.
+// Acceptance filter cho ID này khai báo trong can_filters.h.
+
+namespace VehicleState {
+
+enum LockState : uint8_t {
+  LOCK_UNKNOWN  = 0,   // chưa nhận frame status nào
+  LOCK_LOCKED   = 1,
+  LOCK_UNLOCKED = 2
+};
+
+} // namespace VehicleState
+
+class VehicleStateDecoder {
+private:
+  volatile VehicleState::LockState lockState = VehicleState::LOCK_UNKNOWN;
+  volatile bool     doorOpen     = false;
+  volatile uint32_t lastUpdateMs = 0;
+  volatile uint32_t frameCount   = 0;
+
+public:
+  // Trả về true nếu lock state thay đổi so với lần trước
+  bool feed(const struct can_frame& frame) {
+    if (frame.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG)) return false;
+    if ((frame.can_id & CAN_SFF_MASK) != CAN_BODY_STATUS_ID) return false;
+    if (frame.can_dlc <= CAN_LOCK_STATE_BYTE || frame.can_dlc <= CAN_DOOR_STATE_BYTE) return false;
+
+    bool unlocked = (frame.data[CAN_LOCK_STATE_BYTE] & CAN_LOCK_STATE_MASK) == CAN_LOCK_STATE_UNLOCKED;
+    VehicleState::LockState next = unlocked ? VehicleState::LOCK_UNLOCKED : VehicleState::LOCK_LOCKED;
+
+    doorOpen     = (frame.data[CAN_DOOR_STATE_BYTE] & CAN_DOOR_STATE_MASK) != 0;
+    lastUpdateMs = millis();
+    frameCount++;
+
+    bool changed = (next != lockState);
+    lockState = next;
+    return changed;
+  }
+
+  VehicleState::LockState getLockState() const { return lockState; }
+  bool     isDoorOpen()   const { return doorOpen; }
+  uint32_t getFrameCount() const { return frameCount; }
+
+  // State chỉ đáng tin nếu frame status mới hơn CAN_STATE_STALE_MS
+  bool isFresh() const {
+    return lockState != VehicleState::LOCK_UNKNOWN &&
+           (millis() - lastUpdateMs) < CAN_STATE_STALE_MS;
+  }
+};
+
+#endif // VEHICLE_STATE_H
@@ -4,6 +4,17 @@
 #include <SPI.h>
 #include "dw3000.h"
 #include "tag_config.h"
+#include "uwb_fsm.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "dlog.h"
+#include "boot_profile.h"
+#include "gatt_cache.h"
+#include "session_ticket.h"
+#include "hmac_engine.h"
+#include "key_store.h"
+#include "low_power.h"
+#include "cir_nlos.h"
 #include <mbedtls/md.h>
 
 // =============================================================================
@@ -15,9 +26,21 @@ static EventGroupHandle_t sysEvents;
 #define EVT_CONNECTED        (1 << 0)  // BLE kết nối Anchor thành công
 #define EVT_AUTHED           (1 << 1)  // Auth HMAC-SHA256 OK
 #define EVT_ANCHOR_UWB_READY (1 << 2)  // Nhận "UWB_ACTIVE" notification từ Anchor
-#define EVT_UWB_INIT         (1 << 3)  // Signal cho uwbTask: bắt đầu DW3000
-#define EVT_UWB_STOP         (1 << 4)  // Signal cho uwbTask: dừng DW3000
 #define EVT_DEVICE_FOUND     (1 << 5)  // BLE scan tìm thấy Anchor
+#define EVT_CHALLENGE        (1 << 6)  // Nhận challenge qua notify
+#define EVT_RESUME_FAIL      (1 << 7)  // Anchor từ chối RESUME ticket
+
+// UWB state machine — START/STOP từ bleTask + DW3000 IRQ qua task notification (xem uwb_fsm.h)
+static UwbFsm uwbFsm;
+
+// Unlock latency trace — flush ra Serial từ bleTask (xem trace.h, Tools/trace_merge.py)
+static Tracer tracer;
+static bool   traceFirstRange = false;   // chỉ mark range OK đầu tiên của mỗi lần RANGING
+
+#if TELEMETRY_ENABLE
+// Telemetry — task/queue/heap sampling, stream qua Serial
+static Telemetry telemetry;
+#endif
 
 // Queue: uwbTask gửi BLE write requests → bleTask (Core 0) thực hiện
 // Tránh cross-core BLE writeValue từ uwbTask (Core 1) gây disconnect
@@ -46,8 +69,21 @@ static BLERemoteCharacteristic* pRemoteCharacteristic = nullptr;
 static BLERemoteCharacteristic* pChallengeChar        = nullptr;
 static BLERemoteCharacteristic* pAuthChar             = nullptr;
 
+// Handle/MTU Anchor lưu NVS — reconnect bỏ qua discovery (xem gatt_cache.h)
+static GattCache gattCache;
+
+// Session ticket từ Anchor — reconnect nhanh không qua challenge (session_ticket.h)
+static TicketWallet ticketWallet;
+
+// Pairing key + STS dẫn xuất sẵn (key_store.h) — nạp 1 lần lúc boot
+static KeyStore keyStore;
 static uint8_t pairingKey[16];
 
+// Radio-on time + PM lock (low_power.h) — chỉ uwbTask
+static UwbPowerMeter   uwbPower;
+static EspPowerManager espPower;
+static uint8_t notifiedChallenge[16];   // ghi bởi notifyCallback trước khi set EVT_CHALLENGE
+
 // =============================================================================
 // UWB frame buffers + config
 // =============================================================================
@@ -59,10 +95,13 @@ static dwt_config_t uwbConfig = {
     1001, DWT_STS_MODE_1, DWT_STS_LEN_256, DWT_PDOA_M0
 };
 
-// STS key/IV — derived từ pairingKey, phải khớp với Anchor
+// STS key/IV — copy từ keyStore (dẫn xuất từ pairing key), phải khớp với Anchor
 static dwt_sts_cp_key_t sts_key;
 static dwt_sts_cp_iv_t  sts_iv;
 static bool stsConfigured = false;
+#if UWB_LP_ENABLE
+static bool dwAsleep = false;           // DW3000 deep sleep — không SPI tới khi uwbWake()
+#endif
 extern dwt_txconfig_t txconfig_options;
 
 static uint8_t tx_poll_msg[] = {0x41U,0x88U,0U,0xCAU,0xDEU,'W','A','V','E',0xE0U,0U,0U};
@@ -71,27 +110,32 @@ static uint8_t  frame_seq_nb = 0U;
 static uint8_t  rx_buffer[MSG_BUFFER_SIZE];
 
 // =============================================================================
-// Distance filter (moving average)
+// Distance filter (weighted moving average)
 // =============================================================================
 
 // float thay double: ESP32-S3 FPU chỉ hỗ trợ single-precision hardware
 // double trên ESP32-S3 chạy bằng software emulation (~10x chậm hơn float)
+// Trọng số: 1 cho mẫu LOS, CIR_NLOS_WEIGHT cho mẫu NLOS (cir_nlos.h) — chắn thoáng qua
+// chỉ kéo trung bình ít; chắn suốt cửa sổ thì mọi mẫu cùng trọng số → như boxcar cũ.
 static float   distBuf[DIST_FILTER_SIZE] = {};
+static float   distW[DIST_FILTER_SIZE]   = {};
 static uint8_t distBufIdx  = 0;
 static bool    distBufFull = false;
 
-static float applyDistanceFilter(float raw) {
+static float applyDistanceFilter(float raw, float weight) {
     distBuf[distBufIdx] = raw;
+    distW[distBufIdx]   = weight;
     distBufIdx = (distBufIdx + 1) % DIST_FILTER_SIZE;
     if (distBufIdx == 0) distBufFull = true;
     uint8_t count = distBufFull ? DIST_FILTER_SIZE : distBufIdx;
-    float sum = 0.0f;
-    for (uint8_t i = 0; i < count; i++) sum += distBuf[i];
-    return sum / count;
+    float sum = 0.0f, wsum = 0.0f;
+    for (uint8_t i = 0; i < count; i++) { sum += distBuf[i] * distW[i]; wsum += distW[i]; }
+    return sum / wsum;
 }
 
 static void resetDistanceFilter() {
     memset(distBuf, 0, sizeof(distBuf));
+    memset(distW, 0, sizeof(distW));
     distBufIdx  = 0;
     distBufFull = false;
 }
@@ -100,34 +144,56 @@ static void resetDistanceFilter() {
 // Crypto helpers
 // =============================================================================
 
-static void hexStringToBytes(const char* hex, uint8_t* bytes, size_t length) {
-    for (size_t i = 0; i < length; i++)
-        sscanf(hex + 2 * i, "%2hhx", &bytes[i]);
-}
-
+// Key schedule (ipad/opad midstate) tính 1 lần, dựng lại khi key đổi — chỉ bleTask gọi
 static bool computeHMAC(const uint8_t* key, size_t keyLen,
                         const uint8_t* data, size_t dataLen,
                         uint8_t* output) {
-    const mbedtls_md_info_t* md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
-    return (mbedtls_md_hmac(md, key, keyLen, data, dataLen, output) == 0);
-}
-
-static void printHex(const char* label, const uint8_t* data, size_t length) {
-    Serial.print(label);
-    for (size_t i = 0; i < length; i++) {
-        if (data[i] < 0x10) Serial.print("0");
-        Serial.print(data[i], HEX);
+    static HmacSha256Key schedule;
+    static uint8_t       scheduleKey[16];
+    if (keyLen != sizeof(scheduleKey)) return false;
+    if (!schedule.valid() || memcmp(scheduleKey, key, keyLen) != 0) {
+        if (!schedule.begin(key, keyLen)) return false;
+        memcpy(scheduleKey, key, keyLen);
     }
-    Serial.println();
+    return schedule.compute(data, dataLen, output);
 }
 
 // =============================================================================
 // UWB init / deinit
 // =============================================================================
 
+// DW3000 IRQ — chỉ đánh thức uwbTask
+static void IRAM_ATTR uwbIrqIsr() {
+    uwbFsm.irqFromISR();
+}
+
+// Thanh ghi ngoài dwt_configure — sau initUWB và sau mỗi lần wake (không chắc còn
+// nguyên qua deep sleep; vài chục byte SPI)
+static void uwbApplyRuntimeConfig() {
+    dwt_configuretxrf(&txconfig_options);
+    dwt_setrxantennadelay(RX_ANT_DLY);
+    dwt_settxantennadelay(TX_ANT_DLY);
+    dwt_setrxaftertxdelay(POLL_TX_TO_RESP_RX_DLY_UUS);
+    dwt_setrxtimeout(RESP_RX_TIMEOUT_UUS);
+    dwt_setlnapamode(DWT_LNA_ENABLE | DWT_PA_ENABLE);
+#if CIR_NLOS_ENABLE
+    // First path index (IP_DIAG_8) chỉ được CIA ghi khi log đầy đủ
+    dwt_configciadiag(DW_CIA_DIAG_LOG_ALL);
+#endif
+
+    // IRQ khi nhận Response / RX lỗi / RX timeout → uwbTask thức dậy, không poll SPI
+    dwt_setinterrupt(DWT_INT_RFCG | DWT_INT_RPHE | DWT_INT_RFCE | DWT_INT_RFSL |
+                     DWT_INT_RFTO | DWT_INT_RXPTO | DWT_INT_SFDT, 0, DWT_ENABLE_INT_ONLY);
+
+    dwt_configurestskey(&sts_key);
+    dwt_configurestsiv(&sts_iv);
+    dwt_configurestsloadiv();
+}
+
 static bool initUWB() {
     if (uwbInitialized) return true;
     Serial.println("[uwbTask] UWB: initializing...");
+    espPower.hold();
 
     spiBegin(PIN_IRQ, PIN_RST);
     { extern uint8_t _ss; _ss = PIN_SS; }
@@ -143,41 +209,53 @@ static bool initUWB() {
     if (retries <= 0) { Serial.println("UWB: IDLE_RC timeout"); goto fail; }
     if (dwt_initialise(DWT_DW_INIT) == DWT_ERROR) { Serial.println("UWB: init failed"); goto fail; }
 
+#if UWB_LP_ENABLE
+    dwt_setleds(DWT_LEDS_DISABLE);
+#else
     dwt_setleds(DWT_LEDS_ENABLE | DWT_LEDS_INIT_BLINK);
+#endif
     if (dwt_configure(&uwbConfig) != 0) { Serial.println("UWB: configure failed"); goto fail; }
 
-    dwt_configuretxrf(&txconfig_options);
-    dwt_setrxantennadelay(RX_ANT_DLY);
-    dwt_settxantennadelay(TX_ANT_DLY);
-    dwt_setrxaftertxdelay(POLL_TX_TO_RESP_RX_DLY_UUS);
-    dwt_setrxtimeout(RESP_RX_TIMEOUT_UUS);
-    dwt_setlnapamode(DWT_LNA_ENABLE | DWT_PA_ENABLE);
-
-    // Derive STS key từ pairingKey — phải khớp với Anchor
-    memcpy(&sts_key, pairingKey, sizeof(sts_key));
-    sts_iv.iv0 = 0x00000001U;
-    sts_iv.iv1 = 0x00000000U;
-    sts_iv.iv2 = 0x00000000U;
-    sts_iv.iv3 = 0x00000000U;
-    dwt_configurestskey(&sts_key);
-    dwt_configurestsiv(&sts_iv);
-    dwt_configurestsloadiv();
+    // STS key/IV dẫn xuất sẵn trong keyStore — phải khớp với Anchor
+    memcpy(&sts_key, keyStore.stsKey(), sizeof(sts_key));
+    memcpy(&sts_iv,  keyStore.stsIv(),  sizeof(sts_iv));
+    uwbApplyRuntimeConfig();
+    attachInterrupt(digitalPinToInterrupt(PIN_IRQ), uwbIrqIsr, RISING);
     stsConfigured = true;
 
+#if UWB_LP_ENABLE
+    // Wake: CSn, config AON nạp lại + PGF calibration. Không dùng sleep counter: đơn vị
+    // 4096 chu kỳ LP osc (~120–270 ms) thô hơn 1 slot.
+    dwt_configuresleep(DWT_CONFIG | DWT_PGFCAL, DWT_PRES_SLEEP | DWT_WAKE_CSN | DWT_SLP_EN);
+    dwAsleep = false;
+#endif
     uwbInitialized = true;
+    uwbPower.enter(UWB_PWR_AWAKE);
     Serial.println("[uwbTask] UWB: ready (STS mode 1)");
     return true;
 fail:
     pinMode(PIN_RST, OUTPUT); digitalWrite(PIN_RST, LOW);
+    espPower.release();
     return false;
 }
 
 static void deinitUWB() {
     if (!uwbInitialized) return;
-    dwt_forcetrxoff();
-    dwt_softreset();
-    vTaskDelay(pdMS_TO_TICKS(2));
+    detachInterrupt(digitalPinToInterrupt(PIN_IRQ));
+#if UWB_LP_ENABLE
+    if (!dwAsleep)   // đang ngủ → RST kéo ra khỏi sleep luôn, không SPI
+#endif
+    {
+        dwt_forcetrxoff();
+        dwt_softreset();
+        vTaskDelay(pdMS_TO_TICKS(2));
+    }
     pinMode(PIN_RST, OUTPUT); digitalWrite(PIN_RST, LOW);
+#if UWB_LP_ENABLE
+    dwAsleep = false;
+#endif
+    uwbPower.enter(UWB_PWR_OFF);
+    espPower.release();
     uwbInitialized  = false;
     stsConfigured   = false;
     tagInUnlockZone = false;
@@ -185,12 +263,121 @@ static void deinitUWB() {
     Serial.println("[uwbTask] UWB: stopped");
 }
 
+#if UWB_LP_ENABLE
+// Hết slot: xoá status (IRQ line về LOW), deep sleep, trả PM lock → ESP32 light sleep
+static void uwbSleep() {
+    if (!uwbInitialized || dwAsleep) return;
+    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_GOOD | SYS_STATUS_ALL_RX_TO |
+                                     SYS_STATUS_ALL_RX_ERR | SYS_STATUS_ALL_TX);
+    dwt_entersleep(DWT_DW_IDLE_RC);
+    dwAsleep = true;
+    uwbPower.enter(UWB_PWR_SLEEP);
+    espPower.release();
+}
+
+// Đầu slot: CSn → IDLE_RC → restore config AON + thanh ghi runtime.
+// false = không về IDLE_RC trong UWB_LP_WAKE_TIMEOUT_MS (caller init lại).
+static bool uwbWake() {
+    if (!dwAsleep) return true;
+    espPower.hold();
+    uwbPower.enter(UWB_PWR_AWAKE);   // tính cả cửa sổ wake — budget nghiêng về phía an toàn
+    int64_t t0 = esp_timer_get_time();
+    dwt_wakeup_ic();
+    bool ok = dwt_checkidlerc();
+    for (uint32_t t = millis(); !ok && millis() - t < UWB_LP_WAKE_TIMEOUT_MS; ) {
+        vTaskDelay(1);
+        ok = dwt_checkidlerc();
+    }
+    uwbPower.wakeDone((uint32_t)(esp_timer_get_time() - t0), ok);
+    if (!ok) return false;
+    dwt_restoreconfig();
+    uwbApplyRuntimeConfig();
+    dwAsleep = false;
+    return true;
+}
+
+// Chờ tới hết slot (tính từ slotStart); STOP/SUSPEND thì thoát ngay, IRQ lạc bị bỏ qua
+static void uwbSlotWait(TickType_t slotStart) {
+    const TickType_t period = pdMS_TO_TICKS(UWB_LP_SLOT_MS);
+    for (;;) {
+        TickType_t elapsed = xTaskGetTickCount() - slotStart;
+        if (elapsed >= period || uwbFsm.interrupted()) return;
+        uwbFsm.wait(period - elapsed);
+    }
+}
+#endif
+
+// Radio-on time + current budget (low_power.h) qua dlog
+static void printPowerReport() {
+    UwbPowerSnapshot snap = uwbPower.snapshot();
+    PowerBudget b = PowerBudget::estimate(snap, espPower.lightSleepEnabled());
+    DLOGI("[LP] DW3000 awake %u/1000 trx %u/1000 | slots %lu wakes %lu",
+          b.radioOnPermille, b.trxPermille, (unsigned long)snap.slots, (unsigned long)snap.wakes);
+    if (snap.wakes || snap.wakeFails)
+        DLOGI("[LP] wake avg %lu max %lu us, %lu failed",
+              (unsigned long)(snap.wakes ? snap.wakeSumUs / snap.wakes : 0),
+              (unsigned long)snap.wakeMaxUs, (unsigned long)snap.wakeFails);
+    DLOGI("[LP] budget %lu uA (~%lu h) vs always-on %lu uA (~%lu h)",
+          (unsigned long)b.avgUa, (unsigned long)b.hours, (unsigned long)b.baselineUa,
+          (unsigned long)b.baselineHours);
+}
+
+#if CIR_NLOS_ENABLE
+static CirNlosDetector cirDetector;
+static CirStats        cirStats;
+
+// Sau Response hợp lệ, trước lần RX kế (accumulator còn nguyên). Đọc từng chunk tới
+// khi detector đủ dữ liệu; CIR_DUMP đọc hết cửa sổ và in 1 dòng cho Tools/cir_bench:
+//   CIR <fpIndexQ6> <first sample> <n> <hex n×6 byte>
+static CirResult uwbAnalyzeCir() {
+    uint32_t t0   = micros();
+    uint16_t fpQ6 = dwt_read16bitoffsetreg(IP_DIAG_8_ID, 0);
+    uint8_t  buf[1 + CIR_CHUNK_SAMPLES * CIR_SAMPLE_BYTES];   // +1: byte dummy đầu mỗi lần đọc
+    cirDetector.begin(fpQ6, CIR_DUMP);
+#if CIR_DUMP
+    static char line[32 + 2 * CIR_WINDOW_MAX * CIR_SAMPLE_BYTES];
+    int pos = snprintf(line, sizeof(line), "CIR %u %u %u ", fpQ6, cirDetector.first(), cirDetector.windowLen());
+#endif
+    while (cirDetector.wantMore()) {
+        uint8_t n = cirDetector.chunk();
+        dwt_readaccdata(buf, (uint16_t)(n * CIR_SAMPLE_BYTES + 1), (uint16_t)(cirDetector.next() * CIR_SAMPLE_BYTES));
+        cirDetector.feed(buf + 1, n);
+#if CIR_DUMP
+        for (int i = 1; i <= n * CIR_SAMPLE_BYTES; i++) pos += snprintf(line + pos, sizeof(line) - pos, "%02x", buf[i]);
+#endif
+    }
+    CirResult r = cirDetector.finish();
+#if CIR_DUMP
+    Serial.println(line);
+#endif
+    cirStats.add(r, micros() - t0);
+    return r;
+}
+
+static void printCirReport() {
+    const CirStats& c = cirStats;
+    DLOGI("[CIR] %lu analyzed, %lu NLOS, %lu invalid, avg %lu samples read",
+          (unsigned long)c.analyzed, (unsigned long)c.nlos, (unsigned long)c.invalid,
+          (unsigned long)(c.analyzed ? c.samples / c.analyzed : 0));
+    DLOGI("[CIR] read+analyze avg %lu max %lu us",
+          (unsigned long)(c.analyzed ? c.usSum / c.analyzed : 0), (unsigned long)c.usMax);
+}
+#endif
+
 // =============================================================================
 // UWB initiator loop (SS-TWR) — chạy trong uwbTask
 // Logic giống BLE_UWB_Tag, dùng vTaskDelay thay delay()
 // =============================================================================
 
-// Returns true nếu cần dừng UWB (vượt 20m)
+// "<prefix><m>.<dm>m" như snprintf("%.1fm") trước đây, nhưng chỉ dùng số nguyên —
+// không chạy float printf trong uwbTask.
+static uint8_t formatZoneMsg(char* out, size_t max, const char* prefix, float distM) {
+    uint32_t dm = (uint32_t)(distM * 10.0f + 0.5f);
+    return (uint8_t)snprintf(out, max, "%s%lu.%lum", prefix, (unsigned long)(dm / 10), (unsigned long)(dm % 10));
+}
+
+// Returns true nếu cần dừng UWB (vượt 20m).
+// Chờ Response bằng IRQ; lệnh STOP tới trong lúc chờ → tắt RX và return ngay.
 static bool uwbInitiatorLoop() {
     // Reload STS IV counter trước mỗi TX để sync với Anchor
     dwt_writetodevice(STS_IV0_ID, 0, 4, (uint8_t*)&sts_iv.iv0);
@@ -198,22 +385,39 @@ static bool uwbInitiatorLoop() {
 
     dwt_write32bitreg(SYS_STATUS_ID,
         SYS_STATUS_TXFRS_BIT_MASK | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+    uwbFsm.clearIrq();
 
     tx_poll_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
     dwt_writetxdata(sizeof(tx_poll_msg), tx_poll_msg, 0U);
     dwt_writetxfctrl(sizeof(tx_poll_msg), 0U, 1);
 
+    uwbPower.trxStart();
     if (dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED) != DWT_SUCCESS) {
+        uwbPower.trxStop();
         frame_seq_nb++; return false;
     }
 
+    // Chờ IRQ (Response / RX lỗi / RX timeout của DW3000), không đụng SPI: status đã xoá
+    // trước starttx nên cạnh IRQ tin được. Chỉ đọc SYS_STATUS khi có IRQ, hoặc 1 lần lúc
+    // hết UWB_RX_WAIT_MS (lỡ cạnh).
+    const TickType_t window = pdMS_TO_TICKS(UWB_RX_WAIT_MS);
+    TickType_t t0 = xTaskGetTickCount();
     uint32_t status_reg = 0U;
-    unsigned long t0 = millis();
-    while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) &
-             (SYS_STATUS_RXFCG_BIT_MASK | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR))) {
-        if ((millis() - t0) > 600UL) { dwt_forcetrxoff(); frame_seq_nb++; return false; }
-        taskYIELD();
+    for (;;) {
+        TickType_t elapsed = xTaskGetTickCount() - t0;
+        bool late = elapsed >= window;
+        bool irq  = !late && uwbFsm.wait(window - elapsed);
+        if (uwbFsm.interrupted()) {
+            dwt_forcetrxoff(); uwbPower.trxStop(); frame_seq_nb++; return false;
+        }
+        if (!irq && !late) continue;   // lệnh không cắt RX (START) hoặc wait hết hạn — vòng sau đọc
+        status_reg = dwt_read32bitreg(SYS_STATUS_ID);
+        if (status_reg & (SYS_STATUS_RXFCG_BIT_MASK | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)) break;
+        if (late) {
+            dwt_forcetrxoff(); uwbPower.trxStop(); frame_seq_nb++; return false;
+        }
     }
+    uwbPower.trxStop();
     frame_seq_nb++;
 
     if (!(status_reg & SYS_STATUS_RXFCG_BIT_MASK)) {
@@ -253,7 +457,14 @@ static bool uwbInitiatorLoop() {
 
     if (distance < 0.0f || distance > 100.0f) return false;
 
-    float filtDist = applyDistanceFilter(distance);
+#if CIR_NLOS_ENABLE
+    CirResult cir  = uwbAnalyzeCir();
+    bool      nlos = cir.valid && cir.nlos;
+#else
+    bool      nlos = false;
+#endif
+    float filtDist = applyDistanceFilter(distance, nlos ? CIR_NLOS_WEIGHT : 1.0f);
+    if (traceFirstRange) { traceFirstRange = false; tracer.mark(TP_T_RANGE_OK, (uint32_t)(filtDist * 100.0f)); }
 
     // Vượt 20m — dừng UWB, báo Anchor, chuyển sang RSSI monitor
     if (filtDist > UWB_FAR_DISTANCE_M) {
@@ -262,7 +473,7 @@ static bool uwbInitiatorLoop() {
             BleWriteMsg wm; wm.len = 8; memcpy(wm.data, "UWB_STOP", 8);
             xQueueSend(bleWriteQueue, &wm, 0);
         }
-        Serial.printf("[uwbTask] avg=%.1f m — beyond 20m, stopping UWB\n", filtDist);
+        DLOGI("[uwbTask] avg=%.1f m — beyond 20m, stopping UWB", filtDist);
         return true; // caller sẽ deinit UWB
     }
 
@@ -272,27 +483,29 @@ static bool uwbInitiatorLoop() {
 
     if (shouldUnlock && !tagInUnlockZone) {
         tagInUnlockZone = true;
+        tracer.mark(TP_T_VERIFIED_TX, (uint32_t)(filtDist * 100.0f));
         if (connected) {
             BleWriteMsg wm;
-            wm.len = (uint8_t)snprintf(wm.data, sizeof(wm.data), "VERIFIED:%.1fm", filtDist);
+            wm.len = formatZoneMsg(wm.data, sizeof(wm.data), "VERIFIED:", filtDist);
             xQueueSend(bleWriteQueue, &wm, 0);
         }
-        Serial.printf("[uwbTask] avg=%.1f m — UNLOCK\n", filtDist);
+        DLOGI("[uwbTask] avg=%.1f m — UNLOCK", filtDist);
     } else if (shouldLock && tagInUnlockZone) {
         tagInUnlockZone = false;
         if (connected) {
             BleWriteMsg wm;
-            wm.len = (uint8_t)snprintf(wm.data, sizeof(wm.data), "WARNING:%.1fm", filtDist);
+            wm.len = formatZoneMsg(wm.data, sizeof(wm.data), "WARNING:", filtDist);
             xQueueSend(bleWriteQueue, &wm, 0);
         }
-        Serial.printf("[uwbTask] avg=%.1f m — LOCK\n", filtDist);
+        DLOGI("[uwbTask] avg=%.1f m — LOCK", filtDist);
     }
 
     static unsigned long lastDistLog = 0;
     if (millis() - lastDistLog > 500) {
         lastDistLog = millis();
-        Serial.printf("[uwbTask] raw=%.1f avg=%.1f m %s | RSSI=%d dBm\n",
-                      distance, filtDist, tagInUnlockZone ? "[UNLOCKED]" : "[LOCKED]", currentRssi);
+        static const char* const ZONE[2][2] = { { "[LOCKED]", "[LOCKED] NLOS" }, { "[UNLOCKED]", "[UNLOCKED] NLOS" } };
+        DLOGI("[uwbTask] raw=%.1f avg=%.1f m %s | RSSI=%d dBm",
+              distance, filtDist, ZONE[tagInUnlockZone][nlos], currentRssi);
     }
     return false;
 }
@@ -301,31 +514,56 @@ static bool uwbInitiatorLoop() {
 // BLE scan + connection callbacks
 // =============================================================================
 
-// Notification callback: chạy trong BLE stack task (Core 0)
-// So sánh bằng con trỏ characteristic thay vì String UUID — không heap allocate
-static void notifyCallback(BLERemoteCharacteristic* pChar,
-                           uint8_t* pData, size_t length, bool isNotify) {
+// Notification: chạy trong BLE stack task (Core 0). Đến từ notifyCallback
+// (kết nối discovery thường) hoặc custom GATTC handler của gattCache (fast path).
+static void handleNotify(GattChar ch, const uint8_t* pData, size_t length) {
     if (!pData || length == 0) return;
 
-    if (pChar == pAuthChar) {
+    if (ch == GATT_CH_CHALLENGE) {
+        if (length == 16) {
+            memcpy(notifiedChallenge, pData, 16);
+            xEventGroupSetBits(sysEvents, EVT_CHALLENGE);
+        }
+    } else if (ch == GATT_CH_AUTH) {
         // memcmp thay std::string — zero allocation
         if (length == 7 && memcmp(pData, "AUTH_OK", 7) == 0) {
             authenticated = true;
+            tracer.mark(TP_T_AUTH_OK_RX);
             xEventGroupSetBits(sysEvents, EVT_AUTHED);
-            Serial.println("[BLE notify] AUTH_OK");
+            DLOGI("[BLE notify] AUTH_OK");
         } else if (length == 9 && memcmp(pData, "AUTH_FAIL", 9) == 0) {
             authenticated = false;
-            Serial.println("[BLE notify] AUTH_FAIL");
+            DLOGI("[BLE notify] AUTH_FAIL");
+        } else if (length == 6 + TICKET_ID_LEN + 2 && memcmp(pData, "TICKET", 6) == 0) {
+            ticketWallet.accept(pData + 6);
+        } else if (length == 9 + TICKET_ID_LEN + 2 && memcmp(pData, "RESUME_OK", 9) == 0) {
+            ticketWallet.accept(pData + 9);
+            authenticated = true;
+            xEventGroupSetBits(sysEvents, EVT_AUTHED);
+            DLOGI("[BLE notify] RESUME_OK");
+        } else if (length == 11 && memcmp(pData, "RESUME_FAIL", 11) == 0) {
+            ticketWallet.discard();
+            xEventGroupSetBits(sysEvents, EVT_RESUME_FAIL);
+            DLOGI("[BLE notify] RESUME_FAIL");
         }
-    } else if (pChar == pRemoteCharacteristic) {
+    } else if (ch == GATT_CH_DATA) {
         if (length >= 10 && memcmp(pData, "UWB_ACTIVE", 10) == 0) {
             anchorUwbReady = true;
+            tracer.mark(TP_T_UWB_ACTIVE_RX);
             xEventGroupSetBits(sysEvents, EVT_ANCHOR_UWB_READY);
-            Serial.println("[BLE notify] UWB_ACTIVE received");
+            DLOGI("[BLE notify] UWB_ACTIVE received");
         }
     }
 }
 
+// So sánh bằng con trỏ characteristic thay vì String UUID — không heap allocate
+static void notifyCallback(BLERemoteCharacteristic* pChar,
+                           uint8_t* pData, size_t length, bool isNotify) {
+    if      (pChar == pChallengeChar)        handleNotify(GATT_CH_CHALLENGE, pData, length);
+    else if (pChar == pAuthChar)             handleNotify(GATT_CH_AUTH, pData, length);
+    else if (pChar == pRemoteCharacteristic) handleNotify(GATT_CH_DATA, pData, length);
+}
+
 class MyAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
     void onResult(BLEAdvertisedDevice advertisedDevice) override {
         if (!advertisedDevice.haveServiceUUID() ||
@@ -347,6 +585,7 @@ class MyAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
         delete myDevice;
         myDevice = new BLEAdvertisedDevice(advertisedDevice);
         BLEDevice::getScan()->stop();
+        tracer.mark(TP_T_DEVICE_FOUND, (uint32_t)rssi);
         // Báo bleTask đã tìm thấy Anchor
         xEventGroupSetBits(sysEvents, EVT_DEVICE_FOUND);
     }
@@ -355,12 +594,13 @@ class MyAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
 class MyClientCallback : public BLEClientCallbacks {
     void onConnect(BLEClient* pclient) override {
         connected = true;
+        tracer.mark(TP_T_CONNECTED);
         xEventGroupSetBits(sysEvents, EVT_CONNECTED);
-        xEventGroupClearBits(sysEvents, EVT_UWB_STOP);
-        Serial.println("[BLE] Connected to Anchor");
+        DLOGI("[BLE] Connected to Anchor");
     }
     void onDisconnect(BLEClient* pclient) override {
-        Serial.println("[BLE] Disconnected from Anchor");
+        DLOGI("[BLE] Disconnected from Anchor");
+        tracer.mark(TP_SESSION_END);
         connected             = false;
         authenticated         = false;
         anchorUwbReady        = false;
@@ -369,16 +609,103 @@ class MyClientCallback : public BLEClientCallbacks {
         pRemoteCharacteristic = nullptr;
         pChallengeChar        = nullptr;
         pAuthChar             = nullptr;
+        gattCache.detach();
 
-        xEventGroupClearBits(sysEvents, EVT_CONNECTED | EVT_AUTHED | EVT_ANCHOR_UWB_READY | EVT_UWB_INIT);
-        // Signal uwbTask dừng UWB — không còn cần pendingUwbDeinit defer nữa
-        xEventGroupSetBits(sysEvents, EVT_UWB_STOP);
+        xEventGroupClearBits(sysEvents, EVT_CONNECTED | EVT_AUTHED | EVT_ANCHOR_UWB_READY);
+        // uwbTask nhận lệnh ngay cả khi đang chờ Response. Còn ticket → chỉ SUSPEND
+        // (giữ config DW3000 cho lần resume), bleTask gửi STOP khi ticket hết hạn.
+        uwbFsm.request(ticketWallet.usable() ? UWB_NOTIFY_SUSPEND : UWB_NOTIFY_STOP);
 
         delete myDevice; myDevice = nullptr;
     }
 };
 static MyClientCallback clientCallback;
 
+// =============================================================================
+// Characteristic access — qua BLERemoteCharacteristic (kết nối discovery) hoặc
+// handle đã cache (gattCache.active(), fast reconnect)
+// =============================================================================
+
+static BLERemoteCharacteristic* remoteChar(GattChar ch) {
+    switch (ch) {
+        case GATT_CH_CHALLENGE: return pChallengeChar;
+        case GATT_CH_AUTH:      return pAuthChar;
+        default:                return pRemoteCharacteristic;
+    }
+}
+
+static void charWrite(GattChar ch, const uint8_t* data, size_t len) {
+    if (gattCache.active()) { gattCache.write(ch, data, len); return; }
+    BLERemoteCharacteristic* c = remoteChar(ch);
+    if (c) c->writeValue((uint8_t*)data, len);
+}
+
+// Trả về số byte đọc được (0 = lỗi)
+static size_t charRead(GattChar ch, uint8_t* out, size_t maxLen) {
+    if (gattCache.active()) return gattCache.read(ch, out, maxLen, GATT_CACHE_OP_TIMEOUT_MS);
+    BLERemoteCharacteristic* c = remoteChar(ch);
+    if (!c) return 0;
+    String raw = c->readValue();
+    size_t n = min((size_t)raw.length(), maxLen);
+    memcpy(out, raw.c_str(), n);
+    return n;
+}
+
+static bool charSubscribe(GattChar ch) {
+    if (gattCache.active()) return gattCache.subscribe(ch, GATT_CACHE_OP_TIMEOUT_MS);
+    BLERemoteCharacteristic* c = remoteChar(ch);
+    if (!c || !c->canNotify()) return false;
+    c->registerForNotify(notifyCallback);
+    return true;
+}
+
+// Discovery đầy đủ (lần đầu gặp Anchor / cache không khớp) → cập nhật cache
+static bool discoverServices(BLEAddress addr, uint8_t addrType) {
+    pClient->setMTU(517);
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+    BLERemoteService* pSvc = pClient->getService(SERVICE_UUID);
+    if (!pSvc) return false;
+
+    pChallengeChar        = pSvc->getCharacteristic(CHALLENGE_CHAR_UUID);
+    pAuthChar             = pSvc->getCharacteristic(AUTH_CHAR_UUID);
+    pRemoteCharacteristic = pSvc->getCharacteristic(CHARACTERISTIC_UUID);
+    if (!pChallengeChar || !pAuthChar || !pRemoteCharacteristic) {
+        Serial.println("[bleTask] Characteristic(s) missing"); return false;
+    }
+
+#if GATT_CACHE_ENABLE
+    // Anchor firmware cũ không publish layout hash → không cache
+    BLERemoteCharacteristic* pLayout = pSvc->getCharacteristic(GATT_LAYOUT_CHAR_UUID);
+    String hash = pLayout ? pLayout->readValue() : String();
+    BLERemoteCharacteristic* const chars[GATT_CH_COUNT] = { pChallengeChar, pAuthChar, pRemoteCharacteristic };
+    gattCache.learn(pClient, addr, addrType, chars,
+                    hash.length() == GATT_LAYOUT_HASH_LEN ? (const uint8_t*)hash.c_str() : nullptr);
+#endif
+    return true;
+}
+
+// Resume bằng ticket (session_ticket.h). false → caller chạy challenge/HMAC như thường.
+static bool tryResume() {
+#if TICKET_ENABLE
+    uint8_t req[TICKET_RESUME_LEN], nonce[TICKET_NONCE_LEN];
+    if (!ticketWallet.buildResume(pairingKey, req, nonce)) return false;
+
+    xEventGroupClearBits(sysEvents, EVT_AUTHED | EVT_RESUME_FAIL);
+    tracer.bind(nonce);
+    tracer.mark(TP_T_RESUME_TX);
+    charWrite(GATT_CH_AUTH, req, sizeof(req));
+    EventBits_t bits = xEventGroupWaitBits(sysEvents, EVT_AUTHED | EVT_RESUME_FAIL, pdFALSE, pdFALSE,
+                                           pdMS_TO_TICKS(RESUME_WAIT_MS));
+    if (bits & EVT_AUTHED) {
+        DLOGI("[bleTask] Session resumed (ticket)");
+        return true;
+    }
+    DLOGI("[bleTask] Resume %s — full auth", (bits & EVT_RESUME_FAIL) ? "rejected" : "timed out");
+#endif
+    return false;
+}
+
 // =============================================================================
 // BLE connection + challenge-response auth
 // Chạy trực tiếp trong bleTask (không phải callback) — có thể dùng blocking delay
@@ -388,6 +715,10 @@ static bool connectToServer() {
     if (!myDevice) return false;
     Serial.println("[bleTask] Connecting to Anchor...");
 
+    // Lấy trước khi connect — onDisconnect delete myDevice
+    BLEAddress addr     = myDevice->getAddress();
+    uint8_t    addrType = myDevice->getAddressType();
+
     if (pClient) { delete pClient; pClient = nullptr; }
     pClient = BLEDevice::createClient();
     pClient->setClientCallbacks(&clientCallback);
@@ -400,31 +731,53 @@ static bool connectToServer() {
     }
     if (!connOk) { delete pClient; pClient = nullptr; return false; }
 
-    pClient->setMTU(517);
-    vTaskDelay(pdMS_TO_TICKS(100));
+    // Interval ngắn cho chuỗi request/response connect → auth → arm UWB
+    GattCache::tuneConnParams(addr, CONN_FAST_MIN_INT, CONN_FAST_MAX_INT, 0, CONN_SUP_TIMEOUT);
 
-    BLERemoteService* pSvc = pClient->getService(SERVICE_UUID);
-    if (!pSvc) { pClient->disconnect(); return false; }
+#if GATT_CACHE_ENABLE
+    bool fast = gattCache.validate(pClient, addr, GATT_CACHE_OP_TIMEOUT_MS);
+#else
+    bool fast = false;
+#endif
+    if (!fast && !discoverServices(addr, addrType)) { pClient->disconnect(); return false; }
 
-    pChallengeChar        = pSvc->getCharacteristic(CHALLENGE_CHAR_UUID);
-    pAuthChar             = pSvc->getCharacteristic(AUTH_CHAR_UUID);
-    pRemoteCharacteristic = pSvc->getCharacteristic(CHARACTERISTIC_UUID);
-    if (!pChallengeChar || !pAuthChar || !pRemoteCharacteristic) {
-        Serial.println("[bleTask] Characteristic(s) missing"); pClient->disconnect(); return false;
+    tracer.mark(TP_T_SERVICES_READY, fast ? 1 : 0);
+    DLOGI("[bleTask] Services ready (%s)", fast ? "GATT cache" : "discovery");
+
+    bool subOk = charSubscribe(GATT_CH_AUTH);
+    subOk = charSubscribe(GATT_CH_DATA) && subOk;
+    if (fast && !subOk) {
+        // Handle cache không còn đúng dù hash khớp → xoá, lần sau discovery
+        gattCache.invalidate();
+        pClient->disconnect(); return false;
     }
 
-    if (pAuthChar->canNotify())             pAuthChar->registerForNotify(notifyCallback);
-    if (pRemoteCharacteristic->canNotify()) pRemoteCharacteristic->registerForNotify(notifyCallback);
+    // Còn ticket → thử RESUME: 1 write, Anchor trả RESUME_OK (kèm ticket mới) hoặc RESUME_FAIL
+    if (tryResume()) {
+        tracer.mark(TP_T_SESSION_READY, 1);
+        return true;
+    }
 
-    // Poll challenge characteristic (up to 3s)
+    // Subscribe challenge → ghi CCCD → Anchor notify challenge ngay (không còn chờ 2s cố định)
     std::string challenge;
-    for (int i = 0; i < 60; i++) {
-        String raw = pChallengeChar->readValue();
-        if (raw.length() == 16) { challenge = std::string(raw.c_str(), 16); break; }
+    xEventGroupClearBits(sysEvents, EVT_CHALLENGE);
+    if (charSubscribe(GATT_CH_CHALLENGE)) {
+        EventBits_t bits = xEventGroupWaitBits(sysEvents, EVT_CHALLENGE, pdTRUE, pdFALSE,
+                                               pdMS_TO_TICKS(CHALLENGE_NOTIFY_WAIT_MS));
+        if (bits & EVT_CHALLENGE) challenge = std::string((const char*)notifiedChallenge, 16);
+    }
+    // Fallback: poll challenge characteristic (Anchor cũ / notify bị miss)
+    for (int i = 0; challenge.empty() && i < 40 && pClient->isConnected(); i++) {
+        uint8_t raw[32];
+        if (charRead(GATT_CH_CHALLENGE, raw, sizeof(raw)) == 16) { challenge = std::string((const char*)raw, 16); break; }
         vTaskDelay(pdMS_TO_TICKS(50));
     }
+    if (challenge.length() == 16) {
+        tracer.bind((const uint8_t*)challenge.data());
+        tracer.mark(TP_T_CHALLENGE_RX);
+    }
     if (challenge.length() != 16) {
-        Serial.printf("[bleTask] Challenge not ready (%d bytes)\n", challenge.length());
+        DLOGW("[bleTask] Challenge not ready (%d bytes)", challenge.length());
         pClient->disconnect(); return false;
     }
 
@@ -432,44 +785,52 @@ static bool connectToServer() {
     if (!computeHMAC(pairingKey, 16, (const uint8_t*)challenge.data(), 16, response)) {
         pClient->disconnect(); return false;
     }
-    pAuthChar->writeValue(response, 32);
-    Serial.println("[bleTask] HMAC response sent");
+    tracer.mark(TP_T_AUTH_TX);
+    ticketWallet.expect((const uint8_t*)challenge.data());   // ticket sau AUTH_OK gắn với challenge này
+    charWrite(GATT_CH_AUTH, response, 32);
+    DLOGI("[bleTask] HMAC response sent");
 
     // Đợi AUTH_OK notification (tối đa 2s), fallback poll
     xEventGroupWaitBits(sysEvents, EVT_AUTHED, pdFALSE, pdFALSE, pdMS_TO_TICKS(2000));
     if (!authenticated) {
-        if (!pAuthChar || !pClient || !pClient->isConnected()) return false;
-        String authRaw = pAuthChar->readValue();
-        if (authRaw == "AUTH_OK") {
+        if (!pClient || !pClient->isConnected()) return false;
+        uint8_t authRaw[16];
+        size_t  n = charRead(GATT_CH_AUTH, authRaw, sizeof(authRaw));
+        if (n == 7 && memcmp(authRaw, "AUTH_OK", 7) == 0) {
             authenticated = true;
+            tracer.mark(TP_T_AUTH_OK_RX, 1);
             xEventGroupSetBits(sysEvents, EVT_AUTHED);
-            Serial.println("[bleTask] Auth OK (poll fallback)");
+            DLOGI("[bleTask] Auth OK (poll fallback)");
         } else {
-            Serial.println("[bleTask] Auth FAIL"); pClient->disconnect(); return false;
+            DLOGW("[bleTask] Auth FAIL"); pClient->disconnect(); return false;
         }
     }
+    tracer.mark(TP_T_SESSION_READY, 0);
     return true;
 }
 
 // =============================================================================
 // armUWB — helper dùng chung cho lần arm đầu và re-arm sau RSSI recovery
 // Gửi TAG_UWB_READY, retry mỗi UWB_REQUEST_RETRY_MS cho đến khi Anchor xác nhận.
-// Trả về true nếu arm thành công (EVT_UWB_INIT đã được set).
+// Trả về true nếu arm thành công (đã gửi START cho uwbTask).
 // =============================================================================
 
 static bool armUWB(const char* label) {
     anchorUwbReady = false;
-    xEventGroupClearBits(sysEvents, EVT_ANCHOR_UWB_READY | EVT_UWB_INIT);
+    xEventGroupClearBits(sysEvents, EVT_ANCHOR_UWB_READY);
     while (connected) {
-        if (pRemoteCharacteristic)
-            pRemoteCharacteristic->writeValue("TAG_UWB_READY", 13U);
-        Serial.printf("[bleTask] %s: Sent TAG_UWB_READY\n", label);
+        tracer.mark(TP_T_UWB_READY_TX);
+        charWrite(GATT_CH_DATA, (const uint8_t*)"TAG_UWB_READY", 13U);
+        DLOGI("[bleTask] %s: Sent TAG_UWB_READY", label);
         EventBits_t bits = xEventGroupWaitBits(sysEvents, EVT_ANCHOR_UWB_READY,
                                                pdFALSE, pdFALSE,
                                                pdMS_TO_TICKS(UWB_REQUEST_RETRY_MS));
         if (bits & EVT_ANCHOR_UWB_READY) {
-            xEventGroupSetBits(sysEvents, EVT_UWB_INIT);
-            Serial.printf("[bleTask] %s: UWB armed\n", label);
+            uwbFsm.request(UWB_NOTIFY_START);
+            // Handshake xong — chỉ còn VERIFIED/WARNING, nới interval cho Anchor
+            if (pClient) GattCache::tuneConnParams(pClient->getPeerAddress(), CONN_IDLE_MIN_INT,
+                                                   CONN_IDLE_MAX_INT, 0, CONN_SUP_TIMEOUT);
+            DLOGI("[bleTask] %s: UWB armed", label);
             return true;
         }
     }
@@ -483,8 +844,24 @@ static bool armUWB(const char* label) {
 //   scan → đợi device found → connect → auth → arm UWB → monitor
 // =============================================================================
 
+static void initBLE() {
+    uint8_t st = bootProfile.start("ble_init");
+    BLEDevice::init("UserTag_01");
+    BLEDevice::setPower(ESP_PWR_LVL_P9);
+#if UWB_LP_ENABLE
+    espPower.enableBleModemSleep();
+#endif
+    bootProfile.end(st);
+    st = bootProfile.start("gatt_cache");
+    gattCache.begin(handleNotify);
+    bootProfile.end(st);
+}
+
 static void bleTask(void* param) {
     Serial.println("[bleTask] started on core " + String(xPortGetCoreID()));
+#if BOOT_FAST
+    initBLE();
+#endif
 
     BLEScan* pBLEScan = BLEDevice::getScan();
     pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks());
@@ -496,11 +873,18 @@ static void bleTask(void* param) {
         // ── SCAN ──────────────────────────────────────────────────────────────
         Serial.println("[bleTask] Scanning for Anchor...");
         xEventGroupClearBits(sysEvents, EVT_DEVICE_FOUND);
+        tracer.newSession();
+        tracer.mark(TP_T_SCAN_START);
         // start(10, false) là blocking — trả về khi hết 10s hoặc stop() được gọi sớm
         // Sau khi trả về, check bit ngay — không cần wait thêm
         do {
+            // Anchor không quay lại trước khi ticket hết hạn → deinit UWB như cũ
+            if (uwbFsm.state() == UWB_ST_SUSPEND && !ticketWallet.usable())
+                uwbFsm.request(UWB_NOTIFY_STOP);
             pBLEScan->clearResults();
+            bootProfile.ready("scan");
             pBLEScan->start(10, false);
+            tracer.flush(16);
         } while (!(xEventGroupGetBits(sysEvents) & EVT_DEVICE_FOUND));
 
         // ── CONNECT + AUTH ─────────────────────────────────────────────────────
@@ -518,10 +902,11 @@ static void bleTask(void* param) {
             // Xử lý BLE write requests từ uwbTask — Core 0 an toàn để gọi BLE
             BleWriteMsg wm;
             while (xQueueReceive(bleWriteQueue, &wm, 0) == pdTRUE) {
-                if (pRemoteCharacteristic && connected)
-                    pRemoteCharacteristic->writeValue((uint8_t*)wm.data, wm.len);
+                if (connected) charWrite(GATT_CH_DATA, (const uint8_t*)wm.data, wm.len);
             }
 
+            tracer.flush(8);
+
             // Cập nhật RSSI để uwbTask log
             if (pClient) currentRssi = pClient->getRssi();
 
@@ -544,7 +929,9 @@ static void bleTask(void* param) {
         }
 
         // ── DISCONNECT cleanup ─────────────────────────────────────────────────
-        xEventGroupClearBits(sysEvents, EVT_DEVICE_FOUND | EVT_ANCHOR_UWB_READY | EVT_UWB_INIT);
+        xEventGroupClearBits(sysEvents, EVT_DEVICE_FOUND | EVT_ANCHOR_UWB_READY);
+        tracer.flush(32);
+        gattCache.print();
         Serial.println("[bleTask] Disconnected — scanning again in 1s");
         vTaskDelay(pdMS_TO_TICKS(1000));
     }
@@ -553,75 +940,184 @@ static void bleTask(void* param) {
 // =============================================================================
 // TASK: uwbTask — Core 1, Priority 4
 //
-// Đợi EVT_UWB_INIT, init DW3000, ranging loop liên tục.
-// Dừng khi nhận EVT_UWB_STOP (BLE disconnect / vượt 20m).
+// State machine (uwb_fsm.h) chạy bằng task notification:
+//   START (armUWB)      : IDLE → INIT → RANGING, hoặc SUSPEND → RANGING
+//   vượt 20m            : RANGING → SUSPEND (giữ config DW3000, re-arm không init lại)
+//   STOP (disconnect)   : → DEINIT → IDLE
+// Lệnh và DW3000 IRQ cùng đánh thức task → STOP có hiệu lực trong ≤ 1 tick,
+// kể cả khi đang chờ Response hay đang nghỉ giữa 2 lần ranging.
 //
 // Trước: chạy lẫn trong loop() — BLE callbacks có thể preempt
 // Sau:   pin cứng Core 1, priority 4 → không bị BLE task preempt
 // =============================================================================
 
 static void uwbTask(void* param) {
+    uwbFsm.attach(xTaskGetCurrentTaskHandle());   // trước mọi thứ khác — lệnh tới sớm đã được giữ
     Serial.println("[uwbTask] started on core " + String(xPortGetCoreID()));
+    uwbPower.begin();
+    uint32_t lastReport = millis();
 
     for (;;) {
-        // Đợi signal init từ bleTask
-        xEventGroupWaitBits(sysEvents, EVT_UWB_INIT, pdFALSE, pdFALSE, portMAX_DELAY);
-
-        if (!initUWB()) {
-            Serial.println("[uwbTask] Init failed — waiting for next signal");
-            xEventGroupClearBits(sysEvents, EVT_UWB_INIT);
-            continue;
-        }
-
-        // Ranging loop — chạy cho đến khi có EVT_UWB_STOP
-        while (!(xEventGroupGetBits(sysEvents) & EVT_UWB_STOP)) {
-            bool stopRequested = uwbInitiatorLoop();
-            if (stopRequested) {
-                // uwbInitiatorLoop trả true khi tag > 20m
+        if (uwbFsm.state() == UWB_ST_RANGING) {
+            TickType_t slotStart = xTaskGetTickCount();
+            uwbPower.slot();
+#if UWB_LP_ENABLE
+            if (!uwbWake()) {
+                DLOGW("[uwbTask] DW3000 wake timeout — re-init");
+                deinitUWB();
+                if (!initUWB()) { uwbFsm.enter(UWB_ST_IDLE); continue; }
+            }
+#endif
+            bool far = uwbInitiatorLoop();
+            if (far) {
+                // uwbInitiatorLoop trả true khi tag > 20m — bleTask chuyển sang RSSI monitor
+                dwt_forcetrxoff();
+                tagInUnlockZone = false;
+                resetDistanceFilter();
                 uwbStoppedFar = true;
-                xEventGroupClearBits(sysEvents, EVT_UWB_INIT | EVT_ANCHOR_UWB_READY);
-                break;
+                xEventGroupClearBits(sysEvents, EVT_ANCHOR_UWB_READY);
+            }
+#if UWB_LP_ENABLE
+            uwbSleep();   // giữa 2 slot và suốt SUSPEND
+            if (far) uwbFsm.enter(UWB_ST_SUSPEND);
+            else     uwbSlotWait(slotStart);
+#else
+            (void)slotStart;
+            if (far) uwbFsm.enter(UWB_ST_SUSPEND);
+            else     uwbFsm.wait(pdMS_TO_TICKS(20));   // nghỉ giữa 2 Poll, lệnh tới thì thức ngay
+#endif
+            if (UWB_LP_REPORT_MS && millis() - lastReport >= UWB_LP_REPORT_MS) {
+                lastReport = millis();
+                printPowerReport();
+#if CIR_NLOS_ENABLE
+                printCirReport();
+#endif
             }
-            vTaskDelay(pdMS_TO_TICKS(20));
+        } else if (!uwbFsm.hasCommand()) {   // STOP rồi START: START còn pending sau deinit
+            uwbFsm.wait(portMAX_DELAY);
         }
 
-        // Deinit DW3000
-        deinitUWB();
-        xEventGroupClearBits(sysEvents, EVT_UWB_INIT | EVT_UWB_STOP);
+        uint32_t cmd = uwbFsm.takeCommand();
+        if (cmd == UWB_NOTIFY_START && uwbFsm.state() != UWB_ST_RANGING) {
+            if (uwbFsm.state() == UWB_ST_IDLE) {
+                uwbFsm.enter(UWB_ST_INIT);
+                if (!initUWB()) {
+                    Serial.println("[uwbTask] Init failed — waiting for next signal");
+                    uwbFsm.enter(UWB_ST_IDLE);
+                    continue;
+                }
+            }
+            uwbFsm.enter(UWB_ST_RANGING, UWB_NOTIFY_START);
+            traceFirstRange = true;
+            tracer.mark(TP_T_UWB_RANGING);
+        } else if (cmd == UWB_NOTIFY_SUSPEND && uwbFsm.state() == UWB_ST_RANGING) {
+            // Disconnect khi còn ticket — giữ DW3000 configured cho lần resume
+            // (LP: đã deep sleep từ cuối slot, config nằm trong AON)
+#if !UWB_LP_ENABLE
+            dwt_forcetrxoff();
+#endif
+            tagInUnlockZone = false;
+            resetDistanceFilter();
+            uwbFsm.enter(UWB_ST_SUSPEND, UWB_NOTIFY_SUSPEND);
+        } else if (cmd == UWB_NOTIFY_STOP && uwbFsm.state() != UWB_ST_IDLE) {
+            uwbFsm.enter(UWB_ST_DEINIT);
+            deinitUWB();
+            uwbFsm.enter(UWB_ST_IDLE, UWB_NOTIFY_STOP);
+            uwbFsm.print();
+            printPowerReport();
+#if CIR_NLOS_ENABLE
+            printCirReport();
+#endif
+        }
     }
 }
 
+// =============================================================================
+// TASK: telemetryTask — Core 0, Priority 1 (chỉ khi TELEMETRY_ENABLE)
+// =============================================================================
+
+#if TELEMETRY_ENABLE
+static void telemetryTask(void* param) {
+    telemetry.run();
+}
+#endif
+
+// =============================================================================
+// TASK: dlogTask — Core 0, Priority 1
+//
+// Format + in log deferred (dlog.h) của bleTask/uwbTask/BLE callback.
+// =============================================================================
+
+static void dlogTask(void* param) {
+    dlog.run();
+}
+
 // =============================================================================
 // setup
 // =============================================================================
 
 void setup() {
     Serial.begin(115200);
+#if BOOT_FAST
+    // Chờ host mở USB-CDC (để thấy log boot) thay vì 500 ms cố định — UART0 sẵn sàng ngay
+    for (uint32_t t0 = millis(); !Serial && millis() - t0 < BOOT_SERIAL_WAIT_MS; ) vTaskDelay(1);
+#else
     vTaskDelay(pdMS_TO_TICKS(500));
+#endif
 
     esp_reset_reason_t reason = esp_reset_reason();
     Serial.printf("\nSmart Car Tag [FreeRTOS] (reset: %d)\n", reason);
     if (reason == ESP_RST_PANIC) Serial.println("WARNING: previous reset was a CRASH");
     if (reason == ESP_RST_WDT || reason == ESP_RST_TASK_WDT || reason == ESP_RST_INT_WDT)
         Serial.println("WARNING: previous reset was a WATCHDOG");
+    bootProfile.begin(BOOT_FAST);
 
-    // Hold DW3000 in reset during BLE init
+    // Hold DW3000 in reset during BLE init — giữ LOW tới initUWB (reset pulse riêng)
     pinMode(PIN_RST, OUTPUT); digitalWrite(PIN_RST, LOW);
     pinMode(PIN_SS,  OUTPUT); digitalWrite(PIN_SS,  HIGH);
+#if !BOOT_FAST
     vTaskDelay(pdMS_TO_TICKS(100));
+#endif
+
+    // Key store: 1 lần đọc NVS. PAIRING_KEY_HEX chỉ parse khi record chưa có hoặc config đổi.
+    uint8_t st = bootProfile.start("nvs_keys");
+    keyStore.begin();
+    if (!keyStore.hasPairingKey() || keyStore.source() != KeyStore::sourceId(PAIRING_KEY_HEX)) {
+        uint8_t k[16];
+        for (size_t i = 0; i < sizeof(k); i++) sscanf(PAIRING_KEY_HEX + 2 * i, "%2hhx", &k[i]);
+        keyStore.setPairingKey(k, KeyStore::sourceId(PAIRING_KEY_HEX));
+        memset(k, 0, sizeof(k));
+        keyStore.commit();
+    }
+    memcpy(pairingKey, keyStore.pairingKey(), sizeof(pairingKey));
+    keyStore.print();
+    bootProfile.end(st);
 
-    hexStringToBytes(PAIRING_KEY_HEX, pairingKey, 16);
-    printHex("Pairing key: ", pairingKey, 16);
+    tracer.begin('T');
+#if UWB_LP_ENABLE
+    espPower.begin();
+#endif
 
     // Khởi tạo FreeRTOS primitives
+    st = bootProfile.start("rtos_prims");
     sysEvents     = xEventGroupCreate();
     bleWriteQueue = xQueueCreate(8, sizeof(BleWriteMsg));
     if (!sysEvents || !bleWriteQueue) {
         Serial.println("FreeRTOS alloc failed — halting"); while(1);
     }
+    bootProfile.end(st);
+    xTaskCreatePinnedToCore(dlogTask, "Log_Task", DLOG_TASK_STACK, NULL, DLOG_TASK_PRIO, NULL, DLOG_TASK_CORE);
 
-    BLEDevice::init("UserTag_01");
-    BLEDevice::setPower(ESP_PWR_LVL_P9);
+#if !BOOT_FAST
+    initBLE();
+#endif
+
+#if TELEMETRY_ENABLE
+    if (telemetry.begin(TELEMETRY_SINKS)) {
+        telemetry.addQueue("bleWriteQueue", bleWriteQueue, 8);
+        xTaskCreatePinnedToCore(telemetryTask, "TLM_Task", 3072, NULL, 1, NULL, 0);
+    }
+#endif
 
     // Tạo tasks và pin vào đúng core
     xTaskCreatePinnedToCore(bleTask, "BLE_Task", 10240, NULL, 3, NULL, 0);
@@ -0,0 +1,168 @@
+#ifndef CIR_NLOS_H
+#define CIR_NLOS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// ==================== NLOS detection từ CIR ====================
+// Người / cửa xe chắn giữa Tag và Anchor: đường thẳng yếu đi, năng lượng tới qua
+// phản xạ muộn hơn → SS-TWR dài ra mà boxcar filter không phân biệt được với việc
+// đi xa thật. CIR (accumulator DW3000) quanh first path cho 2 dấu hiệu:
+//   fpPeakDb : công suất first path so với peak trong cửa sổ (LOS ≈ 0 dB)
+//   rise     : số sample từ mép lên (10% biên độ peak) tới 90% biên độ peak
+//              (LOS: 1–2 sample, NLOS: năng lượng dồn lên từ từ qua nhiều path)
+// NLOS nếu fpPeakDb < −CIR_NLOS_FP_PEAK_DB hoặc rise > CIR_NLOS_RISE_SAMPLES.
+//
+// Chỉ đọc cửa sổ [fp − CIR_PRE_SAMPLES, fp + CIR_MAX_SAMPLES), từng chunk
+// CIR_CHUNK_SAMPLES (6 byte/sample) → mỗi SPI transaction có trần. Dừng sớm khi đã
+// qua fp + CIR_MIN_POST_SAMPLES và CIR_TAIL_SAMPLES sample liền nhau sau peak đều
+// dưới 50% biên độ peak — LOS thường chỉ cần 2 chunk.
+// Cách dùng (caller giữ DW3000, trước lần RX kế):
+//   det.begin(fpIndexQ6);
+//   while (det.wantMore()) { n = det.chunk(); dwt_readaccdata(buf, n*6+1, det.next()*6); det.feed(buf+1, n); }
+//   CirResult r = det.finish();
+// Không phụ thuộc Arduino — Tools/cir_bench chạy nguyên file này trên corpus CIR.
+
+#ifndef CIR_PRE_SAMPLES
+#define CIR_PRE_SAMPLES        (4)
+#endif
+#ifndef CIR_MAX_SAMPLES
+#define CIR_MAX_SAMPLES        (32)     // sau first path — ~32 ns ≈ 9.6 m đường phản xạ thừa
+#endif
+#ifndef CIR_CHUNK_SAMPLES
+#define CIR_CHUNK_SAMPLES      (8)      // 48 byte / transaction
+#endif
+#ifndef CIR_MIN_POST_SAMPLES
+#define CIR_MIN_POST_SAMPLES   (12)     // không dừng sớm trước fp + N (path muộn sau 1 khoảng lặng)
+#endif
+#ifndef CIR_TAIL_SAMPLES
+#define CIR_TAIL_SAMPLES       (4)
+#endif
+#ifndef CIR_NLOS_FP_PEAK_DB
+#define CIR_NLOS_FP_PEAK_DB    (6.0f)
+#endif
+#ifndef CIR_NLOS_RISE_SAMPLES
+#define CIR_NLOS_RISE_SAMPLES  (4)
+#endif
+
+#define CIR_IPATOV_LEN         (1016)   // PRF 64: sample 0..1015 là CIR Ipatov
+#define CIR_SAMPLE_BYTES       (6)      // 18-bit real + 18-bit imag, mỗi phần 3 byte LE
+#define CIR_WINDOW_MAX         (CIR_PRE_SAMPLES + CIR_MAX_SAMPLES)
+
+struct CirResult {
+    bool     valid;
+    bool     nlos;
+    float    fpPeakDb;      // ≤ 0
+    uint8_t  rise;          // sample (~1 ns)
+    uint8_t  peakOffset;    // peak − first path (sample)
+    uint8_t  samplesRead;
+};
+
+class CirNlosDetector {
+private:
+    float    pw[CIR_WINDOW_MAX];   // công suất re² + im²
+    uint16_t start  = 0;           // index sample đầu cửa sổ trong accumulator
+    uint8_t  fpRel  = 0;           // first path trong cửa sổ
+    uint8_t  limit  = 0;           // số sample tối đa đọc
+    uint8_t  count  = 0;
+    uint8_t  peakAt = 0;
+    uint8_t  belowRun = 0;
+    bool     done   = true;
+    bool     whole  = false;       // đọc hết cửa sổ (dump corpus / so sánh)
+
+    static int32_t s18(const uint8_t* p) {
+        int32_t v = (int32_t)p[0] | (int32_t)p[1] << 8 | (int32_t)(p[2] & 0x03) << 16;
+        return (v & 0x20000) ? v - 0x40000 : v;
+    }
+
+public:
+    // fpIndexQ6: IP_DIAG_8 (first path, 10.6 fixed point). wholeWindow: tắt dừng sớm.
+    void begin(uint16_t fpIndexQ6, bool wholeWindow = false) {
+        uint16_t fp = fpIndexQ6 >> 6;
+        if (fp >= CIR_IPATOV_LEN) fp = CIR_IPATOV_LEN - 1;
+        start    = fp > CIR_PRE_SAMPLES ? fp - CIR_PRE_SAMPLES : 0;
+        fpRel    = (uint8_t)(fp - start);
+        uint16_t room = CIR_IPATOV_LEN - start;
+        limit    = (uint8_t)(room < CIR_WINDOW_MAX ? room : CIR_WINDOW_MAX);
+        count    = 0;
+        peakAt   = 0;
+        belowRun = 0;
+        done     = false;
+        whole    = wholeWindow;
+    }
+
+    bool     wantMore()  const { return !done && count < limit; }
+    uint16_t first()     const { return start; }
+    uint8_t  windowLen() const { return limit; }
+    uint16_t next()      const { return start + count; }
+    uint8_t  chunk()     const {
+        uint8_t left = limit - count;
+        return left < CIR_CHUNK_SAMPLES ? left : CIR_CHUNK_SAMPLES;
+    }
+
+    // raw: n sample liền nhau bắt đầu tại next() (đã bỏ byte dummy của SPI read)
+    void feed(const uint8_t* raw, uint8_t n) {
+        for (uint8_t i = 0; i < n && count < limit; i++, raw += CIR_SAMPLE_BYTES) {
+            float re = (float)s18(raw), im = (float)s18(raw + 3);
+            float p  = re * re + im * im;
+            pw[count] = p;
+            if (count == fpRel || (count > fpRel && p > pw[peakAt])) { peakAt = count; belowRun = 0; }
+            else if (count > fpRel) belowRun = p < 0.25f * pw[peakAt] ? belowRun + 1 : 0;
+            count++;
+        }
+        if (!whole && belowRun >= CIR_TAIL_SAMPLES && count >= fpRel + CIR_MIN_POST_SAMPLES) done = true;
+    }
+
+    CirResult finish() {
+        CirResult r = {};
+        r.samplesRead = count;
+        done = true;
+        if (count <= fpRel + 1 || pw[peakAt] <= 0.0f) return r;
+
+        float peak = pw[peakAt];
+        // first path: sample floor(fp) hoặc kế tiếp (fp có phần lẻ)
+        float fpP = pw[fpRel] > pw[fpRel + 1] ? pw[fpRel] : pw[fpRel + 1];
+
+        // Nền nhiễu: trung bình các sample trước fp − 1
+        float noise = 0.0f;
+        uint8_t nn  = fpRel > 1 ? fpRel - 1 : 0;
+        for (uint8_t i = 0; i < nn; i++) noise += pw[i];
+        if (nn) noise /= nn;
+
+        float lo = 0.01f * peak;                    // 10% biên độ
+        if (lo < 4.0f * noise) lo = 4.0f * noise;
+        float hi = 0.81f * peak;                    // 90% biên độ
+        uint8_t t10 = peakAt, t90 = peakAt;
+        for (uint8_t i = fpRel > 0 ? fpRel - 1 : 0; i <= peakAt; i++) if (pw[i] >= lo) { t10 = i; break; }
+        for (uint8_t i = t10; i <= peakAt; i++)                       if (pw[i] >= hi) { t90 = i; break; }
+
+        r.valid      = true;
+        r.fpPeakDb   = fpP > 0.0f ? 10.0f * log10f(fpP / peak) : -99.0f;
+        r.rise       = t90 - t10;
+        r.peakOffset = peakAt > fpRel ? peakAt - fpRel : 0;
+        r.nlos       = r.fpPeakDb < -CIR_NLOS_FP_PEAK_DB || r.rise > CIR_NLOS_RISE_SAMPLES;
+        return r;
+    }
+};
+
+// Thống kê cho log — chỉ uwbTask
+struct CirStats {
+    uint32_t analyzed = 0;
+    uint32_t nlos     = 0;
+    uint32_t invalid  = 0;
+    uint32_t samples  = 0;
+    uint32_t usSum    = 0;
+    uint32_t usMax    = 0;
+
+    void add(const CirResult& r, uint32_t us) {
+        if (!r.valid) { invalid++; return; }
+        analyzed++;
+        if (r.nlos) nlos++;
+        samples += r.samplesRead;
+        usSum   += us;
+        if (us > usMax) usMax = us;
+    }
+};
+
+#endif // CIR_NLOS_H
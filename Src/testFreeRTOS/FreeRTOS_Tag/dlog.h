@@ -0,0 +1,278 @@
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <Arduino.h>
+
+// ==================== Deferred binary log ====================
+// Log từ đường nóng (uwbTask, canTask, bleTask, authTask) không format, không chờ
+// Serial: call site chỉ ghi con trỏ format (nằm trong flash → chính là ID) + tối đa
+// DLOG_MAX_ARGS tham số thô vào ring lock-free của core đang chạy. dlogTask
+// (priority thấp) format rồi ghi Serial, gộp 2 ring theo timestamp.
+//   DLOGE/W/I/D(fmt, ...)          — 1 dòng, tự thêm '\n'
+//   DLOG_HEX(level, label, data, n) — copy tối đa 16 byte/dòng, format hex lúc drain
+// Level > DLOG_LEVEL bị bỏ lúc compile (tham số cũng không được tính).
+// Ring đầy → bỏ entry mới, đếm drop (in "[DLOG] dropped" ở lần drain sau).
+//
+// Tham số: số nguyên ≤ 32 bit, float/double (lưu float), con trỏ. %s chỉ được
+// trỏ vào chuỗi sống tới lúc drain (literal, bảng const) — String.c_str() / buffer
+// trên stack phải dùng Serial.printf như cũ.
+// File giống nhau ở Anchor và Tag.
+
+#define DLOG_LVL_NONE  (0)
+#define DLOG_LVL_ERROR (1)
+#define DLOG_LVL_WARN  (2)
+#define DLOG_LVL_INFO  (3)
+#define DLOG_LVL_DEBUG (4)
+
+#ifndef DLOG_LEVEL
+#define DLOG_LEVEL      DLOG_LVL_INFO
+#endif
+#ifndef DLOG_RING_SIZE
+#define DLOG_RING_SIZE  (64)     // entry/core, lũy thừa của 2 — 32 byte/entry
+#endif
+#ifndef DLOG_LINE_MAX
+#define DLOG_LINE_MAX   (192)
+#endif
+#ifndef DLOG_DRAIN_MS
+#define DLOG_DRAIN_MS   (20U)
+#endif
+#ifndef DLOG_TIMESTAMP
+#define DLOG_TIMESTAMP  (0)      // 1 = tiền tố "[s.µs]" lúc ghi (không phải lúc in)
+#endif
+
+#define DLOG_MAX_ARGS   (4)
+#define DLOG_HEX_MAX    (DLOG_MAX_ARGS * 4)
+
+enum DlogArgType : uint8_t { DLOG_T_INT = 0, DLOG_T_UINT, DLOG_T_FLOAT, DLOG_T_PTR };
+
+// Kiểu tham số chốt lúc compile bằng overload → lúc drain gọi snprintf đúng kiểu
+struct DlogArg {
+    uintptr_t v;                        // 32 bit trên ESP32; rộng hơn trên host
+    uint8_t  t;
+
+    DlogArg()                       : v(0), t(DLOG_T_UINT) {}
+    DlogArg(int x)                  : v((uint32_t)x), t(DLOG_T_INT) {}
+    DlogArg(long x)                 : v((uint32_t)x), t(DLOG_T_INT) {}
+    DlogArg(long long x)            : v((uint32_t)x), t(DLOG_T_INT) {}
+    DlogArg(unsigned x)             : v(x), t(DLOG_T_UINT) {}
+    DlogArg(unsigned long x)        : v((uint32_t)x), t(DLOG_T_UINT) {}
+    DlogArg(unsigned long long x)   : v((uint32_t)x), t(DLOG_T_UINT) {}
+    DlogArg(double x)               : t(DLOG_T_FLOAT) { float f = (float)x; uint32_t u; memcpy(&u, &f, 4); v = u; }
+    DlogArg(const void* p)          : v((uintptr_t)p), t(DLOG_T_PTR) {}
+};
+
+class DeferredLog {
+private:
+    struct Entry {
+        volatile uint32_t seq;       // = index + 1 khi đã ghi xong
+        uint32_t    tUs;
+        const char* fmt;             // format, hoặc label nếu là dòng hex
+        uint8_t     level;
+        uint8_t     nArgs;           // dòng hex: số byte
+        uint8_t     types;           // 2 bit/tham số; 0xFF = dòng hex
+        union {
+            uintptr_t a[DLOG_MAX_ARGS];
+            uint8_t  bytes[DLOG_HEX_MAX];
+        };
+    };
+
+    struct Ring {
+        Entry    slot[DLOG_RING_SIZE];
+        uint32_t head    = 0;        // __atomic, mọi task trên core (và task đổi core)
+        uint32_t tail    = 0;        // chỉ dlogTask ghi
+        uint32_t dropped = 0;
+    };
+
+    Ring     rings[portNUM_PROCESSORS];
+    uint32_t reported = 0;           // tổng drop đã in
+
+    // CAS trên head: không ghi đè entry chưa drain → dlogTask không đọc entry dở
+    Entry* reserve(uint32_t& idx) {
+        Ring& r = rings[xPortGetCoreID()];
+        uint32_t h = __atomic_load_n(&r.head, __ATOMIC_RELAXED);
+        do {
+            if (h - __atomic_load_n(&r.tail, __ATOMIC_ACQUIRE) >= DLOG_RING_SIZE) {
+                __atomic_fetch_add(&r.dropped, 1, __ATOMIC_RELAXED);
+                return nullptr;
+            }
+        } while (!__atomic_compare_exchange_n(&r.head, &h, h + 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+        idx = h;
+        return &r.slot[h & (DLOG_RING_SIZE - 1)];
+    }
+
+    static void publish(Entry* e, uint32_t idx) { __atomic_store_n(&e->seq, idx + 1, __ATOMIC_RELEASE); }
+
+    void push(uint8_t level, const char* fmt, const DlogArg* args, uint8_t n) {
+        uint32_t idx;
+        Entry* e = reserve(idx);
+        if (!e) return;
+        e->tUs   = (uint32_t)micros();
+        e->fmt   = fmt;
+        e->level = level;
+        e->nArgs = n;
+        e->types = 0;
+        for (uint8_t i = 0; i < n; i++) {
+            e->a[i]   = args[i].v;
+            e->types |= (uint8_t)(args[i].t << (2 * i));
+        }
+        publish(e, idx);
+    }
+
+    // 1 conversion spec (đã bỏ h/l/z/j/t/L) + 1 tham số → out
+    static int formatArg(char* out, size_t max, const char* spec, char conv, uintptr_t v, uint8_t t) {
+        switch (conv) {
+        case 'd': case 'i':
+            return snprintf(out, max, spec, (int)(int32_t)v);
+        case 'u': case 'x': case 'X': case 'o':
+            return snprintf(out, max, spec, (unsigned)v);
+        case 'c':
+            return snprintf(out, max, spec, (int)(uint8_t)v);
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+            float f;
+            uint32_t u = (uint32_t)v;
+            if (t == DLOG_T_FLOAT) memcpy(&f, &u, 4);
+            else f = (t == DLOG_T_INT) ? (float)(int32_t)v : (float)v;
+            return snprintf(out, max, spec, (double)f);
+        }
+        case 's':
+            return snprintf(out, max, spec, v ? (const char*)v : "(null)");
+        case 'p':
+            return snprintf(out, max, spec, (void*)v);
+        }
+        return 0;
+    }
+
+    static size_t format(char* out, size_t max, const Entry& e) {
+        size_t n = 0;
+#if DLOG_TIMESTAMP
+        n = snprintf(out, max, "[%lu.%06lu] ", (unsigned long)(e.tUs / 1000000), (unsigned long)(e.tUs % 1000000));
+#endif
+        if (e.types == 0xFF) {
+            n += snprintf(out + n, max - n, "%s", e.fmt);
+            if (n > max - 1) n = max - 1;
+            for (uint8_t i = 0; i < e.nArgs && n + 3 < max; i++)
+                n += snprintf(out + n, max - n, "%02X", e.bytes[i]);
+            return n;
+        }
+        const char* f = e.fmt;
+        uint8_t ai = 0;
+        while (*f && n + 1 < max) {
+            if (*f != '%') { out[n++] = *f++; continue; }
+            if (f[1] == '%') { out[n++] = '%'; f += 2; continue; }
+            char spec[16];
+            size_t sl = 0;
+            spec[sl++] = *f++;
+            while (*f && !strchr("diouxXcsfFeEgGp", *f)) {
+                if (!strchr("hlzjtLq", *f) && sl < sizeof(spec) - 2) spec[sl++] = *f;
+                f++;
+            }
+            if (!*f) break;
+            char conv = *f++;
+            spec[sl++] = conv;
+            spec[sl]   = '\0';
+            if (ai >= e.nArgs) continue;                            // thiếu tham số → bỏ spec
+            int w = formatArg(out + n, max - n, spec, conv, e.a[ai], (e.types >> (2 * ai)) & 3);
+            ai++;
+            if (w > 0) n += min((size_t)w, max - n - 1);
+        }
+        out[n] = '\0';
+        return n;
+    }
+
+public:
+    template <typename... A>
+    void write(uint8_t level, const char* fmt, A... args) {
+        static_assert(sizeof...(A) <= DLOG_MAX_ARGS, "dlog: tối đa DLOG_MAX_ARGS tham số");
+        const DlogArg a[] = { DlogArg(args)..., DlogArg() };
+        push(level, fmt, a, (uint8_t)sizeof...(A));
+    }
+
+    // Copy data (n > 16 → nhiều dòng, dòng sau label rỗng)
+    void hex(uint8_t level, const char* label, const uint8_t* data, size_t n) {
+        for (size_t off = 0; off < n || off == 0; off += DLOG_HEX_MAX) {
+            uint32_t idx;
+            Entry* e = reserve(idx);
+            if (!e) return;
+            size_t k = min(n - off, (size_t)DLOG_HEX_MAX);
+            e->tUs   = (uint32_t)micros();
+            e->fmt   = off ? "" : label;
+            e->level = level;
+            e->nArgs = (uint8_t)k;
+            e->types = 0xFF;
+            memcpy(e->bytes, data + off, k);
+            publish(e, idx);
+            if (!n) break;
+        }
+    }
+
+    // Consumer duy nhất. In entry theo thứ tự timestamp giữa các core.
+    // → số dòng đã in.
+    uint32_t drain(uint32_t maxLines = UINT32_MAX) {
+        char line[DLOG_LINE_MAX + 1];
+        uint32_t printed = 0;
+        while (printed < maxLines) {
+            Ring*  pick = nullptr;
+            Entry* pe   = nullptr;
+            for (int c = 0; c < portNUM_PROCESSORS; c++) {
+                Ring& r = rings[c];
+                Entry& e = r.slot[r.tail & (DLOG_RING_SIZE - 1)];
+                if (r.tail == __atomic_load_n(&r.head, __ATOMIC_ACQUIRE)) continue;
+                if (__atomic_load_n(&e.seq, __ATOMIC_ACQUIRE) != r.tail + 1) continue;   // đang ghi dở
+                if (!pe || (int32_t)(e.tUs - pe->tUs) < 0) { pick = &r; pe = &e; }
+            }
+            if (!pe) break;
+            size_t n = format(line, DLOG_LINE_MAX, *pe);
+            line[n++] = '\n';
+            __atomic_store_n(&pick->tail, pick->tail + 1, __ATOMIC_RELEASE);    // slot trả lại producer
+            Serial.write((const uint8_t*)line, n);
+            printed++;
+        }
+        uint32_t d = getDropped();
+        if (d != reported) {
+            Serial.printf("[DLOG] dropped %lu entries (total %lu)\n", (unsigned long)(d - reported), (unsigned long)d);
+            reported = d;
+        }
+        return printed;
+    }
+
+    // Thân dlogTask
+    void run() {
+        for (;;) {
+            drain();
+            vTaskDelay(pdMS_TO_TICKS(DLOG_DRAIN_MS));
+        }
+    }
+
+    uint32_t getDropped() const {
+        uint32_t d = 0;
+        for (int c = 0; c < portNUM_PROCESSORS; c++) d += __atomic_load_n(&rings[c].dropped, __ATOMIC_RELAXED);
+        return d;
+    }
+};
+
+static DeferredLog dlog;
+
+#if DLOG_LEVEL >= DLOG_LVL_ERROR
+#define DLOGE(...) dlog.write(DLOG_LVL_ERROR, __VA_ARGS__)
+#else
+#define DLOGE(...) do {} while (0)
+#endif
+#if DLOG_LEVEL >= DLOG_LVL_WARN
+#define DLOGW(...) dlog.write(DLOG_LVL_WARN, __VA_ARGS__)
+#else
+#define DLOGW(...) do {} while (0)
+#endif
+#if DLOG_LEVEL >= DLOG_LVL_INFO
+#define DLOGI(...) dlog.write(DLOG_LVL_INFO, __VA_ARGS__)
+#else
+#define DLOGI(...) do {} while (0)
+#endif
+#if DLOG_LEVEL >= DLOG_LVL_DEBUG
+#define DLOGD(...) dlog.write(DLOG_LVL_DEBUG, __VA_ARGS__)
+#else
+#define DLOGD(...) do {} while (0)
+#endif
+#define DLOG_HEX(level, label, data, n) \
+    do { if ((level) <= DLOG_LEVEL) dlog.hex((level), (label), (data), (n)); } while (0)
+
+#endif // DLOG_H
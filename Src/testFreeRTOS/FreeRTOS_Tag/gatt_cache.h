@@ -0,0 +1,281 @@
+#ifndef GATT_CACHE_H
+#define GATT_CACHE_H
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <Preferences.h>
+#include "esp_gattc_api.h"
+#include "esp_gap_ble_api.h"
+
+// ==================== GATT cache + fast reconnect ====================
+// Lần connect đầu: discovery đầy đủ (getService + getCharacteristic + CCCD),
+// rồi lưu vào NVS: địa chỉ Anchor, handle value/CCCD của 3 characteristic,
+// MTU đã thương lượng, và layout hash Anchor publish (GATT_LAYOUT_CHAR_UUID).
+//
+// Lần sau gặp lại đúng địa chỉ đó:
+//   1. Read-By-Type theo UUID layout hash (1 ATT round trip, không cần handle)
+//   2. Hash khớp → dùng handle đã lưu: subscribe/read/write bằng esp_ble_gattc_*
+//      thẳng, notify đi qua custom GATTC handler thay vì BLERemoteCharacteristic
+//   3. Không khớp / Anchor cũ không có hash / lỗi ATT → discovery đầy đủ và lưu lại
+//
+// Bluedroid chỉ có Database Hash (0x2B2A) khi bật robust caching — Arduino core
+// build không bật, nên Anchor tự publish hash bảng attribute của nó.
+// Các op raw chỉ được gọi từ bleTask (1 op tại 1 thời điểm).
+
+#define GATT_LAYOUT_HASH_LEN  (8)
+#define GATT_CACHE_MAGIC      (0x47430001UL)   // 'GC' + version record
+
+enum GattChar : uint8_t {
+    GATT_CH_CHALLENGE = 0,
+    GATT_CH_AUTH,
+    GATT_CH_DATA,
+    GATT_CH_COUNT
+};
+
+struct GattCacheRecord {
+    uint32_t magic;
+    uint8_t  addr[6];
+    uint8_t  addrType;
+    uint8_t  reserved;
+    uint16_t mtu;
+    uint16_t value[GATT_CH_COUNT];   // handle characteristic value
+    uint16_t cccd[GATT_CH_COUNT];    // handle CCCD (0 = không có)
+    uint8_t  layoutHash[GATT_LAYOUT_HASH_LEN];
+};
+
+typedef void (*GattNotifyFn)(GattChar ch, const uint8_t* data, size_t len);
+
+class GattCache {
+private:
+    enum Op : uint8_t { OP_NONE = 0, OP_READ, OP_WRITE };
+
+    static GattCache* self;
+
+    GattCacheRecord   rec = {};
+    bool              valid   = false;
+    volatile bool     fast    = false;       // kết nối hiện tại dùng handle cache
+    BLEClient* volatile client = nullptr;     // onDisconnect → detach() xoá bất cứ lúc nào
+    GattNotifyFn      onNotify = nullptr;
+    SemaphoreHandle_t done    = nullptr;
+    volatile Op       op      = OP_NONE;
+    volatile esp_gatt_status_t opStatus = ESP_GATT_OK;
+    uint8_t           readBuf[32];
+    volatile uint16_t readLen = 0;
+    volatile uint16_t mtu     = 23;
+    uint32_t          hits = 0, misses = 0;
+
+    bool waitOp(uint32_t timeoutMs) {
+        bool ok = xSemaphoreTake(done, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+        op = OP_NONE;
+        return ok && opStatus == ESP_GATT_OK;
+    }
+
+    // Đọc client đúng 1 lần: op chỉ dùng bản copy trả về, detach() giữa chừng không
+    // làm null dereference (ATT call trên conn đã đứt chỉ trả lỗi / timeout).
+    BLEClient* beginOp(Op o) {
+        BLEClient* c = client;
+        if (!c || !c->isConnected()) return nullptr;
+        xSemaphoreTake(done, 0);                 // bỏ give cũ (op trước timeout)
+        op = o;
+        return c;
+    }
+
+    static void gattcHandler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if,
+                             esp_ble_gattc_cb_param_t* param) {
+        GattCache* c = self;
+        BLEClient* cl = c ? c->client : nullptr;
+        if (!cl || gattc_if != cl->getGattcIf()) return;
+        switch (event) {
+            case ESP_GATTC_CFG_MTU_EVT:
+                if (param->cfg_mtu.status == ESP_GATT_OK) c->mtu = param->cfg_mtu.mtu;
+                break;
+            case ESP_GATTC_READ_CHAR_EVT:
+                if (c->op != OP_READ) break;
+                c->opStatus = param->read.status;
+                c->readLen  = min((uint16_t)sizeof(c->readBuf), param->read.value_len);
+                if (param->read.status == ESP_GATT_OK) memcpy(c->readBuf, param->read.value, c->readLen);
+                xSemaphoreGive(c->done);
+                break;
+            case ESP_GATTC_WRITE_CHAR_EVT:
+            case ESP_GATTC_WRITE_DESCR_EVT:
+                if (c->op != OP_WRITE) break;
+                c->opStatus = param->write.status;
+                xSemaphoreGive(c->done);
+                break;
+            case ESP_GATTC_NOTIFY_EVT:
+                // Kết nối discovery thường → BLERemoteCharacteristic đã dispatch
+                if (!c->fast || !c->onNotify) break;
+                for (int i = 0; i < GATT_CH_COUNT; i++) {
+                    if (param->notify.handle == c->rec.value[i]) {
+                        c->onNotify((GattChar)i, param->notify.value, param->notify.value_len);
+                        break;
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+public:
+    // Gọi 1 lần sau BLEDevice::init()
+    void begin(GattNotifyFn fn) {
+        self     = this;
+        onNotify = fn;
+        done     = xSemaphoreCreateBinary();
+        BLEDevice::setCustomGattcHandler(gattcHandler);
+
+        Preferences prefs;
+        prefs.begin("gattcache", true);
+        valid = prefs.getBytes("rec", &rec, sizeof(rec)) == sizeof(rec) && rec.magic == GATT_CACHE_MAGIC;
+        prefs.end();
+        if (valid) {
+            BLEAddress a(rec.addr);
+            Serial.printf("[GATT] Cache: %s mtu=%u handles=%u/%u/%u\n", a.toString().c_str(),
+                          rec.mtu, rec.value[0], rec.value[1], rec.value[2]);
+        }
+    }
+
+    bool matches(BLEAddress addr) const {
+        return valid && memcmp(*addr.getNative(), rec.addr, 6) == 0;
+    }
+
+    // Connection mới: gửi MTU request (song song, không sleep) rồi đọc layout
+    // hash. Trả về true nếu handle cache dùng được cho kết nối này.
+    bool validate(BLEClient* c, BLEAddress addr, uint32_t timeoutMs) {
+        client = c;
+        fast   = false;
+        mtu    = 23;
+        if (!matches(addr)) return false;
+        esp_ble_gattc_send_mtu_req(c->getGattcIf(), c->getConnId());
+
+        uint8_t hash[GATT_LAYOUT_HASH_LEN];
+        if (!readByUuid(GATT_LAYOUT_CHAR_UUID, hash, sizeof(hash), timeoutMs) ||
+            memcmp(hash, rec.layoutHash, sizeof(hash)) != 0) {
+            misses++;
+            Serial.println("[GATT] Layout hash mismatch — full discovery");
+            return false;
+        }
+        // Auth response 32 byte gửi bằng write command → cần MTU > 35
+        for (uint32_t t = 0; mtu < 35 && t < timeoutMs; t += 5) vTaskDelay(pdMS_TO_TICKS(5));
+        if (mtu < 35) { misses++; return false; }
+        hits++;
+        fast = true;
+        return true;
+    }
+
+    // Sau discovery đầy đủ: lưu handle + hash (hash null → Anchor cũ, không cache)
+    void learn(BLEClient* c, BLEAddress addr, uint8_t addrType,
+               BLERemoteCharacteristic* const chars[GATT_CH_COUNT], const uint8_t* hash) {
+        client = c;
+        fast   = false;
+        if (!hash) { invalidate(); return; }
+        GattCacheRecord r = {};
+        r.magic    = GATT_CACHE_MAGIC;
+        memcpy(r.addr, *addr.getNative(), 6);
+        r.addrType = addrType;
+        r.mtu      = c->getMTU();
+        for (int i = 0; i < GATT_CH_COUNT; i++) {
+            r.value[i] = chars[i]->getHandle();
+            BLERemoteDescriptor* d = chars[i]->getDescriptor(BLEUUID((uint16_t)0x2902));
+            r.cccd[i]  = d ? d->getHandle() : 0;
+        }
+        memcpy(r.layoutHash, hash, GATT_LAYOUT_HASH_LEN);
+        if (valid && memcmp(&r, &rec, sizeof(r)) == 0) return;   // không ghi flash nếu không đổi
+
+        rec   = r;
+        valid = true;
+        Preferences prefs;
+        prefs.begin("gattcache", false);
+        prefs.putBytes("rec", &rec, sizeof(rec));
+        prefs.end();
+        Serial.printf("[GATT] Cache saved: handles=%u/%u/%u\n", rec.value[0], rec.value[1], rec.value[2]);
+    }
+
+    void invalidate() {
+        if (!valid) return;
+        valid = false;
+        fast  = false;
+        Preferences prefs;
+        prefs.begin("gattcache", false);
+        prefs.remove("rec");
+        prefs.end();
+        Serial.println("[GATT] Cache cleared");
+    }
+
+    // Gọi từ onDisconnect
+    void detach() { fast = false; client = nullptr; }
+
+    bool active() const { return fast; }
+
+    // ── Raw ATT ops (chỉ khi active()) ─────────────────────────────────────────
+    bool subscribe(GattChar ch, uint32_t timeoutMs) {
+        BLEClient* c;
+        if (!fast || !rec.cccd[ch] || !(c = beginOp(OP_WRITE))) return false;
+        esp_ble_gattc_register_for_notify(c->getGattcIf(), *c->getPeerAddress().getNative(), rec.value[ch]);
+        uint8_t en[2] = { 0x01, 0x00 };
+        if (esp_ble_gattc_write_char_descr(c->getGattcIf(), c->getConnId(), rec.cccd[ch],
+                                           sizeof(en), en, ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE) != ESP_OK) {
+            op = OP_NONE;
+            return false;
+        }
+        return waitOp(timeoutMs);
+    }
+
+    // Write command (không response) — giống writeValue(data, len) mặc định
+    bool write(GattChar ch, const uint8_t* data, size_t len) {
+        BLEClient* c = client;
+        if (!fast || !c || !c->isConnected()) return false;
+        return esp_ble_gattc_write_char(c->getGattcIf(), c->getConnId(), rec.value[ch], len,
+                                        (uint8_t*)data, ESP_GATT_WRITE_TYPE_NO_RSP, ESP_GATT_AUTH_REQ_NONE) == ESP_OK;
+    }
+
+    // Trả về số byte đọc được, 0 nếu lỗi
+    size_t read(GattChar ch, uint8_t* out, size_t maxLen, uint32_t timeoutMs) {
+        BLEClient* c;
+        if (!fast || !(c = beginOp(OP_READ))) return 0;
+        if (esp_ble_gattc_read_char(c->getGattcIf(), c->getConnId(), rec.value[ch],
+                                    ESP_GATT_AUTH_REQ_NONE) != ESP_OK) {
+            op = OP_NONE;
+            return 0;
+        }
+        if (!waitOp(timeoutMs)) return 0;
+        size_t n = min((size_t)readLen, maxLen);
+        memcpy(out, readBuf, n);
+        return n;
+    }
+
+    bool readByUuid(const char* uuid, uint8_t* out, size_t len, uint32_t timeoutMs) {
+        BLEClient* c = beginOp(OP_READ);
+        if (!c) return false;
+        if (esp_ble_gattc_read_by_type(c->getGattcIf(), c->getConnId(), 0x0001, 0xFFFF,
+                                       BLEUUID(uuid).getNative(), ESP_GATT_AUTH_REQ_NONE) != ESP_OK) {
+            op = OP_NONE;
+            return false;
+        }
+        if (!waitOp(timeoutMs) || readLen != len) return false;
+        memcpy(out, readBuf, len);
+        return true;
+    }
+
+    // Tag là central → áp dụng connection interval trực tiếp (đơn vị 1.25 ms)
+    static void tuneConnParams(BLEAddress addr, uint16_t minInt, uint16_t maxInt,
+                               uint16_t latency, uint16_t timeout10ms) {
+        esp_ble_conn_update_params_t p = {};
+        memcpy(p.bda, *addr.getNative(), 6);
+        p.min_int = minInt;
+        p.max_int = maxInt;
+        p.latency = latency;
+        p.timeout = timeout10ms;
+        esp_ble_gap_update_conn_params(&p);
+    }
+
+    void print() const {
+        Serial.printf("[GATT] cache=%s fast hits=%lu misses=%lu\n", valid ? "valid" : "empty",
+                      (unsigned long)hits, (unsigned long)misses);
+    }
+};
+
+GattCache* GattCache::self = nullptr;
+
+#endif // GATT_CACHE_H
@@ -0,0 +1,159 @@
+#ifndef LOW_POWER_H
+#define LOW_POWER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <esp_pm.h>
+#include <esp_bt.h>
+
+// ==================== Low-power ranging ====================
+// Tag chạy pin — giữa 2 slot ranging cả DW3000 lẫn ESP32-S3 được ngủ:
+// - DW3000: deep sleep (dwt_entersleep), host đánh thức bằng CSn (dwt_wakeup_ic)
+//   rồi dwt_restoreconfig() — config nằm trong AON, không phải init lại.
+// - ESP32-S3: esp_pm auto light sleep khi mọi task idle, BLE controller modem sleep
+//   giữa các connection event. uwbTask giữ PM lock NO_LIGHT_SLEEP khi DW3000 thức
+//   (SPI + chờ IRQ) — light sleep không cắt ngang 1 lần đo.
+//
+// UwbPowerMeter: thời gian DW3000 ở từng trạng thái (reset / ngủ / thức) và phần
+// TX+RX thật sự bật — radio-on time đo được, không phải ước lượng.
+// PowerBudget: nhân tỉ lệ đó với dòng điển hình trong tag_config.h (PWR_*) → dòng
+// trung bình + giờ pin, so với chế độ cũ (DW3000 idle giữa 2 slot, ESP32 không
+// light sleep) với cùng số lần đo. PWR_* là số datasheet — đo trên board rồi sửa.
+// Chỉ uwbTask gọi UwbPowerMeter / hold / release.
+// Tools/power_bench chạy nguyên file này trên đồng hồ giả (timeline slot → số [LP]).
+
+enum UwbPowerState : uint8_t {
+    UWB_PWR_OFF = 0,    // giữ RST (UWB chưa init / đã deinit)
+    UWB_PWR_SLEEP,      // deep sleep giữa 2 slot hoặc lúc SUSPEND
+    UWB_PWR_AWAKE,      // IDLE + TX/RX
+    UWB_PWR_COUNT
+};
+
+struct UwbPowerSnapshot {
+    uint64_t us[UWB_PWR_COUNT];
+    uint64_t trxUs;          // phần của AWAKE có TX hoặc RX bật
+    uint32_t slots;
+    uint32_t wakes;
+    uint32_t wakeFails;
+    uint32_t wakeMaxUs;      // CSn → IDLE_RC
+    uint64_t wakeSumUs;
+};
+
+class UwbPowerMeter {
+private:
+    UwbPowerSnapshot acc = {};
+    UwbPowerState    st  = UWB_PWR_OFF;
+    int64_t          sinceUs    = 0;
+    int64_t          trxSinceUs = 0;
+
+    void settle(int64_t now) {
+        acc.us[st] += (uint64_t)(now - sinceUs);
+        sinceUs = now;
+    }
+
+public:
+    void begin() { sinceUs = esp_timer_get_time(); }
+
+    void enter(UwbPowerState next) {
+        if (next == st) return;
+        settle(esp_timer_get_time());
+        st = next;
+    }
+
+    void slot() { acc.slots++; }
+
+    void trxStart() { trxSinceUs = esp_timer_get_time(); }
+    void trxStop() {
+        if (!trxSinceUs) return;
+        acc.trxUs += (uint64_t)(esp_timer_get_time() - trxSinceUs);
+        trxSinceUs = 0;
+    }
+
+    void wakeDone(uint32_t us, bool ok) {
+        if (!ok) { acc.wakeFails++; return; }
+        acc.wakes++;
+        acc.wakeSumUs += us;
+        if (us > acc.wakeMaxUs) acc.wakeMaxUs = us;
+    }
+
+    UwbPowerSnapshot snapshot() {
+        settle(esp_timer_get_time());
+        return acc;
+    }
+};
+
+// Dòng trung bình từ snapshot. ESP32: active trong lúc DW3000 thức (uwbTask giữ
+// PM lock), còn lại light sleep (hoặc WAITI idle nếu light sleep không bật được);
+// BLE connection cộng PWR_BLE_CONN_UA cố định.
+struct PowerBudget {
+    uint32_t avgUa;
+    uint32_t baselineUa;
+    uint32_t hours;
+    uint32_t baselineHours;
+    uint16_t radioOnPermille;   // DW3000 thức / tổng thời gian UWB init
+    uint16_t trxPermille;       // TX+RX / tổng thời gian UWB init
+
+    static PowerBudget estimate(const UwbPowerSnapshot& s, bool espLightSleep) {
+        PowerBudget b = {};
+        uint64_t total = s.us[UWB_PWR_OFF] + s.us[UWB_PWR_SLEEP] + s.us[UWB_PWR_AWAKE];
+        if (!total) return b;
+        uint64_t trx   = s.trxUs < s.us[UWB_PWR_AWAKE] ? s.trxUs : s.us[UWB_PWR_AWAKE];
+        uint64_t idle  = s.us[UWB_PWR_AWAKE] - trx;
+        uint64_t other = s.us[UWB_PWR_OFF] + s.us[UWB_PWR_SLEEP];   // ESP32 không chờ DW3000
+
+        // Điện tích µA·µs — uint64 đủ cho nhiều tháng
+        uint64_t dw   = s.us[UWB_PWR_OFF] * PWR_DW_RESET_UA + s.us[UWB_PWR_SLEEP] * PWR_DW_SLEEP_UA +
+                        idle * PWR_DW_IDLE_UA + trx * PWR_DW_TRX_UA;
+        uint64_t esp  = s.us[UWB_PWR_AWAKE] * PWR_ESP_ACTIVE_UA +
+                        other * (espLightSleep ? PWR_ESP_LIGHT_SLEEP_UA : PWR_ESP_IDLE_UA);
+        uint64_t dwBase  = s.us[UWB_PWR_OFF] * PWR_DW_RESET_UA + (s.us[UWB_PWR_SLEEP] + idle) * PWR_DW_IDLE_UA +
+                           trx * PWR_DW_TRX_UA;
+        uint64_t espBase = s.us[UWB_PWR_AWAKE] * PWR_ESP_ACTIVE_UA + other * PWR_ESP_IDLE_UA;
+
+        b.avgUa         = (uint32_t)((dw + esp) / total) + PWR_BLE_CONN_UA;
+        b.baselineUa    = (uint32_t)((dwBase + espBase) / total) + PWR_BLE_CONN_UA;
+        b.hours         = (uint32_t)((uint64_t)PWR_BATTERY_MAH * 1000U / b.avgUa);
+        b.baselineHours = (uint32_t)((uint64_t)PWR_BATTERY_MAH * 1000U / b.baselineUa);
+        b.radioOnPermille = (uint16_t)(s.us[UWB_PWR_AWAKE] * 1000U / total);
+        b.trxPermille     = (uint16_t)(trx * 1000U / total);
+        return b;
+    }
+};
+
+// esp_pm: auto light sleep + PM lock cho cửa sổ DW3000 thức.
+// Cần firmware build với CONFIG_PM_ENABLE + CONFIG_FREERTOS_USE_TICKLESS_IDLE; thiếu
+// → esp_pm_configure lỗi, ESP32 chỉ idle (WAITI) và budget tính theo PWR_ESP_IDLE_UA.
+// min = max freq: không DFS — SPI/UART của Arduino tính divider theo APB lúc begin.
+class EspPowerManager {
+private:
+    esp_pm_lock_handle_t lock = nullptr;
+    bool lightSleep = false;
+    bool held       = false;
+
+public:
+    // setup(), trước khi tạo task
+    void begin() {
+        esp_pm_config_esp32s3_t cfg = {};
+        cfg.max_freq_mhz       = (int)getCpuFrequencyMhz();
+        cfg.min_freq_mhz       = cfg.max_freq_mhz;
+        cfg.light_sleep_enable = true;
+        esp_err_t err = esp_pm_configure(&cfg);
+        lightSleep = err == ESP_OK;
+        if (lightSleep && esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "uwb", &lock) != ESP_OK) lock = nullptr;
+        if (lightSleep) Serial.println("[LP] ESP32 auto light sleep enabled");
+        else            Serial.printf("[LP] Auto light sleep unavailable (%s) — ESP32 idles awake\n", esp_err_to_name(err));
+    }
+
+    // Sau BLEDevice::init — controller ngủ giữa các connection/scan event
+    void enableBleModemSleep() {
+        esp_err_t err = esp_bt_sleep_enable();
+        if (err != ESP_OK) Serial.printf("[LP] BLE modem sleep unavailable (%s)\n", esp_err_to_name(err));
+    }
+
+    void hold()    { if (lock && !held) { esp_pm_lock_acquire(lock); held = true; } }
+    void release() { if (lock && held)  { esp_pm_lock_release(lock); held = false; } }
+
+    bool lightSleepEnabled() const { return lightSleep; }
+};
+
+#endif // LOW_POWER_H
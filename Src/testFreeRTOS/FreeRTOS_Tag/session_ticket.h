@@ -0,0 +1,237 @@
+#ifndef SESSION_TICKET_H
+#define SESSION_TICKET_H
+
+#include <Arduino.h>
+#include <mbedtls/md.h>
+
+// ==================== Session resumption ticket ====================
+// Sau challenge/HMAC đầy đủ, Anchor cấp 1 ticket ngắn hạn. Tag reconnect trong
+// thời hạn ticket gửi 1 write duy nhất lên auth characteristic thay vì chờ
+// challenge → HMAC → AUTH_OK:
+//
+//   RESUME  = 'R' | id(4) | nonce(8) | mac(16)                        (29 byte)
+//   mac     = HMAC(secret, "RSM" | id | nonce)[0..16]
+//   secret  = HMAC(pairingKey, "TKT" | seed(16) | id)[0..16]
+//   seed    = challenge của lần auth đầy đủ, hoặc mac của lần resume trước
+//
+// Secret không bao giờ đi trên sóng — 2 bên tự tính từ pairingKey + seed.
+// Anchor trả lời bằng notify trên auth characteristic:
+//   "TICKET"    | id(4) | lifetime_s(2)   sau AUTH_OK
+//   "RESUME_OK" | id(4) | lifetime_s(2)   ticket mới (seed = mac vừa nhận)
+//   "RESUME_FAIL"                         Tag quay về challenge/HMAC
+//
+// Replay: ticket dùng đúng 1 lần — bị tiêu khi Anchor nhận RESUME với id đó,
+// kể cả khi mac sai. Hết hạn theo millis() của Anchor; Anchor reboot → bảng
+// ticket (RAM) mất → mọi ticket cũ bị từ chối.
+//
+// File giống nhau ở Tag và Anchor: Tag dùng TicketWallet, Anchor dùng TicketIssuer.
+
+#define TICKET_ID_LEN      (4)
+#define TICKET_NONCE_LEN   (8)
+#define TICKET_MAC_LEN     (16)
+#define TICKET_SEED_LEN    (16)
+#define TICKET_RESUME_LEN  (1 + TICKET_ID_LEN + TICKET_NONCE_LEN + TICKET_MAC_LEN)
+#define TICKET_RESUME_TAG  ('R')
+
+namespace Ticket {
+
+// HMAC-SHA256(key, label | a | b), cắt còn outLen byte
+inline bool mac(const uint8_t* key, size_t keyLen, const char* label,
+                const uint8_t* a, size_t aLen, const uint8_t* b, size_t bLen,
+                uint8_t* out, size_t outLen) {
+    uint8_t full[32];
+    mbedtls_md_context_t ctx;
+    mbedtls_md_init(&ctx);
+    bool ok = mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1) == 0 &&
+              mbedtls_md_hmac_starts(&ctx, key, keyLen) == 0 &&
+              mbedtls_md_hmac_update(&ctx, (const uint8_t*)label, strlen(label)) == 0 &&
+              mbedtls_md_hmac_update(&ctx, a, aLen) == 0 &&
+              mbedtls_md_hmac_update(&ctx, b, bLen) == 0 &&
+              mbedtls_md_hmac_finish(&ctx, full) == 0;
+    mbedtls_md_free(&ctx);
+    if (ok) memcpy(out, full, outLen);
+    return ok;
+}
+
+inline bool deriveSecret(const uint8_t* pairingKey, const uint8_t* seed, const uint8_t* id, uint8_t* secret) {
+    return mac(pairingKey, 16, "TKT", seed, TICKET_SEED_LEN, id, TICKET_ID_LEN, secret, 16);
+}
+
+inline bool resumeMac(const uint8_t* secret, const uint8_t* id, const uint8_t* nonce, uint8_t* out) {
+    return mac(secret, 16, "RSM", id, TICKET_ID_LEN, nonce, TICKET_NONCE_LEN, out, TICKET_MAC_LEN);
+}
+
+// So sánh constant-time
+inline bool equal(const uint8_t* a, const uint8_t* b, size_t n) {
+    uint8_t d = 0;
+    for (size_t i = 0; i < n; i++) d |= a[i] ^ b[i];
+    return d == 0;
+}
+
+} // namespace Ticket
+
+// =============================================================================
+// Anchor: cấp + xác minh ticket. Chỉ 1 task gọi issue()/verify() (authTask).
+// =============================================================================
+
+#ifndef TICKET_SLOTS
+#define TICKET_SLOTS (4)
+#endif
+
+class TicketIssuer {
+public:
+    enum Result : uint8_t { RESUME_OK = 0, RESUME_MALFORMED, RESUME_UNKNOWN, RESUME_EXPIRED, RESUME_BAD_MAC };
+
+private:
+    struct Entry {
+        uint8_t  id[TICKET_ID_LEN];
+        uint8_t  secret[16];
+        uint32_t issuedAt;
+        bool     live;
+    };
+
+    Entry          slots[TICKET_SLOTS] = {};
+    const uint8_t* key        = nullptr;
+    uint32_t       lifetimeMs = 0;
+    uint32_t       issued = 0, resumed = 0;
+    uint32_t       rejected[RESUME_BAD_MAC + 1] = {};
+
+    bool expired(const Entry& e, uint32_t now) const { return now - e.issuedAt >= lifetimeMs; }
+
+public:
+    static const char* name(Result r) {
+        static const char* NAMES[] = { "OK", "malformed", "unknown", "expired", "bad mac" };
+        return r <= RESUME_BAD_MAC ? NAMES[r] : "?";
+    }
+
+    void begin(const uint8_t* pairingKey, uint32_t lifetime) {
+        key        = pairingKey;
+        lifetimeMs = lifetime;
+    }
+
+    // Cấp ticket từ seed, ghi "<prefix>" | id | lifetime_s vào out. Trả về độ dài, 0 nếu lỗi.
+    size_t issue(const uint8_t* seed, const char* prefix, uint8_t* out, size_t outMax) {
+        size_t plen = strlen(prefix);
+        if (!key || outMax < plen + TICKET_ID_LEN + 2) return 0;
+
+        // Slot trống/hết hạn, hết thì thay ticket cũ nhất
+        uint32_t now = millis();
+        Entry* e = &slots[0];
+        for (Entry& s : slots) {
+            if (!s.live || expired(s, now)) { e = &s; break; }
+            if (now - s.issuedAt > now - e->issuedAt) e = &s;
+        }
+        esp_fill_random(e->id, TICKET_ID_LEN);
+        if (!Ticket::deriveSecret(key, seed, e->id, e->secret)) { e->live = false; return 0; }
+        e->issuedAt = now;
+        e->live     = true;
+        issued++;
+
+        uint16_t lifeS = (uint16_t)(lifetimeMs / 1000);
+        memcpy(out, prefix, plen);
+        memcpy(out + plen, e->id, TICKET_ID_LEN);
+        memcpy(out + plen + TICKET_ID_LEN, &lifeS, 2);
+        return plen + TICKET_ID_LEN + 2;
+    }
+
+    // Xác minh RESUME. OK → mac (seed cho ticket kế tiếp) ghi vào seedOut.
+    Result verify(const uint8_t* req, size_t len, uint8_t* seedOut) {
+        Result r = RESUME_UNKNOWN;
+        if (len != TICKET_RESUME_LEN || req[0] != TICKET_RESUME_TAG) {
+            r = RESUME_MALFORMED;
+        } else {
+            const uint8_t* id    = req + 1;
+            const uint8_t* nonce = id + TICKET_ID_LEN;
+            const uint8_t* mac   = nonce + TICKET_NONCE_LEN;
+            for (Entry& e : slots) {
+                if (!e.live || memcmp(e.id, id, TICKET_ID_LEN) != 0) continue;
+                e.live = false;                                   // 1 lần duy nhất
+                uint8_t expect[TICKET_MAC_LEN];
+                if (expired(e, millis()))                                    r = RESUME_EXPIRED;
+                else if (!Ticket::resumeMac(e.secret, id, nonce, expect) ||
+                         !Ticket::equal(expect, mac, TICKET_MAC_LEN))        r = RESUME_BAD_MAC;
+                else { r = RESUME_OK; memcpy(seedOut, mac, TICKET_SEED_LEN); }
+                memset(e.secret, 0, sizeof(e.secret));
+                break;
+            }
+        }
+        if (r == RESUME_OK) resumed++;
+        else                rejected[r]++;
+        return r;
+    }
+
+    bool hasLive() const {
+        uint32_t now = millis();
+        for (const Entry& e : slots) if (e.live && !expired(e, now)) return true;
+        return false;
+    }
+
+    void print() const {
+        Serial.printf("[TICKET] issued=%lu resumed=%lu rejected: malformed=%lu unknown=%lu expired=%lu badmac=%lu\n",
+                      (unsigned long)issued, (unsigned long)resumed,
+                      (unsigned long)rejected[RESUME_MALFORMED], (unsigned long)rejected[RESUME_UNKNOWN],
+                      (unsigned long)rejected[RESUME_EXPIRED], (unsigned long)rejected[RESUME_BAD_MAC]);
+    }
+};
+
+// =============================================================================
+// Tag: giữ 1 ticket. accept() chạy trong notify callback (chỉ copy), phần HMAC
+// chạy trong bleTask lúc build RESUME.
+// =============================================================================
+
+#ifndef TICKET_EXPIRY_MARGIN_MS
+#define TICKET_EXPIRY_MARGIN_MS (1000U)   // không dùng ticket sắp hết hạn
+#endif
+
+class TicketWallet {
+private:
+    uint8_t           seed[TICKET_SEED_LEN];      // seed của ticket sắp nhận
+    uint8_t           id[TICKET_ID_LEN];
+    uint8_t           ticketSeed[TICKET_SEED_LEN];
+    volatile uint32_t expiresAt = 0;
+    volatile bool     valid     = false;
+
+public:
+    // Trước khi gửi auth response / RESUME: seed mà ticket trả về sẽ gắn với
+    void expect(const uint8_t* s) { memcpy(seed, s, TICKET_SEED_LEN); }
+
+    // payload = id(4) | lifetime_s(2) (phần sau "TICKET" / "RESUME_OK")
+    void accept(const uint8_t* payload) {
+        uint16_t lifeS;
+        memcpy(&lifeS, payload + TICKET_ID_LEN, 2);
+        valid = false;
+        memcpy(id, payload, TICKET_ID_LEN);
+        memcpy(ticketSeed, seed, TICKET_SEED_LEN);
+        uint32_t life = (uint32_t)lifeS * 1000UL;
+        if (life <= TICKET_EXPIRY_MARGIN_MS) return;
+        expiresAt = millis() + life - TICKET_EXPIRY_MARGIN_MS;
+        valid     = true;
+    }
+
+    void discard() { valid = false; }
+
+    bool usable() const { return valid && (int32_t)(expiresAt - millis()) > 0; }
+
+    // Build RESUME (TICKET_RESUME_LEN byte). Ticket bị tiêu ngay — Anchor cũng vậy.
+    // nonceOut (tuỳ chọn) = nonce để gắn trace session.
+    bool buildResume(const uint8_t* pairingKey, uint8_t* out, uint8_t* nonceOut = nullptr) {
+        if (!usable()) return false;
+        valid = false;
+        uint8_t secret[16];
+        uint8_t* pid   = out + 1;
+        uint8_t* nonce = pid + TICKET_ID_LEN;
+        uint8_t* mac   = nonce + TICKET_NONCE_LEN;
+        out[0] = TICKET_RESUME_TAG;
+        memcpy(pid, id, TICKET_ID_LEN);
+        esp_fill_random(nonce, TICKET_NONCE_LEN);
+        bool ok = Ticket::deriveSecret(pairingKey, ticketSeed, id, secret) &&
+                  Ticket::resumeMac(secret, id, nonce, mac);
+        memset(secret, 0, sizeof(secret));
+        if (!ok) return false;
+        expect(mac);                       // ticket kế tiếp gắn với mac này
+        if (nonceOut) memcpy(nonceOut, nonce, TICKET_NONCE_LEN);
+        return true;
+    }
+};
+
+#endif // SESSION_TICKET_H
@@ -10,6 +10,7 @@
 #define CHARACTERISTIC_UUID "abcdef12-3456-7890-abcd-ef1234567890"
 #define AUTH_CHAR_UUID      "beb5483e-36e1-4688-b7f5-ea07361b26a8"
 #define CHALLENGE_CHAR_UUID "ceb5483e-36e1-4688-b7f5-ea07361b26a9"
+#define GATT_LAYOUT_CHAR_UUID "5e7a1c3d-9b2f-4d6e-8a1c-2f4b6d8e0a13"   // hash bảng attribute Anchor
 
 // ── Distance thresholds ───────────────────────────────────────────────────────
 #define UWB_UNLOCK_DISTANCE_M   (3.0)   // ≤ 
@@ -21,6 +22,56 @@
 #define RSSI_THRESHOLD_DBM      (-100)  // RSSI above this → resume UWB (≈ 20 m BLE range)
 #define RSSI_CHECK_INTERVAL_MS  (1000U) // how often to check RSSI while UWB is stopped
 
+// ── Challenge ─────────────────────────────────────────────────────────────────
+// Anchor notify challenge ngay khi Tag ghi CCCD. Không nhận được trong khoảng
+// này → fallback readValue() poll.
+#define CHALLENGE_NOTIFY_WAIT_MS (1500U)
+
+// ── Session resumption (session_ticket.h) ─────────────────────────────────────
+// Reconnect khi còn ticket từ Anchor → gửi RESUME thay vì challenge/HMAC.
+// Không có trả lời trong RESUME_WAIT_MS → quay về challenge trên cùng connection.
+#define TICKET_ENABLE           (1)
+#define RESUME_WAIT_MS          (800U)
+
+// ── Fast reconnect (gatt_cache.h) ─────────────────────────────────────────────
+// Handle + MTU của Anchor lưu NVS; gặp lại cùng địa chỉ + layout hash khớp →
+// bỏ qua service discovery. Connection interval đơn vị 1.25 ms, timeout 10 ms.
+#define GATT_CACHE_ENABLE       (1)
+#define GATT_CACHE_OP_TIMEOUT_MS (1000U)
+#define CONN_FAST_MIN_INT       (6)     // 7.5 ms — connect → auth → arm UWB
+#define CONN_FAST_MAX_INT       (12)    // 15 ms
+#define CONN_IDLE_MIN_INT       (12)    // 15 ms — sau khi UWB armed (chỉ còn verdict/warning)
+#define CONN_IDLE_MAX_INT       (24)    // 30 ms
+#define CONN_SUP_TIMEOUT        (400)   // 4 s
+
+// ── Boot (boot_profile.h) ─────────────────────────────────────────────────────
+// Profile từng giai đoạn boot ghi vào RTC memory, in ở lần boot kế tiếp.
+// BOOT_FAST: bỏ delay cố định trước scan (chờ Serial 500 ms, giữ reset DW3000
+// 100 ms); BLE init + GATT cache chạy trong bleTask (Core 0) song song với setup.
+// 0 = thứ tự boot cũ — để so profile 2 chế độ.
+#define BOOT_FAST               (1)
+#define BOOT_SERIAL_WAIT_MS     (200U)  // chờ host mở USB-CDC tối đa; UART0 không chờ
+
+// ── Low-power ranging (low_power.h) ───────────────────────────────────────────
+// DW3000 deep sleep giữa 2 slot (wake bằng CSn) và lúc SUSPEND; ESP32 auto light
+// sleep + BLE modem sleep; LED DW3000 tắt. 0 = DW3000 thức suốt, nghỉ 20 ms như cũ.
+// Slot dài hơn → ít dòng hơn nhưng bộ lọc DIST_FILTER_SIZE mẫu cần SIZE × slot để ổn định.
+#define UWB_LP_ENABLE           (1)
+#define UWB_LP_SLOT_MS          (100U)  // chu kỳ ranging (10 Hz)
+#define UWB_LP_WAKE_TIMEOUT_MS  (5U)    // CSn wake → IDLE_RC; quá → init lại DW3000
+#define UWB_LP_REPORT_MS        (10000U)// in radio-on time + current budget (0 = chỉ khi STOP)
+
+// Current budget — dòng điển hình (µA), số datasheet, đo lại trên board
+#define PWR_DW_TRX_UA           (55000U) // DW3000 RX/TX ch5 (SS-TWR initiator chủ yếu RX)
+#define PWR_DW_IDLE_UA          (7500U)  // IDLE_PLL
+#define PWR_DW_SLEEP_UA         (1U)     // DEEPSLEEP
+#define PWR_DW_RESET_UA         (500U)   // giữ RST — chưa đo, giả sử như IDLE_RC
+#define PWR_ESP_ACTIVE_UA       (45000U) // 240 MHz, uwbTask chạy
+#define PWR_ESP_IDLE_UA         (30000U) // 240 MHz, WAITI (không light sleep)
+#define PWR_ESP_LIGHT_SLEEP_UA  (2000U)  // light sleep, XTAL giữ cho BLE
+#define PWR_BLE_CONN_UA         (1500U)  // trung bình connection event 15–30 ms
+#define PWR_BATTERY_MAH         (500U)
+
 // ── UWB retry ────────────────────────────────────────────────────────────────
 #define UWB_REQUEST_RETRY_MS    (5000U) // retry TAG_UWB_READY if Anchor hasn't responded
 
@@ -41,7 +92,30 @@
 // Anchor phản hồi sau POLL_RX_TO_RESP_TX_DLY_UUS = 3000µs + frame TX ~1100µs
 // → response đến Tag ở ~4100µs từ POLL TX. 10000µs cho margin an toàn × 2.
 #define RESP_RX_TIMEOUT_UUS     (50000U)
+#define UWB_RX_WAIT_MS          (60U)    // > RX timeout (~51 ms): chỉ là hạn dự phòng khi lỡ cạnh IRQ
 #define MSG_BUFFER_SIZE         (20U)
 
 // ── Distance filter ───────────────────────────────────────────────────────────
 #define DIST_FILTER_SIZE (5)
+
+// ── NLOS detection (cir_nlos.h) ───────────────────────────────────────────────
+// Đọc CIR quanh first path sau mỗi Response; mẫu NLOS giảm trọng số trong distance filter.
+#define CIR_NLOS_ENABLE  (1)
+#define CIR_NLOS_WEIGHT  (0.25f)  // trọng số mẫu NLOS (LOS = 1)
+#define CIR_DUMP         (0)      // 1 = in cả cửa sổ CIR ra Serial cho Tools/cir_bench (chậm, chỉ để thu corpus)
+
+// ── Deferred log (dlog.h) ─────────────────────────────────────────────────────
+// Log trong uwbTask/bleTask/notify callback ghi vào ring, dlogTask in sau.
+#define DLOG_LEVEL            DLOG_LVL_INFO
+#define DLOG_RING_SIZE        (64)     // entry/core, 32 byte/entry
+#define DLOG_DRAIN_MS         (20U)
+#define DLOG_TASK_STACK       (4096)   // snprintf %f
+#define DLOG_TASK_PRIO        (1)
+#define DLOG_TASK_CORE        (0)
+
+// ── Telemetry (telemetry.h, decode bằng Tools/telemetry_decode.py) ────────────
+// Tag là BLE client → chỉ có sink Serial (binary xen lẫn log text).
+// Bật khi đọc bằng decoder qua USB — Serial Monitor sẽ hiện ký tự rác.
+#define TELEMETRY_ENABLE      (0)
+#define TELEMETRY_SINKS       (TELEMETRY_SINK_SERIAL)
+#define TELEMETRY_PERIOD_MS   (2000U)
@@ -0,0 +1,167 @@
+#ifndef UWB_FSM_H
+#define UWB_FSM_H
+
+#include <Arduino.h>
+#include "dlog.h"
+
+// ==================== UWB state machine ====================
+// uwbTask chỉ block ở 1 chỗ: xTaskNotifyWait trên notification value của nó.
+// - Lệnh (START/SUSPEND/STOP) từ task khác → xTaskNotify(eSetBits)
+// - DW3000 IRQ (RX xong / RX lỗi / timeout) → xTaskNotifyFromISR(eSetBits)
+// Cả 2 cùng đánh thức task → stop được xử lý trong lúc chờ frame, không phải
+// đợi hết RX timeout hay hết vòng ranging.
+//
+//   IDLE ──START──▶ INIT ──ok──▶ RANGING ──SUSPEND──▶ SUSPEND ──START──▶ RANGING
+//                     │fail         │STOP                 │STOP
+//                     ▼             ▼                     ▼
+//                   IDLE ◀──────── DEINIT ◀──────────────┘
+//
+// SUSPEND: DW3000 tắt TRX nhưng giữ config → resume không phải init lại.
+// Latency request → vào state mới được đo cho từng state đích.
+
+#define UWB_NOTIFY_IRQ      (1UL << 0)   // DW3000 IRQ line
+#define UWB_NOTIFY_START    (1UL << 1)   // init (IDLE) hoặc resume (SUSPEND)
+#define UWB_NOTIFY_SUSPEND  (1UL << 2)   // dừng ranging, giữ DW3000 configured
+#define UWB_NOTIFY_STOP     (1UL << 3)   // deinit, DW3000 về reset
+#define UWB_NOTIFY_CMDS     (UWB_NOTIFY_START | UWB_NOTIFY_SUSPEND | UWB_NOTIFY_STOP)
+
+enum UwbState : uint8_t {
+    UWB_ST_IDLE = 0,
+    UWB_ST_INIT,
+    UWB_ST_RANGING,
+    UWB_ST_SUSPEND,
+    UWB_ST_DEINIT,
+    UWB_ST_COUNT
+};
+
+class UwbFsm {
+public:
+    struct TransitionStats {
+        uint32_t count = 0;
+        uint32_t maxUs = 0;   // request → vào state
+        uint64_t sumUs = 0;
+    };
+
+private:
+    TaskHandle_t      task    = nullptr;
+    volatile UwbState st      = UWB_ST_IDLE;
+    uint32_t          pending = 0;              // lệnh đã nhận, chưa xử lý
+    uint32_t          early   = 0;              // lệnh tới trước attach()
+    portMUX_TYPE      mux     = portMUX_INITIALIZER_UNLOCKED;
+    volatile uint32_t requestedAtUs[4] = {};    // theo bit lệnh (index = bit)
+    volatile uint32_t requestSeq[4]    = {};    // thứ tự tới của lần request gần nhất
+    uint32_t          seqNext = 0;
+    TransitionStats   stats[UWB_ST_COUNT];
+
+    static int bitIndex(uint32_t bit) {
+        for (int i = 0; i < 4; i++) if (bit == (1UL << i)) return i;
+        return 0;
+    }
+
+public:
+    static const char* name(UwbState s) {
+        static const char* NAMES[UWB_ST_COUNT] = { "IDLE", "INIT", "RANGING", "SUSPEND", "DEINIT" };
+        return s < UWB_ST_COUNT ? NAMES[s] : "?";
+    }
+
+    // Dòng đầu uwbTask. Lệnh tới trước đó (BLE connect lúc boot) được giữ lại và
+    // notify ngay khi attach → vòng wait() đầu tiên thấy.
+    void attach(TaskHandle_t handle) {
+        portENTER_CRITICAL(&mux);
+        task = handle;
+        uint32_t bits = early;
+        early = 0;
+        portEXIT_CRITICAL(&mux);
+        if (bits) xTaskNotify(handle, bits, eSetBits);
+    }
+
+    // Producer (task bất kỳ, không dùng trong ISR)
+    void request(uint32_t cmd) {
+        requestedAtUs[bitIndex(cmd)] = micros();
+        portENTER_CRITICAL(&mux);
+        requestSeq[bitIndex(cmd)] = ++seqNext;
+        TaskHandle_t t = task;
+        if (!t) early |= cmd;
+        portEXIT_CRITICAL(&mux);
+        if (t) xTaskNotify(t, cmd, eSetBits);
+    }
+
+    // DW3000 IRQ handler
+    void IRAM_ATTR irqFromISR() {
+        BaseType_t woken = pdFALSE;
+        if (task) xTaskNotifyFromISR(task, UWB_NOTIFY_IRQ, eSetBits, &woken);
+        if (woken) portYIELD_FROM_ISR();
+    }
+
+    // uwbTask: chờ IRQ hoặc lệnh. Bit lệnh được gom vào pending (không mất khi
+    // caller chỉ quan tâm IRQ). Trả về true nếu có IRQ.
+    bool wait(TickType_t ticks) {
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, 0xFFFFFFFFUL, &bits, ticks);
+        pending |= bits & UWB_NOTIFY_CMDS;
+        return (bits & UWB_NOTIFY_IRQ) != 0;
+    }
+
+    // Bỏ IRQ cũ (vd. trước khi arm RX) — lệnh vẫn được giữ lại
+    void clearIrq() { wait(0); }
+
+    // Có lệnh làm state hiện tại phải dừng không (dùng trong vòng chờ RX)
+    bool interrupted() const {
+        return (pending & (UWB_NOTIFY_STOP | UWB_NOTIFY_SUSPEND)) != 0;
+    }
+
+    // Còn lệnh chưa xử lý → vòng task không được block chờ lệnh mới
+    bool hasCommand() const { return (pending & UWB_NOTIFY_CMDS) != 0; }
+
+    // Lấy lệnh theo thứ tự tới: lệnh mới nhất thắng các lệnh tới trước nó, trừ STOP —
+    // STOP rồi START/SUSPEND → trả STOP trước (deinit), lệnh sau vẫn pending cho lần gọi kế.
+    // Vd. STOP rồi START → IDLE rồi init lại → RANGING; START rồi STOP → chỉ STOP.
+    uint32_t takeCommand() {
+        uint32_t cmd = 0, newest = 0;
+        for (int i = 1; i < 4; i++) {
+            uint32_t bit = 1UL << i;
+            if ((pending & bit) && requestSeq[i] >= newest) { newest = requestSeq[i]; cmd = bit; }
+        }
+        if (cmd && cmd != UWB_NOTIFY_STOP && (pending & UWB_NOTIFY_STOP)) {
+            uint32_t stopSeq = requestSeq[bitIndex(UWB_NOTIFY_STOP)];
+            for (int i = 1; i < 4; i++)
+                if (requestSeq[i] <= stopSeq) pending &= ~(1UL << i);   // STOP + lệnh cũ hơn nó
+            return UWB_NOTIFY_STOP;
+        }
+        pending &= ~UWB_NOTIFY_CMDS;
+        return cmd;
+    }
+
+    // Chuyển state. cause = bit lệnh gây ra (0 = chuyển nội bộ, không đo latency)
+    void enter(UwbState next, uint32_t cause = 0) {
+        UwbState prev = st;
+        st = next;
+        if (!cause) {
+            DLOGI("[UWBFSM] %s -> %s", name(prev), name(next));
+            return;
+        }
+        uint32_t us = micros() - requestedAtUs[bitIndex(cause)];
+        TransitionStats& s = stats[next];
+        s.count++;
+        s.sumUs += us;
+        if (us > s.maxUs) s.maxUs = us;
+        DLOGI("[UWBFSM] %s -> %s in %lu us", name(prev), name(next), (unsigned long)us);
+    }
+
+    UwbState state() const { return st; }
+    bool     ranging() const { return st == UWB_ST_RANGING; }
+    const TransitionStats& get(UwbState s) const { return stats[s]; }
+
+    void print() const {
+        Serial.printf("[UWBFSM] state=%s |", name(st));
+        for (int i = 0; i < UWB_ST_COUNT; i++) {
+            const TransitionStats& s = stats[i];
+            if (!s.count) continue;
+            Serial.printf(" %s n=%lu avg=%lu max=%lu us |", name((UwbState)i), (unsigned long)s.count,
+                          (unsigned long)(s.sumUs / s.count), (unsigned long)s.maxUs);
+        }
+        Serial.println();
+    }
+};
+
+#endif // UWB_FSM_H
@@ -0,0 +1,43 @@
+#pragma once
+// Host shim cho Arduino API — chỉ đủ cho mcp2515.cpp, can_commands.h, can_scheduler.h và các
+// tool trong thư mục này.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "freertos_shim.h"
+
+#define HIGH   (1)
+#define LOW    (0)
+#define INPUT  (0)
+#define OUTPUT (1)
+#define HEX    (16)
+#define DEC    (10)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+class HostSerial {
+public:
+    void begin(unsigned long) {}
+    void flush() { fflush(stdout); }
+    size_t print(const char* s) { return (size_t)fputs(s, stdout); }
+    size_t print(long v, int base = DEC) { return (size_t)printf(base == HEX ? "%lX" : "%ld", v); }
+    size_t println() { return print("\n"); }
+    size_t println(const char* s) { return print(s) + println(); }
+    size_t println(long v, int base = DEC) { return print(v, base) + println(); }
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        va_list ap; va_start(ap, fmt);
+        int n = vprintf(fmt, ap);
+        va_end(ap);
+        return n < 0 ? 0 : (size_t)n;
+    }
+};
+extern HostSerial Serial;
@@ -0,0 +1,21 @@
+#pragma once
+// Host shim cho Arduino SPI — mọi byte được chuyển tới MCP2515 emulator.
+
+#include "Arduino.h"
+
+#define MSBFIRST  (1)
+#define SPI_MODE0 (0)
+
+class SPISettings {
+public:
+    SPISettings(uint32_t = 0, uint8_t = 0, uint8_t = 0) {}
+};
+
+class SPIClass {
+public:
+    void begin() {}
+    void beginTransaction(SPISettings) {}
+    void endTransaction() {}
+    uint8_t transfer(uint8_t data);
+};
+extern SPIClass SPI;
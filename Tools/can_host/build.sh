@@ -0,0 +1,15 @@
+#!/usr/bin/env bash
+# Build can_host: thư viện autowp-mcp2515 nguyên bản + CANCommands của anchor + MCP2515 emulator.
+set -euo pipefail
+HERE="$(cd "$(dirname "$0")" && pwd)"
+ROOT="$HERE/../.."
+ANCHOR="$ROOT/Src/testFreeRTOS/FreeRTOS_Anchor_TestSimFetchKey"
+LIB="$ROOT/lib/autowp-mcp2515"
+OUT="${1:-$HERE/can_host}"
+
+${CXX:-g++} -std=c++17 -O2 -Wall -Wextra -Wno-unused-parameter -DCAN_LOG_SERIAL \
+    -I"$HERE" -I"$LIB" -I"$ANCHOR" \
+    "$HERE/can_host.cpp" "$HERE/host_shim.cpp" "$HERE/mcp2515_emu.cpp" \
+    "$HERE/socketcan_backend.cpp" "$LIB/mcp2515.cpp" \
+    -o "$OUT"
+echo "built $OUT"
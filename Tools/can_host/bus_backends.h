@@ -0,0 +1,40 @@
+#pragma once
+// Backend cho Mcp2515Emu:
+//  - SocketCanBackend: gắn vào interface Linux SocketCAN (vcan0, can0...)
+//  - MemoryBus: bus trong bộ nhớ — dùng khi máy không có vcan, và cho selftest
+// Header này không include <linux/can.h> để tránh trùng struct can_frame với can.h của thư viện.
+
+#include "mcp2515_emu.h"
+#include <deque>
+#include <vector>
+
+class SocketCanBackend : public CanBusBackend {
+public:
+    SocketCanBackend() : fd(-1) {}
+    ~SocketCanBackend();
+    bool open(const char* ifname);
+    bool send(const EmuFrame& frame) override;
+    bool receive(EmuFrame& frame) override;
+
+private:
+    int fd;
+};
+
+class MemoryBus : public CanBusBackend {
+public:
+    bool ack = true;                   // false → không node nào ACK (bus hở / sai bitrate)
+    std::vector<EmuFrame> sent;        // frame emulator đã gửi, đúng thứ tự trên dây
+    std::deque<EmuFrame>  pending;     // frame chờ emulator nhận
+
+    bool send(const EmuFrame& frame) override {
+        if (!ack) return false;
+        sent.push_back(frame);
+        return true;
+    }
+    bool receive(EmuFrame& frame) override {
+        if (pending.empty()) return false;
+        frame = pending.front();
+        pending.pop_front();
+        return true;
+    }
+};
@@ -0,0 +1,347 @@
+// can_host — chạy đường CAN của anchor (MCP2515 + CANCommands + can_frames.h) trên Linux.
+// Thư viện autowp-mcp2515 được build nguyên bản; SPI của nó đi vào Mcp2515Emu,
+// emulator gửi/nhận frame qua SocketCAN (vcan0) hoặc bus trong bộ nhớ.
+//
+//   can_host [-i vcan0 | -m] <unlock | lock | sniff [giây] | bench [n] | selftest | dualbus>
+
+#include <SPI.h>
+#include <mcp2515.h>
+#include "can_commands.h"
+#include "can_scheduler.h"
+#include "vehicle_state.h"
+
+#include "mcp2515_emu.h"
+#include "bus_backends.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t SPI_HZ = 10000000UL;   // MCP2515::DEFAULT_SPI_CLOCK
+
+// ==================== Helpers ====================
+
+static bool waitTxIdle(Mcp2515Emu& emu, uint32_t timeoutMs) {
+    unsigned long t0 = millis();
+    while (millis() - t0 < timeoutMs) {
+        emu.poll();
+        if (!((emu.reg(0x30) | emu.reg(0x40) | emu.reg(0x50)) & 0x08)) return true;
+        delayMicroseconds(100);
+    }
+    return false;
+}
+
+static void printFrame(const struct can_frame& f) {
+    bool ext = f.can_id & CAN_EFF_FLAG;
+    uint32_t id = f.can_id & (ext ? CAN_EFF_MASK : CAN_SFF_MASK);
+    Serial.printf(ext ? "EXT  0x%08lX" : "STD  0x%03lX", (unsigned long)id);
+    Serial.printf("  DLC:%u  DATA:", f.can_dlc);
+    for (int i = 0; i < f.can_dlc; i++) Serial.printf(" %02X", f.data[i]);
+    Serial.println();
+}
+
+static void printSpiCost(const char* label, const Mcp2515Emu::Stats& s, uint32_t frames) {
+    double spiUs = (double)s.spiBytes * 8.0 * 1e6 / SPI_HZ;
+    Serial.printf("%-14s SPI: %llu B / %llu transactions (~%.0f us @ %lu MHz)",
+                  label, (unsigned long long)s.spiBytes, (unsigned long long)s.spiTransactions,
+                  spiUs, (unsigned long)(SPI_HZ / 1000000UL));
+    if (frames)
+        Serial.printf(" | per frame %.1f B, %.1f tx, ~%.1f us",
+                      (double)s.spiBytes / frames, (double)s.spiTransactions / frames, spiUs / frames);
+    Serial.println();
+}
+
+static bool runSequence(CANCommands& can, Mcp2515Emu& emu, bool unlock) {
+    emu.resetStats();
+    unsigned long t0 = micros();
+    bool ok = unlock ? can.unlockCar() : can.lockCar();
+    ok &= waitTxIdle(emu, 100);
+    unsigned long t1 = micros();
+    const Mcp2515Emu::Stats& s = emu.stats();
+    Serial.printf("%s: %llu frames on wire, %llu tx errors, %.1f ms\n", unlock ? "unlock" : "lock",
+                  (unsigned long long)s.txFrames, (unsigned long long)s.txErrors, (t1 - t0) / 1000.0);
+    printSpiCost(unlock ? "unlock" : "lock", s, (uint32_t)s.txFrames);
+    return ok;
+}
+
+// ==================== Commands ====================
+
+static int cmdSniff(MCP2515& mcp, Mcp2515Emu& emu, uint32_t seconds) {
+    VehicleStateDecoder vehicle;
+    struct can_frame f;
+    uint32_t count = 0;
+    unsigned long t0 = millis();
+    Serial.println("=== CAN MONITOR START ===");
+    while (seconds == 0 || millis() - t0 < seconds * 1000UL) {
+        if (mcp.readMessage(&f) == MCP2515::ERROR_OK) {
+            printFrame(f);
+            count++;
+            if (vehicle.feed(f))
+                Serial.printf("  -> vehicle %s\n",
+                              vehicle.getLockState() == VehicleState::LOCK_UNLOCKED ? "UNLOCKED" : "LOCKED");
+        } else {
+            delayMicroseconds(200);
+        }
+    }
+    const Mcp2515Emu::Stats& s = emu.stats();
+    Serial.printf("sniff: %lu frames read, %llu overflow, EFLG=0x%02X\n",
+                  (unsigned long)count, (unsigned long long)s.rxOverflows, mcp.getErrorFlags());
+    return 0;
+}
+
+static int cmdBench(MCP2515& mcp, CANCommands& can, Mcp2515Emu& emu, uint32_t n) {
+    Serial.printf("bitrate %lu bps, SPI %lu Hz\n", (unsigned long)emu.bitrate(), (unsigned long)SPI_HZ);
+
+    // 1) Sequence như firmware (delay 10 ms giữa các frame)
+    runSequence(can, emu, true);
+    runSequence(can, emu, false);
+
+    // 2) Burst TX: nạp frame liên tục, gặp ALLTXBUSY thì nhường 200 µs rồi thử lại
+    struct can_frame f;
+    f.can_id = 0x123;
+    f.can_dlc = 8;
+    memset(f.data, 0xA5, 8);
+    emu.resetStats();
+    uint32_t busy = 0;
+    unsigned long t0 = micros();
+    for (uint32_t i = 0; i < n; i++) {
+        f.data[0] = (uint8_t)i;
+        MCP2515::ERROR rc;
+        while ((rc = mcp.sendMessage(&f)) == MCP2515::ERROR_ALLTXBUSY) {
+            busy++;
+            delayMicroseconds(200);
+        }
+        if (rc != MCP2515::ERROR_OK) break;
+    }
+    waitTxIdle(emu, 1000);
+    unsigned long t1 = micros();
+    double secs = (t1 - t0) / 1e6;
+    double wireMax = emu.bitrate() / (47.0 * 1.1 + 64.0 * 1.1);
+    Serial.printf("burst TX: %llu frames in %.1f ms = %.0f fps (bus max ~%.0f fps), %lu ALLTXBUSY polls\n",
+                  (unsigned long long)emu.stats().txFrames, secs * 1000, emu.stats().txFrames / secs,
+                  wireMax, (unsigned long)busy);
+    printSpiCost("burst TX", emu.stats(), (uint32_t)emu.stats().txFrames);
+
+    // 3) Đường RX: loopback mode, mỗi frame gửi rồi đọc lại
+    mcp.setLoopbackMode();
+    uint32_t rx = 0;
+    Mcp2515Emu::Stats txOnly = {};
+    emu.resetStats();
+    for (uint32_t i = 0; i < n; i++) {
+        f.data[0] = (uint8_t)i;
+        mcp.sendMessage(&f);
+        waitTxIdle(emu, 10);
+        if (i == 0) txOnly = emu.stats();
+        struct can_frame r;
+        if (mcp.readMessage(&r) == MCP2515::ERROR_OK) rx++;
+    }
+    Mcp2515Emu::Stats rxCost = emu.stats();
+    // Trừ phần chi phí TX (đo ở frame đầu) để còn lại chi phí readMessage
+    rxCost.spiBytes        -= txOnly.spiBytes * n;
+    rxCost.spiTransactions -= txOnly.spiTransactions * n;
+    Serial.printf("loopback RX: %lu/%lu frames read back\n", (unsigned long)rx, (unsigned long)n);
+    printSpiCost("readMessage", rxCost, rx);
+    mcp.setNormalMode();
+    return rx == n ? 0 : 1;
+}
+
+// ==================== Selftest (MemoryBus) ====================
+
+static int failures = 0;
+static void check(bool ok, const char* what) {
+    Serial.printf("[%s] %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) failures++;
+}
+
+// So frame trên 1 bus với các frame route tới bus đó (mặc định chỉ emulate bus body)
+static bool sameAsTable(const MemoryBus& bus, const CANFrames::FrameData* table, int count,
+                        uint8_t busId = CAN_BUS_BODY) {
+    size_t n = 0;
+    for (int i = 0; i < count; i++) {
+        if (table[i].bus != busId && table[i].bus != CAN_BUS_ALL) continue;
+        if (n >= bus.sent.size()) return false;
+        const EmuFrame& e = bus.sent[n++];
+        if (e.ext || e.id != table[i].id || e.dlc != table[i].dlc) return false;
+        if (memcmp(e.data, table[i].data, e.dlc) != 0) return false;
+    }
+    return n == bus.sent.size();
+}
+
+static EmuFrame makeFrame(uint32_t id, uint8_t b2, uint8_t b3) {
+    EmuFrame e = {};
+    e.id = id;
+    e.dlc = 8;
+    e.data[2] = b2;
+    e.data[3] = b3;
+    return e;
+}
+
+static int cmdSelftest(MCP2515& mcp, CANCommands& can, Mcp2515Emu& emu, MemoryBus& bus) {
+    bus.sent.clear();
+    check(runSequence(can, emu, true), "unlock sequence sent");
+    check(sameAsTable(bus, CANFrames::UNLOCK_FRAMES, CANFrames::UNLOCK_FRAME_COUNT), "unlock frames match can_frames.h order");
+
+    bus.sent.clear();
+    check(runSequence(can, emu, false), "lock sequence sent");
+    check(sameAsTable(bus, CANFrames::LOCK_FRAMES, CANFrames::LOCK_FRAME_COUNT), "lock frames match can_frames.h order");
+
+    // Acceptance filter: chỉ CAN_BODY_STATUS_ID lên tới MCU
+    CANFilters::Compiled cfg = CANFilters::compile(CANFilters::RX_RULES, CANFilters::RX_RULE_COUNT);
+    check(can.applyFilters(cfg), "applyFilters");
+    emu.resetStats();
+    bus.pending.push_back(makeFrame(0x003, 0, 0));
+    bus.pending.push_back(makeFrame(CAN_BODY_STATUS_ID, CAN_LOCK_STATE_UNLOCKED, 0x01));
+    bus.pending.push_back(makeFrame(0x501, 0, 0));
+    emu.poll();                                                // frame tới trước khi MCU đọc
+    VehicleStateDecoder vehicle;
+    struct can_frame f;
+    int accepted = 0;
+    while (can.readFrame(&f)) { accepted++; vehicle.feed(f); }
+    check(accepted == 1 && emu.stats().rxRejected == 2, "filter passes only body status frame");
+    check(vehicle.getLockState() == VehicleState::LOCK_UNLOCKED && vehicle.isDoorOpen(), "decoder sees unlocked + door open");
+
+    // 3 frame khớp filter mà MCU không đọc → RXB0, RXB1 (rollover), rồi overflow
+    for (int i = 0; i < 3; i++) bus.pending.push_back(makeFrame(CAN_BODY_STATUS_ID, 0, 0));
+    emu.poll();
+    check(can.takeRxOverflows() == 1, "RX overflow reported after rollover");
+    while (can.readFrame(&f)) {}
+
+    // Không có ACK: TEC tăng tới error-passive, TXERR bật, frame không lên bus
+    bus.ack = false;
+    bus.sent.clear();
+    f.can_id = 0x7DF;
+    f.can_dlc = 8;
+    memset(f.data, 0, 8);
+    mcp.sendMessage(&f);
+    waitTxIdle(emu, 50);
+    uint8_t eflg = mcp.getErrorFlags();
+    check(bus.sent.empty() && emu.reg(0x1C) >= 128 && (eflg & MCP2515::EFLG_TXEP), "no-ACK drives TEC to error passive");
+    bus.ack = true;
+    waitTxIdle(emu, 50);
+    check(bus.sent.size() == 1 && emu.reg(0x1C) < 128, "frame delivered once ACK returns");
+
+    // Scheduler: command ngược chiều tới sau frame thứ 3 (BLE callback chen vào giữa
+    // sequence). LOCK giữa UNLOCK → UNLOCK dừng, LOCK chạy đủ; UNLOCK giữa LOCK → LOCK
+    // chạy đủ rồi mới tới UNLOCK.
+    static CanScheduler sched;
+    static int          checks = 0;
+    check(sched.begin(), "scheduler begin");
+    can.setAbortCheck([]() {
+        if (++checks == 4) sched.request(sched.current() == CAN_CMD_UNLOCK ? CAN_CMD_LOCK : CAN_CMD_UNLOCK);
+        return sched.shouldAbort();
+    });
+    CanCmdMsg msg;
+    sched.request(CAN_CMD_UNLOCK);
+    check(sched.take(msg, 0) && msg.cmd == CAN_CMD_UNLOCK, "scheduler hands out UNLOCK");
+    bus.sent.clear();
+    checks = 0;
+    bool ok = can.unlockCar();
+    waitTxIdle(emu, 100);
+    sched.finish(can.wasAborted());
+    check(!ok && can.wasAborted() && bus.sent.size() == 3, "LOCK requested during UNLOCK aborts it after 3 frames");
+    check(sched.take(msg, 0) && msg.cmd == CAN_CMD_LOCK, "pending LOCK runs next");
+    bus.sent.clear();
+    checks = 0;
+    ok = can.lockCar() && waitTxIdle(emu, 100);
+    sched.finish(can.wasAborted());
+    check(ok && sameAsTable(bus, CANFrames::LOCK_FRAMES, CANFrames::LOCK_FRAME_COUNT),
+          "UNLOCK requested during LOCK does not abort it");
+    check(sched.take(msg, 0) && msg.cmd == CAN_CMD_UNLOCK, "UNLOCK waits for LOCK to finish");
+    sched.finish(false);
+    check(sched.get(CAN_CMD_UNLOCK).aborted == 1 && sched.get(CAN_CMD_LOCK).executed == 1, "scheduler stats");
+    can.setAbortCheck(nullptr);
+
+    Serial.printf("selftest: %d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
+
+// ==================== Dual bus (MemoryBus) ====================
+// 2 MCP2515 trên 2 chân CS như firmware (CAN_CS / CAN1_CS): mỗi chip nhận đúng bitrate
+// của bus mình, sequence route theo field bus của can_frames.h, RX báo đúng bus nguồn,
+// và 1 chip không trả lời chỉ làm bus đó offline.
+
+static int cmdDualBus() {
+    MemoryBus   wire[CAN_BUS_MAX];
+    Mcp2515Emu  emu0(CAN_CS, &wire[0], 8000000UL);
+    Mcp2515Emu  emu1(CAN1_CS, &wire[1], 8000000UL);
+    MCP2515     mcp0(CAN_CS), mcp1(CAN1_CS);
+    MCP2515*    chips[CAN_BUS_MAX] = { &mcp0, &mcp1 };
+    CANCommands can(chips, 2);
+
+    check(can.initializeBus(0, CAN0_BITRATE, MCP_CLOCK) && can.initializeBus(1, CAN1_BITRATE, MCP_CLOCK),
+          "both buses initialized");
+    Serial.printf("bus0 %lu bps, bus1 %lu bps\n", (unsigned long)emu0.bitrate(), (unsigned long)emu1.bitrate());
+    check(emu0.bitrate() != emu1.bitrate(), "each MCP2515 configured on its own CS pin");
+
+    bool ok = can.unlockCar();
+    ok &= waitTxIdle(emu0, 100) && waitTxIdle(emu1, 100);
+    check(ok, "unlock sequence sent on 2 buses");
+    check(sameAsTable(wire[0], CANFrames::UNLOCK_FRAMES, CANFrames::UNLOCK_FRAME_COUNT, CAN_BUS_BODY) &&
+          sameAsTable(wire[1], CANFrames::UNLOCK_FRAMES, CANFrames::UNLOCK_FRAME_COUNT, CAN_BUS_COMFORT),
+          "unlock frames routed per can_frames.h bus field");
+
+    wire[1].pending.push_back(makeFrame(0x2A0, 0, 0));
+    emu1.poll();
+    struct can_frame f;
+    uint8_t from = 0xFF;
+    check(can.readFrame(&f, &from) && from == CAN_BUS_COMFORT && f.can_id == 0x2A0, "RX frame tagged with source bus");
+
+    // Chip thứ 2 không có trên SPI (chân CS không có emulator)
+    MCP2515     ghost(CAN1_CS + 1);
+    MCP2515*    partial[CAN_BUS_MAX] = { &mcp0, &ghost };
+    CANCommands half(partial, 2);
+    check(half.initializeBus(0, CAN0_BITRATE, MCP_CLOCK) && !half.initializeBus(1, CAN1_BITRATE, MCP_CLOCK) &&
+          half.isOnline(0) && !half.isOnline(1), "silent chip leaves only its bus offline");
+    wire[0].sent.clear();
+    ok = half.lockCar() && waitTxIdle(emu0, 100);
+    check(ok && sameAsTable(wire[0], CANFrames::LOCK_FRAMES, CANFrames::LOCK_FRAME_COUNT, CAN_BUS_BODY),
+          "body bus keeps working with bus 1 offline");
+
+    Serial.printf("dualbus: %d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
+
+// ==================== main ====================
+
+static void usage() {
+    fprintf(stderr, "usage: can_host [-i IFACE | -m] <unlock | lock | sniff [seconds] | bench [n] | selftest | dualbus>\n"
+                    "  -i IFACE  SocketCAN interface (default vcan0)\n"
+                    "  -m        in-memory bus (no SocketCAN needed)\n");
+}
+
+int main(int argc, char** argv) {
+    const char* ifname = "vcan0";
+    bool memory = false;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-m")) memory = true;
+        else if (!strcmp(argv[i], "-i") && i + 1 < argc) ifname = argv[++i];
+        else { usage(); return 2; }
+    }
+    if (i >= argc) { usage(); return 2; }
+    const char* cmd = argv[i];
+    uint32_t arg = (i + 1 < argc) ? (uint32_t)strtoul(argv[i + 1], nullptr, 0) : 0;
+
+    if (!strcmp(cmd, "selftest")) memory = true;
+    if (!strcmp(cmd, "dualbus"))  return cmdDualBus();
+
+    MemoryBus        memBus;
+    SocketCanBackend sockBus;
+    CanBusBackend*   backend = &memBus;
+    if (!memory) {
+        if (!sockBus.open(ifname)) return 1;
+        backend = &sockBus;
+    }
+
+    Mcp2515Emu  emu(CAN_CS, backend, 8000000UL);
+    MCP2515     mcp(CAN_CS);
+    CANCommands can(&mcp);
+    if (!can.initialize(CAN_100KBPS, MCP_CLOCK)) return 1;
+
+    if (!strcmp(cmd, "unlock"))   return runSequence(can, emu, true) ? 0 : 1;
+    if (!strcmp(cmd, "lock"))     return runSequence(can, emu, false) ? 0 : 1;
+    if (!strcmp(cmd, "sniff"))    return cmdSniff(mcp, emu, arg);
+    if (!strcmp(cmd, "bench"))    return cmdBench(mcp, can, emu, arg ? arg : 1000);
+    if (!strcmp(cmd, "selftest")) return cmdSelftest(mcp, can, emu, memBus);
+    usage();
+    return 2;
+}
@@ -0,0 +1,90 @@
+#pragma once
+// Host shim cho FreeRTOS queue/mutex — chỉ đủ cho can_scheduler.h. Arduino.h của ESP32
+// kéo FreeRTOS vào mọi sketch; Arduino.h của host include file này cho giống.
+// Queue = deque item cố định kích thước + condition_variable; mutex = queue 1 item
+// (đúng cách FreeRTOS cài semaphore). Tick = 1 ms.
+
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+typedef uint32_t     TickType_t;
+typedef int          BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE            (1)
+#define pdFALSE           (0)
+#define portMAX_DELAY     (0xFFFFFFFFU)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+struct HostQueue {
+    std::mutex                        m;
+    std::condition_variable           cv;
+    size_t                            itemSize;
+    UBaseType_t                       capacity;
+    std::deque<std::vector<uint8_t>>  items;
+
+    HostQueue(UBaseType_t cap, size_t size) : itemSize(size), capacity(cap) {}
+
+    // Chờ tới khi pred() đúng hoặc hết ticks; giữ lock khi trả về
+    template <typename Pred> bool waitFor(std::unique_lock<std::mutex>& lk, TickType_t ticks, Pred pred) {
+        if (ticks == portMAX_DELAY) { cv.wait(lk, pred); return true; }
+        return cv.wait_for(lk, std::chrono::milliseconds(ticks), pred);
+    }
+};
+typedef HostQueue* QueueHandle_t;
+typedef HostQueue* SemaphoreHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, size_t itemSize) { return new HostQueue(length, itemSize); }
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    std::lock_guard<std::mutex> lk(q->m);
+    return (UBaseType_t)q->items.size();
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lk(q->m);
+    if (!q->waitFor(lk, ticks, [q] { return q->items.size() < q->capacity; })) return pdFALSE;
+    const uint8_t* p = (const uint8_t*)item;
+    q->items.emplace_back(p, p + q->itemSize);
+    q->cv.notify_all();
+    return pdTRUE;
+}
+
+// Chỉ cho queue length 1
+inline BaseType_t xQueueOverwrite(QueueHandle_t q, const void* item) {
+    std::lock_guard<std::mutex> lk(q->m);
+    const uint8_t* p = (const uint8_t*)item;
+    q->items.clear();
+    q->items.emplace_back(p, p + q->itemSize);
+    q->cv.notify_all();
+    return pdTRUE;
+}
+
+inline BaseType_t xQueuePeek(QueueHandle_t q, void* out, TickType_t ticks) {
+    std::unique_lock<std::mutex> lk(q->m);
+    if (!q->waitFor(lk, ticks, [q] { return !q->items.empty(); })) return pdFALSE;
+    if (q->itemSize) memcpy(out, q->items.front().data(), q->itemSize);
+    return pdTRUE;
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t q, void* out, TickType_t ticks) {
+    std::unique_lock<std::mutex> lk(q->m);
+    if (!q->waitFor(lk, ticks, [q] { return !q->items.empty(); })) return pdFALSE;
+    if (q->itemSize) memcpy(out, q->items.front().data(), q->itemSize);
+    q->items.pop_front();
+    q->cv.notify_all();
+    return pdTRUE;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+    SemaphoreHandle_t s = xQueueCreate(1, 0);
+    xQueueSend(s, nullptr, 0);   // mutex tạo ra ở trạng thái "có sẵn"
+    return s;
+}
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks) { return xQueueReceive(s, nullptr, ticks); }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t s) { return xQueueSend(s, nullptr, 0); }
@@ -0,0 +1,37 @@
+// Arduino/SPI shim cho host: thời gian lấy từ steady_clock, chân CS định tuyến
+// transaction tới Mcp2515Emu đăng ký trên chân đó.
+
+#include "Arduino.h"
+#include "SPI.h"
+#include "mcp2515_emu.h"
+
+#include <chrono>
+#include <thread>
+
+HostSerial Serial;
+SPIClass   SPI;
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+unsigned long micros() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long millis() { return micros() / 1000UL; }
+
+void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+void delayMicroseconds(unsigned int us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    Mcp2515Emu* emu = Mcp2515Emu::forPin(pin);
+    if (emu) emu->select(value == LOW);
+}
+
+uint8_t SPIClass::transfer(uint8_t data) {
+    Mcp2515Emu* emu = Mcp2515Emu::selected();
+    return emu ? emu->transfer(data) : 0xFF;
+}
@@ -0,0 +1,446 @@
+#include "mcp2515_emu.h"
+
+#include <string.h>
+#include "Arduino.h"
+
+// Địa chỉ/bit theo datasheet MCP2515 (DS20001801) — giữ riêng ở đây để emulator
+// không phụ thuộc vào header của thư viện mà nó đang kiểm thử.
+namespace {
+
+const uint8_t I_WRITE       = 0x02;
+const uint8_t I_READ        = 0x03;
+const uint8_t I_BITMOD      = 0x05;
+const uint8_t I_LOAD_TX     = 0x40;   // 0x40..0x45
+const uint8_t I_RTS         = 0x80;   // 0x80..0x87
+const uint8_t I_READ_RX     = 0x90;   // 0x90..0x96
+const uint8_t I_READ_STATUS = 0xA0;
+const uint8_t I_RX_STATUS   = 0xB0;
+const uint8_t I_RESET       = 0xC0;
+
+const uint8_t R_CANSTAT  = 0x0E;
+const uint8_t R_CANCTRL  = 0x0F;
+const uint8_t R_TEC      = 0x1C;
+const uint8_t R_REC      = 0x1D;
+const uint8_t R_CNF3     = 0x28;
+const uint8_t R_CNF2     = 0x29;
+const uint8_t R_CNF1     = 0x2A;
+const uint8_t R_CANINTF  = 0x2C;
+const uint8_t R_EFLG     = 0x2D;
+const uint8_t R_TXB0CTRL = 0x30;   // TXBn: 0x30/0x40/0x50
+const uint8_t R_RXB0CTRL = 0x60;   // RXBn: 0x60/0x70
+
+const uint8_t MODE_NORMAL   = 0x00;
+const uint8_t MODE_SLEEP    = 0x20;
+const uint8_t MODE_LOOPBACK = 0x40;
+const uint8_t MODE_LISTEN   = 0x60;
+const uint8_t MODE_CONFIG   = 0x80;
+
+const uint8_t CTRL_OSM  = 0x08;
+const uint8_t CTRL_ABAT = 0x10;
+
+const uint8_t TX_ABTF  = 0x40;
+const uint8_t TX_TXERR = 0x10;
+const uint8_t TX_TXREQ = 0x08;
+
+const uint8_t RX_RXM  = 0x60;
+const uint8_t RX_RXRTR = 0x08;
+const uint8_t RX_BUKT = 0x04;
+
+const uint8_t EFLG_RX1OVR = 0x80;
+const uint8_t EFLG_RX0OVR = 0x40;
+const uint8_t EFLG_TXBO   = 0x20;
+const uint8_t EFLG_TXEP   = 0x10;
+const uint8_t EFLG_RXEP   = 0x08;
+const uint8_t EFLG_TXWAR  = 0x04;
+const uint8_t EFLG_RXWAR  = 0x02;
+const uint8_t EFLG_EWARN  = 0x01;
+
+const int MAX_EMU = 4;
+Mcp2515Emu* registry[MAX_EMU];
+int         registryCount = 0;
+Mcp2515Emu* current = nullptr;
+
+inline uint8_t txBase(int n) { return (uint8_t)(R_TXB0CTRL + 0x10 * n); }
+inline uint8_t rxBase(int n) { return (uint8_t)(R_RXB0CTRL + 0x10 * n); }
+
+// Chỉ ghi được trong config mode: filter, mask, CNF1..3
+inline bool configOnly(uint8_t a) {
+    return (a <= 0x0B) || (a >= 0x10 && a <= 0x1B) || (a >= 0x20 && a <= 0x2A);
+}
+
+// SIDH/SIDL/EID8/EID0 → ID (11 bit, hoặc 29 bit khi ext)
+uint32_t decodeId(const uint8_t* r, bool ext) {
+    uint32_t sid = ((uint32_t)r[0] << 3) | (r[1] >> 5);
+    if (!ext) return sid;
+    return (sid << 18) | ((uint32_t)(r[1] & 0x03) << 16) | ((uint32_t)r[2] << 8) | r[3];
+}
+
+void encodeId(uint8_t* r, uint32_t id, bool ext) {
+    if (ext) {
+        uint32_t sid = id >> 18;
+        r[0] = (uint8_t)(sid >> 3);
+        r[1] = (uint8_t)(((sid & 0x07) << 5) | 0x08 | ((id >> 16) & 0x03));
+        r[2] = (uint8_t)(id >> 8);
+        r[3] = (uint8_t)id;
+    } else {
+        r[0] = (uint8_t)(id >> 3);
+        r[1] = (uint8_t)((id & 0x07) << 5);
+        r[2] = 0;
+        r[3] = 0;
+    }
+}
+
+} // namespace
+
+Mcp2515Emu::Mcp2515Emu(uint8_t csPin, CanBusBackend* backend, uint32_t oscHz)
+    : cs(csPin), bus(backend), osc(oscHz), active(false), phase(PH_IDLE),
+      instr(0), addr(0), bitmodMask(0), readRxBuf(-1), onWire(-1), wireDoneUs(0) {
+    hardReset();
+    resetStats();
+    if (registryCount < MAX_EMU) registry[registryCount++] = this;
+}
+
+Mcp2515Emu* Mcp2515Emu::forPin(uint8_t pin) {
+    for (int i = 0; i < registryCount; i++)
+        if (registry[i]->cs == pin) return registry[i];
+    return nullptr;
+}
+
+Mcp2515Emu* Mcp2515Emu::selected() { return current; }
+
+void Mcp2515Emu::resetStats() { memset(&st, 0, sizeof(st)); }
+
+void Mcp2515Emu::hardReset() {
+    memset(regs, 0, sizeof(regs));
+    regs[R_CANCTRL] = 0x87;           // REQOP=config, CLKEN, CLKPRE=/8
+    regs[R_CANSTAT] = MODE_CONFIG;
+    onWire = -1;
+}
+
+uint8_t Mcp2515Emu::opMode() const { return regs[R_CANSTAT] & 0xE0; }
+bool    Mcp2515Emu::inConfig() const { return opMode() == MODE_CONFIG; }
+
+uint32_t Mcp2515Emu::bitrate() const {
+    uint32_t brp  = (regs[R_CNF1] & 0x3F) + 1;
+    uint32_t prop = (regs[R_CNF2] & 0x07) + 1;
+    uint32_t ps1  = ((regs[R_CNF2] >> 3) & 0x07) + 1;
+    uint32_t ps2  = (regs[R_CNF3] & 0x07) + 1;
+    uint32_t ntq  = 1 + prop + ps1 + ps2;
+    return osc / (2 * brp * ntq);
+}
+
+// Thời gian 1 frame trên dây: SOF..EOF + IFS, cộng ~10% bit stuffing
+uint32_t Mcp2515Emu::frameTimeUs(uint8_t dlc, bool ext) const {
+    uint32_t bits = (ext ? 67U : 47U) + 8U * dlc;
+    bits += bits / 10;
+    uint32_t br = bitrate();
+    return br ? (uint32_t)((uint64_t)bits * 1000000ULL / br) : 0;
+}
+
+// ==================== SPI ====================
+
+void Mcp2515Emu::select(bool on) {
+    if (on) {
+        active = true;
+        phase  = PH_INSTR;
+        current = this;
+        st.spiTransactions++;
+        return;
+    }
+    // CS lên: READ RX BUFFER tự xóa cờ RXnIF tương ứng
+    if (readRxBuf >= 0) regs[R_CANINTF] &= (uint8_t)~(1 << readRxBuf);
+    readRxBuf = -1;
+    active = false;
+    phase  = PH_IDLE;
+    if (current == this) current = nullptr;
+    poll();
+}
+
+uint8_t Mcp2515Emu::transfer(uint8_t mosi) {
+    st.spiBytes++;
+    if (!active) return 0xFF;
+
+    switch (phase) {
+    case PH_INSTR:
+        instr = mosi;
+        if (mosi == I_RESET) {
+            hardReset();
+            phase = PH_IDLE;
+        } else if (mosi == I_READ || mosi == I_WRITE || mosi == I_BITMOD) {
+            phase = PH_ADDR;
+        } else if ((mosi & 0xF8) == I_LOAD_TX && (mosi & 0x07) <= 5) {
+            int n = (mosi & 0x06) >> 1;
+            addr  = (uint8_t)(txBase(n) + ((mosi & 0x01) ? 6 : 1));
+            phase = PH_DATA;
+        } else if ((mosi & 0xF8) == I_RTS) {
+            for (int n = 0; n < 3; n++)
+                if (mosi & (1 << n)) regs[txBase(n)] |= TX_TXREQ;
+            phase = PH_IDLE;
+        } else if ((mosi & 0xF9) == I_READ_RX) {
+            int n = (mosi & 0x04) ? 1 : 0;
+            addr  = (uint8_t)(rxBase(n) + ((mosi & 0x02) ? 6 : 1));
+            readRxBuf = n;
+            phase = PH_STREAM;
+        } else if (mosi == I_READ_STATUS || mosi == I_RX_STATUS) {
+            phase = PH_STREAM;
+        } else {
+            phase = PH_IDLE;   // lệnh không hợp lệ — chip bỏ qua
+        }
+        return 0xFF;
+
+    case PH_ADDR:
+        addr  = mosi & 0x7F;
+        phase = (instr == I_BITMOD) ? PH_MASK : (instr == I_WRITE ? PH_DATA : PH_STREAM);
+        return 0xFF;
+
+    case PH_MASK:
+        bitmodMask = mosi;
+        phase = PH_DATA;
+        return 0xFF;
+
+    case PH_DATA:
+        if (instr == I_BITMOD) {
+            writeReg(addr, (uint8_t)((regs[addr] & ~bitmodMask) | (mosi & bitmodMask)));
+            phase = PH_IDLE;
+        } else {
+            writeReg(addr, mosi);
+            addr = (addr + 1) & 0x7F;
+        }
+        return 0xFF;
+
+    case PH_STREAM:
+        if (instr == I_READ_STATUS) return readStatus();
+        if (instr == I_RX_STATUS)   return rxStatus();
+        {
+            uint8_t v = regs[addr];
+            addr = (addr + 1) & 0x7F;
+            return v;
+        }
+
+    default:
+        return 0xFF;
+    }
+}
+
+void Mcp2515Emu::writeReg(uint8_t a, uint8_t v) {
+    a &= 0x7F;
+    if (a == R_CANSTAT || a == R_TEC || a == R_REC) return;   // read-only
+    if (configOnly(a) && !inConfig()) return;
+
+    if (a == R_CANCTRL) {
+        regs[a] = v;
+        // Chuyển mode ngay lập tức (chip thật mất vài µs — setMode() của thư viện vẫn poll CANSTAT)
+        regs[R_CANSTAT] = (uint8_t)((regs[R_CANSTAT] & ~0xE0) | (v & 0xE0));
+        if (v & CTRL_ABAT) {
+            for (int n = 0; n < 3; n++)
+                if ((regs[txBase(n)] & TX_TXREQ) && n != onWire)
+                    regs[txBase(n)] = (uint8_t)((regs[txBase(n)] & ~TX_TXREQ) | TX_ABTF);
+        }
+        return;
+    }
+
+    if (a == R_EFLG) {
+        // Chỉ RX0OVR/RX1OVR xóa được từ MCU
+        uint8_t ovr = EFLG_RX0OVR | EFLG_RX1OVR;
+        regs[a] = (uint8_t)((regs[a] & ~ovr) | (regs[a] & v & ovr));
+        return;
+    }
+
+    for (int n = 0; n < 3; n++) {
+        if (a == txBase(n)) {
+            // ABTF/MLOA/TXERR chỉ đọc; TXREQ 1→0 = hủy (frame đang trên dây vẫn gửi xong)
+            uint8_t keepReq = (n == onWire) ? TX_TXREQ : 0;
+            regs[a] = (uint8_t)((regs[a] & 0x70) | (v & 0x0B) | keepReq);
+            return;
+        }
+    }
+
+    if (a == rxBase(0)) { regs[a] = (uint8_t)((regs[a] & 0x0B) | (v & 0x64)); return; }
+    if (a == rxBase(1)) { regs[a] = (uint8_t)((regs[a] & 0x0F) | (v & 0x60)); return; }
+
+    regs[a] = v;
+}
+
+uint8_t Mcp2515Emu::readStatus() const {
+    uint8_t intf = regs[R_CANINTF];
+    uint8_t s = intf & 0x03;                                   // RX0IF, RX1IF
+    if (regs[txBase(0)] & TX_TXREQ) s |= 0x04;
+    if (intf & 0x04)                s |= 0x08;                 // TX0IF
+    if (regs[txBase(1)] & TX_TXREQ) s |= 0x10;
+    if (intf & 0x08)                s |= 0x20;                 // TX1IF
+    if (regs[txBase(2)] & TX_TXREQ) s |= 0x40;
+    if (intf & 0x10)                s |= 0x80;                 // TX2IF
+    return s;
+}
+
+uint8_t Mcp2515Emu::rxStatus() const {
+    uint8_t intf = regs[R_CANINTF];
+    int n = (intf & 0x01) ? 0 : ((intf & 0x02) ? 1 : -1);
+    if (n < 0) return 0;
+    uint8_t s = (uint8_t)((intf & 0x03) << 6);
+    uint8_t sidl = regs[rxBase(n) + 2];
+    bool ext = sidl & 0x08;
+    bool rtr = ext ? (regs[rxBase(n) + 5] & 0x40) : (regs[rxBase(n)] & RX_RXRTR);
+    s |= (uint8_t)(((ext ? 2 : 0) | (rtr ? 1 : 0)) << 3);
+    s |= (uint8_t)(regs[rxBase(n)] & (n == 0 ? 0x01 : 0x07));  // FILHIT
+    return s;
+}
+
+// ==================== TX ====================
+
+bool Mcp2515Emu::txPending(int n) const {
+    return (regs[txBase(n)] & TX_TXREQ) && n != onWire;
+}
+
+// 1 bus = 1 frame tại một thời điểm. Buffer có TXP cao nhất đi trước, cùng TXP thì buffer số lớn hơn.
+void Mcp2515Emu::startNextTx(uint64_t now) {
+    uint8_t mode = opMode();
+    if (mode != MODE_NORMAL && mode != MODE_LOOPBACK) return;  // chờ tới khi về normal
+    if (regs[R_EFLG] & EFLG_TXBO) return;
+    int best = -1;
+    for (int n = 2; n >= 0; n--) {
+        if (!txPending(n)) continue;
+        if (best < 0 || (regs[txBase(n)] & 0x03) > (regs[txBase(best)] & 0x03)) best = n;
+    }
+    if (best < 0) return;
+    const uint8_t* r = &regs[txBase(best) + 1];
+    uint64_t start = now > wireDoneUs ? now : wireDoneUs;       // back-to-back nếu MCU nạp kịp
+    onWire     = best;
+    wireDoneUs = start + frameTimeUs(r[4] & 0x0F, r[1] & 0x08);
+}
+
+void Mcp2515Emu::completeTx(int n) {
+    uint8_t base = txBase(n);
+    uint8_t* r = &regs[base + 1];
+    EmuFrame f;
+    memset(&f, 0, sizeof(f));
+    f.ext = r[1] & 0x08;
+    f.id  = decodeId(r, f.ext);
+    f.rtr = r[4] & 0x40;
+    f.dlc = r[4] & 0x0F;
+    if (f.dlc > 8) f.dlc = 8;
+    memcpy(f.data, r + 5, f.dlc);
+
+    bool ok;
+    if (opMode() == MODE_LOOPBACK) {
+        ok = true;
+        receiveFrame(f);
+    } else {
+        ok = bus ? bus->send(f) : false;
+    }
+
+    onWire = -1;
+    if (ok) {
+        regs[base] &= (uint8_t)~(TX_TXREQ | TX_TXERR);
+        regs[R_CANINTF] |= (uint8_t)(0x04 << n);
+        if (regs[R_TEC]) regs[R_TEC]--;
+        st.txFrames++;
+    } else {
+        // Không có ACK: TEC += 8, trừ khi đã error-passive (ISO 11898 ngoại lệ ACK error)
+        regs[base] |= TX_TXERR;
+        regs[R_CANINTF] |= 0x80;                               // MERRF
+        if (regs[R_TEC] < 128) regs[R_TEC] = (uint8_t)(regs[R_TEC] + 8);
+        st.txErrors++;
+        if (regs[R_CANCTRL] & CTRL_OSM)
+            regs[base] = (uint8_t)((regs[base] & ~TX_TXREQ) | TX_ABTF);
+        // không OSM: TXREQ vẫn bật → startNextTx() gửi lại như chip thật
+    }
+    updateErrorFlags();
+}
+
+void Mcp2515Emu::updateErrorFlags() {
+    uint8_t tec = regs[R_TEC], rec = regs[R_REC];
+    uint8_t e = regs[R_EFLG] & (EFLG_RX0OVR | EFLG_RX1OVR | EFLG_TXBO);
+    if (tec >= 96)  e |= EFLG_TXWAR;
+    if (rec >= 96)  e |= EFLG_RXWAR;
+    if (tec >= 128) e |= EFLG_TXEP;
+    if (rec >= 128) e |= EFLG_RXEP;
+    if (e & (EFLG_TXWAR | EFLG_RXWAR)) e |= EFLG_EWARN;
+    regs[R_EFLG] = e;
+}
+
+// ==================== RX ====================
+
+bool Mcp2515Emu::filterMatch(int filterIdx, int maskIdx, const EmuFrame& f) const {
+    const uint8_t* fr = &regs[filterIdx < 3 ? filterIdx * 4 : 0x10 + (filterIdx - 3) * 4];
+    const uint8_t* mr = &regs[0x20 + maskIdx * 4];
+    bool filterExt = fr[1] & 0x08;
+    if (filterExt != f.ext) return false;                      // EXIDE phải khớp loại frame
+    uint32_t fid = decodeId(fr, f.ext);
+    uint32_t mid = decodeId(mr, f.ext);
+    return ((f.id ^ fid) & mid) == 0;
+}
+
+void Mcp2515Emu::loadRx(int n, int filhit, const EmuFrame& f) {
+    uint8_t base = rxBase(n);
+    uint8_t* r = &regs[base + 1];
+    encodeId(r, f.id, f.ext);
+    if (!f.ext && f.rtr) r[1] |= 0x10;                         // SRR
+    r[4] = (uint8_t)(f.dlc | ((f.ext && f.rtr) ? 0x40 : 0));
+    memset(r + 5, 0, 8);
+    memcpy(r + 5, f.data, f.dlc > 8 ? 8 : f.dlc);
+    uint8_t keep = (n == 0) ? (uint8_t)(RX_RXM | RX_BUKT) : RX_RXM;
+    uint8_t ctrl = regs[base] & keep;
+    if (!f.ext && f.rtr) ctrl |= RX_RXRTR;
+    ctrl |= (uint8_t)(filhit & (n == 0 ? 0x01 : 0x07));        // RXB1 FILHIT 0/1 = rollover từ RXB0
+    regs[base] = ctrl;
+    regs[R_CANINTF] |= (uint8_t)(1 << n);
+    if (regs[R_REC]) regs[R_REC]--;
+    st.rxFrames++;
+}
+
+void Mcp2515Emu::receiveFrame(const EmuFrame& f) {
+    uint8_t mode = opMode();
+    if (mode == MODE_CONFIG || mode == MODE_SLEEP) return;
+
+    bool any0 = (regs[rxBase(0)] & RX_RXM) == RX_RXM;          // RXM=11: tắt filter
+    bool any1 = (regs[rxBase(1)] & RX_RXM) == RX_RXM;
+
+    int hit0 = -1;
+    if (any0) hit0 = 0;
+    else if (filterMatch(0, 0, f)) hit0 = 0;
+    else if (filterMatch(1, 0, f)) hit0 = 1;
+
+    if (hit0 >= 0) {
+        if (!(regs[R_CANINTF] & 0x01)) { loadRx(0, hit0, f); return; }
+        if ((regs[rxBase(0)] & RX_BUKT) && !(regs[R_CANINTF] & 0x02)) {
+            loadRx(1, hit0, f);
+            return;
+        }
+        regs[R_EFLG] |= EFLG_RX0OVR;
+        regs[R_CANINTF] |= 0x80;
+        st.rxOverflows++;
+        return;
+    }
+
+    int hit1 = -1;
+    if (any1) hit1 = 2;
+    else for (int i = 2; i < 6 && hit1 < 0; i++) if (filterMatch(i, 1, f)) hit1 = i;
+
+    if (hit1 < 0) { st.rxRejected++; return; }
+    if (regs[R_CANINTF] & 0x02) {
+        regs[R_EFLG] |= EFLG_RX1OVR;
+        regs[R_CANINTF] |= 0x80;
+        st.rxOverflows++;
+        return;
+    }
+    loadRx(1, hit1, f);
+}
+
+void Mcp2515Emu::inject(const EmuFrame& f) { receiveFrame(f); }
+
+void Mcp2515Emu::poll() {
+    uint64_t now = micros();
+    // Hoàn tất mọi frame đã kết thúc trên dây tính tới "now" (MCU có thể không poll đủ nhanh)
+    for (;;) {
+        if (onWire < 0) startNextTx(now);
+        if (onWire < 0 || wireDoneUs > now) break;
+        completeTx(onWire);
+    }
+
+    uint8_t mode = opMode();
+    if (!bus || mode == MODE_CONFIG || mode == MODE_SLEEP || mode == MODE_LOOPBACK) return;
+    EmuFrame f;
+    // Bus không chờ MCU: mọi frame đã tới đều đi qua filter ngay, MCU đọc chậm → overflow như chip thật
+    while (bus->receive(f)) receiveFrame(f);
+}
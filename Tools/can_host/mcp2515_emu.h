@@ -0,0 +1,85 @@
+#pragma once
+// MCP2515 emulator — nhận từng byte SPI từ shim SPI.h và mô phỏng instruction set,
+// thanh ghi, TX/RX buffer, acceptance filter, TEC/REC/EFLG của chip thật.
+// Frame ra/vào bus đi qua CanBusBackend (SocketCAN vcan hoặc bus trong bộ nhớ).
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct EmuFrame {
+    uint32_t id;
+    bool     ext;
+    bool     rtr;
+    uint8_t  dlc;
+    uint8_t  data[8];
+};
+
+class CanBusBackend {
+public:
+    virtual ~CanBusBackend() {}
+    virtual bool send(const EmuFrame& frame) = 0;   // false → không có ACK / lỗi bus
+    virtual bool receive(EmuFrame& frame) = 0;      // non-blocking
+};
+
+class Mcp2515Emu {
+public:
+    struct Stats {
+        uint64_t spiBytes;
+        uint64_t spiTransactions;
+        uint64_t txFrames;
+        uint64_t txErrors;
+        uint64_t rxFrames;      // frame nạp vào RXB0/RXB1
+        uint64_t rxRejected;    // bị acceptance filter loại
+        uint64_t rxOverflows;   // khớp filter nhưng RX buffer đầy
+    };
+
+    Mcp2515Emu(uint8_t csPin, CanBusBackend* bus, uint32_t oscHz = 8000000UL);
+
+    uint8_t csPin() const { return cs; }
+    void    select(bool active);           // CS LOW = true
+    uint8_t transfer(uint8_t mosi);
+    void    poll();                        // hoàn tất TX đến hạn + kéo RX từ backend
+    void    inject(const EmuFrame& frame); // nạp frame trực tiếp (bỏ qua backend)
+
+    uint8_t  reg(uint8_t addr) const { return regs[addr & 0x7F]; }
+    uint32_t bitrate() const;
+    const Stats& stats() const { return st; }
+    void resetStats();
+
+    // Registry theo chân CS — digitalWrite()/SPI.transfer() của shim dùng để định tuyến
+    static Mcp2515Emu* forPin(uint8_t pin);
+    static Mcp2515Emu* selected();
+
+private:
+    enum Phase { PH_IDLE, PH_INSTR, PH_ADDR, PH_MASK, PH_DATA, PH_STREAM };
+
+    uint8_t        cs;
+    CanBusBackend* bus;
+    uint32_t       osc;
+    uint8_t        regs[128];
+    Stats          st;
+
+    bool     active;
+    Phase    phase;
+    uint8_t  instr;
+    uint8_t  addr;
+    uint8_t  bitmodMask;
+    int      readRxBuf;              // READ RX BUFFER → xóa RXnIF khi CS lên
+    int      onWire;                 // TX buffer đang chiếm bus, -1 = bus rảnh
+    uint64_t wireDoneUs;             // thời điểm frame đang gửi kết thúc
+
+    void    hardReset();
+    uint8_t opMode() const;
+    bool    inConfig() const;
+    void    writeReg(uint8_t a, uint8_t v);
+    uint8_t readStatus() const;
+    uint8_t rxStatus() const;
+    bool    txPending(int n) const;
+    void    startNextTx(uint64_t now);
+    void    completeTx(int n);
+    void    receiveFrame(const EmuFrame& f);
+    bool    filterMatch(int filterIdx, int maskIdx, const EmuFrame& f) const;
+    void    loadRx(int n, int filhit, const EmuFrame& f);
+    void    updateErrorFlags();
+    uint32_t frameTimeUs(uint8_t dlc, bool ext) const;
+};
@@ -0,0 +1,87 @@
+#!/usr/bin/env bash
+# CI cho đường CAN không cần phần cứng:
+#   1. build can_host
+#   2. selftest + dualbus (2 MCP2515, 2 chân CS) trên bus trong bộ nhớ (luôn chạy)
+#   3. nếu có vcan + can-utils: unlock/lock đối chiếu candump với can_frames.h,
+#      sniff nhận frame bơm vào bằng cansend, rồi bench
+# Cần quyền tạo vcan (sudo) — CI runner: apt install can-utils linux-modules-extra-$(uname -r)
+set -euo pipefail
+HERE="$(cd "$(dirname "$0")" && pwd)"
+FRAMES="$HERE/../../Src/testFreeRTOS/FreeRTOS_Anchor_TestSimFetchKey/can_frames.h"
+IFACE="${IFACE:-vcan0}"
+WORK="$(mktemp -d)"
+BIN="$WORK/can_host"
+trap 'kill $(jobs -p) 2>/dev/null || true; rm -rf "$WORK"' EXIT
+
+# can_commands.h / can_frames.h giữ CRLF như bản gốc — đổi line ending cả file
+# làm diff mất dấu thay đổi thật
+for f in can_commands.h can_frames.h; do
+    if grep -q $'[^\r]$\|^$' "$(dirname "$FRAMES")/$f"; then
+        echo "[FAIL] $f: có dòng không kết thúc bằng CRLF"; exit 1
+    fi
+done
+
+"$HERE/build.sh" "$BIN"
+"$BIN" selftest
+"$BIN" dualbus
+
+SUDO=""
+[ "$(id -u)" -ne 0 ] && SUDO="sudo"
+if ! ip link show "$IFACE" >/dev/null 2>&1; then
+    $SUDO modprobe vcan 2>/dev/null || true
+    $SUDO ip link add dev "$IFACE" type vcan 2>/dev/null || true
+fi
+$SUDO ip link set up "$IFACE" 2>/dev/null || true
+if ! ip link show "$IFACE" >/dev/null 2>&1 || ! command -v candump >/dev/null; then
+    echo "SKIP: $IFACE / can-utils không có — chỉ chạy selftest + dualbus"
+    exit 0
+fi
+
+# Frame thứ tự đúng theo can_frames.h → "ID#DATA"
+expected() {
+    python3 - "$FRAMES" "$1" <<'PY'
+import re, sys
+src = open(sys.argv[1]).read()
+body = re.search(r'\b%s_FRAMES\[[^\]]*\]\s*=\s*\{(.*?)\n\};' % sys.argv[2], src, re.S).group(1)
+for m in re.finditer(r'\{\s*(0x[0-9A-Fa-f]+)\s*,\s*(\d+)\s*,\s*\{([^}]*)\}\s*(?:,\s*(\w+)\s*)?\}', body):
+    if m.group(4) not in (None, 'CAN_BUS_BODY', 'CAN_BUS_ALL'):
+        continue  # can_host chỉ emulate bus body
+    data = [int(b, 16) for b in m.group(3).split(',')][:int(m.group(2))]
+    print('%03X#%s' % (int(m.group(1), 16), ''.join('%02X' % b for b in data)))
+PY
+}
+
+run_sequence() {
+    local cmd="$1" table="$2"
+    candump -L "$IFACE" > "$WORK/$cmd.log" &
+    local pid=$!
+    sleep 0.3
+    "$BIN" -i "$IFACE" "$cmd"
+    sleep 0.2
+    kill "$pid"; wait "$pid" 2>/dev/null || true
+    awk '{print $3}' "$WORK/$cmd.log" > "$WORK/$cmd.got"
+    expected "$table" > "$WORK/$cmd.want"
+    if diff -u "$WORK/$cmd.want" "$WORK/$cmd.got"; then
+        echo "[PASS] $cmd: $(wc -l < "$WORK/$cmd.got") frames trên $IFACE khớp can_frames.h"
+    else
+        echo "[FAIL] $cmd: candump khác can_frames.h"; exit 1
+    fi
+}
+
+run_sequence unlock UNLOCK
+run_sequence lock LOCK
+
+# Sniffer: bơm frame status (unlocked, cửa mở) + 1 frame extended
+"$BIN" -i "$IFACE" sniff 2 > "$WORK/sniff.log" &
+SNIFF=$!
+sleep 0.5
+cansend "$IFACE" 3B3#0000020100000000
+cansend "$IFACE" 12345678#DEADBEEF
+wait "$SNIFF"
+cat "$WORK/sniff.log"
+grep -q "STD  0x3B3" "$WORK/sniff.log"
+grep -q "vehicle UNLOCKED" "$WORK/sniff.log"
+grep -q "EXT  0x12345678" "$WORK/sniff.log"
+echo "[PASS] sniff"
+
+"$BIN" -i "$IFACE" bench 500
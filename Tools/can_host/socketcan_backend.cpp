@@ -0,0 +1,57 @@
+// Translation unit riêng: <linux/can.h> định nghĩa struct can_frame trùng tên với can.h của thư viện.
+
+#include "bus_backends.h"
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+
+SocketCanBackend::~SocketCanBackend() {
+    if (fd >= 0) close(fd);
+}
+
+bool SocketCanBackend::open(const char* ifname) {
+    fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (fd < 0) { perror("socket(PF_CAN)"); return false; }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) { perror(ifname); close(fd); fd = -1; return false; }
+
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); close(fd); fd = -1; return false; }
+    return true;
+}
+
+bool SocketCanBackend::send(const EmuFrame& f) {
+    struct can_frame cf;
+    memset(&cf, 0, sizeof(cf));
+    cf.can_id = f.id | (f.ext ? CAN_EFF_FLAG : 0) | (f.rtr ? CAN_RTR_FLAG : 0);
+    cf.can_dlc = f.dlc;
+    memcpy(cf.data, f.data, f.dlc);
+    // vcan không có ACK thật: ghi thành công = có node nhận
+    return write(fd, &cf, sizeof(cf)) == (ssize_t)sizeof(cf);
+}
+
+bool SocketCanBackend::receive(EmuFrame& f) {
+    struct can_frame cf;
+    ssize_t n = recv(fd, &cf, sizeof(cf), MSG_DONTWAIT);
+    if (n != (ssize_t)sizeof(cf)) return false;
+    if (cf.can_id & CAN_ERR_FLAG) return false;
+    f.ext = cf.can_id & CAN_EFF_FLAG;
+    f.rtr = cf.can_id & CAN_RTR_FLAG;
+    f.id  = cf.can_id & (f.ext ? CAN_EFF_MASK : CAN_SFF_MASK);
+    f.dlc = cf.can_dlc > 8 ? 8 : cf.can_dlc;
+    memset(f.data, 0, 8);
+    memcpy(f.data, cf.data, f.dlc);
+    return true;
+}
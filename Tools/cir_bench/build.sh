@@ -0,0 +1,14 @@
+#!/usr/bin/env bash
+# Build cir_bench: cir_nlos.h của Tag (không phụ thuộc Arduino).
+# Thử ngưỡng khác: CXXFLAGS="-DCIR_NLOS_RISE_SAMPLES=3" ./build.sh
+set -euo pipefail
+HERE="$(cd "$(dirname "$0")" && pwd)"
+ROOT="$HERE/../.."
+TAG="$ROOT/Src/testFreeRTOS/FreeRTOS_Tag"
+OUT="${1:-$HERE/cir_bench}"
+
+${CXX:-g++} -std=c++17 -O2 -Wall -Wextra \
+    ${CXXFLAGS:-} -I"$TAG" \
+    "$HERE/cir_bench.cpp" \
+    -o "$OUT"
+echo "built $OUT"
@@ -0,0 +1,255 @@
+// cir_bench — chạy nguyên cir_nlos.h của Tag trên corpus CIR:
+//   - corpus thu bằng CIR_DUMP=1 (dòng "CIR <fpQ6> <first> <n> <hex>" trong log Serial),
+//     nhãn theo file: los:walk.log nlos:door.log
+//   - hoặc --synth N: corpus tổng hợp (mô hình kênh đơn giản, có nhãn sẵn) để kiểm logic
+//     và đo chi phí khi chưa có log thật
+// In: tỉ lệ gắn cờ NLOS theo nhãn, sample / chunk đọc (dừng sớm vs cả cửa sổ),
+// ước lượng thời gian SPI trên Tag, và ns/cửa sổ cho phần phân tích (CPU host).
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cir_nlos.h"
+
+struct Window {
+    bool                 nlos;     // nhãn
+    uint16_t             fpQ6;
+    uint16_t             first;
+    std::vector<uint8_t> raw;      // n × CIR_SAMPLE_BYTES, bắt đầu tại sample first
+};
+
+struct Run {
+    CirResult r;
+    uint8_t   chunks;
+};
+
+// Cùng vòng lặp như uwbAnalyzeCir() trên Tag, "SPI read" = memcpy từ corpus
+static Run analyze(CirNlosDetector& det, const Window& w, bool whole) {
+    Run out = {};
+    uint8_t buf[1 + CIR_CHUNK_SAMPLES * CIR_SAMPLE_BYTES];
+    det.begin(w.fpQ6, whole);
+    size_t have = w.raw.size() / CIR_SAMPLE_BYTES;
+    while (det.wantMore()) {
+        size_t at = det.next();
+        if (at < w.first || at - w.first >= have) break;   // corpus ngắn hơn cửa sổ
+        uint8_t n = det.chunk();
+        if (at - w.first + n > have) n = (uint8_t)(have - (at - w.first));
+        memcpy(buf + 1, &w.raw[(at - w.first) * CIR_SAMPLE_BYTES], n * CIR_SAMPLE_BYTES);
+        det.feed(buf + 1, n);
+        out.chunks++;
+    }
+    out.r = det.finish();
+    return out;
+}
+
+// ── Corpus từ log ───────────────────────────────────────────────────────────
+static bool loadLog(const char* path, bool nlos, std::vector<Window>& out) {
+    std::ifstream f(path);
+    if (!f) { fprintf(stderr, "cannot open %s\n", path); return false; }
+    std::string line;
+    size_t before = out.size();
+    while (std::getline(f, line)) {
+        size_t p = line.find("CIR ");
+        if (p == std::string::npos) continue;
+        std::istringstream in(line.substr(p + 4));
+        unsigned fpQ6, first, n;
+        std::string hex;
+        if (!(in >> fpQ6 >> first >> n >> hex) || hex.size() != (size_t)n * CIR_SAMPLE_BYTES * 2) continue;
+        Window w;
+        w.nlos  = nlos;
+        w.fpQ6  = (uint16_t)fpQ6;
+        w.first = (uint16_t)first;
+        for (size_t i = 0; i < hex.size(); i += 2) w.raw.push_back((uint8_t)std::stoul(hex.substr(i, 2), nullptr, 16));
+        out.push_back(std::move(w));
+    }
+    printf("%-6s %6zu windows  %s\n", nlos ? "nlos" : "los", out.size() - before, path);
+    return true;
+}
+
+// ── Corpus tổng hợp ─────────────────────────────────────────────────────────
+// Mỗi path: xung băng 500 MHz (~2 sample chân), trễ lẻ, pha ngẫu nhiên.
+//   LOS  : direct mạnh nhất + tail phản xạ suy giảm mũ; 20% có phản xạ mặt đất mạnh sát
+//          direct (+1..3 ns, 0.5–0.9) — ca khó gây báo nhầm
+//   NLOS : direct suy hao 6–20 dB (người / cửa xe) + cụm phản xạ mạnh sau 1–6 ns;
+//          20% chỉ suy hao 3–6 dB — ca khó gây bỏ sót
+// Nhiễu Gaussian phức, peak SNR 18–35 dB, biên độ peak ~2^14 (18-bit còn dư).
+struct Synth {
+    std::mt19937 rng;
+    explicit Synth(unsigned seed) : rng(seed) {}
+
+    double uni(double a, double b) { return std::uniform_real_distribution<double>(a, b)(rng); }
+
+    struct Path { double delay, amp, phase; };
+
+    // cos², chân ±2 sample: 1 / 0.5 / 0 tại 0 / ±1 / ±2
+    static double pulse(double t) {
+        double a = fabs(t);
+        if (a >= 2.0) return 0.0;
+        double c = cos(M_PI * a / 4.0);
+        return c * c;
+    }
+
+    static void put18(uint8_t* p, double v) {
+        long x = lround(v);
+        if (x > 0x1FFFF) x = 0x1FFFF;
+        if (x < -0x20000) x = -0x20000;
+        uint32_t u = (uint32_t)x & 0x3FFFF;
+        p[0] = (uint8_t)u; p[1] = (uint8_t)(u >> 8); p[2] = (uint8_t)(u >> 16);
+    }
+
+    Window make(bool nlos) {
+        std::vector<Path> paths;
+        double tau = 740.0 + uni(0.0, 1.0);
+        bool   hard = uni(0, 1) < 0.2;
+        if (!nlos) {
+            paths.push_back({0.0, 1.0, uni(0, 2 * M_PI)});
+            if (hard) paths.push_back({uni(1.0, 3.0), uni(0.5, 0.9), uni(0, 2 * M_PI)});
+            int k = 3 + (int)(rng() % 6);
+            for (int i = 0; i < k; i++) {
+                double d = std::exponential_distribution<double>(1.0 / 8.0)(rng) + 1.0;
+                paths.push_back({d, uni(0.1, 0.5) * exp(-d / 15.0), uni(0, 2 * M_PI)});
+            }
+        } else {
+            double lossDb = hard ? uni(3.0, 6.0) : uni(6.0, 20.0);
+            paths.push_back({0.0, pow(10.0, -lossDb / 20.0), uni(0, 2 * M_PI)});
+            double c = uni(1.0, 6.0);
+            int k = 3 + (int)(rng() % 4);
+            for (int i = 0; i < k; i++) paths.push_back({c + i * uni(0.8, 2.0), uni(0.4, 1.0), uni(0, 2 * M_PI)});
+            int t = 3 + (int)(rng() % 6);
+            for (int i = 0; i < t; i++) {
+                double d = c + std::exponential_distribution<double>(1.0 / 10.0)(rng);
+                paths.push_back({d, uni(0.1, 0.4) * exp(-(d - c) / 15.0), uni(0, 2 * M_PI)});
+            }
+        }
+
+        // LDE ước lượng first path lệch ±0.3 sample
+        double fpEst = tau + uni(-0.3, 0.3);
+        Window w;
+        w.nlos  = nlos;
+        w.fpQ6  = (uint16_t)lround(fpEst * 64.0);
+        uint16_t fp = w.fpQ6 >> 6;
+        w.first = fp - CIR_PRE_SAMPLES;
+        w.raw.resize(CIR_WINDOW_MAX * CIR_SAMPLE_BYTES);
+
+        std::vector<double> re(CIR_WINDOW_MAX), im(CIR_WINDOW_MAX);
+        double peak = 0.0;
+        for (int i = 0; i < CIR_WINDOW_MAX; i++) {
+            double t = w.first + i;
+            for (const Path& p : paths) {
+                double g = p.amp * pulse(t - tau - p.delay);
+                re[i] += g * cos(p.phase);
+                im[i] += g * sin(p.phase);
+            }
+            peak = std::max(peak, std::hypot(re[i], im[i]));
+        }
+        double scale = 16384.0 / peak;
+        double sigma = 16384.0 * pow(10.0, -uni(18.0, 35.0) / 20.0) / sqrt(2.0);
+        std::normal_distribution<double> n(0.0, sigma);
+        for (int i = 0; i < CIR_WINDOW_MAX; i++) {
+            put18(&w.raw[i * CIR_SAMPLE_BYTES],     re[i] * scale + n(rng));
+            put18(&w.raw[i * CIR_SAMPLE_BYTES + 3], im[i] * scale + n(rng));
+        }
+        return w;
+    }
+};
+
+// ── Báo cáo ─────────────────────────────────────────────────────────────────
+struct Tally {
+    size_t n = 0, flagged = 0, invalid = 0, samples = 0, chunks = 0;
+    double fpDb = 0, rise = 0;
+};
+
+int main(int argc, char** argv) {
+    std::vector<Window> corpus;
+    unsigned synthN = 0, seed = 1;
+    double spiMhz = 8.0, txnUs = 4.0;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        if (a == "--synth" && i + 1 < argc)        synthN = (unsigned)atoi(argv[++i]);
+        else if (a == "--seed" && i + 1 < argc)    seed   = (unsigned)atoi(argv[++i]);
+        else if (a == "--spi-mhz" && i + 1 < argc) spiMhz = atof(argv[++i]);
+        else if (a == "--txn-us" && i + 1 < argc)  txnUs  = atof(argv[++i]);
+        else if (a.rfind("los:", 0) == 0)  { if (!loadLog(a.c_str() + 4, false, corpus)) return 2; }
+        else if (a.rfind("nlos:", 0) == 0) { if (!loadLog(a.c_str() + 5, true, corpus)) return 2; }
+        else {
+            fprintf(stderr, "usage: %s [--synth N] [--seed S] [--spi-mhz 8] [--txn-us 4] [los:FILE] [nlos:FILE]...\n", argv[0]);
+            return 2;
+        }
+    }
+    if (synthN) {
+        Synth s(seed);
+        for (unsigned i = 0; i < synthN; i++) corpus.push_back(s.make(i & 1));
+        printf("synth  %6u windows  (seed %u, 50%% nlos)\n", synthN, seed);
+    }
+    if (corpus.empty()) { fprintf(stderr, "empty corpus\n"); return 2; }
+
+    CirNlosDetector det;
+    Tally t[2], whole[2];
+    size_t disagree = 0;
+    for (const Window& w : corpus) {
+        Run e = analyze(det, w, false);
+        Run f = analyze(det, w, true);
+        for (int k = 0; k < 2; k++) {
+            const Run& r = k ? f : e;
+            Tally& x = (k ? whole : t)[w.nlos];
+            x.n++;
+            if (!r.r.valid) { x.invalid++; continue; }
+            x.flagged += r.r.nlos;
+            x.samples += r.r.samplesRead;
+            x.chunks  += r.chunks;
+            x.fpDb    += r.r.fpPeakDb;
+            x.rise    += r.r.rise;
+        }
+        disagree += e.r.valid && f.r.valid && e.r.nlos != f.r.nlos;
+    }
+
+    // Mỗi chunk: modify CLK_CTRL, 2 write indirect, read (2 header + 1 dummy + data), modify
+    // lại — 5 transaction, ~27 byte ngoài data; + 1 lần đọc IP_DIAG_8.
+    auto spiUs = [&](const Tally& x) {
+        size_t v = x.n - x.invalid;
+        if (!v) return 0.0;
+        double bytes = (double)x.samples * CIR_SAMPLE_BYTES + (double)x.chunks * 27.0 + v * 6.0;
+        double txn   = (double)x.chunks * 5.0 + v;
+        return (bytes * 8.0 / spiMhz + txn * txnUs) / v;
+    };
+
+    printf("\nlabel   windows  flagged-nlos  fp/peak dB  rise  samples  chunks  spi est us   (whole window)\n");
+    for (int l = 0; l < 2; l++) {
+        const Tally& x = t[l];
+        const Tally& y = whole[l];
+        size_t v = x.n - x.invalid;
+        if (!x.n) continue;
+        printf("%-6s %8zu  %10.1f%%  %10.1f  %4.1f  %7.1f  %6.2f  %10.0f   (%.1f%%, %.0f us)\n",
+               l ? "nlos" : "los", x.n, v ? 100.0 * x.flagged / v : 0.0, v ? x.fpDb / v : 0.0,
+               v ? x.rise / v : 0.0, v ? (double)x.samples / v : 0.0, v ? (double)x.chunks / v : 0.0,
+               spiUs(x), (y.n - y.invalid) ? 100.0 * y.flagged / (y.n - y.invalid) : 0.0, spiUs(y));
+        if (x.invalid) printf("       %zu invalid (first path sát cuối CIR / corpus ngắn)\n", x.invalid);
+    }
+    if (t[0].n && t[1].n) {
+        size_t vl = t[0].n - t[0].invalid, vn = t[1].n - t[1].invalid;
+        printf("\ndetection %.1f%%  false alarm %.1f%%  early-stop vs whole disagree %zu\n",
+               vn ? 100.0 * t[1].flagged / vn : 0.0, vl ? 100.0 * t[0].flagged / vl : 0.0, disagree);
+    }
+
+    // CPU: feed + finish, gồm cả memcpy thay cho SPI read
+    using clk = std::chrono::steady_clock;
+    size_t reps = 0;
+    auto t0 = clk::now(), end = t0 + std::chrono::milliseconds(300);
+    clk::time_point now;
+    volatile uint32_t sink = 0;
+    do {
+        for (const Window& w : corpus) sink += analyze(det, w, false).r.nlos;
+        reps += corpus.size();
+    } while ((now = clk::now()) < end);
+    printf("analyze   %.0f ns/window (host CPU, early stop)\n",
+           std::chrono::duration<double, std::nano>(now - t0).count() / reps);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+// Host shim cho Arduino API — chỉ đủ cho hmac_engine.h / friend_keys.h.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <chrono>
+
+inline unsigned long millis() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class HostSerial {
+public:
+    size_t println(const char* s) { return (size_t)puts(s); }
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        va_list ap; va_start(ap, fmt);
+        int n = vprintf(fmt, ap);
+        va_end(ap);
+        return n < 0 ? 0 : (size_t)n;
+    }
+};
+inline HostSerial Serial;
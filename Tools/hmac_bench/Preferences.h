@@ -0,0 +1,12 @@
+#pragma once
+// Host shim: NVS luôn rỗng — bench chỉ dùng FriendKeyTable::load()
+#include <stddef.h>
+
+class Preferences {
+public:
+    bool   begin(const char*, bool) { return true; }
+    void   end() {}
+    bool   isKey(const char*) { return false; }
+    size_t getBytes(const char*, void*, size_t) { return 0; }
+    size_t putBytes(const char*, const void*, size_t len) { return len; }
+};
@@ -0,0 +1,13 @@
+#!/usr/bin/env bash
+# Build hmac_bench: hmac_engine.h + friend_keys.h của anchor, mbedtls shim trên OpenSSL libcrypto.
+set -euo pipefail
+HERE="$(cd "$(dirname "$0")" && pwd)"
+ROOT="$HERE/../.."
+ANCHOR="$ROOT/Src/testFreeRTOS/FreeRTOS_Anchor_TestSimFetchKey"
+OUT="${1:-$HERE/hmac_bench}"
+
+${CXX:-g++} -std=c++17 -O2 -Wall -Wextra -Wno-unused-parameter -Wno-deprecated-declarations \
+    -I"$HERE" -I"$ANCHOR" \
+    "$HERE/hmac_bench.cpp" -lcrypto \
+    -o "$OUT"
+echo "built $OUT"
@@ -0,0 +1,201 @@
+// hmac_bench — số lần verify challenge/HMAC mỗi giây trên host:
+//   baseline  : computeHMAC() cũ (mbedtls_md_hmac: malloc + ipad/opad mỗi lần) + memcmp
+//   schedule  : HmacSha256Key::verify (midstate tính sẵn, compare constant-time)
+//   friend N  : FriendKeyTable::lookup + verify với bảng N key
+//
+// Số tuyệt đối là SHA-256 software của host; trên ESP32-S3 chỉ tỉ lệ giữa các dòng là đáng tin.
+
+#include <Arduino.h>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <stdlib.h>
+
+#include "hmac_engine.h"
+#include "friend_keys.h"
+
+static const char* VEHICLE_ID = "bench-vehicle";
+
+static void fill(std::mt19937& rng, uint8_t* p, size_t n) {
+    for (size_t i = 0; i < n; i++) p[i] = (uint8_t)rng();
+}
+
+static void wr32(uint8_t* p, uint32_t v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+// Chạy fn() tới khi hết ~durMs, trả về số lần/giây
+template <typename Fn> static double rate(Fn fn, unsigned durMs) {
+    using clk = std::chrono::steady_clock;
+    uint64_t n = 0;
+    auto t0 = clk::now(), end = t0 + std::chrono::milliseconds(durMs);
+    clk::time_point t;
+    do {
+        for (int i = 0; i < 256; i++) fn();
+        n += 256;
+    } while ((t = clk::now()) < end);
+    return n / std::chrono::duration<double>(t - t0).count();
+}
+
+// RFC 4231 test case 2 + so với HMAC() của OpenSSL trên key/message ngẫu nhiên
+static bool selftest(std::mt19937& rng) {
+    static const uint8_t TC2_MAC[32] = {
+        0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e, 0x6a, 0x04, 0x24, 0x26, 0x08, 0x95, 0x75, 0xc7,
+        0x5a, 0x00, 0x3f, 0x08, 0x9d, 0x27, 0x39, 0x83, 0x9d, 0xec, 0x58, 0xb9, 0x64, 0xec, 0x38, 0x43 };
+    HmacSha256Key k;
+    uint8_t mac[32];
+    if (!k.begin((const uint8_t*)"Jefe", 4) ||
+        !k.compute((const uint8_t*)"what do ya want for nothing?", 28, mac) ||
+        memcmp(mac, TC2_MAC, 32) != 0) {
+        puts("selftest: RFC 4231 TC2 FAIL");
+        return false;
+    }
+    for (int i = 0; i < 200; i++) {
+        uint8_t key[100], msg[80], ref[32];
+        size_t keyLen = 1 + rng() % sizeof(key), msgLen = rng() % sizeof(msg);
+        fill(rng, key, keyLen);
+        fill(rng, msg, msgLen);
+        unsigned refLen = 0;
+        HMAC(EVP_sha256(), key, (int)keyLen, msg, msgLen, ref, &refLen);
+        if (!k.begin(key, keyLen) || !k.verify(msg, msgLen, ref, 32) || !k.verify(msg, msgLen, ref, 16)) {
+            printf("selftest: lệch OpenSSL (key %zu, msg %zu)\n", keyLen, msgLen);
+            return false;
+        }
+        ref[rng() % 32] ^= 0x01;
+        if (k.verify(msg, msgLen, ref, 32)) {
+            puts("selftest: verify nhận MAC sai");
+            return false;
+        }
+    }
+    puts("selftest: OK (RFC 4231 + 200 vector so với OpenSSL)");
+    return true;
+}
+
+int main(int argc, char** argv) {
+    unsigned durMs = argc > 1 ? (unsigned)atoi(argv[1]) : 500;
+    std::mt19937 rng(0x5eed);
+    if (!selftest(rng)) return 1;
+
+    uint8_t key[16], challenge[16], resp[32];
+    fill(rng, key, sizeof(key));
+    fill(rng, challenge, sizeof(challenge));
+    const mbedtls_md_info_t* md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    mbedtls_md_hmac(md, key, sizeof(key), challenge, sizeof(challenge), resp);
+
+    volatile bool sink = true;
+    printf("\n%-28s %14s\n", "verify 16-byte challenge", "verifies/s");
+
+    double base = rate([&] {
+        uint8_t mac[32];
+        sink = mbedtls_md_hmac(md, key, sizeof(key), challenge, sizeof(challenge), mac) == 0 &&
+               memcmp(mac, resp, sizeof(mac)) == 0;
+    }, durMs);
+    printf("%-28s %14.0f\n", "baseline (md_hmac+memcmp)", base);
+
+    HmacSha256Key pairing;
+    pairing.begin(key, sizeof(key));
+    double sched = rate([&] { sink = pairing.verify(challenge, sizeof(challenge), resp, sizeof(resp)); }, durMs);
+    printf("%-28s %14.0f   x%.2f\n", "schedule (HmacSha256Key)", sched, sched / base);
+
+    // Bảng friend N key: mỗi vòng chọn 1 friend, lookup theo id_hash rồi verify bằng key của friend đó
+    static const unsigned SIZES[] = { 1, 8, FRIEND_MAX_KEYS };
+    static FriendKeyTable table;
+    for (unsigned n : SIZES) {
+        std::vector<uint8_t> blob(FRIEND_HEADER_LEN + n * FRIEND_ENTRY_LEN, 0);
+        std::vector<uint8_t> ids(n * FRIEND_ID_HASH_LEN), macs(n * 32);
+        uint8_t h[32];
+        SHA256((const uint8_t*)VEHICLE_ID, strlen(VEHICLE_ID), h);
+        memcpy(&blob[0], "FKT1", 4);
+        blob[4] = 1;
+        blob[5] = (uint8_t)n;
+        wr32(&blob[8], 1760000000u);
+        memcpy(&blob[12], h, 4);
+        for (unsigned i = 0; i < n; i++) {
+            uint8_t* e = &blob[FRIEND_HEADER_LEN + i * FRIEND_ENTRY_LEN];
+            char friendId[24];
+            snprintf(friendId, sizeof(friendId), "friend-%02u", i);
+            FriendKeyTable::hashId(friendId, e);
+            memcpy(&ids[i * FRIEND_ID_HASH_LEN], e, FRIEND_ID_HASH_LEN);
+            wr32(e + 8, 1760000000u + 86400u);
+            fill(rng, e + 16, 16);
+            mbedtls_md_hmac(md, e + 16, 16, challenge, sizeof(challenge), &macs[i * 32]);
+        }
+        if (!table.load(blob.data(), blob.size(), VEHICLE_ID, true) || table.size() != n) {
+            printf("friend %u: load FAIL\n", n);
+            return 1;
+        }
+
+        unsigned next = 0;
+        double r = rate([&] {
+            unsigned i = next++ % n;
+            const HmacSha256Key* fk = nullptr;
+            sink = table.lookup(&ids[i * FRIEND_ID_HASH_LEN], &fk) == FriendKeyTable::FRIEND_OK &&
+                   fk->verify(challenge, sizeof(challenge), &macs[i * 32], 32);
+        }, durMs);
+        if (!sink) { printf("friend %u: verify FAIL\n", n); return 1; }
+        char label[32];
+        snprintf(label, sizeof(label), "friend lookup+verify N=%u", n);
+        printf("%-28s %14.0f   x%.2f\n", label, r, r / base);
+    }
+
+    // Đồng hồ friend expiry: blob nạp lúc boot (chưa sync) chỉ là cận dưới của giờ thật
+    {
+        std::vector<uint8_t> blob(FRIEND_HEADER_LEN + FRIEND_ENTRY_LEN, 0);
+        uint8_t h[32], id[FRIEND_ID_HASH_LEN], key[16];
+        SHA256((const uint8_t*)VEHICLE_ID, strlen(VEHICLE_ID), h);
+        memcpy(&blob[0], "FKT1", 4);
+        blob[4] = 1;
+        blob[5] = 1;
+        wr32(&blob[8], 1760000000u);
+        memcpy(&blob[12], h, 4);
+        FriendKeyTable::hashId("friend-00", &blob[FRIEND_HEADER_LEN]);
+        memcpy(id, &blob[FRIEND_HEADER_LEN], sizeof(id));
+        wr32(&blob[FRIEND_HEADER_LEN + 8], 1760000000u + 2 * FRIEND_UNTRUSTED_MARGIN_S);
+        fill(rng, key, sizeof(key));
+        memcpy(&blob[FRIEND_HEADER_LEN + 16], key, sizeof(key));
+
+        static FriendKeyTable boot, later, synced;
+        const HmacSha256Key* fk = nullptr;
+        bool ok = boot.load(blob.data(), blob.size(), VEHICLE_ID) &&
+                  boot.lookup(id, &fk) == FriendKeyTable::FRIEND_OK;
+        // Floor đã lưu gần expiry → giờ không lùi về generated_at, key sắp hết hạn bị từ chối
+        later.restoreClock(1760000000u + FRIEND_UNTRUSTED_MARGIN_S + 60);
+        ok = ok && later.load(blob.data(), blob.size(), VEHICLE_ID) &&
+             later.now() >= 1760000000u + FRIEND_UNTRUSTED_MARGIN_S + 60 &&
+             later.lookup(id, &fk) == FriendKeyTable::FRIEND_EXPIRING;
+        later.restoreClock(1760000000u + 3 * FRIEND_UNTRUSTED_MARGIN_S);
+        ok = ok && later.lookup(id, &fk) == FriendKeyTable::FRIEND_EXPIRED;
+        // Cùng floor, blob sync mới hơn floor → giờ tin được, dùng được tới đúng expiry
+        std::vector<uint8_t> fresh = blob;
+        wr32(&fresh[8], 1760000000u + FRIEND_UNTRUSTED_MARGIN_S + 120);
+        synced.restoreClock(1760000000u + FRIEND_UNTRUSTED_MARGIN_S + 60);
+        ok = ok && synced.load(fresh.data(), fresh.size(), VEHICLE_ID, true) &&
+             synced.lookup(id, &fk) == FriendKeyTable::FRIEND_OK;
+        printf("\nfriend clock: %s (floor, no rollback, untrusted margin %lu s)\n", ok ? "OK" : "FAIL",
+               (unsigned long)FRIEND_UNTRUSTED_MARGIN_S);
+        if (!ok) return 1;
+
+        // Replay: blob cũ hơn bảng đang nạp / floor bị từ chối, bảng giữ nguyên.
+        // Bản cũ còn friend mà bản mới đã revoke.
+        std::vector<uint8_t> revoked = fresh;
+        wr32(&revoked[8], 1760000000u + FRIEND_UNTRUSTED_MARGIN_S + 180);
+        revoked[FRIEND_HEADER_LEN + 12] = FRIEND_FLAG_REVOKED;
+        memset(&revoked[FRIEND_HEADER_LEN + 16], 0, 16);
+        static FriendKeyTable replay, floored;
+        ok = replay.load(revoked.data(), revoked.size(), VEHICLE_ID, true) &&
+             replay.lookup(id, &fk) == FriendKeyTable::FRIEND_REVOKED &&
+             !replay.load(fresh.data(), fresh.size(), VEHICLE_ID, true) &&
+             replay.lookup(id, &fk) == FriendKeyTable::FRIEND_REVOKED &&
+             replay.load(revoked.data(), revoked.size(), VEHICLE_ID, true);   // sync lại đúng bảng đang có
+        // Boot chưa nạp được bảng (blob NVS mất) — floor vẫn chặn blob cũ
+        floored.restoreClock(1760000000u + FRIEND_UNTRUSTED_MARGIN_S + 150);
+        ok = ok && !floored.load(fresh.data(), fresh.size(), VEHICLE_ID, true) &&
+             floored.lookup(id, &fk) == FriendKeyTable::FRIEND_UNKNOWN &&
+             floored.load(revoked.data(), revoked.size(), VEHICLE_ID, true);
+        printf("friend replay: %s (older signed blob rejected vs table and clock floor)\n", ok ? "OK" : "FAIL");
+        if (!ok) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+// Host shim: mbedtls_md_* chỉ SHA-256. mbedtls_md_hmac() làm đúng như mbedtls:
+// setup (malloc ctx + ipad/opad) → hmac_starts (băm key^ipad) → update → finish
+// (băm key^opad + inner digest) → free. Đây là baseline computeHMAC() cũ.
+#include <stdlib.h>
+#include <string.h>
+#include "mbedtls/sha256.h"
+
+typedef enum { MBEDTLS_MD_NONE = 0, MBEDTLS_MD_SHA256 = 6 } mbedtls_md_type_t;
+typedef struct { mbedtls_md_type_t type; } mbedtls_md_info_t;
+typedef struct {
+    const mbedtls_md_info_t* md_info;
+    mbedtls_sha256_context*  md_ctx;
+    unsigned char*           hmac_ctx;   // ipad | opad
+} mbedtls_md_context_t;
+
+inline const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t t) {
+    static const mbedtls_md_info_t SHA256_INFO = { MBEDTLS_MD_SHA256 };
+    return t == MBEDTLS_MD_SHA256 ? &SHA256_INFO : nullptr;
+}
+
+inline void mbedtls_md_init(mbedtls_md_context_t* c) { memset(c, 0, sizeof(*c)); }
+
+inline void mbedtls_md_free(mbedtls_md_context_t* c) {
+    if (c->md_ctx) { mbedtls_sha256_free(c->md_ctx); free(c->md_ctx); }
+    if (c->hmac_ctx) { memset(c->hmac_ctx, 0, 128); free(c->hmac_ctx); }
+    memset(c, 0, sizeof(*c));
+}
+
+inline int mbedtls_md_setup(mbedtls_md_context_t* c, const mbedtls_md_info_t* info, int hmac) {
+    if (!info) return -1;
+    c->md_info = info;
+    c->md_ctx  = (mbedtls_sha256_context*)calloc(1, sizeof(mbedtls_sha256_context));
+    if (!c->md_ctx) return -1;
+    if (hmac && !(c->hmac_ctx = (unsigned char*)calloc(2, 64))) { mbedtls_md_free(c); return -1; }
+    return 0;
+}
+
+inline int mbedtls_md_starts(mbedtls_md_context_t* c) { return mbedtls_sha256_starts_ret(c->md_ctx, 0); }
+inline int mbedtls_md_update(mbedtls_md_context_t* c, const unsigned char* d, size_t n) { return mbedtls_sha256_update_ret(c->md_ctx, d, n); }
+inline int mbedtls_md_finish(mbedtls_md_context_t* c, unsigned char* out) { return mbedtls_sha256_finish_ret(c->md_ctx, out); }
+
+inline int mbedtls_md_hmac_starts(mbedtls_md_context_t* c, const unsigned char* key, size_t keyLen) {
+    unsigned char sum[32];
+    if (keyLen > 64) {
+        if (mbedtls_md_starts(c) || mbedtls_md_update(c, key, keyLen) || mbedtls_md_finish(c, sum)) return -1;
+        key = sum; keyLen = 32;
+    }
+    unsigned char* ipad = c->hmac_ctx;
+    unsigned char* opad = c->hmac_ctx + 64;
+    memset(ipad, 0x36, 64);
+    memset(opad, 0x5c, 64);
+    for (size_t i = 0; i < keyLen; i++) { ipad[i] ^= key[i]; opad[i] ^= key[i]; }
+    return mbedtls_md_starts(c) || mbedtls_md_update(c, ipad, 64);
+}
+
+inline int mbedtls_md_hmac_update(mbedtls_md_context_t* c, const unsigned char* d, size_t n) { return mbedtls_md_update(c, d, n); }
+
+inline int mbedtls_md_hmac_finish(mbedtls_md_context_t* c, unsigned char* out) {
+    unsigned char tmp[32];
+    return mbedtls_md_finish(c, tmp) || mbedtls_md_starts(c) || mbedtls_md_update(c, c->hmac_ctx + 64, 64) ||
+           mbedtls_md_update(c, tmp, 32) || mbedtls_md_finish(c, out);
+}
+
+inline int mbedtls_md_hmac(const mbedtls_md_info_t* info, const unsigned char* key, size_t keyLen,
+                           const unsigned char* in, size_t inLen, unsigned char* out) {
+    mbedtls_md_context_t c;
+    mbedtls_md_init(&c);
+    int ret = mbedtls_md_setup(&c, info, 1);
+    if (!ret) ret = mbedtls_md_hmac_starts(&c, key, keyLen) || mbedtls_md_hmac_update(&c, in, inLen) ||
+                    mbedtls_md_hmac_finish(&c, out);
+    mbedtls_md_free(&c);
+    return ret;
+}
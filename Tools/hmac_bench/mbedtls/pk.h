@@ -0,0 +1,10 @@
+#pragma once
+// Host shim: bench không kiểm chữ ký blob — mọi verify đều fail
+#include "mbedtls/md.h"
+
+typedef struct { int unused; } mbedtls_pk_context;
+inline void mbedtls_pk_init(mbedtls_pk_context*) {}
+inline void mbedtls_pk_free(mbedtls_pk_context*) {}
+inline int  mbedtls_pk_parse_public_key(mbedtls_pk_context*, const unsigned char*, size_t) { return -1; }
+inline int  mbedtls_pk_verify(mbedtls_pk_context*, mbedtls_md_type_t, const unsigned char*, size_t,
+                              const unsigned char*, size_t) { return -1; }
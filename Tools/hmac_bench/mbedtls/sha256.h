@@ -0,0 +1,13 @@
+#pragma once
+// Host shim: API mbedtls_sha256_*_ret trên SHA256 software của OpenSSL libcrypto
+#include <openssl/sha.h>
+#include <string.h>
+
+typedef SHA256_CTX mbedtls_sha256_context;
+
+inline void mbedtls_sha256_init(mbedtls_sha256_context* c) { memset(c, 0, sizeof(*c)); }
+inline void mbedtls_sha256_free(mbedtls_sha256_context* c) { memset(c, 0, sizeof(*c)); }
+inline void mbedtls_sha256_clone(mbedtls_sha256_context* d, const mbedtls_sha256_context* s) { *d = *s; }
+inline int  mbedtls_sha256_starts_ret(mbedtls_sha256_context* c, int is224) { return is224 || SHA256_Init(c) != 1; }
+inline int  mbedtls_sha256_update_ret(mbedtls_sha256_context* c, const unsigned char* d, size_t n) { return SHA256_Update(c, d, n) != 1; }
+inline int  mbedtls_sha256_finish_ret(mbedtls_sha256_context* c, unsigned char out[32]) { return SHA256_Final(out, c) != 1; }
@@ -0,0 +1,3 @@
+#pragma once
+// Giống mbedtls 2.28 của Arduino core ESP32 2.x → hmac_engine.h dùng API *_ret
+#define MBEDTLS_VERSION_NUMBER 0x021C0000
@@ -0,0 +1,21 @@
+#pragma once
+// Host shim cho Arduino API — chỉ đủ cho low_power.h.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+inline uint32_t getCpuFrequencyMhz() { return 240; }
+
+class HostSerial {
+public:
+    size_t println(const char* s) { return (size_t)puts(s); }
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        va_list ap; va_start(ap, fmt);
+        int n = vprintf(fmt, ap);
+        va_end(ap);
+        return n < 0 ? 0 : (size_t)n;
+    }
+};
+inline HostSerial Serial;
@@ -0,0 +1,14 @@
+#!/usr/bin/env bash
+# Build power_bench: low_power.h + hằng PWR_* trong tag_config.h của Tag, shim esp_timer/esp_pm/esp_bt.
+# Số dòng PWR_* sửa trong tag_config.h rồi build lại — số kỳ vọng tính lại từ chính các hằng đó.
+set -euo pipefail
+HERE="$(cd "$(dirname "$0")" && pwd)"
+ROOT="$HERE/../.."
+TAG="$ROOT/Src/testFreeRTOS/FreeRTOS_Tag"
+OUT="${1:-$HERE/power_bench}"
+
+${CXX:-g++} -std=c++17 -O2 -Wall -Wextra \
+    ${CXXFLAGS:-} -I"$HERE" -I"$TAG" \
+    "$HERE/power_bench.cpp" \
+    -o "$OUT"
+echo "built $OUT"
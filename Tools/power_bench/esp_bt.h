@@ -0,0 +1,6 @@
+#pragma once
+// Host shim cho esp_bt — chỉ esp_bt_sleep_enable() mà EspPowerManager gọi.
+
+#include "esp_pm.h"
+
+inline esp_err_t esp_bt_sleep_enable() { return ESP_OK; }
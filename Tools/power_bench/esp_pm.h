@@ -0,0 +1,32 @@
+#pragma once
+// Host shim cho esp_pm — EspPowerManager compile được; hostPmErr chọn light sleep có/không.
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK                 (0)
+#define ESP_ERR_NOT_SUPPORTED  (0x106)
+
+inline const char* esp_err_to_name(esp_err_t err) { return err == ESP_OK ? "ESP_OK" : "ESP_ERR_NOT_SUPPORTED"; }
+
+typedef struct {
+    int  max_freq_mhz;
+    int  min_freq_mhz;
+    bool light_sleep_enable;
+} esp_pm_config_esp32s3_t;
+
+typedef enum { ESP_PM_CPU_FREQ_MAX, ESP_PM_APB_FREQ_MAX, ESP_PM_NO_LIGHT_SLEEP } esp_pm_lock_type_t;
+
+struct HostPmLock { int held = 0; };
+typedef HostPmLock* esp_pm_lock_handle_t;
+
+inline esp_err_t hostPmErr  = ESP_OK;   // ≠ ESP_OK: như firmware thiếu CONFIG_PM_ENABLE
+inline int       hostPmHeld = 0;        // tổng số lock đang giữ — bench kiểm ESP32 được light sleep
+
+inline esp_err_t esp_pm_configure(const void*) { return hostPmErr; }
+inline esp_err_t esp_pm_lock_create(esp_pm_lock_type_t, int, const char*, esp_pm_lock_handle_t* out) {
+    *out = new HostPmLock();
+    return ESP_OK;
+}
+inline esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t l) { l->held++; hostPmHeld++; return ESP_OK; }
+inline esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t l) { l->held--; hostPmHeld--; return ESP_OK; }
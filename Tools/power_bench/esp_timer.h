@@ -0,0 +1,8 @@
+#pragma once
+// Host shim: đồng hồ giả — bench tự đẩy thời gian, UwbPowerMeter đọc qua esp_timer_get_time().
+
+#include <stdint.h>
+
+inline int64_t hostNowUs = 0;
+
+inline int64_t esp_timer_get_time() { return hostNowUs; }
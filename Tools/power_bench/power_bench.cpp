@@ -0,0 +1,154 @@
+// power_bench — chạy nguyên low_power.h của Tag trên đồng hồ giả:
+//   - replay timeline slot ranging theo đúng thứ tự gọi của uwbTask (UWB_LP_ENABLE):
+//     slot() → uwbWake() (hold, AWAKE, wakeDone) → restore config → TX/RX → uwbSleep()
+//     (SLEEP, release) → chờ hết UWB_LP_SLOT_MS
+//   - in 3 dòng [LP] giống printPowerReport() rồi so với số tính tay từ timeline và
+//     hằng PWR_* (double, không qua UwbPowerMeter/PowerBudget)
+// Exit code ≠ 0 khi lệch.
+//
+// Timeline mặc định: 600 slot (1 phút), wake CSn → IDLE_RC 2000/2000/2900 µs luân phiên
+// (avg 2300, max 2900), TX/RX 5 ms, 1 ms overhead thức ngoài TX/RX (restore config,
+// filter, notify). Bắt đầu lúc DW3000 đang ngủ (RANGING tiếp sau SUSPEND) → slot nào
+// cũng có 1 lần wake.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "tag_config.h"
+#include "low_power.h"
+
+struct Timeline {
+    uint32_t slots;
+    uint32_t slotUs;
+    uint32_t trxUs;
+    uint32_t overheadUs;     // thức nhưng TX/RX tắt — chia đôi trước / sau TX/RX
+    uint32_t wakeUs[3];      // luân phiên theo slot
+};
+
+static const Timeline kTimeline = { 600, UWB_LP_SLOT_MS * 1000U, 5000, 1000, { 2000, 2000, 2900 } };
+
+static void advance(int64_t us) { hostNowUs += us; }
+
+static bool check(const char* what, double got, double want) {
+    bool ok = got == want;
+    if (!ok) printf("  %s: got %.0f, expected %.0f\n", what, got, want);
+    return ok;
+}
+
+// uwbTask với UWB_LP_ENABLE, phần đụng tới UwbPowerMeter / EspPowerManager
+static bool replay(const Timeline& tl, UwbPowerMeter& meter, EspPowerManager& esp) {
+    bool lockOk = true;
+    hostNowUs = 0;
+    meter.begin();
+    meter.enter(UWB_PWR_SLEEP);
+    for (uint32_t i = 0; i < tl.slots; i++) {
+        int64_t slotStart = hostNowUs;
+        meter.slot();
+
+        // uwbWake()
+        esp.hold();
+        meter.enter(UWB_PWR_AWAKE);
+        int64_t t0 = esp_timer_get_time();
+        advance(tl.wakeUs[i % 3]);
+        meter.wakeDone((uint32_t)(esp_timer_get_time() - t0), true);
+        advance(tl.overheadUs / 2);
+
+        // uwbInitiatorLoop(): Poll TX → Response RX
+        meter.trxStart();
+        advance(tl.trxUs);
+        meter.trxStop();
+        advance(tl.overheadUs - tl.overheadUs / 2);
+        lockOk &= !esp.lightSleepEnabled() || hostPmHeld == 1;
+
+        // uwbSleep() + uwbSlotWait()
+        meter.enter(UWB_PWR_SLEEP);
+        esp.release();
+        lockOk &= hostPmHeld == 0;
+        advance(slotStart + tl.slotUs - hostNowUs);
+    }
+    return lockOk;
+}
+
+// Cùng công thức PowerBudget, tính lại từ tham số timeline (không qua snapshot)
+struct Expected {
+    double awakeUs, trxUs, sleepUs, totalUs;
+    double wakeAvg, wakeMax;
+    uint32_t avgUa, baselineUa, hours, baselineHours, radioOn, trx;
+};
+
+static Expected expect(const Timeline& tl, bool lightSleep) {
+    Expected e = {};
+    double wakeSum = 0;
+    for (uint32_t i = 0; i < tl.slots; i++) {
+        wakeSum += tl.wakeUs[i % 3];
+        if (tl.wakeUs[i % 3] > e.wakeMax) e.wakeMax = tl.wakeUs[i % 3];
+    }
+    e.totalUs = (double)tl.slots * tl.slotUs;
+    e.trxUs   = (double)tl.slots * tl.trxUs;
+    e.awakeUs = wakeSum + (double)tl.slots * (tl.trxUs + tl.overheadUs);
+    e.sleepUs = e.totalUs - e.awakeUs;
+    e.wakeAvg = std::floor(wakeSum / tl.slots);
+    double idle = e.awakeUs - e.trxUs;
+
+    double dw      = e.sleepUs * PWR_DW_SLEEP_UA + idle * PWR_DW_IDLE_UA + e.trxUs * PWR_DW_TRX_UA;
+    double espQ    = e.awakeUs * PWR_ESP_ACTIVE_UA +
+                     e.sleepUs * (lightSleep ? PWR_ESP_LIGHT_SLEEP_UA : PWR_ESP_IDLE_UA);
+    double dwBase  = (e.sleepUs + idle) * PWR_DW_IDLE_UA + e.trxUs * PWR_DW_TRX_UA;
+    double espBase = e.awakeUs * PWR_ESP_ACTIVE_UA + e.sleepUs * PWR_ESP_IDLE_UA;
+
+    e.avgUa         = (uint32_t)std::floor((dw + espQ) / e.totalUs) + PWR_BLE_CONN_UA;
+    e.baselineUa    = (uint32_t)std::floor((dwBase + espBase) / e.totalUs) + PWR_BLE_CONN_UA;
+    e.hours         = PWR_BATTERY_MAH * 1000U / e.avgUa;
+    e.baselineHours = PWR_BATTERY_MAH * 1000U / e.baselineUa;
+    e.radioOn       = (uint32_t)std::floor(e.awakeUs * 1000.0 / e.totalUs);
+    e.trx           = (uint32_t)std::floor(e.trxUs * 1000.0 / e.totalUs);
+    return e;
+}
+
+static bool run(const char* name, const Timeline& tl, esp_err_t pmErr) {
+    hostPmErr  = pmErr;
+    hostPmHeld = 0;
+    EspPowerManager esp;
+    esp.begin();
+    UwbPowerMeter meter;
+    bool lockOk = replay(tl, meter, esp);
+
+    UwbPowerSnapshot snap = meter.snapshot();
+    PowerBudget b = PowerBudget::estimate(snap, esp.lightSleepEnabled());
+    unsigned long wakeAvg = snap.wakes ? (unsigned long)(snap.wakeSumUs / snap.wakes) : 0;
+    printf("[LP] DW3000 awake %u/1000 trx %u/1000 | slots %lu wakes %lu\n",
+           b.radioOnPermille, b.trxPermille, (unsigned long)snap.slots, (unsigned long)snap.wakes);
+    printf("[LP] wake avg %lu max %lu us, %lu failed\n",
+           wakeAvg, (unsigned long)snap.wakeMaxUs, (unsigned long)snap.wakeFails);
+    printf("[LP] budget %lu uA (~%lu h) vs always-on %lu uA (~%lu h)\n",
+           (unsigned long)b.avgUa, (unsigned long)b.hours, (unsigned long)b.baselineUa,
+           (unsigned long)b.baselineHours);
+
+    Expected e = expect(tl, esp.lightSleepEnabled());
+    bool ok = lockOk;
+    if (!lockOk) printf("  PM lock not held exactly while DW3000 awake\n");
+    ok &= check("slots", snap.slots, tl.slots);
+    ok &= check("wakes", snap.wakes, tl.slots);
+    ok &= check("wake fails", snap.wakeFails, 0);
+    ok &= check("wake avg us", wakeAvg, e.wakeAvg);
+    ok &= check("wake max us", snap.wakeMaxUs, e.wakeMax);
+    ok &= check("awake us", (double)snap.us[UWB_PWR_AWAKE], e.awakeUs);
+    ok &= check("sleep us", (double)snap.us[UWB_PWR_SLEEP], e.sleepUs);
+    ok &= check("off us", (double)snap.us[UWB_PWR_OFF], 0);
+    ok &= check("trx us", (double)snap.trxUs, e.trxUs);
+    ok &= check("awake permille", b.radioOnPermille, e.radioOn);
+    ok &= check("trx permille", b.trxPermille, e.trx);
+    ok &= check("avg uA", b.avgUa, e.avgUa);
+    ok &= check("baseline uA", b.baselineUa, e.baselineUa);
+    ok &= check("hours", b.hours, e.hours);
+    ok &= check("baseline hours", b.baselineHours, e.baselineHours);
+    printf("%s: %s\n\n", name, ok ? "OK" : "FAIL");
+    return ok;
+}
+
+int main() {
+    bool ok = run("light sleep", kTimeline, ESP_OK);
+    ok &= run("no light sleep", kTimeline, ESP_ERR_NOT_SUPPORTED);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+#pragma once
+// Host shim cho Arduino API + FreeRTOS — chỉ đủ cho at_engine.h / sim_modem.h.
+// Task = std::thread, queue/semaphore/notify = mutex + condition_variable.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+
+using std::min;
+using std::max;
+
+#define SERIAL_8N1 (0x800001cU)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+class HostSerial {
+public:
+    size_t println(const char* s) { return (size_t)puts(s); }
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        va_list ap; va_start(ap, fmt);
+        int n = vprintf(fmt, ap);
+        va_end(ap);
+        return n < 0 ? 0 : (size_t)n;
+    }
+};
+extern HostSerial Serial;
+
+// ── FreeRTOS ─────────────────────────────────────────────────────────────────
+typedef uint32_t TickType_t;
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdTRUE            (1)
+#define pdFALSE           (0)
+#define pdPASS            (1)
+#define portMAX_DELAY     (0xFFFFFFFFU)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))   // tick = 1 ms
+
+struct HostQueue;
+struct HostSem;
+struct HostTask;
+typedef HostQueue* QueueHandle_t;
+typedef HostSem*   SemaphoreHandle_t;
+typedef HostTask*  TaskHandle_t;
+
+QueueHandle_t     xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t        xQueueSend(QueueHandle_t q, const void* item, TickType_t wait);
+BaseType_t        xQueueReceive(QueueHandle_t q, void* item, TickType_t wait);
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+BaseType_t        xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait);
+BaseType_t        xSemaphoreGive(SemaphoreHandle_t s);
+BaseType_t        xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack, void* arg,
+                                          UBaseType_t prio, TaskHandle_t* handle, BaseType_t core);
+BaseType_t        xTaskNotifyGive(TaskHandle_t t);
+uint32_t          ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t wait);
+void              vTaskDelay(TickType_t ticks);
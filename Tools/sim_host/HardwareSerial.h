@@ -0,0 +1,36 @@
+#pragma once
+// Host shim: HardwareSerial trên 1 file descriptor (đầu master của pty).
+// Reader thread đóng vai driver UART: đọc fd vào buffer rồi gọi onReceive
+// callback, giống task sự kiện UART của Arduino core ESP32.
+
+#include "Arduino.h"
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+class HardwareSerial {
+private:
+    int                   fd = -1;
+    std::function<void()> rxCallback;
+    std::mutex            lock;
+    std::deque<uint8_t>   rxBuf;
+    std::thread           reader;
+    std::atomic<bool>     running{false};
+
+    void readerLoop();
+
+public:
+    explicit HardwareSerial(int) {}
+    ~HardwareSerial() { end(); }
+
+    void   attachFd(int f) { fd = f; }
+    size_t setRxBufferSize(size_t n) { return n; }
+    void   begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1);
+    void   end();
+    void   onReceive(std::function<void()> cb, bool onlyOnTimeout = false) { (void)onlyOnTimeout; rxCallback = cb; }
+
+    int    available();
+    size_t read(uint8_t* buf, size_t n);
+    size_t write(const uint8_t* buf, size_t n);
+};
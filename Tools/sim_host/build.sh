@@ -0,0 +1,25 @@
+#!/usr/bin/env bash
+# Build sim_host: at_engine.h + sim_modem.h của anchor nguyên bản trên shim Arduino/FreeRTOS
+# (std::thread) + modem A7680C giả lập qua pty.
+# Build sim_replay: at_engine.h + secure_response.h trên libmbedcrypto 2.28 của hệ thống
+# (header khai báo tay trong mbedtls/ — gói runtime libmbedcrypto7 không kèm header).
+set -euo pipefail
+HERE="$(cd "$(dirname "$0")" && pwd)"
+ROOT="$HERE/../.."
+ANCHOR="$ROOT/Src/testFreeRTOS/FreeRTOS_Anchor_TestSimFetchKey"
+OUT="${1:-$HERE/sim_host}"
+REPLAY_OUT="$(dirname "$OUT")/sim_replay"
+
+# SIM_AT_LOG=1 ./build.sh → in mọi lệnh AT như trên firmware (làm chậm số đo parse)
+${CXX:-g++} -std=c++17 -O2 -Wall -Wextra -Wno-unused-parameter -pthread \
+    -DSIM_AT_LOG="${SIM_AT_LOG:-0}" \
+    -I"$HERE" -I"$ANCHOR" \
+    "$HERE/sim_host.cpp" "$HERE/host_shim.cpp" "$HERE/modem_sim.cpp" \
+    -lutil -o "$OUT"
+echo "built $OUT"
+
+${CXX:-g++} -std=c++17 -O2 -Wall -Wextra -Wno-unused-parameter \
+    -I"$HERE" -I"$ANCHOR" \
+    "$HERE/sim_replay.cpp" \
+    -l:libmbedcrypto.so.7 -o "$REPLAY_OUT"
+echo "built $REPLAY_OUT"
@@ -0,0 +1,195 @@
+// Arduino/FreeRTOS shim cho host: thời gian từ steady_clock, task = std::thread,
+// HardwareSerial đọc/ghi 1 fd (pty master).
+
+#include "Arduino.h"
+#include "HardwareSerial.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+HostSerial Serial;
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+unsigned long micros() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long millis() { return micros() / 1000UL; }
+
+void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+// ── FreeRTOS ─────────────────────────────────────────────────────────────────
+
+// Chờ cv tới khi pred() đúng hoặc hết `wait` tick (1 tick = 1 ms)
+template <typename Pred>
+static bool waitFor(std::condition_variable& cv, std::unique_lock<std::mutex>& lk, TickType_t wait, Pred pred) {
+    if (wait == portMAX_DELAY) { cv.wait(lk, pred); return true; }
+    return cv.wait_for(lk, std::chrono::milliseconds(wait), pred);
+}
+
+struct HostQueue {
+    std::mutex                        m;
+    std::condition_variable           cv;
+    std::deque<std::vector<uint8_t>>  items;
+    size_t                            length, itemSize;
+};
+
+struct HostSem {
+    std::mutex              m;
+    std::condition_variable cv;
+    unsigned                count, maxCount;
+};
+
+struct HostTask {
+    std::mutex              m;
+    std::condition_variable cv;
+    uint32_t                notify = 0;
+    TaskFunction_t          fn;
+    void*                   arg;
+};
+
+static thread_local HostTask* currentTask = nullptr;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    HostQueue* q = new HostQueue;
+    q->length   = length;
+    q->itemSize = itemSize;
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t wait) {
+    std::unique_lock<std::mutex> lk(q->m);
+    if (!waitFor(q->cv, lk, wait, [q] { return q->items.size() < q->length; })) return pdFALSE;
+    const uint8_t* p = (const uint8_t*)item;
+    q->items.emplace_back(p, p + q->itemSize);
+    q->cv.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t wait) {
+    std::unique_lock<std::mutex> lk(q->m);
+    if (!waitFor(q->cv, lk, wait, [q] { return !q->items.empty(); })) return pdFALSE;
+    memcpy(item, q->items.front().data(), q->itemSize);
+    q->items.pop_front();
+    q->cv.notify_all();
+    return pdTRUE;
+}
+
+static SemaphoreHandle_t semCreate(unsigned initial) {
+    HostSem* s = new HostSem;
+    s->count    = initial;
+    s->maxCount = 1;
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()  { return semCreate(1); }
+SemaphoreHandle_t xSemaphoreCreateBinary() { return semCreate(0); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait) {
+    std::unique_lock<std::mutex> lk(s->m);
+    if (!waitFor(s->cv, lk, wait, [s] { return s->count > 0; })) return pdFALSE;
+    s->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+    std::lock_guard<std::mutex> lk(s->m);
+    if (s->count >= s->maxCount) return pdFALSE;
+    s->count++;
+    s->cv.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char*, uint32_t, void* arg,
+                                   UBaseType_t, TaskHandle_t* handle, BaseType_t) {
+    HostTask* t = new HostTask;
+    t->fn  = fn;
+    t->arg = arg;
+    if (handle) *handle = t;
+    std::thread([t] { currentTask = t; t->fn(t->arg); }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t t) {
+    std::lock_guard<std::mutex> lk(t->m);
+    t->notify++;
+    t->cv.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t wait) {
+    HostTask* t = currentTask;
+    if (!t) return 0;
+    std::unique_lock<std::mutex> lk(t->m);
+    waitFor(t->cv, lk, wait, [t] { return t->notify > 0; });
+    uint32_t v = t->notify;
+    if (v) t->notify = clearOnExit ? 0 : v - 1;
+    return v;
+}
+
+void vTaskDelay(TickType_t ticks) { delay(ticks); }
+
+// ── HardwareSerial ───────────────────────────────────────────────────────────
+
+void HardwareSerial::begin(unsigned long, uint32_t, int8_t, int8_t) {
+    if (running || fd < 0) return;
+    running = true;
+    reader  = std::thread([this] { readerLoop(); });
+}
+
+void HardwareSerial::end() {
+    if (!running) return;
+    running = false;
+    if (reader.joinable()) reader.join();
+}
+
+void HardwareSerial::readerLoop() {
+    uint8_t buf[256];
+    while (running) {
+        struct pollfd p = { fd, POLLIN, 0 };
+        if (poll(&p, 1, 50) <= 0) continue;
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            rxBuf.insert(rxBuf.end(), buf, buf + n);
+        }
+        if (rxCallback) rxCallback();
+    }
+}
+
+int HardwareSerial::available() {
+    std::lock_guard<std::mutex> lk(lock);
+    return (int)rxBuf.size();
+}
+
+size_t HardwareSerial::read(uint8_t* buf, size_t n) {
+    std::lock_guard<std::mutex> lk(lock);
+    n = min(n, rxBuf.size());
+    std::copy(rxBuf.begin(), rxBuf.begin() + n, buf);
+    rxBuf.erase(rxBuf.begin(), rxBuf.begin() + n);
+    return n;
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t w = ::write(fd, buf + done, n - done);
+        if (w < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            break;
+        }
+        done += (size_t)w;
+    }
+    return done;
+}
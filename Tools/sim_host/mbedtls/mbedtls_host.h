@@ -0,0 +1,114 @@
+#pragma once
+// Khai báo tay API mbedtls 2.28 (chỉ phần secure_response.h + sim_replay dùng) để
+// link thẳng libmbedcrypto.so.7 của hệ thống — Debian/Ubuntu chỉ cài runtime
+// (libmbedcrypto7), không có header. Cùng major với mbedtls trong Arduino core ESP32 2.x.
+// Context mà code chỉ dùng qua con trỏ → khối opaque dư kích thước (x86_64).
+// pk/md context giữ đúng layout vì mbedtls_pk_ec() đọc thẳng field.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MBEDTLS_VERSION_NUMBER 0x021C0300   // 2.28.3
+
+#define MBEDTLS_GCM_ENCRYPT 1
+#define MBEDTLS_GCM_DECRYPT 0
+
+extern "C" {
+
+typedef int (*mbedtls_rng_fn)(void*, unsigned char*, size_t);
+
+// md
+typedef enum {
+    MBEDTLS_MD_NONE = 0, MBEDTLS_MD_MD2, MBEDTLS_MD_MD4, MBEDTLS_MD_MD5, MBEDTLS_MD_SHA1,
+    MBEDTLS_MD_SHA224, MBEDTLS_MD_SHA256, MBEDTLS_MD_SHA384, MBEDTLS_MD_SHA512, MBEDTLS_MD_RIPEMD160
+} mbedtls_md_type_t;
+typedef struct mbedtls_md_info_t mbedtls_md_info_t;
+typedef struct mbedtls_md_context_t {
+    const mbedtls_md_info_t* md_info;
+    void* md_ctx;
+    void* hmac_ctx;
+} mbedtls_md_context_t;
+const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t md_type);
+void mbedtls_md_init(mbedtls_md_context_t* ctx);
+void mbedtls_md_free(mbedtls_md_context_t* ctx);
+int  mbedtls_md_setup(mbedtls_md_context_t* ctx, const mbedtls_md_info_t* md_info, int hmac);
+int  mbedtls_md(const mbedtls_md_info_t* md_info, const unsigned char* input, size_t ilen, unsigned char* output);
+int  mbedtls_md_hmac(const mbedtls_md_info_t* md_info, const unsigned char* key, size_t keylen,
+                     const unsigned char* input, size_t ilen, unsigned char* output);
+int  mbedtls_md_hmac_starts(mbedtls_md_context_t* ctx, const unsigned char* key, size_t keylen);
+int  mbedtls_md_hmac_update(mbedtls_md_context_t* ctx, const unsigned char* input, size_t ilen);
+int  mbedtls_md_hmac_finish(mbedtls_md_context_t* ctx, unsigned char* output);
+
+// ecp
+typedef enum {
+    MBEDTLS_ECP_DP_NONE = 0, MBEDTLS_ECP_DP_SECP192R1, MBEDTLS_ECP_DP_SECP224R1, MBEDTLS_ECP_DP_SECP256R1
+} mbedtls_ecp_group_id;
+typedef struct mbedtls_ecp_keypair mbedtls_ecp_keypair;
+int mbedtls_ecp_gen_key(mbedtls_ecp_group_id grp_id, mbedtls_ecp_keypair* key, mbedtls_rng_fn f_rng, void* p_rng);
+
+// pk
+typedef enum {
+    MBEDTLS_PK_NONE = 0, MBEDTLS_PK_RSA, MBEDTLS_PK_ECKEY, MBEDTLS_PK_ECKEY_DH, MBEDTLS_PK_ECDSA
+} mbedtls_pk_type_t;
+typedef struct mbedtls_pk_info_t mbedtls_pk_info_t;
+typedef struct mbedtls_pk_context {
+    const mbedtls_pk_info_t* pk_info;
+    void* pk_ctx;
+} mbedtls_pk_context;
+const mbedtls_pk_info_t* mbedtls_pk_info_from_type(mbedtls_pk_type_t pk_type);
+void mbedtls_pk_init(mbedtls_pk_context* ctx);
+void mbedtls_pk_free(mbedtls_pk_context* ctx);
+int  mbedtls_pk_setup(mbedtls_pk_context* ctx, const mbedtls_pk_info_t* info);
+int  mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keylen);
+int  mbedtls_pk_parse_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keylen,
+                          const unsigned char* pwd, size_t pwdlen);
+int  mbedtls_pk_write_pubkey_der(mbedtls_pk_context* ctx, unsigned char* buf, size_t size);
+int  mbedtls_pk_write_key_der(mbedtls_pk_context* ctx, unsigned char* buf, size_t size);
+static inline mbedtls_ecp_keypair* mbedtls_pk_ec(const mbedtls_pk_context pk) {
+    return (mbedtls_ecp_keypair*)pk.pk_ctx;
+}
+
+// ecdh
+typedef enum { MBEDTLS_ECDH_OURS, MBEDTLS_ECDH_THEIRS } mbedtls_ecdh_side;
+typedef struct { alignas(16) unsigned char opaque[4096]; } mbedtls_ecdh_context;
+void mbedtls_ecdh_init(mbedtls_ecdh_context* ctx);
+void mbedtls_ecdh_free(mbedtls_ecdh_context* ctx);
+int  mbedtls_ecdh_get_params(mbedtls_ecdh_context* ctx, const mbedtls_ecp_keypair* key, mbedtls_ecdh_side side);
+int  mbedtls_ecdh_calc_secret(mbedtls_ecdh_context* ctx, size_t* olen, unsigned char* buf, size_t blen,
+                              mbedtls_rng_fn f_rng, void* p_rng);
+
+// cipher / gcm
+typedef enum { MBEDTLS_CIPHER_ID_NONE = 0, MBEDTLS_CIPHER_ID_NULL, MBEDTLS_CIPHER_ID_AES } mbedtls_cipher_id_t;
+typedef struct { alignas(16) unsigned char opaque[4096]; } mbedtls_gcm_context;
+void mbedtls_gcm_init(mbedtls_gcm_context* ctx);
+void mbedtls_gcm_free(mbedtls_gcm_context* ctx);
+int  mbedtls_gcm_setkey(mbedtls_gcm_context* ctx, mbedtls_cipher_id_t cipher, const unsigned char* key,
+                        unsigned int keybits);
+int  mbedtls_gcm_starts(mbedtls_gcm_context* ctx, int mode, const unsigned char* iv, size_t iv_len,
+                        const unsigned char* add, size_t add_len);
+int  mbedtls_gcm_update(mbedtls_gcm_context* ctx, size_t length, const unsigned char* input, unsigned char* output);
+int  mbedtls_gcm_finish(mbedtls_gcm_context* ctx, unsigned char* tag, size_t tag_len);
+int  mbedtls_gcm_crypt_and_tag(mbedtls_gcm_context* ctx, int mode, size_t length, const unsigned char* iv,
+                               size_t iv_len, const unsigned char* add, size_t add_len, const unsigned char* input,
+                               unsigned char* output, size_t tag_len, unsigned char* tag);
+int  mbedtls_gcm_auth_decrypt(mbedtls_gcm_context* ctx, size_t length, const unsigned char* iv, size_t iv_len,
+                              const unsigned char* add, size_t add_len, const unsigned char* tag, size_t tag_len,
+                              const unsigned char* input, unsigned char* output);
+
+// base64
+int mbedtls_base64_encode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen);
+int mbedtls_base64_decode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen);
+
+// entropy / ctr_drbg
+typedef struct { alignas(16) unsigned char opaque[65536]; } mbedtls_entropy_context;
+typedef struct { alignas(16) unsigned char opaque[4096]; } mbedtls_ctr_drbg_context;
+void mbedtls_entropy_init(mbedtls_entropy_context* ctx);
+void mbedtls_entropy_free(mbedtls_entropy_context* ctx);
+int  mbedtls_entropy_func(void* data, unsigned char* output, size_t len);
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context* ctx);
+void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context* ctx);
+int  mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context* ctx, int (*f_entropy)(void*, unsigned char*, size_t),
+                           void* p_entropy, const unsigned char* custom, size_t len);
+int  mbedtls_ctr_drbg_random(void* p_rng, unsigned char* output, size_t output_len);
+
+}
@@ -0,0 +1,214 @@
+// Modem A7680C giả lập — xem modem_sim.h cho cú pháp script.
+
+#include "modem_sim.h"
+
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static std::string trim(const std::string& s) {
+    size_t a = s.find_first_not_of(" \t"), b = s.find_last_not_of(" \t\r");
+    return a == std::string::npos ? "" : s.substr(a, b - a + 1);
+}
+
+// Tách "a | b | c" thành tối đa n phần; phần cuối giữ nguyên mọi '|' còn lại
+static std::vector<std::string> splitBar(const std::string& s, size_t n) {
+    std::vector<std::string> out;
+    size_t pos = 0;
+    while (out.size() + 1 < n) {
+        size_t bar = s.find('|', pos);
+        if (bar == std::string::npos) break;
+        out.push_back(trim(s.substr(pos, bar - pos)));
+        pos = bar + 1;
+    }
+    out.push_back(trim(s.substr(pos)));
+    return out;
+}
+
+// JSON giống response của server: base64 dài + chuỗi bẫy cho parser kiểu cũ
+static std::string randomBody(size_t n) {
+    static const char B64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    static const std::string HEAD = "{\"trap\":\"\r\nOK\r\n+HTTPREAD: 0\r\nERROR\r\n\",\"data_b64\":\"";
+    static const std::string TAIL = "\"}";
+    std::mt19937 rng(0xA7680C);
+    std::string s = HEAD;
+    while (s.size() + TAIL.size() < n) s += B64[rng() % 64];
+    return s + TAIL;
+}
+
+uint64_t ModemSim::nowUs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::string ModemSim::unescape(const std::string& s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] != '\\' || i + 1 == s.size()) { out += s[i]; continue; }
+        char c = s[++i];
+        out += c == 'r' ? '\r' : c == 'n' ? '\n' : c;
+    }
+    return out;
+}
+
+bool ModemSim::load(const char* path) {
+    std::ifstream f(path);
+    if (!f) { fprintf(stderr, "modem_sim: không mở được %s\n", path); return false; }
+    std::string raw;
+    int lineNo = 0;
+    while (std::getline(f, raw)) {
+        lineNo++;
+        std::string l = trim(raw);
+        if (l.empty() || l[0] == '#') continue;
+        std::istringstream in(l);
+        std::string kw;
+        in >> kw;
+        if (kw == "echo")   { int v; in >> v; echo = v != 0; }
+        else if (kw == "chunk")  { in >> chunk; }
+        else if (kw == "gap_us") { in >> gapUs; }
+        else if (kw == "baud")   { in >> baud; }
+        else if (kw == "expect") { std::string v; in >> v; expectSuccess = v == "ok"; }
+        else if (kw == "body") {
+            std::string mode;
+            in >> mode;
+            if (mode == "random") { size_t n = 0; in >> n; httpBody = randomBody(n); }
+            else if (mode == "text") httpBody = unescape(trim(l.substr(l.find("text") + 4)));
+            else { fprintf(stderr, "%s:%d: body random|text\n", path, lineNo); return false; }
+        } else if (kw == "urc") {
+            std::vector<std::string> p = splitBar(l.substr(3), 2);
+            if (p.size() != 2) { fprintf(stderr, "%s:%d: urc <ms> | <reply>\n", path, lineNo); return false; }
+            queue((uint64_t)atoll(p[0].c_str()) * 1000, unescape(p[1]));   // mốc tương đối, cộng startUs lúc start()
+        } else if (kw == "on") {
+            std::vector<std::string> p = splitBar(l.substr(2), 3);
+            if (p.size() != 3) { fprintf(stderr, "%s:%d: on <prefix> | <ms> | <reply>\n", path, lineNo); return false; }
+            Rule* r = nullptr;
+            for (Rule& x : rules) if (x.prefix == p[0]) r = &x;
+            if (!r) { rules.push_back(Rule{ p[0], {}, 0 }); r = &rules.back(); }
+            r->replies.push_back(Reply{ (uint32_t)atoi(p[1].c_str()), p[2][0] == '@' ? p[2] : unescape(p[2]) });
+        } else {
+            fprintf(stderr, "%s:%d: không hiểu '%s'\n", path, lineNo, kw.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void ModemSim::start(int f) {
+    fd      = f;
+    startUs = nowUs();
+    std::multimap<uint64_t, std::string> urcs;
+    for (auto& p : pending) urcs.emplace(startUs + p.first, p.second);
+    pending.swap(urcs);
+    running = true;
+    worker  = std::thread([this] { run(); });
+}
+
+void ModemSim::stop() {
+    running = false;
+    if (worker.joinable()) worker.join();
+}
+
+void ModemSim::emit(const std::string& bytes) {
+    size_t step = chunk ? chunk : bytes.size();
+    for (size_t off = 0; off < bytes.size(); off += step) {
+        size_t n = std::min(step, bytes.size() - off);
+        for (size_t done = 0; done < n;) {
+            ssize_t w = ::write(fd, bytes.data() + off + done, n - done);
+            if (w < 0) { if (errno == EINTR || errno == EAGAIN) continue; return; }
+            done += (size_t)w;
+        }
+        sent += n;
+        uint64_t pauseUs = gapUs + (baud ? n * 10ULL * 1000000ULL / baud : 0);
+        if (pauseUs && off + n < bytes.size()) std::this_thread::sleep_for(std::chrono::microseconds(pauseUs));
+    }
+}
+
+void ModemSim::onCommand(const std::string& cmd) {
+    cmdCount++;
+    if (echo) queue(nowUs(), cmd + "\r");
+    if (cmd == "ATE0") echo = false;
+
+    Rule* rule = nullptr;
+    for (Rule& r : rules) {
+        if (cmd.compare(0, r.prefix.size(), r.prefix) == 0) { rule = &r; break; }
+    }
+    if (!rule) { unmatchedCount++; queue(nowUs(), "\r\nERROR\r\n"); return; }
+
+    const Reply& rep = rule->replies[std::min(rule->next, rule->replies.size() - 1)];
+    rule->next++;
+    uint64_t at = nowUs() + rep.delayMs * 1000ULL;
+    std::istringstream in(rep.text);
+    std::string op;
+    in >> op;
+
+    if (op == "@silent") return;
+    if (op == "@httpdata") {
+        size_t eq = cmd.find('=');
+        dataLeft = eq == std::string::npos ? 0 : (size_t)atol(cmd.c_str() + eq + 1);
+        postBody.clear();
+        queue(at, "\r\nDOWNLOAD\r\n");
+        if (!dataLeft) queue(at, "\r\nOK\r\n");
+    } else if (op == "@httpaction") {
+        int status = 200;
+        in >> status;
+        queue(nowUs(), "\r\nOK\r\n");
+        queue(at, "\r\n+HTTPACTION: 1," + std::to_string(status) + "," + std::to_string(httpBody.size()) + "\r\n");
+    } else if (op == "@httpread") {
+        size_t block = 0, c1 = cmd.find(',');
+        in >> block;
+        size_t want = c1 == std::string::npos ? httpBody.size() : (size_t)atol(cmd.c_str() + c1 + 1);
+        want = std::min(want, httpBody.size());
+        if (!block) block = want;
+        std::string urc;                                 // phần còn lại: URC chen trước khối đầu
+        std::getline(in, urc);
+        std::string out = "\r\nOK\r\n";
+        if (!trim(urc).empty()) out += "\r\n" + unescape(trim(urc)) + "\r\n";
+        for (size_t off = 0; off < want; off += block) {
+            size_t n = std::min(block, want - off);
+            out += "\r\n+HTTPREAD: " + std::to_string(n) + "\r\n" + httpBody.substr(off, n);
+        }
+        queue(at, out + "\r\n+HTTPREAD: 0\r\n");
+    } else {
+        queue(at, rep.text);
+    }
+}
+
+void ModemSim::run() {
+    char buf[512];
+    while (running) {
+        uint64_t now = nowUs();
+        while (!pending.empty() && pending.begin()->first <= now) {
+            std::string bytes = pending.begin()->second;
+            pending.erase(pending.begin());
+            emit(bytes);
+        }
+        int waitMs = 20;
+        if (!pending.empty()) waitMs = (int)std::min<uint64_t>(20, (pending.begin()->first - now + 999) / 1000);
+
+        struct pollfd p = { fd, POLLIN, 0 };
+        if (poll(&p, 1, waitMs) <= 0) continue;
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n <= 0) { if (n < 0 && errno == EINTR) continue; break; }
+
+        for (ssize_t i = 0; i < n; i++) {
+            char c = buf[i];
+            if (dataLeft) {                              // HTTPDATA payload
+                postBody += c;
+                if (--dataLeft == 0) queue(nowUs(), "\r\nOK\r\n");
+                continue;
+            }
+            if (c == '\r') {
+                if (!cmdLine.empty()) onCommand(cmdLine);
+                cmdLine.clear();
+            } else if (c != '\n') {
+                cmdLine += c;
+            }
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+// Modem A7680C giả lập theo script, chạy trên đầu slave của pty.
+//
+// Script (mỗi dòng 1 lệnh, '#' = comment, reply hỗ trợ \r \n \\ \"):
+//   echo 1|0                  echo lệnh như module thật (tắt khi nhận ATE0)
+//   chunk <n>                 ghi phản hồi thành mảnh ≤ n byte (0 = cả khối)
+//   gap_us <us>               nghỉ giữa các mảnh
+//   baud <n>                  giới hạn tốc độ như UART (0 = không giới hạn)
+//   body random <n>           HTTP response body n byte (JSON + base64, có bẫy "OK"/"ERROR")
+//   body text <reply>
+//   urc <ms> | <reply>        phát URC tự phát ở mốc ms kể từ lúc start
+//   on <prefix> | <ms> | <reply>
+//                             lệnh bắt đầu bằng prefix → reply sau ms. Nhiều dòng cùng
+//                             prefix dùng lần lượt, dòng cuối lặp lại. Prefix đầu tiên
+//                             khớp (theo thứ tự file) thắng. Không khớp → "ERROR".
+//     reply đặc biệt: @silent           không trả lời (→ timeout)
+//                     @httpdata         DOWNLOAD, nhận n byte, OK
+//                     @httpaction <st>  OK ngay, +HTTPACTION: 1,<st>,<len body> sau ms
+//                     @httpread <n> [urc]
+//                                       OK, [urc], body thành các khối +HTTPREAD: <≤n>, +HTTPREAD: 0
+//   expect ok|fail            kết quả httpPost mong đợi (sim_host kiểm)
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ModemSim {
+public:
+    bool load(const char* path);
+    void start(int fd);
+    void stop();
+
+    const std::string& body()      const { return httpBody; }
+    const std::string& lastPost()  const { return postBody; }
+    bool               expectOk()  const { return expectSuccess; }
+    uint64_t           bytesOut()  const { return sent; }
+    uint32_t           commands()  const { return cmdCount; }
+    uint32_t           unmatched() const { return unmatchedCount; }
+
+private:
+    struct Reply { uint32_t delayMs; std::string text; };
+    struct Rule  { std::string prefix; std::vector<Reply> replies; size_t next = 0; };
+
+    std::vector<Rule>                   rules;
+    std::multimap<uint64_t, std::string> pending;   // mốc µs → byte cần ghi
+    std::string                         httpBody, postBody, cmdLine;
+    bool                                echo = true, expectSuccess = true;
+    size_t                              chunk = 0, dataLeft = 0;
+    uint32_t                            gapUs = 0, baud = 0;
+    uint64_t                            startUs = 0, sent = 0;
+    uint32_t                            cmdCount = 0, unmatchedCount = 0;
+    int                                 fd = -1;
+    std::atomic<bool>                   running{false};
+    std::thread                         worker;
+
+    static uint64_t nowUs();
+    static std::string unescape(const std::string& s);
+    void queue(uint64_t atUs, const std::string& bytes) { pending.emplace(atUs, bytes); }
+    void emit(const std::string& bytes);
+    void onCommand(const std::string& cmd);
+    void run();
+};
@@ -0,0 +1,99 @@
+// sim_host — chạy SimModem/AtEngine của anchor trên Linux, nói chuyện với modem
+// giả lập (modem_sim.cpp) qua pty. Đo throughput RX và chi phí parse mỗi response.
+//
+//   sim_host <script> [-n <posts>]
+
+#include "Arduino.h"
+#include "HardwareSerial.h"
+#include "sim_modem.h"
+#include "modem_sim.h"
+
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+static const char* POST_BODY =
+    "{\"vehicle_id\":\"1HGBH41JXMN109186\",\"client_public_key_b64\":"
+    "\"MFkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDQgAEhost/test/key/only/0123456789abcdefABCDEF==\"}";
+
+static uint8_t respBuf[64 * 1024];
+
+static bool rawPty(int fd) {
+    struct termios t;
+    if (tcgetattr(fd, &t) != 0) return false;
+    cfmakeraw(&t);
+    return tcsetattr(fd, TCSANOW, &t) == 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) { fprintf(stderr, "usage: %s <script> [-n posts]\n", argv[0]); return 2; }
+    int posts = 3;
+    for (int i = 2; i + 1 < argc; i++) if (!strcmp(argv[i], "-n")) posts = atoi(argv[++i]);
+
+    ModemSim sim;
+    if (!sim.load(argv[1])) return 2;
+
+    int master, slave;
+    if (openpty(&master, &slave, nullptr, nullptr, nullptr) != 0 || !rawPty(master) || !rawPty(slave)) {
+        perror("openpty");
+        return 2;
+    }
+    sim.start(slave);
+
+    HardwareSerial port(2);
+    port.attachFd(master);
+    SimModem modem(port);
+    if (!modem.begin(115200, -1, -1)) { fprintf(stderr, "SimModem::begin failed\n"); return 2; }
+
+    uint32_t t0 = millis();
+    bool attached = modem.attach("sim-host");
+    uint32_t attachMs = millis() - t0;
+    printf("attach: %s (%lu ms)\n", attached ? "OK" : "FAIL", (unsigned long)attachMs);
+
+    // Chỉ tính phần HTTP: attach có vTaskDelay cố định
+    AtEngine::Stats before = modem.stats();
+    uint32_t parseBefore = modem.parseMicros();
+    uint32_t postStart   = micros();
+    int good = 0;
+    for (int i = 0; attached && i < posts; i++) {
+        size_t n = modem.httpPost("http://sim-host/secure-check-pairing", POST_BODY, respBuf, sizeof(respBuf));
+        bool match = n == sim.body().size() && memcmp(respBuf, sim.body().data(), n) == 0 &&
+                     sim.lastPost() == POST_BODY;
+        printf("post %d: %zu B %s\n", i + 1, n, n ? (match ? "OK" : "MISMATCH") : "FAIL");
+        good += n && match;
+    }
+    uint32_t postUs = micros() - postStart;
+    AtEngine::Stats s = modem.stats();
+    uint32_t parseUs  = modem.parseMicros() - parseBefore;
+    uint32_t bytes    = s.bytesIn - before.bytesIn;
+    uint32_t done     = (s.ok + s.errors + s.timeouts) - (before.ok + before.errors + before.timeouts);
+
+    printf("\n== AT engine ==\n");
+    printf("commands   : %lu (ok %lu, error %lu, timeout %lu), max latency %lu ms\n",
+           (unsigned long)s.commands, (unsigned long)s.ok, (unsigned long)s.errors,
+           (unsigned long)s.timeouts, (unsigned long)s.maxLatencyMs);
+    printf("rx total   : %lu B (%lu raw), %lu lines, %lu URC, %lu long lines\n",
+           (unsigned long)s.bytesIn, (unsigned long)s.rawBytes, (unsigned long)s.lines,
+           (unsigned long)s.urcs, (unsigned long)s.longLines);
+    printf("modem sim  : %u commands, %u unmatched, %llu B sent\n",
+           sim.commands(), sim.unmatched(), (unsigned long long)sim.bytesOut());
+    if (attached && posts) {
+        printf("\n== HTTP phase (%d post) ==\n", posts);
+        printf("rx         : %lu B in %.1f ms → %.1f KB/s end-to-end\n",
+               (unsigned long)bytes, postUs / 1000.0, postUs ? bytes * 1000.0 / postUs : 0.0);
+        printf("parse      : %lu us total, %.1f ns/B, %.2f us/response (%lu responses)\n",
+               (unsigned long)parseUs, bytes ? parseUs * 1000.0 / bytes : 0.0,
+               done ? (double)parseUs / done : 0.0, (unsigned long)done);
+        printf("            (simTask CPU; 115200 baud = 11.5 KB/s)\n");
+    }
+
+    bool success = attached && good == posts;
+    bool pass    = success == sim.expectOk();
+    printf("\nresult: %s (expected %s) → %s\n", success ? "ok" : "fail", sim.expectOk() ? "ok" : "fail",
+           pass ? "PASS" : "FAIL");
+
+    port.end();
+    sim.stop();
+    fflush(stdout);
+    _exit(pass ? 0 : 1);   // simTask là thread detached, không join được
+}
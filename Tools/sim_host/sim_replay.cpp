@@ -0,0 +1,487 @@
+// sim_replay — replay output modem đã ghi (AT+HTTPREAD của /secure-check-pairing,
+// /friend-sharing/sync) qua AtEngine của anchor, so 2 đường giải mã response:
+//   buffered  — đường trước đây: gom body vào buffer SIM_HTTP_RESP_MAX, parse JSON
+//               zero-copy (DynamicJsonDocument 512 B trên heap), base64 decode 3 field,
+//               rồi ECDH + HKDF + GCM sau khi tải xong
+//   streaming — secure_response.h: JSON/base64 theo mảnh, ECDH khi server key tới,
+//               GCM in-place trong lúc tải
+// Đo peak heap (malloc/calloc/free của cả mbedtls) và time-to-key: từ byte đầu tiên
+// của response tới khi plaintext đã xác thực, với UART pacing mô phỏng.
+//
+//   sim_replay gen <capture> [--kind pairing|friend] [--order stream|legacy] [--block n]
+//   sim_replay <capture> [--baud 115200] [--rx-chunk 120] [--cpu-scale 1] [--runs 15]
+
+#include "at_engine.h"
+#include "secure_response.h"
+#include <mbedtls/base64.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// ==================== Heap accounting ====================
+extern "C" void* __libc_malloc(size_t);
+extern "C" void* __libc_calloc(size_t, size_t);
+extern "C" void* __libc_realloc(void*, size_t);
+extern "C" void  __libc_free(void*);
+
+static size_t heapNow = 0, heapPeak = 0;
+
+static void heapAdd(void* p) {
+    if (!p) return;
+    heapNow += malloc_usable_size(p);
+    if (heapNow > heapPeak) heapPeak = heapNow;
+}
+static void heapSub(void* p) { if (p) heapNow -= malloc_usable_size(p); }
+
+extern "C" void* malloc(size_t n)            { void* p = __libc_malloc(n); heapAdd(p); return p; }
+extern "C" void* calloc(size_t n, size_t s)  { void* p = __libc_calloc(n, s); heapAdd(p); return p; }
+extern "C" void  free(void* p)               { heapSub(p); __libc_free(p); }
+extern "C" void* realloc(void* p, size_t n) {
+    heapSub(p);
+    void* q = __libc_realloc(p, n);
+    heapAdd(q ? q : p);
+    return q;
+}
+
+// Peak heap tăng thêm trong 1 cửa sổ đo
+struct HeapWindow {
+    size_t base;
+    HeapWindow() : base(heapNow) { heapPeak = heapNow; }
+    size_t peak() const { return heapPeak - base; }
+};
+
+// ==================== Tiện ích ====================
+static mbedtls_entropy_context  entropy;
+static mbedtls_ctr_drbg_context drbg;
+
+static std::string b64(const uint8_t* d, size_t n) {
+    std::string s(4 * ((n + 2) / 3) + 1, '\0');
+    size_t olen = 0;
+    mbedtls_base64_encode((uint8_t*)&s[0], s.size(), &olen, d, n);
+    s.resize(olen);
+    return s;
+}
+
+static std::vector<uint8_t> unb64(const std::string& s) {
+    std::vector<uint8_t> v(s.size());
+    size_t olen = 0;
+    if (mbedtls_base64_decode(v.data(), v.size(), &olen, (const uint8_t*)s.data(), s.size()) != 0) olen = 0;
+    v.resize(olen);
+    return v;
+}
+
+static std::string sha256Hex(const uint8_t* d, size_t n) {
+    uint8_t h[32];
+    mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), d, n, h);
+    char hex[65];
+    for (int i = 0; i < 32; i++) snprintf(hex + 2 * i, 3, "%02x", h[i]);
+    return hex;
+}
+
+static double nowUs() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Key pair P-256 → DER
+static bool genKey(mbedtls_pk_context* pk) {
+    mbedtls_pk_init(pk);
+    return mbedtls_pk_setup(pk, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY)) == 0 &&
+           mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(*pk), mbedtls_ctr_drbg_random, &drbg) == 0;
+}
+
+static std::vector<uint8_t> pubDer(mbedtls_pk_context* pk) {
+    uint8_t buf[256];
+    int n = mbedtls_pk_write_pubkey_der(pk, buf, sizeof(buf));
+    return n > 0 ? std::vector<uint8_t>(buf + sizeof(buf) - n, buf + sizeof(buf)) : std::vector<uint8_t>();
+}
+
+// ==================== Capture ====================
+// Header text ("key value" mỗi dòng) tới dòng "modem", sau đó là byte UART thô
+// từ lúc gửi AT+HTTPREAD=0,<len> (OK, +HTTPREAD: <n> + data ..., +HTTPREAD: 0).
+struct Capture {
+    std::string kekInfo, clientKeyB64, plainSha, kind;
+    size_t      bodyLen = 0;
+    std::string modem;
+};
+
+static bool loadCapture(const char* path, Capture& c) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) { fprintf(stderr, "không mở được %s\n", path); return false; }
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line == "modem") {
+            std::stringstream rest;
+            rest << f.rdbuf();
+            c.modem = rest.str();
+            return !c.clientKeyB64.empty() && c.bodyLen;
+        }
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream in(line);
+        std::string k;
+        in >> k;
+        if (k == "kek_info") in >> c.kekInfo;
+        else if (k == "client_key") in >> c.clientKeyB64;
+        else if (k == "plaintext_sha256") in >> c.plainSha;
+        else if (k == "body_len") in >> c.bodyLen;
+        else if (k == "kind") in >> c.kind;
+    }
+    fprintf(stderr, "%s: thiếu dòng 'modem'\n", path);
+    return false;
+}
+
+// Vai server (Server/main.py): ECDH với client key, HKDF, AES-128-GCM, JSON compact
+// như FastAPI trả về. Modem chia body thành các khối +HTTPREAD.
+static int gen(const char* path, const std::string& kind, bool streamOrder, size_t block) {
+    mbedtls_pk_context client, server, signer;
+    if (!genKey(&client) || !genKey(&server) || !genKey(&signer)) { fprintf(stderr, "gen key failed\n"); return 1; }
+    uint8_t keyBuf[512];
+    int keyLen = mbedtls_pk_write_key_der(&client, keyBuf, sizeof(keyBuf));
+    std::string clientKey = b64(keyBuf + sizeof(keyBuf) - keyLen, keyLen);
+
+    const char* kekInfo = kind == "friend" ? "friend-sync-kek" : "secure-check-kek";
+    std::vector<uint8_t> plain;
+    if (kind == "friend") {
+        // Hình dạng bảng 32 friend key: blob_len(2) | blob | chữ ký DER (~72) — nội dung ngẫu nhiên
+        size_t blobLen = 1300, sigLen = 72;
+        plain.resize(2 + blobLen + sigLen);
+        mbedtls_ctr_drbg_random(&drbg, plain.data(), plain.size());
+        plain[0] = blobLen & 0xFF;
+        plain[1] = blobLen >> 8;
+    } else {
+        uint8_t key[16];
+        mbedtls_ctr_drbg_random(&drbg, key, sizeof(key));
+        char hex[33];
+        for (int i = 0; i < 16; i++) snprintf(hex + 2 * i, 3, "%02x", key[i]);
+        std::string s = std::string("{\"paired\": true, \"pairing_key\": \"") + hex + "\"}";
+        plain.assign(s.begin(), s.end());
+    }
+
+    mbedtls_ecdh_context ecdh;
+    mbedtls_ecdh_init(&ecdh);
+    uint8_t shared[32], kek[16], nonce[12];
+    size_t  sharedLen = 0;
+    if (mbedtls_ecdh_get_params(&ecdh, mbedtls_pk_ec(server), MBEDTLS_ECDH_OURS) != 0 ||
+        mbedtls_ecdh_get_params(&ecdh, mbedtls_pk_ec(client), MBEDTLS_ECDH_THEIRS) != 0 ||
+        mbedtls_ecdh_calc_secret(&ecdh, &sharedLen, shared, sizeof(shared), mbedtls_ctr_drbg_random, &drbg) != 0 ||
+        !hkdfSha256(NULL, 0, shared, 32, (const uint8_t*)kekInfo, strlen(kekInfo), kek, 16)) {
+        fprintf(stderr, "server ECDH failed\n");
+        return 1;
+    }
+    mbedtls_ecdh_free(&ecdh);
+    mbedtls_ctr_drbg_random(&drbg, nonce, sizeof(nonce));
+    std::vector<uint8_t> enc(plain.size() + 16);
+    mbedtls_gcm_context gcm;
+    mbedtls_gcm_init(&gcm);
+    mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, kek, 128);
+    mbedtls_gcm_crypt_and_tag(&gcm, MBEDTLS_GCM_ENCRYPT, plain.size(), nonce, 12, NULL, 0,
+                              plain.data(), enc.data(), 16, enc.data() + plain.size());
+    mbedtls_gcm_free(&gcm);
+
+    std::string fSrv   = "\"server_public_key_b64\":\"" + b64(pubDer(&server).data(), pubDer(&server).size()) + "\"";
+    std::string fEnc   = "\"encrypted_data_b64\":\"" + b64(enc.data(), enc.size()) + "\"";
+    std::string fNonce = "\"nonce_b64\":\"" + b64(nonce, 12) + "\"";
+    std::string fSign  = kind == "friend"
+        ? ",\"signing_public_key_b64\":\"" + b64(pubDer(&signer).data(), pubDer(&signer).size()) + "\"" : "";
+    std::string body = streamOrder ? "{" + fSrv + "," + fNonce + fSign + "," + fEnc + "}"
+                                   : "{" + fSrv + "," + fEnc + "," + fNonce + fSign + "}";
+
+    std::string modem = "\r\nOK\r\n";
+    for (size_t off = 0; off < body.size(); off += block) {
+        size_t n = std::min(block, body.size() - off);
+        modem += "\r\n+HTTPREAD: " + std::to_string(n) + "\r\n" + body.substr(off, n);
+    }
+    modem += "\r\n+HTTPREAD: 0\r\n";
+
+    FILE* f = fopen(path, "wb");
+    if (!f) { perror(path); return 1; }
+    fprintf(f, "# sim_replay capture v1 — %s, field order %s, HTTPREAD block %zu\n",
+            kind.c_str(), streamOrder ? "stream" : "legacy", block);
+    fprintf(f, "kind %s\nkek_info %s\nclient_key %s\nplaintext_sha256 %s\nbody_len %zu\nmodem\n",
+            kind.c_str(), kekInfo, clientKey.c_str(), sha256Hex(plain.data(), plain.size()).c_str(), body.size());
+    fwrite(modem.data(), 1, modem.size(), f);
+    fclose(f);
+    printf("wrote %s: body %zu B, plaintext %zu B, modem %zu B\n", path, body.size(), plain.size(), modem.size());
+    mbedtls_pk_free(&client);
+    mbedtls_pk_free(&server);
+    mbedtls_pk_free(&signer);
+    return 0;
+}
+
+// ==================== Buffered path (trước user-042) ====================
+#define LEGACY_RESP_MAX   (3072)   // SIM_HTTP_RESP_MAX cũ
+#define LEGACY_DOC_BYTES  (512)    // DynamicJsonDocument resp(512)
+
+static uint8_t legacyResp[LEGACY_RESP_MAX + 1];
+
+struct Buffered {
+    size_t len = 0;
+    bool   truncated = false;
+
+    static void sink(void* ctx, const uint8_t* d, size_t n) {
+        Buffered* b = (Buffered*)ctx;
+        size_t k = std::min(n, (size_t)LEGACY_RESP_MAX - b->len);
+        memcpy(legacyResp + b->len, d, k);
+        b->len += k;
+        if (k < n) b->truncated = true;
+    }
+
+    // deserializeJson zero-copy: 1 lượt qua object phẳng, kết thúc value bằng '\0' tại chỗ
+    static bool parse(char* s, const char** srv, const char** enc, const char** nonce) {
+        *srv = *enc = *nonce = nullptr;
+        char* p = strchr(s, '{');
+        while (p && *p && *p != '}') {
+            char* k = strchr(p, '"');
+            if (!k) return false;
+            char* ke = strchr(k + 1, '"');
+            if (!ke) return false;
+            *ke = '\0';
+            char* v = strchr(ke + 1, '"');
+            if (!v) return false;
+            char* ve = strchr(v + 1, '"');
+            if (!ve) return false;
+            *ve = '\0';
+            if (!strcmp(k + 1, "server_public_key_b64")) *srv = v + 1;
+            else if (!strcmp(k + 1, "encrypted_data_b64")) *enc = v + 1;
+            else if (!strcmp(k + 1, "nonce_b64")) *nonce = v + 1;
+            p = ve + 1;
+            while (*p == ',' || *p == ' ') p++;
+        }
+        return *srv && *enc && *nonce;
+    }
+
+    // simSecurePost sau httpPost, như bản trước user-042
+    size_t finish(mbedtls_pk_context* ours, const char* kekInfo, uint8_t* plaintext, size_t plainMax) {
+        if (truncated || !len) return 0;
+        legacyResp[len] = '\0';
+        void* doc = malloc(LEGACY_DOC_BYTES);
+        const char *srvB64, *encB64, *nonceB64;
+        bool ok = parse((char*)legacyResp, &srvB64, &encB64, &nonceB64);
+        uint8_t srvDer[128]; size_t srvLen = 0;
+        uint8_t nonce[12];   size_t nonceLen = 0;
+        size_t  encLen = 0;
+        ok = ok &&
+             mbedtls_base64_decode(srvDer, sizeof(srvDer), &srvLen, (const uint8_t*)srvB64, strlen(srvB64)) == 0 &&
+             mbedtls_base64_decode(plaintext, plainMax, &encLen, (const uint8_t*)encB64, strlen(encB64)) == 0 &&
+             mbedtls_base64_decode(nonce, sizeof(nonce), &nonceLen, (const uint8_t*)nonceB64, strlen(nonceB64)) == 0 &&
+             nonceLen == 12 && encLen >= 17;
+        free(doc);
+        if (!ok) return 0;
+
+        mbedtls_pk_context srv;
+        mbedtls_pk_init(&srv);
+        mbedtls_ecdh_context ecdh;
+        mbedtls_ecdh_init(&ecdh);
+        uint8_t shared[32], kek[16];
+        size_t  sharedLen = 0;
+        ok = mbedtls_pk_parse_public_key(&srv, srvDer, srvLen) == 0 &&
+             mbedtls_ecdh_get_params(&ecdh, mbedtls_pk_ec(*ours), MBEDTLS_ECDH_OURS) == 0 &&
+             mbedtls_ecdh_get_params(&ecdh, mbedtls_pk_ec(srv), MBEDTLS_ECDH_THEIRS) == 0 &&
+             mbedtls_ecdh_calc_secret(&ecdh, &sharedLen, shared, sizeof(shared), mbedtls_ctr_drbg_random, &drbg) == 0 &&
+             hkdfSha256(NULL, 0, shared, 32, (const uint8_t*)kekInfo, strlen(kekInfo), kek, 16);
+        mbedtls_ecdh_free(&ecdh);
+        mbedtls_pk_free(&srv);
+        if (!ok) return 0;
+
+        size_t ctLen = encLen - 16;
+        uint8_t tag[16];
+        memcpy(tag, plaintext + ctLen, 16);
+        mbedtls_gcm_context gcm;
+        mbedtls_gcm_init(&gcm);
+        ok = mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, kek, 128) == 0 &&
+             mbedtls_gcm_auth_decrypt(&gcm, ctLen, nonce, 12, NULL, 0, tag, 16, plaintext, plaintext) == 0;
+        mbedtls_gcm_free(&gcm);
+        if (!ok) return 0;
+        plaintext[ctLen] = '\0';
+        return ctLen;
+    }
+};
+
+// ==================== Replay ====================
+struct Options {
+    uint32_t baud     = 115200;
+    size_t   rxChunk  = 120;       // ESP32 UART: RX FIFO full threshold (byte/lần đánh thức)
+    double   cpuScale = 1.0;
+    int      runs     = 15;
+};
+
+struct RunResult {
+    bool   ok = false;
+    size_t plainLen = 0;
+    double downloadUs = 0;   // byte cuối tới
+    double keyUs = 0;        // plaintext sẵn sàng
+    double cpuUs = 0;
+    size_t peakHeap = 0;
+    size_t streamed = 0;
+};
+
+static int httpReadLine(void*, const char* line, size_t) {
+    if (strncmp(line, "+HTTPREAD:", 10) != 0) return -1;
+    int n = atoi(line + 10);
+    return n > 0 ? n : 0;
+}
+
+static size_t noWrite(void*, const uint8_t*, size_t n) { return n; }
+
+// Mô phỏng thời gian: mảnh i tới lúc (byte cuối của mảnh)·10/baud; simTask xử lý ngay
+// khi rảnh, tốn CPU đo thật × cpuScale. Mảnh tới khi simTask còn bận thì chờ (UART buffer).
+template <typename Feed, typename Finish>
+static RunResult replay(const Capture& c, const Options& o, Feed&& feedBody, Finish&& finishBody) {
+    RunResult r;
+    AtEngine engine;
+    engine.begin(noWrite, nullptr);
+    char text[40];
+    snprintf(text, sizeof(text), "AT+HTTPREAD=0,%zu", c.bodyLen);
+    AtCmd read;
+    read.text      = text;
+    read.timeoutMs = 10000;
+    read.until     = "+HTTPREAD: 0";
+    read.onLine    = httpReadLine;
+    read.onData    = feedBody.first;
+    read.ctx       = feedBody.second;
+    engine.submit(&read, 0);
+
+    double busy = 0;
+    const uint8_t* d = (const uint8_t*)c.modem.data();
+    for (size_t off = 0; off < c.modem.size(); off += o.rxChunk) {
+        size_t n = std::min(o.rxChunk, c.modem.size() - off);
+        double arrive = o.baud ? (off + n) * 10.0 * 1e6 / o.baud : 0;
+        double t0 = nowUs();
+        engine.feed(d + off, n, (uint32_t)(arrive / 1000));
+        double cpu = (nowUs() - t0) * o.cpuScale;
+        busy = std::max(busy, arrive) + cpu;
+        r.cpuUs += cpu;
+        r.downloadUs = arrive;
+    }
+    if (read.result != AT_OK) return r;
+    double t0 = nowUs();
+    r.plainLen = finishBody();
+    double cpu = (nowUs() - t0) * o.cpuScale;
+    r.keyUs  = busy + cpu;
+    r.cpuUs += cpu;
+    r.ok     = r.plainLen > 0;
+    return r;
+}
+
+static double median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    return v.empty() ? 0 : v[v.size() / 2];
+}
+
+static void report(const char* name, const std::vector<RunResult>& rs, size_t bodyBuf, size_t parser) {
+    std::vector<double> key, tail, cpu;
+    for (const RunResult& r : rs) {
+        key.push_back(r.keyUs);
+        tail.push_back(r.keyUs - r.downloadUs);
+        cpu.push_back(r.cpuUs);
+    }
+    const RunResult& last = rs.back();
+    printf("%-10s %7.2f ms %9.2f ms %9.2f ms %8zu B %8zu B %8zu B %8zu B\n", name,
+           median(key) / 1000, median(tail) / 1000, median(cpu) / 1000,
+           last.peakHeap, bodyBuf, parser, last.streamed);
+}
+
+static int replayMain(const char* path, const Options& o) {
+    Capture c;
+    if (!loadCapture(path, c)) return 2;
+    std::vector<uint8_t> keyDer = unb64(c.clientKeyB64);
+    mbedtls_pk_context ours;
+    mbedtls_pk_init(&ours);
+    if (mbedtls_pk_parse_key(&ours, keyDer.data(), keyDer.size(), NULL, 0) != 0) {
+        fprintf(stderr, "client_key không hợp lệ\n");
+        return 2;
+    }
+
+    static uint8_t plain[4096];
+    std::vector<RunResult> buffered, streaming;
+    bool good = true;
+    for (int i = 0; i < o.runs; i++) {
+        // buffered
+        {
+            memset(plain, 0, sizeof(plain));
+            HeapWindow w;
+            Buffered b;
+            RunResult r = replay(c, o, std::make_pair(&Buffered::sink, (void*)&b),
+                                 [&] { return b.finish(&ours, c.kekInfo.c_str(), plain, sizeof(plain)); });
+            r.peakHeap = w.peak();
+            r.ok = r.ok && sha256Hex(plain, r.plainLen) == c.plainSha;
+            good &= r.ok;
+            buffered.push_back(r);
+        }
+        // streaming
+        {
+            memset(plain, 0, sizeof(plain));
+            HeapWindow w;
+            uint8_t signDer[128];
+            SecureResponse s(&ours, c.kekInfo.c_str(), plain, sizeof(plain), mbedtls_ctr_drbg_random, &drbg);
+            if (c.kind == "friend") s.captureSigningKey(signDer, sizeof(signDer));
+            RunResult r = replay(c, o, std::make_pair(&SecureResponse::sink, (void*)&s),
+                                 [&] { return s.finish(); });
+            r.peakHeap = w.peak();
+            r.streamed = s.streamedBytes();
+            r.ok = r.ok && sha256Hex(plain, r.plainLen) == c.plainSha;
+            if (!r.ok && i == 0) fprintf(stderr, "streaming: %s\n", s.error());
+            good &= r.ok;
+            streaming.push_back(r);
+        }
+    }
+    mbedtls_pk_free(&ours);
+
+    const RunResult& any = streaming.back();
+    printf("capture    : %s (%s, body %zu B, modem %zu B, plaintext %zu B)\n", path, c.kind.c_str(),
+           c.bodyLen, c.modem.size(), any.plainLen);
+    printf("replay     : %u baud, RX chunk %zu B, CPU x%.1f, median of %d runs, download %.1f ms\n",
+           o.baud, o.rxChunk, o.cpuScale, o.runs, any.downloadUs / 1000);
+    printf("\n%-10s %10s %12s %12s %10s %10s %10s %10s\n", "path", "key", "after last", "CPU",
+           "peak heap", "body buf", "parser", "streamed");
+    report("buffered", buffered, sizeof(legacyResp), 0);
+    report("streaming", streaming, 0, sizeof(SecureResponse) - sizeof(mbedtls_gcm_context));
+    printf("\n(key = byte đầu → plaintext đã xác thực; after last = key − download;\n"
+           " body buf = buffer static giữ body; parser = state trên stack simTask, không tính\n"
+           " mbedtls_gcm_context mà cả 2 đường đều có — host shim để opaque dư cỡ)\n");
+    printf("\nresult: %s\n", good ? "PASS" : "FAIL (plaintext sai)");
+    return good ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    const char* pers = "sim_replay";
+    if (mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy, (const uint8_t*)pers, strlen(pers)) != 0) {
+        fprintf(stderr, "ctr_drbg seed failed\n");
+        return 2;
+    }
+    if (argc >= 3 && !strcmp(argv[1], "gen")) {
+        std::string kind = "pairing";
+        bool   streamOrder = true;
+        size_t block = 512;
+        for (int i = 3; i + 1 < argc; i += 2) {
+            if (!strcmp(argv[i], "--kind")) kind = argv[i + 1];
+            else if (!strcmp(argv[i], "--order")) streamOrder = strcmp(argv[i + 1], "legacy") != 0;
+            else if (!strcmp(argv[i], "--block")) block = (size_t)atol(argv[i + 1]);
+        }
+        return gen(argv[2], kind, streamOrder, block ? block : 512);
+    }
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <capture> [--baud n] [--rx-chunk n] [--cpu-scale x] [--runs n]\n"
+                        "       %s gen <capture> [--kind pairing|friend] [--order stream|legacy] [--block n]\n",
+                argv[0], argv[0]);
+        return 2;
+    }
+    Options o;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--baud")) o.baud = (uint32_t)atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--rx-chunk")) o.rxChunk = std::max(1L, atol(argv[i + 1]));
+        else if (!strcmp(argv[i], "--cpu-scale")) o.cpuScale = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--runs")) o.runs = std::max(1, atoi(argv[i + 1]));
+    }
+    return replayMain(argv[1], o);
+}
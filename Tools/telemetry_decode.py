@@ -0,0 +1,252 @@
+#!/usr/bin/env python3
+"""
+telemetry_decode.py — Decode telemetry stream (telemetry.h) từ Anchor / Tag
+
+Nguồn:
+  --port COM5         Serial (binary xen lẫn log text, resync bằng A5 5A + CRC8)
+  --file dump.bin     File raw đã capture (vd. từ serial logger)
+  --ble SmartCar_Vehicle   Notify từ characteristic diag (TELEMETRY_CHAR_UUID)
+
+Yêu cầu: pip install pyserial   (--ble: pip install bleak, --plot: pip install matplotlib)
+Dùng lệnh:
+  python telemetry_decode.py --port COM5 --csv tlm.csv --plot
+  python telemetry_decode.py --ble SmartCar_Vehicle
+"""
+
+import argparse
+import asyncio
+import csv
+import struct
+import sys
+from collections import defaultdict
+
+SYNC = b"\xA5\x5A"
+TELEMETRY_CHAR_UUID = "d1a6e2f0-5c3b-4e8a-9f1d-7b2c4a6e8d01"
+
+REC_TASK, REC_QUEUE, REC_LOCK, REC_HEAP, REC_NAME, REC_END = 1, 2, 3, 4, 5, 6
+REC_UWB_CNT, REC_UWB_LINK = 7, 8
+NO_SAMPLE = -32768
+NAME_TASK, NAME_QUEUE, NAME_LOCK = 0, 1, 2
+TASK_STATES = ["RUN", "READY", "BLOCK", "SUSP", "DEL", "?"]
+
+
+def crc8(data: bytes) -> int:
+    c = 0
+    for b in data:
+        c ^= b
+        for _ in range(8):
+            c = ((c << 1) ^ 0x07) & 0xFF if c & 0x80 else (c << 1) & 0xFF
+    return c
+
+
+class FrameParser:
+    """Tách frame khỏi byte stream; byte rác (log text) bị bỏ qua."""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.crc_errors = 0
+
+    def feed(self, data: bytes):
+        self.buf += data
+        while True:
+            i = self.buf.find(SYNC)
+            if i < 0:
+                del self.buf[:-1]
+                return
+            del self.buf[:i]
+            if len(self.buf) < 4:
+                return
+            ln = self.buf[3]
+            if ln > 40:
+                del self.buf[:2]
+                continue
+            total = 9 + ln
+            if len(self.buf) < total:
+                return
+            frame = bytes(self.buf[:total])
+            if crc8(frame[2:8 + ln]) != frame[8 + ln]:
+                self.crc_errors += 1
+                del self.buf[:2]
+                continue
+            del self.buf[:total]
+            rtype = frame[2]
+            ts_ms = struct.unpack_from("<I", frame, 4)[0]
+            yield rtype, ts_ms, frame[8:8 + ln]
+
+
+class Decoder:
+    def __init__(self, csv_path=None, quiet=False):
+        self.names = {NAME_TASK: {}, NAME_QUEUE: {}, NAME_LOCK: {}}
+        self.sample = defaultdict(list)
+        self.history = defaultdict(list)    # (kind, name, field) -> [(t_s, value)]
+        self.quiet = quiet
+        self.csv = None
+        if csv_path:
+            self.csv_file = open(csv_path, "w", newline="")
+            self.csv = csv.writer(self.csv_file)
+            self.csv.writerow(["ts_ms", "kind", "name", "field", "value"])
+
+    def name(self, kind, idx):
+        return self.names[kind].get(idx, f"#{idx}")
+
+    def record(self, ts_ms, kind, name, **fields):
+        for k, v in fields.items():
+            self.history[(kind, name, k)].append((ts_ms / 1000.0, v))
+            if self.csv:
+                self.csv.writerow([ts_ms, kind, name, k, v])
+
+    def handle(self, rtype, ts_ms, p):
+        if rtype == REC_NAME:
+            self.names.setdefault(p[0], {})[p[1]] = p[2:].decode("ascii", "replace")
+        elif rtype == REC_TASK:
+            tid, core, prio, state, cpu, stack = struct.unpack("<BbBBHH", p)
+            self.sample["task"].append((tid, core, prio, state, cpu, stack))
+        elif rtype == REC_QUEUE:
+            self.sample["queue"].append(struct.unpack("<BBBBHH", p))
+        elif rtype == REC_LOCK:
+            self.sample["lock"].append(struct.unpack("<BIIIII", p))
+        elif rtype == REC_HEAP:
+            self.sample["heap"].append(struct.unpack("<6I", p))
+        elif rtype == REC_UWB_CNT:
+            self.sample["uwb_cnt"].append(struct.unpack("<HII11H", p))
+        elif rtype == REC_UWB_LINK:
+            self.sample["uwb_link"].append(struct.unpack("<HH8hIH", p))
+        elif rtype == REC_END:
+            seq, dropped, task_count = struct.unpack("<HHB", p)
+            self.end_sample(ts_ms, seq, dropped, task_count)
+
+    def end_sample(self, ts_ms, seq, dropped, task_count):
+        out = [f"── t={ts_ms / 1000:.1f}s seq={seq} tasks={task_count} ble-drop={dropped} ──"]
+        for tid, core, prio, state, cpu, stack in sorted(self.sample["task"], key=lambda t: -t[4]):
+            n = self.name(NAME_TASK, tid)
+            cpu_s = "   n/a" if cpu == 0xFFFF else f"{cpu / 10:5.1f}%"
+            out.append(f"  {n:<16} core={'*' if core < 0 else core} P{prio:<2} "
+                       f"{TASK_STATES[min(state, 5)]:<5} cpu={cpu_s} stack-free={stack} B")
+            self.record(ts_ms, "task", n, cpu=None if cpu == 0xFFFF else cpu / 10, stack_free=stack)
+        for qid, depth, cap, maxd, full_ms, full_n in self.sample["queue"]:
+            n = self.name(NAME_QUEUE, qid)
+            out.append(f"  queue {n:<14} depth={depth}/{cap} max={maxd} full-streak={full_ms} ms full-samples={full_n}")
+            self.record(ts_ms, "queue", n, depth=depth, max_depth=maxd, full_ms=full_ms)
+        for lid, waits, timeouts, p50, p99, mx in self.sample["lock"]:
+            n = self.name(NAME_LOCK, lid)
+            out.append(f"  lock  {n:<14} waits={waits} timeouts={timeouts} p50<{p50} p99<{p99} max={mx} us")
+            self.record(ts_ms, "lock", n, p99_us=p99, max_us=mx, timeouts=timeouts)
+        for ifree, ilarge, imin, pfree, plarge, pmin in self.sample["heap"]:
+            frag = 100 - (ilarge * 100 // ifree) if ifree else 0
+            out.append(f"  heap  int free={ifree} largest={ilarge} min={imin} frag={frag}%"
+                       + (f" | psram free={pfree} largest={plarge} min={pmin}" if pfree else ""))
+            self.record(ts_ms, "heap", "internal", free=ifree, largest=ilarge, frag_pct=frag)
+            if pfree:
+                self.record(ts_ms, "heap", "psram", free=pfree, largest=plarge)
+        for (sess, rx_ok, tx, crc_bad, phr, sync_loss, sfd_to, pre_to, pre_rej,
+             rx_to, filt, over, hpw, spi_crc) in self.sample["uwb_cnt"]:
+            out.append(f"  uwb   session={sess} rx-ok={rx_ok} tx={tx} crc-bad={crc_bad} phr-err={phr} "
+                       f"sync-loss={sync_loss} sfd-to={sfd_to} preamble-to={pre_to} preamble-rej={pre_rej} "
+                       f"overrun={over} spi-crc={spi_crc}")
+            self.record(ts_ms, "uwb", f"session{sess}", rx_ok=rx_ok, crc_bad=crc_bad, phr_err=phr,
+                        sfd_timeout=sfd_to, preamble_reject=pre_rej)
+        for (sess, samples, rx_avg, rx_min, rx_max, fp_avg, fp_min, fp_max,
+             sts_avg, sts_min, sts_n, sts_rej) in self.sample["uwb_link"]:
+            def dbm(v):
+                return None if v == NO_SAMPLE else v / 10
+            line = f"  uwb   session={sess} diag-samples={samples}"
+            if rx_avg != NO_SAMPLE:
+                line += f" rx {dbm(rx_avg):.1f} [{dbm(rx_min):.1f}..{dbm(rx_max):.1f}] dBm"
+            if fp_avg != NO_SAMPLE:
+                line += f" fp {dbm(fp_avg):.1f} [{dbm(fp_min):.1f}..{dbm(fp_max):.1f}] dBm"
+            if sts_n:
+                line += f" sts avg={sts_avg} min={sts_min}"
+            out.append(line + f" sts-frames={sts_n} sts-rejected={sts_rej}")
+            self.record(ts_ms, "uwb", f"session{sess}", rx_dbm=dbm(rx_avg), fp_dbm=dbm(fp_avg),
+                        sts_quality=None if sts_avg == NO_SAMPLE else sts_avg, sts_rejected=sts_rej)
+        if not self.quiet:
+            print("\n".join(out), flush=True)
+        self.sample.clear()
+
+    def plot(self):
+        import matplotlib.pyplot as plt
+        panels = [("task", "cpu", "CPU share (%)"), ("task", "stack_free", "Stack free (B)"),
+                  ("queue", "depth", "Queue depth"), ("heap", "free", "Heap free (B)"),
+                  ("uwb", "fp_dbm", "UWB first-path power (dBm)")]
+        fig, axes = plt.subplots(len(panels), 1, sharex=True, figsize=(10, 10))
+        for ax, (kind, field, title) in zip(axes, panels):
+            for (k, n, f), pts in sorted(self.history.items()):
+                pts = [(t, v) for t, v in pts if v is not None]
+                if k == kind and f == field and pts:
+                    ax.plot([t for t, _ in pts], [v for _, v in pts], label=n)
+            ax.set_title(title)
+            ax.legend(fontsize="small", loc="upper right")
+        axes[-1].set_xlabel("time (s)")
+        plt.tight_layout()
+        plt.show()
+
+
+def run_serial(args, parser, dec):
+    import serial
+    with serial.Serial(args.port, args.baud, timeout=0.2) as ser:
+        while True:
+            for rec in parser.feed(ser.read(512)):
+                dec.handle(*rec)
+
+
+def run_file(args, parser, dec):
+    with open(args.file, "rb") as f:
+        while chunk := f.read(4096):
+            for rec in parser.feed(chunk):
+                dec.handle(*rec)
+
+
+def run_ble(args, parser, dec):
+    from bleak import BleakClient, BleakScanner
+
+    async def main():
+        dev = await BleakScanner.find_device_by_name(args.ble, timeout=15.0)
+        if dev is None:
+            dev = await BleakScanner.find_device_by_address(args.ble, timeout=15.0)
+        if dev is None:
+            sys.exit(f"[ERR] Không tìm thấy {args.ble}")
+        async with BleakClient(dev) as client:
+            def on_notify(_, data):
+                for rec in parser.feed(bytes(data)):
+                    dec.handle(*rec)
+            await client.start_notify(TELEMETRY_CHAR_UUID, on_notify)
+            print(f"[INFO] Subscribed {dev.address}, Ctrl-C để dừng")
+            while client.is_connected:
+                await asyncio.sleep(1)
+
+    asyncio.run(main())
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode telemetry stream từ Anchor / Tag")
+    src = ap.add_mutually_exclusive_group(required=True)
+    src.add_argument("--port", "-p", help="Serial port (vd. COM5, /dev/ttyACM0)")
+    src.add_argument("--file", "-f", help="File raw đã capture")
+    src.add_argument("--ble", help="Tên hoặc địa chỉ BLE của Anchor")
+    ap.add_argument("--baud", "-b", type=int, default=115200)
+    ap.add_argument("--csv", help="Ghi mọi giá trị ra CSV (ts_ms, kind, name, field, value)")
+    ap.add_argument("--plot", action="store_true", help="Vẽ đồ thị khi dừng (Ctrl-C / hết file)")
+    ap.add_argument("--quiet", "-q", action="store_true", help="Không in bảng mỗi lần lấy mẫu")
+    args = ap.parse_args()
+
+    parser, dec = FrameParser(), Decoder(args.csv, args.quiet)
+    try:
+        if args.port:
+            run_serial(args, parser, dec)
+        elif args.file:
+            run_file(args, parser, dec)
+        else:
+            run_ble(args, parser, dec)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if dec.csv:
+            dec.csv_file.close()
+        if parser.crc_errors:
+            print(f"[WARN] {parser.crc_errors} frame lỗi CRC")
+    if args.plot:
+        dec.plot()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+"""
+trace_merge.py — Ghép trace unlock latency (trace.h) của Tag + Anchor
+
+Mỗi board in dòng "TRC <side> <session> <point> <t_us> <arg>" xen trong log Serial.
+Tool này:
+  1. Ghép session Tag ↔ Anchor theo SESSION_BIND (4 byte đầu challenge)
+  2. Căn đồng hồ Anchor về Tag bằng cặp AUTH (NTP-style):
+       offset = ((A_AUTH_RX - T_AUTH_TX) + (A_AUTH_OK_TX - T_AUTH_OK_RX)) / 2
+     Session resume bằng ticket dùng cặp RESUME thay cho AUTH.
+  3. In latency từng stage cho mỗi session + percentile, tách session auth đầy đủ
+     và session resume, kèm tỉ lệ handshake trong connect → ranging
+
+Dùng lệnh:
+  python trace_merge.py --tag tag.log --anchor anchor.log
+  python trace_merge.py --tag tag.log --anchor anchor.log --csv stages.csv --sessions
+"""
+
+import argparse
+import csv
+import math
+import re
+from collections import defaultdict
+
+LINE_RE = re.compile(r"TRC ([AT]) (\d+) (\S+) (\d+) (\d+)")
+CAN_CMD_UNLOCK = 1
+
+# (tên stage, (side, point) bắt đầu, (side, point) kết thúc)
+STAGES = [
+    ("scan",              ("T", "T_SCAN_START"),     ("T", "T_DEVICE_FOUND")),
+    ("connect",           ("T", "T_DEVICE_FOUND"),   ("T", "T_CONNECTED")),
+    ("service discovery", ("T", "T_CONNECTED"),      ("T", "T_SERVICES_READY")),
+    ("handshake",         ("T", "T_SERVICES_READY"), ("T", "T_SESSION_READY")),
+    ("  challenge wait",  ("T", "T_SERVICES_READY"), ("T", "T_CHALLENGE_RX")),
+    ("  tag HMAC",        ("T", "T_CHALLENGE_RX"),   ("T", "T_AUTH_TX")),
+    ("  auth round trip", ("T", "T_AUTH_TX"),        ("T", "T_AUTH_OK_RX")),
+    ("    anchor verify", ("A", "A_AUTH_RX"),        ("A", "A_AUTH_OK_TX")),
+    ("  resume round trip", ("T", "T_RESUME_TX"),    ("T", "T_SESSION_READY")),
+    ("    anchor resume", ("A", "A_RESUME_RX"),      ("A", "A_RESUME_DONE")),
+    ("UWB request",       ("T", "T_SESSION_READY"),  ("T", "T_UWB_READY_TX")),
+    ("anchor UWB start",  ("T", "T_UWB_READY_TX"),   ("T", "T_UWB_ACTIVE_RX")),
+    ("  anchor initUWB",  ("A", "A_UWB_READY_RX"),   ("A", "A_UWB_RANGING")),
+    ("tag UWB start",     ("T", "T_UWB_ACTIVE_RX"),  ("T", "T_UWB_RANGING")),
+    ("first range",       ("T", "T_UWB_RANGING"),    ("T", "T_RANGE_OK")),
+    ("ranging → verdict", ("T", "T_RANGE_OK"),       ("T", "T_VERIFIED_TX")),
+    ("verdict delivery",  ("T", "T_VERIFIED_TX"),    ("A", "A_VERIFIED_RX")),
+    ("CAN queue",         ("A", "A_VERIFIED_RX"),    ("A", "A_CAN_START")),
+    ("CAN sequence",      ("A", "A_CAN_START"),      ("A", "A_CAN_DONE")),
+]
+TOTALS = [
+    ("TOTAL connect → ranging",   ("T", "T_CONNECTED"),    ("T", "T_UWB_RANGING")),
+    ("TOTAL scan → unlocked",     ("T", "T_SCAN_START"),   ("A", "A_CAN_DONE")),
+    ("TOTAL in range → unlocked", ("T", "T_DEVICE_FOUND"), ("A", "A_CAN_DONE")),
+]
+
+
+class Session:
+    def __init__(self, side, local_id):
+        self.side = side
+        self.local_id = local_id
+        self.bind = None
+        self.points = {}          # point -> (t_us, arg), lần xuất hiện đầu (xem add)
+
+    @property
+    def resumed(self):
+        return self.points.get("T_SESSION_READY", (0, 0))[1] == 1
+
+    def add(self, point, t_us, arg):
+        if point == "SESSION_BIND":
+            self.bind = arg
+            return
+        if point == "A_CAN_START" and arg != CAN_CMD_UNLOCK:
+            return                # chỉ quan tâm UNLOCK
+        if point == "A_CAN_DONE" and "A_CAN_START" not in self.points:
+            return
+        self.points.setdefault(point, (t_us, arg))
+
+
+def parse(path, side_expected):
+    sessions = []
+    cur = None
+    last_t, wrap = None, 0
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            m = LINE_RE.search(line)
+            if not m or m.group(1) != side_expected:
+                continue
+            sess, point, t_us, arg = int(m.group(2)), m.group(3), int(m.group(4)), int(m.group(5))
+            # micros() 32-bit tràn sau ~71 phút
+            if last_t is not None and t_us + (1 << 31) < last_t:
+                wrap += 1 << 32
+            last_t = t_us
+            # Session mới: mốc bắt đầu, hoặc ID đổi (vd. reboot giữa chừng)
+            if cur is None or point in ("T_SCAN_START", "A_CONNECTED") or sess != cur.local_id:
+                cur = Session(side_expected, sess)
+                sessions.append(cur)
+            cur.add(point, t_us + wrap, arg)
+    return sessions
+
+
+EXCHANGES = [
+    (("T_AUTH_TX", "T_AUTH_OK_RX"), ("A_AUTH_RX", "A_AUTH_OK_TX")),
+    (("T_RESUME_TX", "T_SESSION_READY"), ("A_RESUME_RX", "A_RESUME_DONE")),
+]
+
+
+def clock_offset(tag, anchor):
+    """Offset (anchor - tag) µs và RTT, từ cặp AUTH (hoặc RESUME)."""
+    for (p1, p4), (p2, p3) in EXCHANGES:
+        if all(p in tag.points for p in (p1, p4)) and all(p in anchor.points for p in (p2, p3)):
+            t1, t4 = tag.points[p1][0], tag.points[p4][0]
+            t2, t3 = anchor.points[p2][0], anchor.points[p3][0]
+            return ((t2 - t1) + (t3 - t4)) / 2.0, (t4 - t1) - (t3 - t2)
+    return None, None
+
+
+def stage_times(tag, anchor, offset):
+    def at(side, point):
+        if side == "T":
+            return tag.points.get(point, (None,))[0] if tag else None
+        if anchor is None or point not in anchor.points:
+            return None
+        t = anchor.points[point][0]
+        # Stage chỉ trong Anchor không cần offset; stage chéo cần
+        return t if offset is None else t - offset
+
+    out = {}
+    for name, (s0, p0), (s1, p1) in STAGES + TOTALS:
+        if s0 != s1 and offset is None:
+            continue
+        a, b = at(s0, p0), at(s1, p1)
+        if a is not None and b is not None and b >= a:
+            out[name] = (b - a) / 1000.0
+    return out
+
+
+def percentile(values, pct):
+    v = sorted(values)
+    k = max(0, min(len(v) - 1, math.ceil(pct / 100.0 * len(v)) - 1))   # nearest-rank
+    return v[k]
+
+
+def print_table(title, rows):
+    print(f"\n[{title}] {len(rows)} session")
+    print(f"{'stage':<28} {'n':>4} {'p50':>9} {'p90':>9} {'p99':>9} {'max':>9}  (ms)")
+    for name, *_ in STAGES + TOTALS:
+        vals = [st[name] for *_, st in rows if name in st]
+        if not vals:
+            continue
+        print(f"{name:<28} {len(vals):>4} {percentile(vals, 50):9.1f} {percentile(vals, 90):9.1f} "
+              f"{percentile(vals, 99):9.1f} {max(vals):9.1f}")
+    share = [st["handshake"] / st["TOTAL connect → ranging"] * 100.0 for *_, st in rows
+             if "handshake" in st and st.get("TOTAL connect → ranging")]
+    if share:
+        print(f"handshake / (connect → ranging): p50 {percentile(share, 50):.0f}%  p90 {percentile(share, 90):.0f}%")
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Ghép trace Tag + Anchor thành báo cáo latency unlock")
+    ap.add_argument("--tag", required=True, help="Log Serial của Tag")
+    ap.add_argument("--anchor", required=True, help="Log Serial của Anchor")
+    ap.add_argument("--csv", help="Ghi latency từng stage của mỗi session ra CSV")
+    ap.add_argument("--sessions", action="store_true", help="In chi tiết từng session")
+    args = ap.parse_args()
+
+    tags = parse(args.tag, "T")
+    anchors = parse(args.anchor, "A")
+    by_bind = defaultdict(list)
+    for a in anchors:
+        if a.bind is not None:
+            by_bind[a.bind].append(a)
+
+    results = []
+    unmatched = 0
+    for t in tags:
+        if "T_DEVICE_FOUND" not in t.points:
+            continue                      # scan không tìm thấy Anchor
+        cands = by_bind.get(t.bind, []) if t.bind is not None else []
+        a = cands.pop(0) if cands else None
+        if a is None:
+            unmatched += 1
+        offset, rtt = clock_offset(t, a) if a else (None, None)
+        results.append((t, a, offset, rtt, stage_times(t, a, offset)))
+
+    print(f"Tag sessions: {len(results)} (không ghép được Anchor: {unmatched}), Anchor sessions: {len(anchors)}")
+
+    if args.sessions:
+        for t, a, offset, rtt, st in results:
+            hdr = f"\nTag session {t.local_id} bind={t.bind:08x}" if t.bind is not None else f"\nTag session {t.local_id}"
+            if t.resumed:
+                hdr += " (resumed)"
+            if a:
+                hdr += f" ↔ Anchor session {a.local_id}, offset={offset / 1000:.1f} ms, BLE RTT={rtt / 1000:.1f} ms" \
+                    if offset is not None else f" ↔ Anchor session {a.local_id} (thiếu AUTH — không căn được đồng hồ)"
+            print(hdr)
+            for name, *_ in STAGES + TOTALS:
+                if name in st:
+                    print(f"  {name:<28} {st[name]:9.1f} ms")
+
+    groups = [("all sessions", results)]
+    resumed = [r for r in results if r[0].resumed]
+    if resumed and len(resumed) < len(results):
+        groups += [("full auth", [r for r in results if not r[0].resumed]), ("resumed (ticket)", resumed)]
+    for title, rows in groups:
+        print_table(title, rows)
+
+    if args.csv:
+        names = [n for n, *_ in STAGES + TOTALS]
+        with open(args.csv, "w", newline="") as f:
+            w = csv.writer(f)
+            w.writerow(["tag_session", "bind"] + names)
+            for t, a, offset, rtt, st in results:
+                w.writerow([t.local_id, f"{t.bind:08x}" if t.bind is not None else ""] +
+                           [f"{st[n]:.3f}" if n in st else "" for n in names])
+        print(f"\n[INFO] Ghi {len(results)} session vào {args.csv}")
+
+
+if __name__ == "__main__":
+    main()
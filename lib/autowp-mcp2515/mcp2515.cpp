@@ -594,6 +594,34 @@ MCP2515::ERROR MCP2515::setFilter(const RXF num, const bool ext, const uint32_t
     return ERROR_OK;
 }
 
+MCP2515::ERROR MCP2515::setFilterBank(const bool ext, const uint32_t masks[2], const uint32_t filters[6])
+{
+    // single config-mode entry; RXF0-2, RXF3-5 and RXM0-1 are contiguous
+    // register blocks, so each is written in one burst
+    ERROR res = setConfigMode();
+    if (res != ERROR_OK) {
+        return res;
+    }
+
+    uint8_t tbufdata[12];
+    for (int i=0; i<3; i++) {
+        prepareId(&tbufdata[i*4], ext, filters[i]);
+    }
+    setRegisters(MCP_RXF0SIDH, tbufdata, 12);
+
+    for (int i=0; i<3; i++) {
+        prepareId(&tbufdata[i*4], ext, filters[3+i]);
+    }
+    setRegisters(MCP_RXF3SIDH, tbufdata, 12);
+
+    for (int i=0; i<2; i++) {
+        prepareId(&tbufdata[i*4], ext, masks[i]);
+    }
+    setRegisters(MCP_RXM0SIDH, tbufdata, 8);
+
+    return ERROR_OK;
+}
+
 MCP2515::ERROR MCP2515::sendMessage(const TXBn txbn, const struct can_frame *frame)
 {
     if (frame->can_dlc > CAN_MAX_DLEN) {